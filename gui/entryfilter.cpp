@@ -49,10 +49,12 @@ bool EntryFilter::matches(const TraceEntry &e) const
 
 // ### take care of escaping
 // ### one day, consider different comparison type
-QString EntryFilter::whereClause(const QString &appField,
+QString EntryFilter::whereClause(QSqlDatabase db,
+                                 const QString &appField,
                                  const QString &pidField,
                                  const QString &tidField,
                                  const QString &funcField,
+                                 const QString &entryIdField,
                                  const QString &msgField,
                                  const QString &typeField) const
 {
@@ -70,8 +72,8 @@ QString EntryFilter::whereClause(const QString &appField,
         expressions.append(QString("%1 LIKE '%%2%'")
                            .arg(funcField).arg(m_function));
     if (!m_message.isEmpty())
-        expressions.append(QString("%1 LIKE '%%2%'")
-                           .arg(msgField).arg(m_message));
+        expressions.append(Database::messageContains(db, entryIdField,
+                                                     msgField, m_message));
     if (m_type != -1)
         expressions.append(QString("%1 = %2")
                            .arg(typeField).arg(m_type));
@@ -25,6 +25,7 @@
 #include <QObject>
 #include <QStringList>
 
+class QSqlDatabase;
 struct TraceEntry;
 
 class EntryFilter : public QObject,
@@ -63,10 +64,12 @@ public:
     bool matches(const TraceEntry &e) const;
 
     // for WHERE clauses in SQL queries
-    QString whereClause(const QString &appField,
+    QString whereClause(QSqlDatabase db,
+                        const QString &appField,
                         const QString &pidField,
                         const QString &tidField,
                         const QString &funcField,
+                        const QString &entryIdField,
                         const QString &msgField,
                         const QString &typeField) const;
 
@@ -0,0 +1,196 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entryidscanner.h"
+
+#include <QMutexLocker>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+
+EntryIdScanner::EntryIdScanner(const QString &databaseFileName, QObject *parent)
+    : QThread(parent),
+      m_databaseFileName(databaseFileName),
+      m_hasRequest(false),
+      m_stopRequested(false)
+{
+    qRegisterMetaType<QVector<unsigned int> >();
+}
+
+EntryIdScanner::~EntryIdScanner()
+{
+    stop();
+}
+
+void EntryIdScanner::stop()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopRequested = true;
+        m_requestQueued.wakeOne();
+    }
+    wait();
+}
+
+void EntryIdScanner::scan(int generation, const QStringList &tables,
+                          const QStringList &predicates, unsigned int afterId)
+{
+    QMutexLocker lock(&m_mutex);
+    m_request.generation = generation;
+    m_request.tables = tables.join(", ");
+    m_request.predicates = predicates.join(" AND ");
+    m_request.matchCondition.clear();
+    m_request.matchFields.clear();
+    m_request.pattern = QRegExp();
+    m_request.afterId = afterId;
+    m_hasRequest = true;
+    m_requestQueued.wakeOne();
+}
+
+void EntryIdScanner::scanMatching(int generation, const QStringList &tables,
+                                  const QStringList &predicates,
+                                  const QString &matchCondition,
+                                  const QStringList &matchFields,
+                                  const QRegExp &pattern, unsigned int afterId)
+{
+    QStringList allPredicates = predicates;
+    if (matchFields.isEmpty() && !matchCondition.isEmpty()) {
+        // Nothing to test here, let SQLite do all the work
+        allPredicates << "(" + matchCondition + ")";
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_request.generation = generation;
+    m_request.tables = tables.join(", ");
+    m_request.predicates = allPredicates.join(" AND ");
+    m_request.matchCondition = matchFields.isEmpty() ? QString() : matchCondition;
+    m_request.matchFields = matchFields;
+    // Not shared with the GUI thread, QRegExp caches match state
+    m_request.pattern = QRegExp(pattern.pattern(), pattern.caseSensitivity(),
+                                pattern.patternSyntax());
+    m_request.afterId = afterId;
+    m_hasRequest = true;
+    m_requestQueued.wakeOne();
+}
+
+bool EntryIdScanner::takeRequest(Request *request)
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_hasRequest && !m_stopRequested) {
+        m_requestQueued.wait(&m_mutex);
+    }
+    if (m_stopRequested) {
+        return false;
+    }
+    *request = m_request;
+    m_hasRequest = false;
+    return true;
+}
+
+bool EntryIdScanner::hasNewRequest()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_hasRequest || m_stopRequested;
+}
+
+/* Tells whether the match condition selected for the current row holds or
+ * one of the fields following it matches the pattern.
+ */
+static bool matches(const QSqlQuery &query, QRegExp *pattern, int numFields)
+{
+    if (query.value(1).toBool()) {
+        return true;
+    }
+    for (int i = 0; i < numFields; ++i) {
+        if (pattern->exactMatch(query.value(i + 2).toString())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EntryIdScanner::run()
+{
+    const QString connectionName = QString("EntryIdScanner-%1").arg(reinterpret_cast<quintptr>(this));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(m_databaseFileName);
+        // The server might be writing to the database meanwhile
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+        const bool opened = db.open();
+
+        Request request;
+        while (takeRequest(&request)) {
+            if (!opened) {
+                emit scanFailed(request.generation, db.lastError().text());
+                continue;
+            }
+
+            // Entries are matched against the pattern by selecting the
+            // match condition and the fields along with the id
+            QString columns = "trace_entry.id";
+            const bool matchPattern = !request.matchFields.isEmpty();
+            if (matchPattern) {
+                columns += ", ";
+                columns += request.matchCondition.isEmpty() ? "0" : "(" + request.matchCondition + ")";
+                columns += ", " + request.matchFields.join(", ");
+            }
+
+            // Not using QString::arg() since the predicates may contain '%'
+            QString statementPrefix = "SELECT DISTINCT " + columns + " FROM " + request.tables + " WHERE ";
+            if (!request.predicates.isEmpty()) {
+                statementPrefix += request.predicates + " AND ";
+            }
+            statementPrefix += "trace_entry.id > ";
+            const QString statementSuffix = " ORDER BY trace_entry.id LIMIT " + QString::number(ChunkSize);
+
+            QSqlQuery query(db);
+            query.setForwardOnly(true);
+            unsigned int lastId = request.afterId;
+            while (!hasNewRequest()) {
+                if (!query.exec(statementPrefix + QString::number(lastId) + statementSuffix)) {
+                    emit scanFailed(request.generation, query.lastError().text());
+                    break;
+                }
+
+                QVector<unsigned int> ids;
+                ids.reserve(ChunkSize);
+                int numRows = 0;
+                while (query.next()) {
+                    ++numRows;
+                    lastId = query.value(0).toUInt();
+                    if (!matchPattern || matches(query, &request.pattern, request.matchFields.size())) {
+                        ids.append(lastId);
+                    }
+                }
+                query.finish();
+
+                if (!ids.isEmpty()) {
+                    emit idsFound(request.generation, ids);
+                }
+                if (numRows < ChunkSize) {
+                    emit scanFinished(request.generation, lastId);
+                    break;
+                }
+            }
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+}
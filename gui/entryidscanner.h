@@ -0,0 +1,99 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTRYIDSCANNER_H
+#define ENTRYIDSCANNER_H
+
+#include <QMutex>
+#include <QRegExp>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+/* Collects the ids of the trace entries matching a filter in a
+ * background thread which uses its own connection to the trace
+ * database. Ids are read in ascending chunks (keyset pagination on
+ * trace_entry.id) and passed on as soon as a chunk is complete, so the
+ * first rows can be shown while the rest of the table is scanned.
+ */
+class EntryIdScanner : public QThread
+{
+    Q_OBJECT
+public:
+    static const int ChunkSize = 5000;
+
+    EntryIdScanner(const QString &databaseFileName, QObject *parent = 0);
+    ~EntryIdScanner();
+
+    /* Starts looking for entries with an id larger than afterId, in the given
+     * tables, for which all predicates hold. A scan which is still running
+     * is abandoned; results are tagged with the given generation.
+     */
+    void scan(int generation, const QStringList &tables,
+              const QStringList &predicates, unsigned int afterId);
+
+    /* Like scan(), but only passes on the ids of those entries for which
+     * the match condition (an SQL expression) holds or one of the given
+     * fields exactly matches the pattern. Matching the pattern is done
+     * in the scanner thread since SQLite has no regular expressions.
+     */
+    void scanMatching(int generation, const QStringList &tables,
+                      const QStringList &predicates,
+                      const QString &matchCondition,
+                      const QStringList &matchFields,
+                      const QRegExp &pattern, unsigned int afterId);
+    void stop();
+
+signals:
+    void idsFound(int generation, const QVector<unsigned int> &ids);
+    // lastId is the largest id examined, matching or not
+    void scanFinished(int generation, unsigned int lastId);
+    void scanFailed(int generation, const QString &errMsg);
+
+protected:
+    virtual void run();
+
+private:
+    EntryIdScanner(const EntryIdScanner &other); // disabled
+    void operator=(const EntryIdScanner &rhs); // disabled
+
+    struct Request
+    {
+        int generation;
+        QString tables;
+        QString predicates;
+        QString matchCondition;
+        QStringList matchFields;
+        QRegExp pattern;
+        unsigned int afterId;
+    };
+
+    bool takeRequest(Request *request);
+    bool hasNewRequest();
+
+    const QString m_databaseFileName;
+    QMutex m_mutex;
+    QWaitCondition m_requestQueued;
+    Request m_request;
+    bool m_hasRequest;
+    bool m_stopRequested;
+};
+
+#endif
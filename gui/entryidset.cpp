@@ -0,0 +1,156 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entryidset.h"
+
+#include <algorithm>
+
+EntryIdSet::EntryIdSet()
+    : m_size(0)
+{
+}
+
+/* Returns the index of the first container whose key is not less than
+ * the given one.
+ */
+int EntryIdSet::findContainer(unsigned int key) const
+{
+    int lo = 0;
+    int hi = m_containers.size();
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (m_containers[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void EntryIdSet::insert(unsigned int id)
+{
+    const unsigned int key = id >> 16;
+    const quint16 low = id & 0xffff;
+
+    const int idx = findContainer(key);
+    if (idx == m_containers.size() || m_containers[idx].key != key) {
+        Container c;
+        c.key = key;
+        m_containers.insert(idx, c);
+    }
+    Container &c = m_containers[idx];
+
+    if (!c.bits.isEmpty()) {
+        quint64 &word = c.bits[low / 64];
+        const quint64 mask = quint64(1) << (low % 64);
+        if (!(word & mask)) {
+            word |= mask;
+            ++m_size;
+        }
+        return;
+    }
+
+    QVector<quint16>::iterator it = std::lower_bound(c.values.begin(), c.values.end(), low);
+    if (it != c.values.end() && *it == low) {
+        return;
+    }
+    c.values.insert(it, low);
+    ++m_size;
+
+    if (c.values.size() > MaxArraySize) {
+        c.bits.fill(0, BitmapWords);
+        QVector<quint16>::ConstIterator vit, vend = c.values.constEnd();
+        for (vit = c.values.constBegin(); vit != vend; ++vit) {
+            c.bits[*vit / 64] |= quint64(1) << (*vit % 64);
+        }
+        c.values.clear();
+    }
+}
+
+bool EntryIdSet::contains(unsigned int id) const
+{
+    const unsigned int key = id >> 16;
+    const quint16 low = id & 0xffff;
+
+    const int idx = findContainer(key);
+    if (idx == m_containers.size() || m_containers[idx].key != key) {
+        return false;
+    }
+    const Container &c = m_containers[idx];
+    if (!c.bits.isEmpty()) {
+        return c.bits[low / 64] & (quint64(1) << (low % 64));
+    }
+    return std::binary_search(c.values.constBegin(), c.values.constEnd(), low);
+}
+
+/* Returns the smallest value in the container which is not less than
+ * low, or -1 if there is none.
+ */
+int EntryIdSet::nextValue(const Container &c, int low)
+{
+    if (low > 0xffff) {
+        return -1;
+    }
+    if (c.bits.isEmpty()) {
+        QVector<quint16>::ConstIterator it = std::lower_bound(c.values.constBegin(), c.values.constEnd(), quint16(low));
+        return it == c.values.constEnd() ? -1 : *it;
+    }
+
+    int wordIdx = low / 64;
+    quint64 word = c.bits[wordIdx] & (~quint64(0) << (low % 64));
+    while (true) {
+        if (word != 0) {
+            int bit = 0;
+            while (!(word & (quint64(1) << bit))) {
+                ++bit;
+            }
+            return wordIdx * 64 + bit;
+        }
+        if (++wordIdx == BitmapWords) {
+            return -1;
+        }
+        word = c.bits[wordIdx];
+    }
+}
+
+bool EntryIdSet::next(unsigned int id, unsigned int *nextId) const
+{
+    if (id == 0xffffffffu) {
+        return false;
+    }
+    const unsigned int candidate = id + 1;
+    const unsigned int key = candidate >> 16;
+
+    for (int idx = findContainer(key); idx < m_containers.size(); ++idx) {
+        const Container &c = m_containers[idx];
+        const int low = nextValue(c, c.key == key ? int(candidate & 0xffff) : 0);
+        if (low != -1) {
+            *nextId = (c.key << 16) | low;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EntryIdSet::clear()
+{
+    m_containers.clear();
+    m_size = 0;
+}
@@ -0,0 +1,65 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTRYIDSET_H
+#define ENTRYIDSET_H
+
+#include <QVector>
+
+/* A compressed set of trace entry ids, organized like a roaring bitmap:
+ * ids are grouped by their upper 16 bits. Each group stores the lower 16
+ * bits of its ids in a sorted array as long as it is sparse, and in a
+ * bitmap of 65536 bits once it holds more than MaxArraySize ids.
+ */
+class EntryIdSet
+{
+public:
+    EntryIdSet();
+
+    void insert(unsigned int id);
+    bool contains(unsigned int id) const;
+
+    /* Yields the smallest id in the set which is larger than the given
+     * one; returns false if there is no such id.
+     */
+    bool next(unsigned int id, unsigned int *nextId) const;
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    void clear();
+
+private:
+    static const int MaxArraySize = 4096;
+    static const int BitmapWords = 65536 / 64;
+
+    struct Container
+    {
+        unsigned int key;
+        QVector<quint16> values; // sorted; empty if bits are used
+        QVector<quint64> bits;
+    };
+
+    int findContainer(unsigned int key) const;
+    static int nextValue(const Container &c, int low);
+
+    QVector<Container> m_containers;
+    int m_size;
+};
+
+#endif
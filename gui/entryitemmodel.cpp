@@ -20,14 +20,18 @@
 #include "entryitemmodel.h"
 
 #include "entryfilter.h"
+#include "entryidscanner.h"
 #include "columnsinfo.h"
 #include "../hooklib/tracelib.h"
+#include "../server/database.h"
 #ifdef HAVE_MODELTEST
 #  include "modeltest.h"
 #endif
 
 #include <assert.h>
 
+#include <algorithm>
+
 #include <QBrush>
 #include <QDateTime>
 #include <QDebug>
@@ -105,12 +109,21 @@ static const struct {
 EntryItemModel::EntryItemModel(EntryFilter *filter, ColumnsInfo *ci,
                                QObject *parent )
     : QAbstractTableModel(parent),
-      m_numMatchingEntries(-1),
+      m_idScanner(NULL),
+      m_scanGeneration(0),
+      m_scanning(false),
+      m_topRow(-1),
       m_numNewEntries(0),
       m_databasePollingTimer(NULL),
       m_suspended(false),
       m_filter(filter),
       m_columnsInfo(ci),
+      m_highlightScanner(NULL),
+      m_highlightGeneration(0),
+      m_highlightScanning(false),
+      m_highlightOutdated(false),
+      m_highlightedUpTo(0),
+      m_lastMatchType(SearchWidget::StrictMatch),
       m_highlightedTraceKeyId(-1)
 {
 #if defined(DEBUG_MODEL) && defined(HAVE_MODELTEST)
@@ -119,7 +132,8 @@ EntryItemModel::EntryItemModel(EntryFilter *filter, ColumnsInfo *ci,
     m_databasePollingTimer = new QTimer(this);
     m_databasePollingTimer->setSingleShot(true);
     connect(m_databasePollingTimer, SIGNAL(timeout()), SLOT(insertNewTraceEntries()));
-    connect(m_columnsInfo, SIGNAL(changed()), SLOT(updateScannedFieldsList()));
+    // Only the visible columns are searched
+    connect(m_columnsInfo, SIGNAL(changed()), SLOT(restartHighlighting()));
 }
 
 EntryItemModel::~EntryItemModel()
@@ -131,70 +145,90 @@ bool EntryItemModel::setDatabase(QSqlDatabase database,
 {
     m_databasePollingTimer->stop();
     m_numNewEntries = 0;
-    m_numMatchingEntries = -1;
     m_suspended = false;
 
     m_db = database;
-    if (!queryForEntries(errMsg, 0))
-        return false;
 
+    delete m_idScanner;
+    m_idScanner = new EntryIdScanner(m_db.databaseName(), this);
+    connect(m_idScanner, SIGNAL(idsFound(int, const QVector<unsigned int> &)),
+            SLOT(handleFoundIds(int, const QVector<unsigned int> &)));
+    connect(m_idScanner, SIGNAL(scanFinished(int, unsigned int)), SLOT(handleScanFinished(int)));
+    connect(m_idScanner, SIGNAL(scanFailed(int, const QString &)),
+            SLOT(handleScanFailed(int, const QString &)));
+    m_idScanner->start();
+
+    delete m_highlightScanner;
+    m_highlightScanner = new EntryIdScanner(m_db.databaseName(), this);
+    connect(m_highlightScanner, SIGNAL(idsFound(int, const QVector<unsigned int> &)),
+            SLOT(handleHighlightedIds(int, const QVector<unsigned int> &)));
+    connect(m_highlightScanner, SIGNAL(scanFinished(int, unsigned int)),
+            SLOT(handleHighlightScanFinished(int, unsigned int)));
+    connect(m_highlightScanner, SIGNAL(scanFailed(int, const QString &)),
+            SLOT(handleHighlightScanFailed(int, const QString &)));
+    m_highlightScanner->start();
+
+    beginResetModel();
+    m_idForRow.clear();
+    m_data.clear();
+    m_topRow = -1;
+    endResetModel();
+
+    startScan(0);
+    restartHighlighting();
     return true;
 }
 
-bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
+void EntryItemModel::filterClause(QStringList *tables, QStringList *predicates) const
 {
-#ifdef DEBUG_MODEL
-    qDebug() << "EntryItemModel::queryForEntries: startRow = " << startRow;
-#endif
-
-    QStringList tablesToSelectFrom;
+    QStringList &tablesToSelectFrom = *tables;
     tablesToSelectFrom.append("trace_entry");
 
-    QStringList predicates;
-
     if (!m_filter->application().isEmpty()) {
         tablesToSelectFrom.append("process");
         tablesToSelectFrom.append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << "traced_thread.process_id = process.id"
-                   << QString("process.name LIKE '%%1%'").arg(m_filter->application());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id"
+                    << QString("process.name LIKE '%%1%'").arg(m_filter->application());
     }
 
     if (m_filter->processId() != -1) {
         tablesToSelectFrom.append("process");
         tablesToSelectFrom.append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << "traced_thread.process_id = process.id"
-                   << QString("process.id = %1").arg(m_filter->processId());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id"
+                    << QString("process.id = %1").arg(m_filter->processId());
     }
 
     if (m_filter->threadId() != -1) {
         tablesToSelectFrom.append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << QString("traced_thread.tid = %1").arg(m_filter->threadId());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << QString("traced_thread.tid = %1").arg(m_filter->threadId());
     }
 
     if (!m_filter->function().isEmpty()) {
-        tablesToSelectFrom.append("trace_point");
-        tablesToSelectFrom.append("function_name");
-
-        predicates << "trace_entry.trace_point_id = trace_point.id"
-                   << "trace_point.function_id = function_name.id"
-                   << QString("function_name.name LIKE '%%1%'").arg(m_filter->function());
+        // Function names are stored once, so only the (few) matching trace
+        // points need to be looked up in the trace_entry index
+        *predicates << QString("trace_entry.trace_point_id IN ("
+                               "SELECT trace_point.id FROM trace_point, function_name "
+                               "WHERE trace_point.function_id = function_name.id "
+                               "AND function_name.name LIKE '%%1%')").arg(m_filter->function());
     }
 
     if (!m_filter->message().isEmpty()) {
-        predicates << QString("trace_entry.message LIKE '%%1%'").arg(m_filter->message());
+        *predicates << Database::messageContains(m_db, "trace_entry.id",
+                                                 "trace_entry.message",
+                                                 m_filter->message());
     }
 
     if (m_filter->type() != -1) {
         tablesToSelectFrom.append("trace_point");
 
-        predicates << "trace_entry.trace_point_id = trace_point.id"
-                   << QString("trace_point.type = %1").arg(m_filter->type());
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << QString("trace_point.type = %1").arg(m_filter->type());
     }
 
     if (!m_filter->acceptsEntriesWithoutKey() || !m_filter->inactiveKeys().isEmpty()) {
@@ -232,53 +266,126 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
             keyIdTest += inactiveKeyIdTest;
         }
 
-        predicates << "trace_entry.trace_point_id = trace_point.id" << QString("(%1)").arg(keyIdTest);
+        *predicates << "trace_entry.trace_point_id = trace_point.id" << QString("(%1)").arg(keyIdTest);
     }
 
     tablesToSelectFrom.removeDuplicates();
-    predicates.removeDuplicates();
+    predicates->removeDuplicates();
+}
+
+/* Looks for matching entries following afterId in the background;
+ * handleFoundIds() appends them to the model.
+ */
+void EntryItemModel::startScan(unsigned int afterId)
+{
+    QStringList tables;
+    QStringList predicates;
+    filterClause(&tables, &predicates);
+
+    m_scanning = true;
+    m_idScanner->scan(++m_scanGeneration, tables, predicates, afterId);
+}
 
-    QString fromAndWhereClause = "FROM ";
-    fromAndWhereClause += tablesToSelectFrom.join(", ");
-    if (!predicates.isEmpty()) {
-        fromAndWhereClause += " WHERE ";
-        fromAndWhereClause += predicates.join(" AND ");
+void EntryItemModel::handleFoundIds(int generation, const QVector<unsigned int> &ids)
+{
+    if (generation != m_scanGeneration)
+        return;
+
+    beginInsertRows(QModelIndex(), m_idForRow.size(), m_idForRow.size() + ids.size() - 1);
+    m_idForRow += ids;
+    endInsertRows();
+}
+
+void EntryItemModel::handleScanFinished(int generation)
+{
+    if (generation != m_scanGeneration)
+        return;
+
+    m_scanning = false;
+    continueHighlighting();
+    // Pick up entries which were received while scanning
+    if (m_numNewEntries > 0 && !m_suspended) {
+        insertNewTraceEntries();
     }
+}
 
-    if ( m_numMatchingEntries == -1 ) {
-        QString countQuery = QString( "SELECT DISTINCT trace_entry.id %1 ORDER BY trace_entry.id;" ).arg(fromAndWhereClause);
-#ifdef DEBUG_MODEL
-        QTime t;
-        t.start();
+void EntryItemModel::handleScanFailed(int generation, const QString &errMsg)
+{
+    if (generation != m_scanGeneration)
+        return;
 
-        qDebug() << "Recomputing number of matching entries...";
-        qDebug() << "Query = " << countQuery;
-#endif
-        QSqlQuery q(m_db);
-        q.setForwardOnly(true);
-        if (!q.exec(countQuery)) {
-            *errMsg = m_db.lastError().text();
-            return false;
-        }
+    m_scanning = false;
+    qDebug() << "EntryItemModel: failed to look for matching entries: " << errMsg;
+}
 
-        m_idForRow.clear();
-        while (q.next()) {
-            bool ok;
-            m_idForRow.append(q.value(0).toUInt(&ok));
-            assert(ok);
-        }
-        m_numMatchingEntries = m_idForRow.size();
+/* Yields the SQL expression for the values shown in the given column,
+ * adding the tables and join predicates it needs.
+ */
+bool EntryItemModel::columnSource(const QString &cn, QString *field,
+                                  QStringList *tables, QStringList *predicates) const
+{
+    if (cn == "Time") {
+        *field = "trace_entry.timestamp";
+    } else if (cn == "Application") {
+        *field = "process.name";
+        *tables << "traced_thread" << "process";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id";
+    } else if (cn == "PID") {
+        *field = "process.pid";
+        *tables << "traced_thread" << "process";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id";
+    } else if (cn == "Thread") {
+        *field = "traced_thread.tid";
+        *tables << "traced_thread";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id";
+    } else if (cn == "File") {
+        *field = "path_name.name";
+        *tables << "trace_point" << "path_name";
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << "trace_point.path_id = path_name.id";
+    } else if (cn == "Line") {
+        *field = "trace_point.line";
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+    } else if (cn == "Function") {
+        *field = "function_name.name";
+        *tables << "trace_point" << "function_name";
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << "trace_point.function_id = function_name.id";
+    } else if (cn == "Type") {
+        *field = "trace_point.type";
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+    } else if (cn == "Key") {
+        *field = "trace_point.group_id";
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+    } else if (cn == "Message") {
+        *field = "trace_entry.message";
+    } else if (cn == "Stack Position") {
+        *field = "trace_entry.stack_position";
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* Fetches the data of the (up to) 100 rows starting at startRow. Their ids
+ * are known already, so only the tables needed for the visible columns
+ * are joined.
+ */
+bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
+{
 #ifdef DEBUG_MODEL
-        qDebug() << "Counted " << m_numMatchingEntries << " matching entries in " << t.elapsed() << "ms";
+    qDebug() << "EntryItemModel::queryForEntries: startRow = " << startRow;
 #endif
-        if (m_numMatchingEntries == 0) {
-            // bail out early if none of the entries matched
-            m_topRow = -1;
-            m_data.clear();
-            updateHighlightedEntries();
-            return true;
-        }
-    }
+
+    QStringList tablesToSelectFrom;
+    tablesToSelectFrom.append("trace_entry");
+
+    QStringList predicates;
 
     assert(startRow >= 0);
     assert(startRow < m_idForRow.size());
@@ -289,53 +396,10 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
         QList<int>::ConstIterator it, end = visibleColumns.end();
         fieldsToSelect.append("trace_entry.id");
         for (it = visibleColumns.begin(); it != end; ++it) {
-            const QString cn = m_columnsInfo->columnName(*it);
-            if (cn == "Time") {
-                fieldsToSelect.append("trace_entry.timestamp");
-            } else if (cn == "Application") {
-                fieldsToSelect.append("process.name");
-                tablesToSelectFrom.append("traced_thread");
-                tablesToSelectFrom.append("process");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                           << "traced_thread.process_id = process.id";
-            } else if (cn == "PID") {
-                fieldsToSelect.append("process.pid");
-                tablesToSelectFrom.append("traced_thread");
-                tablesToSelectFrom.append("process");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                           << "traced_thread.process_id = process.id";
-            } else if (cn == "Thread") {
-                fieldsToSelect.append("traced_thread.tid");
-                tablesToSelectFrom.append("traced_thread");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id";
-            } else if (cn == "File") {
-                fieldsToSelect.append("path_name.name");
-                tablesToSelectFrom.append("trace_point");
-                tablesToSelectFrom.append("path_name");
-                predicates << "trace_entry.trace_point_id = trace_point.id"
-                           << "trace_point.path_id = path_name.id";
-            } else if (cn == "Line") {
-                fieldsToSelect.append("trace_point.line");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Function") {
-                fieldsToSelect.append("function_name.name");
-                tablesToSelectFrom.append("trace_point");
-                tablesToSelectFrom.append("function_name");
-                predicates << "trace_entry.trace_point_id = trace_point.id"
-                           << "trace_point.function_id = function_name.id";
-            } else if (cn == "Type") {
-                fieldsToSelect.append("trace_point.type");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Key") {
-                fieldsToSelect.append("trace_point.group_id");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Message") {
-                fieldsToSelect.append("trace_entry.message");
-            } else if (cn == "Stack Position") {
-                fieldsToSelect.append("trace_entry.stack_position");
+            QString field;
+            if (columnSource(m_columnsInfo->columnName(*it), &field,
+                             &tablesToSelectFrom, &predicates)) {
+                fieldsToSelect.append(field);
             }
         }
     }
@@ -343,7 +407,11 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
     tablesToSelectFrom.removeDuplicates();
     predicates.removeDuplicates();
 
-    predicates << QString("trace_entry.id >= %1").arg(m_idForRow[startRow]);
+    QStringList ids;
+    for (int row = startRow; row < m_idForRow.size() && row < startRow + 100; ++row) {
+        ids << QString::number(m_idForRow[row]);
+    }
+    predicates << QString("trace_entry.id IN (%1)").arg(ids.join(", "));
 
     QString statement = "SELECT DISTINCT ";
     statement += fieldsToSelect.join( ", ");
@@ -388,8 +456,6 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
     qDebug() << "Selected " << m_data.size() << " rows in " << t.elapsed() << "ms";
 #endif
 
-    updateHighlightedEntries();
-
     return true;
 }
 
@@ -400,7 +466,7 @@ int EntryItemModel::columnCount(const QModelIndex & parent) const
 
 int EntryItemModel::rowCount(const QModelIndex & parent) const
 {
-    return std::max( 0, m_numMatchingEntries );
+    return m_idForRow.size();
 }
 
 QModelIndex EntryItemModel::index(int row, int column,
@@ -415,14 +481,17 @@ QModelIndex EntryItemModel::index(int row, int column,
 const QVariant &EntryItemModel::getValue(int row, int column) const
 {
     assert(row >= 0);
-    assert(row < m_numMatchingEntries);
+    assert(row < m_idForRow.size());
     assert(column >= 0);
     if (row < m_topRow || row >= m_topRow + m_data.size()) {
         QString errMsg;
         const_cast<EntryItemModel *>(this)->queryForEntries(&errMsg, row);
     }
-    assert(row >= m_topRow);
-    assert(row < m_topRow + m_data.size());
+    if (row < m_topRow || row >= m_topRow + m_data.size()) {
+        // The entry was archived meanwhile
+        static const QVariant missingValue;
+        return missingValue;
+    }
     const QVector<QVariant> &rowData = m_data[row - m_topRow];
     assert(column < rowData.size());
     return m_data[row - m_topRow][column];
@@ -477,7 +546,7 @@ QVariant EntryItemModel::headerData(int section, Qt::Orientation orientation,
         //assert((section >= 0 && section < rowCount()) || !"Invalid section value");
         if (!(section >= 0 && section < rowCount()))
             return QVariant();
-        return getValue(section, 0);
+        return m_idForRow[section];
     }
 
     return QAbstractTableModel::headerData(section, orientation, role);
@@ -510,16 +579,19 @@ void EntryItemModel::clear()
 {
     beginResetModel();
     m_numNewEntries = 0;
-    m_numMatchingEntries = 0;
+    m_idForRow.clear();
+    m_data.clear();
+    m_topRow = -1;
     endResetModel();
+
+    // Entries which were not deleted (e.g. when archiving) show up again
+    startScan(0);
+    restartHighlighting();
 }
 
 unsigned int EntryItemModel::idForIndex(const QModelIndex &index)
 {
-    bool ok;
-    const unsigned int id = getValue(index.row(), 0).toUInt(&ok);
-    assert(ok);
-    return id;
+    return m_idForRow[index.row()];
 }
 
 void EntryItemModel::insertNewTraceEntries()
@@ -527,26 +599,24 @@ void EntryItemModel::insertNewTraceEntries()
     if (m_numNewEntries == 0)
         return;
 
-    beginInsertRows(QModelIndex(), m_numMatchingEntries, m_numMatchingEntries + m_numNewEntries - 1);
-    m_numMatchingEntries = -1;
-    QString errorMsg;
-    if (!queryForEntries(&errorMsg, 0)) {
-        qDebug() << "EntryItemModel::insertNewTraceEntries: failed: " << errorMsg;
-    }
-    endInsertRows();
+    // handleScanFinished() calls us again once the running scan is done
+    if (m_scanning)
+        return;
 
     m_numNewEntries = 0;
+    startScan(m_idForRow.isEmpty() ? 0 : m_idForRow.last());
 }
 
 void EntryItemModel::reApplyFilter()
 {
-    m_numMatchingEntries = -1;
     beginResetModel();
-    QString errorMsg;
-    if (!queryForEntries(&errorMsg, 0)) {
-        qDebug() << "EntryItemModel::reApplyFilter: failed: " << errorMsg;
-    }
+    m_idForRow.clear();
+    m_data.clear();
+    m_topRow = -1;
     endResetModel();
+
+    startScan(0);
+    restartHighlighting();
 }
 
 void EntryItemModel::highlightEntries(const QString &term,
@@ -554,13 +624,9 @@ void EntryItemModel::highlightEntries(const QString &term,
                                       SearchWidget::MatchType matchType)
 {
     if ( term.isEmpty() || fields.isEmpty() ) {
-        if ( !m_highlightedEntryIds.isEmpty() ) {
-            m_highlightedEntryIds.clear();
-            // XXX Is there a more elegant way to have the views repaint
-            // their visible range?
-            emit dataChanged( createIndex( 0, 0, static_cast<void *>( 0 ) ),
-                              createIndex( rowCount() - 1, columnCount() - 1, static_cast<void *>( 0 ) ) );
-        }
+        m_lastSearchTerm = QRegExp();
+        m_scannedFieldNames.clear();
+        restartHighlighting();
         return;
     }
 
@@ -576,12 +642,11 @@ void EntryItemModel::highlightEntries(const QString &term,
             break;
     }
     m_lastSearchTerm.setPattern( term );
+    m_lastMatchType = matchType;
 
     m_scannedFieldNames = fields;
 
-    updateScannedFieldsList();
-
-    updateHighlightedEntries();
+    restartHighlighting();
 }
 
 void EntryItemModel::highlightTraceKey(const QString &traceKey)
@@ -595,73 +660,155 @@ void EntryItemModel::highlightTraceKey(const QString &traceKey)
             q.next();
             m_highlightedTraceKeyId = q.value(0).toInt();
         }
-        updateHighlightedEntries();
+        restartHighlighting();
     }
 }
 
-void EntryItemModel::updateHighlightedEntries()
+/* Forgets all highlighted entries and looks for the matching ones among
+ * all rows again, e.g. after the search term or the filter changed.
+ */
+void EntryItemModel::restartHighlighting()
 {
-    QSet<unsigned int> entriesToHighlight;
-
-    int traceKeyColumn = -1;
-    if ( !m_highlightedTraceKey.isEmpty() ) {
-        const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
-        QList<int>::ConstIterator it, end = visibleColumns.end();
-        int pos = -1;
-        for ( it = visibleColumns.begin(); it != end; ++it, ++pos ) {
-            if ( m_columnsInfo->columnCaption( *it ) == tr( "Key" ) ) {
-                traceKeyColumn = pos + 1;
-                break;
-            }
+    ++m_highlightGeneration;
+    m_highlightScanning = false;
+    m_highlightOutdated = false;
+    m_highlightedUpTo = 0;
+
+    if ( !m_highlightedEntryIds.isEmpty() ) {
+        m_highlightedEntryIds.clear();
+        if ( rowCount() > 0 ) {
+            // XXX Is there a more elegant way to have the views repaint
+            // their visible range?
+            emit dataChanged( createIndex( 0, 0, static_cast<void *>( 0 ) ),
+                              createIndex( rowCount() - 1, columnCount() - 1, static_cast<void *>( 0 ) ) );
         }
     }
 
-    QVector<QVector<QVariant> >::ConstIterator it, end = m_data.end();
-    for ( it = m_data.begin(); it != end; ++it ) {
-        const QVector<QVariant> &row = *it;
+    continueHighlighting();
+}
 
-        bool ok;
-        const unsigned int entryId = row[0].toUInt(&ok);
-        assert(ok);
+/* Looks for matching entries following those which were searched already
+ * in the background; handleHighlightedIds() adds them to the highlighted
+ * entries. The ids are kept in a compressed set covering all rows, so
+ * painting and navigating rows never needs to fetch any data.
+ */
+void EntryItemModel::continueHighlighting()
+{
+    if (!m_highlightScanner)
+        return;
 
-        QList<int>::ConstIterator fieldIdxIt, fieldIdxEnd = m_scannedFields.end();
-        for ( fieldIdxIt = m_scannedFields.begin(); fieldIdxIt != fieldIdxEnd; ++fieldIdxIt ) {
-            const QVariant &v = row[*fieldIdxIt + 1];
-            if ( m_lastSearchTerm.exactMatch( v.toString() ) ) {
-                entriesToHighlight.insert(entryId);
-            }
+    // handleHighlightScanFinished() calls us again once the running scan is done
+    if (m_highlightScanning) {
+        m_highlightOutdated = true;
+        return;
+    }
+
+    QStringList tables;
+    QStringList predicates;
+    filterClause(&tables, &predicates);
+
+    QStringList matchConditions;
+    QStringList matchFields;
+    const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
+    QList<int>::ConstIterator it, end = visibleColumns.end();
+    for ( it = visibleColumns.begin(); it != end; ++it ) {
+        const QString caption = m_columnsInfo->columnCaption( *it );
+        const QString columnName = m_columnsInfo->columnName( *it );
+
+        QString field;
+        if ( !m_highlightedTraceKey.isEmpty() && caption == tr( "Key" ) &&
+             columnSource( columnName, &field, &tables, &predicates ) ) {
+            matchConditions << QString( "%1 = %2" ).arg( field ).arg( m_highlightedTraceKeyId );
         }
 
-        if ( traceKeyColumn != -1 ) {
-            const QVariant &v = row[traceKeyColumn + 1];
-            if ( v.toInt() == m_highlightedTraceKeyId ) {
-                entriesToHighlight.insert(entryId);
+        if ( m_scannedFieldNames.contains( caption ) &&
+             columnSource( columnName, &field, &tables, &predicates ) ) {
+            if ( m_lastMatchType == SearchWidget::StrictMatch ) {
+                // Plain comparisons can be left to SQLite
+                QString term = m_lastSearchTerm.pattern();
+                term.replace( "'", "''" );
+                matchConditions << field + " = '" + term + "'";
+            } else {
+                matchFields << field;
             }
         }
     }
 
-    if ( entriesToHighlight != m_highlightedEntryIds ) {
-        m_highlightedEntryIds = entriesToHighlight;
+    if ( matchConditions.isEmpty() && matchFields.isEmpty() )
+        return;
+
+    tables.removeDuplicates();
+    predicates.removeDuplicates();
+
+    m_highlightScanning = true;
+    m_highlightScanner->scanMatching(m_highlightGeneration, tables, predicates,
+                                     matchConditions.join(" OR "), matchFields,
+                                     m_lastSearchTerm, m_highlightedUpTo);
+}
+
+void EntryItemModel::handleHighlightedIds(int generation, const QVector<unsigned int> &ids)
+{
+    if (generation != m_highlightGeneration)
+        return;
+
+    QVector<unsigned int>::ConstIterator it, end = ids.end();
+    for (it = ids.begin(); it != end; ++it) {
+        m_highlightedEntryIds.insert(*it);
+    }
 
-        // XXX Is there a more elegant way to have the views repaint
-        // their visible range?
-        emit dataChanged( createIndex( 0, 0, static_cast<void *>( 0 ) ),
-                          createIndex( rowCount() - 1, columnCount() - 1, static_cast<void *>( 0 ) ) );
+    // Only repaint the rows which might have been highlighted
+    const QVector<unsigned int>::ConstIterator first =
+        std::lower_bound(m_idForRow.constBegin(), m_idForRow.constEnd(), ids.first());
+    const QVector<unsigned int>::ConstIterator last =
+        std::upper_bound(m_idForRow.constBegin(), m_idForRow.constEnd(), ids.last());
+    if (first != last) {
+        emit dataChanged(createIndex(first - m_idForRow.constBegin(), 0, static_cast<void *>(0)),
+                         createIndex(last - m_idForRow.constBegin() - 1, columnCount() - 1, static_cast<void *>(0)));
     }
 }
 
-void EntryItemModel::updateScannedFieldsList()
+void EntryItemModel::handleHighlightScanFinished(int generation, unsigned int lastId)
 {
-    m_scannedFields.clear();
+    if (generation != m_highlightGeneration)
+        return;
 
-    const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
-    QList<int>::ConstIterator it, end = visibleColumns.end();
-    unsigned int pos = 0;
-    for ( it = visibleColumns.begin(); it != end; ++it, ++pos ) {
-        if ( m_scannedFieldNames.contains( m_columnsInfo->columnCaption( *it ) ) ) {
-            m_scannedFields.append(pos);
+    m_highlightScanning = false;
+    m_highlightedUpTo = lastId;
+    if (m_highlightOutdated) {
+        m_highlightOutdated = false;
+        continueHighlighting();
+    }
+}
+
+void EntryItemModel::handleHighlightScanFailed(int generation, const QString &errMsg)
+{
+    if (generation != m_highlightGeneration)
+        return;
+
+    m_highlightScanning = false;
+    m_highlightOutdated = false;
+    qDebug() << "EntryItemModel: failed to look for highlighted entries: " << errMsg;
+}
+
+int EntryItemModel::nextHighlightedRow(int row) const
+{
+    unsigned int id = row >= 0 && row < m_idForRow.size() ? m_idForRow[row] : 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        // Highlighted entries may not be shown (yet), skip to the next row
+        while (m_highlightedEntryIds.next(id, &id)) {
+            const QVector<unsigned int>::ConstIterator it =
+                std::lower_bound(m_idForRow.constBegin(), m_idForRow.constEnd(), id);
+            if (it == m_idForRow.constEnd()) {
+                break;
+            }
+            if (*it == id) {
+                return it - m_idForRow.constBegin();
+            }
+            id = *it - 1;
         }
+        id = 0;
     }
+    return -1;
 }
 
 QString EntryItemModel::keyName(int id) const
@@ -20,16 +20,17 @@
 #ifndef ENTRYITEMMODEL_H
 #define ENTRYITEMMODEL_H
 
+#include "entryidset.h"
 #include "searchwidget.h"
 
 #include <QAbstractTableModel>
-#include <QSet>
 #include <QSqlDatabase>
 
 class QTimer;
 
 struct TraceEntry;
 class EntryFilter;
+class EntryIdScanner;
 class ColumnsInfo;
 
 class EntryItemModel : public QAbstractTableModel
@@ -61,6 +62,11 @@ public:
 
     QString keyName(int id) const;
 
+    /* Returns the first highlighted row following the given one, wrapping
+     * around at the end; -1 if no row is highlighted.
+     */
+    int nextHighlightedRow(int row) const;
+
     void setCellFont(const QFont &font);
 
 public slots:
@@ -73,14 +79,26 @@ public slots:
 
 private slots:
     void insertNewTraceEntries();
-    void updateScannedFieldsList();
+    void handleFoundIds(int generation, const QVector<unsigned int> &ids);
+    void handleScanFinished(int generation);
+    void handleScanFailed(int generation, const QString &errMsg);
+    void restartHighlighting();
+    void handleHighlightedIds(int generation, const QVector<unsigned int> &ids);
+    void handleHighlightScanFinished(int generation, unsigned int lastId);
+    void handleHighlightScanFailed(int generation, const QString &errMsg);
 
 private:
+    void filterClause(QStringList *tables, QStringList *predicates) const;
+    void startScan(unsigned int afterId);
+    bool columnSource(const QString &columnName, QString *field,
+                      QStringList *tables, QStringList *predicates) const;
     bool queryForEntries(QString *errMsg, int startRow);
-    void updateHighlightedEntries();
+    void continueHighlighting();
 
     QSqlDatabase m_db;
-    int m_numMatchingEntries;
+    EntryIdScanner *m_idScanner;
+    int m_scanGeneration;
+    bool m_scanning;
     int m_topRow;
     QVector<QVector<QVariant> > m_data;
     QVector<unsigned int> m_idForRow;
@@ -89,10 +107,15 @@ private:
     bool m_suspended;
     EntryFilter *m_filter;
     ColumnsInfo *m_columnsInfo;
-    QSet<unsigned int> m_highlightedEntryIds;
+    EntryIdScanner *m_highlightScanner;
+    int m_highlightGeneration;
+    bool m_highlightScanning;
+    bool m_highlightOutdated;
+    unsigned int m_highlightedUpTo;
+    EntryIdSet m_highlightedEntryIds;
     QRegExp m_lastSearchTerm;
+    SearchWidget::MatchType m_lastMatchType;
     QStringList m_scannedFieldNames;
-    QList<int> m_scannedFields;
     QString m_highlightedTraceKey;
     int m_highlightedTraceKeyId;
     QFont m_cellFont;
@@ -25,6 +25,7 @@
 #include "config.h"
 #include "mainwindow.h"
 #include "settings.h"
+#include "../server/columnararchive.h"
 #include "../server/database.h"
 #ifdef Q_OS_WIN
 #  include "jobobject.h"
@@ -56,7 +57,7 @@ int main(int argc, char **argv)
     opt.setApplicationDescription("GUI for analyzing trace files");
     opt.addHelpOption();
     opt.addVersionOption();
-    opt.addPositionalArgument(".trace-file", "Trace file to load");
+    opt.addPositionalArgument(".trace-file", "Trace file or .tracearchive file to load");
     opt.process(a);
     
     QStringList positionalArguments = opt.positionalArguments();
@@ -67,6 +68,7 @@ int main(int argc, char **argv)
 
     QString errMsg;
     if (!traceFile.isEmpty() &&
+        !ColumnarArchive::isArchive(traceFile) &&
         !Database::isValidFileName(traceFile, &errMsg)) {
         cout << errMsg.toLocal8Bit().constData() << endl;
         return Error::CommandLineArgs;
@@ -75,7 +77,7 @@ int main(int argc, char **argv)
     Settings settings;
 
     // respect overrides from command line
-    if (!traceFile.isEmpty())
+    if (!traceFile.isEmpty() && !ColumnarArchive::isArchive(traceFile))
         settings.setDatabaseFile(traceFile);
 
 #ifdef Q_OS_WIN
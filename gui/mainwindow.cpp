@@ -45,6 +45,7 @@
 #endif
 
 #include "../hooklib/tracelib.h"
+#include "../server/columnararchive.h"
 #include "../server/database.h"
 #include "../server/datagramtypes.h"
 
@@ -162,6 +163,7 @@ MainWindow::MainWindow(Settings *settings,
                        QWidget *parent, Qt::WindowFlags flags)
     : QMainWindow(parent, flags),
       m_settings(settings),
+      m_extractedArchive(NULL),
       m_entryItemModel(NULL),
       m_watchTree(NULL),
       m_serverSocket(NULL),
@@ -195,6 +197,8 @@ MainWindow::MainWindow(Settings *settings,
     connect(tracePointsView, SIGNAL(doubleClicked(const QModelIndex &)),
             this, SLOT(traceEntryDoubleClicked(const QModelIndex &)));
 #endif
+    connect(tracePointsSearchWidget, SIGNAL(nextMatchRequested()),
+            this, SLOT(showNextMatch()));
     // replacing standard header for performance reasons
     FixedHeaderView *hv = new FixedHeaderView(9, // ### dynamic
                                               Qt::Vertical,
@@ -267,7 +271,26 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
 	delete m_entryItemModel; m_entryItemModel = NULL;
     }
 
-    if (QFile::exists(databaseFileName)) {
+    if (m_extractedArchive) {
+        const QString connectionName = m_db.connectionName();
+        m_db.close();
+        m_db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+        delete m_extractedArchive; m_extractedArchive = NULL;
+    }
+
+    const bool isArchive = ColumnarArchive::isArchive(databaseFileName);
+    if (isArchive) {
+        // Archives are read-only, their entries are shown from a temporary copy
+        m_extractedArchive = new QTemporaryFile(QDir::temp().filePath(QFileInfo(databaseFileName).completeBaseName() + "-XXXXXX.trace"), this);
+        if (!m_extractedArchive->open()) {
+            *errMsg = m_extractedArchive->errorString();
+            delete m_extractedArchive; m_extractedArchive = NULL;
+            return false;
+        }
+        m_extractedArchive->close();
+        m_db = ColumnarArchive::extract(databaseFileName, m_extractedArchive->fileName(), errMsg);
+    } else if (QFile::exists(databaseFileName)) {
         m_db = Database::open(databaseFileName, errMsg);
     } else {
         m_db = Database::create(databaseFileName, errMsg);
@@ -294,7 +317,7 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
     tracePointsSearchWidget->setTraceKeys(traceKeysNames);
     m_applicationTable->setApplications(Database::tracedApplications(m_db));
 
-    if (m_serverSocket) {
+    if (m_serverSocket && !isArchive) {
         connect(m_serverSocket, SIGNAL(traceEntryReceived(const TraceEntry &)),
                 this, SLOT(handleNewTraceEntry(const TraceEntry &)));
         connect(m_serverSocket, SIGNAL(processShutdown(const ProcessShutdownEvent &)),
@@ -318,7 +341,9 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
     connect(m_settings->columnsInfo(), SIGNAL(changed()),
             m_entryItemModel, SLOT(reApplyFilter()));
 
-    m_settings->setDatabaseFile(databaseFileName);
+    // The server must not write into archives
+    if (!isArchive)
+        m_settings->setDatabaseFile(databaseFileName);
 
     tracePointsView->setModel(m_entryItemModel);
     m_entryItemModel->setCellFont(m_settings->font());
@@ -412,7 +437,7 @@ void MainWindow::fileOpenTrace()
 {
     QString fn = QFileDialog::getOpenFileName(this, tr("Open Trace"),
 					      QDir::currentPath(),
-					      tr("Trace Files (*.trace)"));
+					      tr("Trace Files (*.trace);;Trace Archives (*.tracearchive)"));
     if (fn.isEmpty())
 	return;
 
@@ -791,6 +816,20 @@ void MainWindow::databaseWasNuked()
     tracePointsClear->setEnabled( true );
 }
 
+void MainWindow::showNextMatch()
+{
+    if (!m_entryItemModel)
+        return;
+
+    const int row = m_entryItemModel->nextHighlightedRow(tracePointsView->currentIndex().row());
+    if (row == -1)
+        return;
+
+    const QModelIndex index = m_entryItemModel->index(row, 0);
+    tracePointsView->setCurrentIndex(index);
+    tracePointsView->scrollTo(index);
+}
+
 void MainWindow::traceEntryDoubleClicked(const QModelIndex &index)
 {
     const unsigned int id = m_entryItemModel->idForIndex(index);
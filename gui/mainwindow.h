@@ -38,6 +38,7 @@ class QModelIndex;
 struct TraceEntry;
 struct ProcessShutdownEvent;
 class QLabel;
+class QTemporaryFile;
 class QProcess;
 class JobObject;
 
@@ -118,6 +119,7 @@ private slots:
     void filterChange();
     void clearTracePoints();
     void traceEntryDoubleClicked(const QModelIndex &index);
+    void showNextMatch();
 #if 0
     void addNewTraceKey(const QString &id);
 #endif
@@ -137,6 +139,8 @@ private:
 
     Settings* const m_settings;
     QSqlDatabase m_db;
+    // Database the entries of an opened trace archive were extracted into
+    QTemporaryFile *m_extractedArchive;
     EntryItemModel* m_entryItemModel;
     WatchTree* m_watchTree;
     FilterForm *m_filterForm;
@@ -79,6 +79,8 @@ SearchWidget::SearchWidget( QWidget *parent )
     m_lineEdit = new UnlabelledLineEdit( this );
     connect( m_lineEdit, SIGNAL( textEdited( const QString & ) ),
              this, SLOT( termEdited( const QString & ) ) );
+    connect( m_lineEdit, SIGNAL( returnPressed() ),
+             this, SIGNAL( nextMatchRequested() ) );
     m_lineEdit->setPlaceholderText( "Search trace data..." );
 
     m_strictMatch = new QRadioButton( tr( "Strict" ), this );
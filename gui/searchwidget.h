@@ -66,6 +66,7 @@ signals:
                                 const QStringList &fields,
                                 SearchWidget::MatchType matchType );
     void activeTraceKeyChanged( const QString &activeKey );
+    void nextMatchRequested();
 
 private slots:
     void termEdited( const QString &term );
@@ -9,6 +9,9 @@
 
 WatchTree::WatchTree(EntryFilter *filter, QWidget *parent)
     : QTreeWidget( parent ),
+    m_iconExe( ":/icons/application-x-executable.png" ),
+    m_iconSrc( ":/icons/text-x-csrc.png" ),
+    m_iconFunc( ":/icons/application-sxw.png" ),
     m_databasePollingTimer( 0 ),
     m_dirty( true ),
     m_suspended(false),
@@ -29,7 +32,7 @@ WatchTree::WatchTree(EntryFilter *filter, QWidget *parent)
     m_databasePollingTimer = new QTimer(this);
     m_databasePollingTimer->setSingleShot(true);
     connect(m_databasePollingTimer, SIGNAL(timeout()),
-            SLOT(showNewTraceEntriesFireAndForget()));
+            SLOT(showPendingValues()));
     connect(m_filter, SIGNAL(changed()), SLOT(reApplyFilter()));
 }
 
@@ -53,8 +56,9 @@ bool WatchTree::setDatabase( QSqlDatabase database,
 {
     m_db = database;
     m_dirty = true;
+    m_pendingValues.clear();
 
-    return showNewTraceEntries( errMsg );
+    return showLatestValues( errMsg );
 }
 
 void WatchTree::suspend()
@@ -65,10 +69,7 @@ void WatchTree::suspend()
 void WatchTree::resume()
 {
     m_suspended = false;
-    QString errMsg;
-    if (!showNewTraceEntries(&errMsg)) {
-        qDebug() << "WatchTree::resume: failed: " << errMsg;
-    }
+    showPendingValues();
 }
 
 void WatchTree::handleNewTraceEntry( const TraceEntry &e )
@@ -79,18 +80,35 @@ void WatchTree::handleNewTraceEntry( const TraceEntry &e )
         return;
     }
 
-    m_dirty = true;
+    // The values are shown right away instead of querying the database for
+    // the latest entry of every watch point again
+    WatchedValue v;
+    v.application = QString( "%1 (PID %2)" ).arg( e.processName ).arg( e.pid );
+    v.sourceFile = e.path;
+    v.function = QString( "%1 (line %2)" ).arg( e.function ).arg( e.lineno );
+    QList<Variable>::ConstIterator it, end = e.variables.end();
+    for ( it = e.variables.begin(); it != end; ++it ) {
+        v.name = it->name;
+        v.type = it->type;
+        v.value = it->value;
+        const QString key = ( QStringList() << v.application << v.sourceFile
+                                            << v.function << v.name ).join( "\n" );
+        m_pendingValues[ key ] = v;
+    }
+
     if ( !m_suspended && !m_databasePollingTimer->isActive() ) {
         m_databasePollingTimer->start( 250 );
     }
 }
 
-static QString filterClause(EntryFilter *f)
+static QString filterClause(QSqlDatabase db, EntryFilter *f)
 {
-    QString sql = f->whereClause("process.name",
+    QString sql = f->whereClause(db,
+                                 "process.name",
                                  "process.pid",
                                  "traced_thread.tid",
                                  "function_name.name",
+                                 "trace_entry.id",
                                  "message",
                                  "trace_point.type");
     if (sql.isEmpty())
@@ -107,7 +125,11 @@ void WatchTree::showEvent(QShowEvent *e)
     return QTreeWidget::showEvent(e);
 }
 
-bool WatchTree::showNewTraceEntries( QString *errMsg )
+/* Rebuilds the tree from the latest entry of every watch point in the
+ * database (as maintained in the watch_latest table by the server); only
+ * needed initially and when the filter changes.
+ */
+bool WatchTree::showLatestValues( QString *errMsg )
 {
     if ( !m_dirty || !isVisible() ) {
         return true;
@@ -139,22 +161,10 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
     statement +=
                 "  function_name,"
                 "  variable,"
+                "  watch_latest,"
                 "  trace_entry"
                 " WHERE"
-                "  trace_entry.id IN ("
-                "    SELECT"
-                "      DISTINCT trace_entry_id"
-                "    FROM"
-                "      variable"
-                "    WHERE"
-                "      trace_entry_id IN ("
-                "        SELECT"
-                "          MAX(id)"
-                "        FROM"
-                "          trace_entry"
-                "        GROUP BY trace_point_id, traced_thread_id"
-                "      )"
-                "  )"
+                "  trace_entry.id = watch_latest.trace_entry_id"
                 " AND"
                 "  variable.trace_entry_id = trace_entry.id"
                 " AND"
@@ -167,7 +177,7 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
                 "  path_name.id = trace_point.path_id"
                 " AND"
                 "  function_name.id = trace_point.function_id" +
-                filterClause(m_filter) +
+                filterClause(m_db, m_filter) +
                 " ORDER BY"
                 "  process.name";
 
@@ -180,99 +190,114 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
 
     setUpdatesEnabled( false );
 
-    QIcon iconExe(":/icons/application-x-executable.png");
-    QIcon iconSrc(":/icons/text-x-csrc.png");
-    QIcon iconFunc(":/icons/application-sxw.png");
-
     while ( query.next() ) {
-        TreeItem *applicationItem = 0;
-        {
-            const QString application = QString( "%1 (PID %2)" )
-                                            .arg( query.value( 0 ).toString() )
-                                            .arg( query.value( 1 ).toString() );
-            ItemMap::ConstIterator it = m_applicationItems.find( application );
-            if ( it != m_applicationItems.end() ) {
-                applicationItem = *it;
-            } else {
-                applicationItem = new TreeItem( new QTreeWidgetItem( this,
-                                                       QStringList() << application ) );
-                applicationItem->item->setIcon(0, iconExe);
-                m_applicationItems[ application ] = applicationItem;
-            }
-        }
+        WatchedValue v;
+        v.application = QString( "%1 (PID %2)" )
+                            .arg( query.value( 0 ).toString() )
+                            .arg( query.value( 1 ).toString() );
+        v.sourceFile = query.value( 2 ).toString();
+        v.function = QString( "%1 (line %2)" )
+                        .arg( query.value( 4 ).toString() )
+                        .arg( query.value( 3 ).toString() );
+        v.name = query.value( 5 ).toString();
+        v.type = query.value( 6 ).toInt();
+        v.value = query.value( 7 ).toString();
+        showValue( v );
+    }
 
-        TreeItem *sourceFileItem = 0;
-        {
-            const QString sourceFile = query.value( 2 ).toString();
-            ItemMap::ConstIterator it = applicationItem->children.find( sourceFile );
-            if ( it != applicationItem->children.end() ) {
-                sourceFileItem = *it;
-            } else {
-                sourceFileItem = new TreeItem( new QTreeWidgetItem( applicationItem->item,
-                                                      QStringList() << sourceFile ) );
-                sourceFileItem->item->setIcon(0, iconSrc);
-                applicationItem->children[ sourceFile ] = sourceFileItem;
-            }
-        }
+    setUpdatesEnabled( true );
 
-        TreeItem *functionItem = 0;
-        {
-            const QString function = QString( "%1 (line %2)" )
-                                        .arg( query.value( 4 ).toString() )
-                                        .arg( query.value( 3 ).toString() );
-            ItemMap::ConstIterator it = sourceFileItem->children.find( function );
-            if ( it != sourceFileItem->children.end() ) {
-                functionItem = *it;
-            } else {
-                functionItem = new TreeItem( new QTreeWidgetItem( sourceFileItem->item,
-                                                    QStringList() << function ) );
-                functionItem->item->setIcon(0, iconFunc);
-                sourceFileItem->children[ function ] = functionItem;
-            }
+    m_dirty = false;
 
-        }
+    return true;
+}
 
-        TreeItem *variableItem = 0;
-        {
-            const QString varName = query.value( 5 ).toString();
-            ItemMap::ConstIterator it = functionItem->children.find( varName );
-            if ( it != functionItem->children.end() ) {
-                variableItem = *it;
-            } else {
-                using TRACELIB_NAMESPACE_IDENT(VariableType);
-                const VariableType::Value varType = static_cast<VariableType::Value>( query.value( 6 ).toInt() );
-                variableItem = new TreeItem( new QTreeWidgetItem( functionItem->item,
-                                                    QStringList() << varName
-                                                                  << VariableType::valueAsString( varType ) ) );
-                functionItem->children[ varName ] = variableItem;
-            }
-        }
+void WatchTree::showPendingValues()
+{
+    // The values will be read from the database when the tree is rebuilt
+    if ( m_dirty ) {
+        m_pendingValues.clear();
+        return;
+    }
 
-        const QString currentValue = variableItem->item->data( 2, Qt::DisplayRole ).toString();
-        const QString varValue = query.value( 7 ).toString();
-        if ( currentValue != varValue ) {
-            variableItem->item->setData( 3, Qt::DisplayRole, currentValue );
-            variableItem->item->setData( 3, Qt::ToolTipRole, currentValue );
-            variableItem->item->setData( 2, Qt::DisplayRole, varValue );
-            variableItem->item->setData( 2, Qt::ToolTipRole, varValue );
-        }
+    if ( m_pendingValues.isEmpty() ) {
+        return;
     }
 
-    setUpdatesEnabled( true );
+    setUpdatesEnabled( false );
 
-    m_dirty = false;
+    QMap<QString, WatchedValue>::ConstIterator it, end = m_pendingValues.end();
+    for ( it = m_pendingValues.begin(); it != end; ++it ) {
+        showValue( *it );
+    }
+    m_pendingValues.clear();
 
-    return true;
+    setUpdatesEnabled( true );
 }
 
-// for use as a slot
-// ### better replace all stderr output in this file with a signal to
-// ### be handled by the main window.
-void WatchTree::showNewTraceEntriesFireAndForget()
+void WatchTree::showValue( const WatchedValue &v )
 {
-    QString errMsg;
-    if (!showNewTraceEntries(&errMsg)) {
-        qDebug() << "WatchTree::reApplyFilter: failed: " << errMsg;
+    TreeItem *applicationItem = 0;
+    {
+        ItemMap::ConstIterator it = m_applicationItems.find( v.application );
+        if ( it != m_applicationItems.end() ) {
+            applicationItem = *it;
+        } else {
+            applicationItem = new TreeItem( new QTreeWidgetItem( this,
+                                                   QStringList() << v.application ) );
+            applicationItem->item->setIcon(0, m_iconExe);
+            m_applicationItems[ v.application ] = applicationItem;
+        }
+    }
+
+    TreeItem *sourceFileItem = 0;
+    {
+        ItemMap::ConstIterator it = applicationItem->children.find( v.sourceFile );
+        if ( it != applicationItem->children.end() ) {
+            sourceFileItem = *it;
+        } else {
+            sourceFileItem = new TreeItem( new QTreeWidgetItem( applicationItem->item,
+                                                  QStringList() << v.sourceFile ) );
+            sourceFileItem->item->setIcon(0, m_iconSrc);
+            applicationItem->children[ v.sourceFile ] = sourceFileItem;
+        }
+    }
+
+    TreeItem *functionItem = 0;
+    {
+        ItemMap::ConstIterator it = sourceFileItem->children.find( v.function );
+        if ( it != sourceFileItem->children.end() ) {
+            functionItem = *it;
+        } else {
+            functionItem = new TreeItem( new QTreeWidgetItem( sourceFileItem->item,
+                                                QStringList() << v.function ) );
+            functionItem->item->setIcon(0, m_iconFunc);
+            sourceFileItem->children[ v.function ] = functionItem;
+        }
+
+    }
+
+    TreeItem *variableItem = 0;
+    {
+        ItemMap::ConstIterator it = functionItem->children.find( v.name );
+        if ( it != functionItem->children.end() ) {
+            variableItem = *it;
+        } else {
+            using TRACELIB_NAMESPACE_IDENT(VariableType);
+            const VariableType::Value varType = static_cast<VariableType::Value>( v.type );
+            variableItem = new TreeItem( new QTreeWidgetItem( functionItem->item,
+                                                QStringList() << v.name
+                                                              << VariableType::valueAsString( varType ) ) );
+            functionItem->children[ v.name ] = variableItem;
+        }
+    }
+
+    const QString currentValue = variableItem->item->data( 2, Qt::DisplayRole ).toString();
+    if ( currentValue != v.value ) {
+        variableItem->item->setData( 3, Qt::DisplayRole, currentValue );
+        variableItem->item->setData( 3, Qt::ToolTipRole, currentValue );
+        variableItem->item->setData( 2, Qt::DisplayRole, v.value );
+        variableItem->item->setData( 2, Qt::ToolTipRole, v.value );
     }
 }
 
@@ -282,10 +307,11 @@ void WatchTree::reApplyFilter()
 
     deleteItemMap( m_applicationItems );
     m_applicationItems.clear();
+    m_pendingValues.clear();
     clear();
 
     QString errMsg;
-    if (!showNewTraceEntries(&errMsg)) {
+    if (!showLatestValues(&errMsg)) {
         qDebug() << "WatchTree::reApplyFilter: failed: " << errMsg;
     }
 }
@@ -20,6 +20,7 @@
 #ifndef WATCHTREE_H
 #define WATCHTREE_H
 
+#include <QIcon>
 #include <QSqlDatabase>
 #include <QTreeWidget>
 #include <QMap>
@@ -37,6 +38,16 @@ struct TreeItem {
     ItemMap children;
 };
 
+// The latest value of a watched variable, as shown in a WatchTree row
+struct WatchedValue {
+    QString application;
+    QString sourceFile;
+    QString function;
+    QString name;
+    int type;
+    QString value;
+};
+
 class WatchTree : public QTreeWidget
 {
     Q_OBJECT
@@ -57,11 +68,18 @@ protected:
     virtual void showEvent(QShowEvent *e);
 
 private slots:
-    void showNewTraceEntriesFireAndForget();
+    void showPendingValues();
 
 private:
-    bool showNewTraceEntries( QString *errMsg );
+    bool showLatestValues( QString *errMsg );
+    void showValue( const WatchedValue &v );
+
     ItemMap m_applicationItems;
+    // Values received since the tree was last updated, latest one per variable
+    QMap<QString, WatchedValue> m_pendingValues;
+    QIcon m_iconExe;
+    QIcon m_iconSrc;
+    QIcon m_iconFunc;
     QSqlDatabase m_db;
     QTimer *m_databasePollingTimer;
     bool m_dirty;
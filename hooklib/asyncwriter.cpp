@@ -0,0 +1,395 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "asyncwriter.h"
+#include "log.h"
+#include "ringbuffer.h"
+#include "timehelper.h" // for now
+#include "trace.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+TRACELIB_NAMESPACE_BEGIN
+
+// Time the writer thread sleeps between two passes unless woken up earlier.
+static const unsigned int DrainInterval = 50;
+
+// Time a traced thread waits for the writer thread before re-checking its
+// buffer if the buffer is full and the overflow policy is 'block'.
+static const unsigned int OverflowWaitInterval = 10;
+
+// Minimum time between two reports about dropped entries.
+static const uint64_t DropReportInterval = 1000;
+
+/* The AbstractVariable objects passed to Trace::visitTracePoint only refer to
+ * the traced program's variables, so their values are copied before the
+ * entry leaves the traced thread. The objects are reused along with their
+ * QueuedEntry, so capturing a value only allocates memory if it does not fit
+ * into the strings of an earlier one.
+ */
+class CapturedVariable : public AbstractVariable
+{
+public:
+    CapturedVariable()
+        : m_type( VariableType::Unknown ),
+        m_isSignedNumber( false ),
+        m_number( 0 ),
+        m_float( 0 ),
+        m_boolean( false )
+    {
+    }
+
+    void capture( const AbstractVariable *v )
+    {
+        m_name.assign( v->name() );
+
+        const VariableValue value = v->value();
+        m_type = value.type();
+        m_isSignedNumber = value.isSignedNumber();
+        switch ( m_type ) {
+            case VariableType::String:
+                m_string.assign( value.asString() );
+                break;
+            case VariableType::Number:
+                m_number = value.asNumber();
+                break;
+            case VariableType::Float:
+                m_float = value.asFloat();
+                break;
+            case VariableType::Boolean:
+                m_boolean = value.asBoolean();
+                break;
+            default:
+                break;
+        }
+    }
+
+    virtual const char *name() const { return m_name.c_str(); }
+
+    virtual VariableValue value() const
+    {
+        switch ( m_type ) {
+            case VariableType::Number:
+                if ( m_isSignedNumber ) {
+                    return VariableValue::numberValue( static_cast<vlonglong>( m_number ) );
+                }
+                return VariableValue::numberValue( m_number );
+            case VariableType::Float:
+                return VariableValue::floatValue( m_float );
+            case VariableType::Boolean:
+                return VariableValue::booleanValue( m_boolean );
+            default:
+                return VariableValue::stringValue( m_string.c_str() );
+        }
+    }
+
+private:
+    string m_name;
+    VariableType::Value m_type;
+    bool m_isSignedNumber;
+    vulonglong m_number;
+    long double m_float;
+    bool m_boolean;
+    string m_string;
+};
+
+/* Entries are recycled through the free list of the thread buffer they were
+ * queued in, so the strings and the variable storage they grew stay
+ * allocated and the traced thread does not allocate memory once it recorded
+ * a few entries.
+ */
+struct QueuedEntry
+{
+    QueuedEntry()
+        : threadId( 0 ),
+        timeStamp( 0 ),
+        tracePoint( 0 ),
+        hasMessage( false ),
+        variableCount( 0 ),
+        hasVariables( false ),
+        backtrace( 0 ),
+        stackPosition( 0 )
+    {
+    }
+
+    ~QueuedEntry()
+    {
+        delete backtrace;
+    }
+
+    void assign( TraceEntry &e )
+    {
+        threadId = e.threadId;
+        timeStamp = e.timeStamp;
+        tracePoint = e.tracePoint;
+        hasMessage = e.message != 0;
+        message.assign( e.message ? e.message : "" );
+        hasVariables = e.variables != 0;
+        variableCount = e.variables ? e.variables->size() : 0;
+        if ( variables.size() < variableCount ) {
+            variables.resize( variableCount );
+        }
+        for ( size_t i = 0; i < variableCount; ++i ) {
+            variables[i].capture( ( *e.variables )[i] );
+        }
+        backtrace = e.backtrace;
+        e.backtrace = 0;
+        stackPosition = e.stackPosition;
+    }
+
+    ThreadId threadId;
+    uint64_t timeStamp;
+    const TracePoint *tracePoint;
+    bool hasMessage;
+    string message;
+    vector<CapturedVariable> variables;
+    size_t variableCount;
+    bool hasVariables;
+    Backtrace *backtrace;
+    size_t stackPosition;
+};
+
+struct ThreadBuffer
+{
+    explicit ThreadBuffer( size_t capacity ) : entries( capacity ), freeEntries( capacity ) { }
+
+    ~ThreadBuffer()
+    {
+        QueuedEntry *qe;
+        while ( entries.pop( &qe ) ) {
+            delete qe;
+        }
+        while ( freeEntries.pop( &qe ) ) {
+            delete qe;
+        }
+    }
+
+    // Producer side; reuses an entry which was written already if possible.
+    QueuedEntry *acquire()
+    {
+        QueuedEntry *qe;
+        return freeEntries.pop( &qe ) ? qe : new QueuedEntry;
+    }
+
+    // Consumer side
+    void release( QueuedEntry *qe )
+    {
+        if ( !freeEntries.push( qe ) ) {
+            delete qe;
+        }
+    }
+
+    RingBuffer<QueuedEntry *> entries;
+
+    // Entries which were written and may be reused by the owning thread; the
+    // writer thread pushes, the owning thread pops.
+    RingBuffer<QueuedEntry *> freeEntries;
+
+    // Set once the owning thread exited; the writer thread then releases
+    // the buffer as soon as it is empty.
+    AtomicInt abandoned;
+};
+
+AsyncWriter::AsyncWriter( Trace *trace, Log *log )
+    : m_trace( trace ),
+    m_log( log ),
+    m_enabled( 0 ),
+    m_running( 1 ),
+    m_bufferSize( BufferingConfiguration::DefaultBufferSize ),
+    m_overflowPolicy( BufferingConfiguration::BlockThread ),
+    m_dropped( 0 ),
+    m_currentBuffer( releaseThreadBuffer ),
+    m_reportedDrops( 0 ),
+    m_lastDropReport( 0 )
+{
+    if ( !start() ) {
+        m_log->writeError( "AsyncWriter: failed to start writer thread, writing entries synchronously" );
+        m_running.store( 0 );
+    }
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    m_running.store( 0 );
+    m_dataAvailable.wakeAll();
+    wait();
+
+    flush();
+
+    vector<ThreadBuffer *>::const_iterator it, end = m_buffers.end();
+    for ( it = m_buffers.begin(); it != end; ++it ) {
+        delete *it;
+    }
+}
+
+void AsyncWriter::setConfiguration( const BufferingConfiguration &cfg )
+{
+    m_bufferSize.store( cfg.bufferSize );
+    m_overflowPolicy.store( cfg.overflowPolicy );
+    m_enabled.store( cfg.enabled && m_running.load() ? 1 : 0 );
+    if ( !cfg.enabled ) {
+        flush();
+    }
+}
+
+bool AsyncWriter::enqueue( TraceEntry &entry )
+{
+    ThreadBuffer *buffer = bufferForCurrentThread();
+
+    /* Only this thread pushes to the buffer, so once there is space, the push
+     * below succeeds; nothing is copied for entries which get dropped.
+     */
+    while ( buffer->entries.size() >= buffer->entries.capacity() ) {
+        if ( m_overflowPolicy.loadRelaxed() == BufferingConfiguration::DropEntries ||
+             !m_running.load() ) {
+            m_dropped.fetchAndAdd( 1 );
+            return false;
+        }
+        m_dataAvailable.wakeAll();
+        m_spaceAvailable.wait( OverflowWaitInterval );
+    }
+
+    QueuedEntry *qe = buffer->acquire();
+    qe->assign( entry );
+    buffer->entries.push( qe );
+
+    // Don't wait for the next regular pass if the buffer fills up quickly
+    if ( buffer->entries.size() == buffer->entries.capacity() / 2 ) {
+        m_dataAvailable.wakeAll();
+    }
+    return true;
+}
+
+void AsyncWriter::flush()
+{
+    drain();
+    reportDroppedEntries( true );
+}
+
+void AsyncWriter::run()
+{
+    while ( m_running.load() ) {
+        m_dataAvailable.wait( DrainInterval );
+        drain();
+        reportDroppedEntries( false );
+    }
+}
+
+ThreadBuffer *AsyncWriter::bufferForCurrentThread()
+{
+    ThreadBuffer *buffer = static_cast<ThreadBuffer *>( m_currentBuffer.get() );
+    if ( !buffer ) {
+        buffer = new ThreadBuffer( m_bufferSize.load() );
+        m_currentBuffer.set( buffer );
+
+        MutexLocker buffersLocker( m_buffersMutex );
+        m_buffers.push_back( buffer );
+    }
+    return buffer;
+}
+
+bool AsyncWriter::drain()
+{
+    MutexLocker drainLocker( m_drainMutex );
+
+    vector<ThreadBuffer *> buffers;
+    {
+        MutexLocker buffersLocker( m_buffersMutex );
+        buffers = m_buffers;
+    }
+
+    bool wroteEntries = false;
+    vector<ThreadBuffer *>::const_iterator it, end = buffers.end();
+    for ( it = buffers.begin(); it != end; ++it ) {
+        ThreadBuffer *buffer = *it;
+
+        // Read this before draining: once the flag is set the owning thread
+        // won't push anymore, so the buffer is done as soon as it's empty.
+        const bool abandoned = buffer->abandoned.load() != 0;
+
+        QueuedEntry *qe;
+        while ( buffer->entries.pop( &qe ) ) {
+            writeEntry( qe );
+            buffer->release( qe );
+            wroteEntries = true;
+        }
+
+        if ( abandoned ) {
+            MutexLocker buffersLocker( m_buffersMutex );
+            m_buffers.erase( find( m_buffers.begin(), m_buffers.end(), buffer ) );
+            delete buffer;
+        }
+    }
+
+    if ( wroteEntries ) {
+        m_spaceAvailable.wakeAll();
+    }
+
+    return wroteEntries;
+}
+
+void AsyncWriter::reportDroppedEntries( bool force )
+{
+    MutexLocker drainLocker( m_drainMutex );
+
+    const unsigned long dropped = m_dropped.load();
+    if ( dropped == m_reportedDrops ) {
+        return;
+    }
+
+    const uint64_t currentTime = now();
+    if ( force || currentTime - m_lastDropReport >= DropReportInterval ) {
+        m_log->writeError( "AsyncWriter: dropped %lu trace entries since the per-thread buffers were full", dropped - m_reportedDrops );
+        m_reportedDrops = dropped;
+        m_lastDropReport = currentTime;
+    }
+}
+
+void AsyncWriter::writeEntry( QueuedEntry *qe )
+{
+    TraceEntry entry( qe->tracePoint,
+                      qe->hasMessage ? qe->message.c_str() : 0,
+                      qe->threadId,
+                      qe->timeStamp,
+                      qe->stackPosition );
+
+    VariableSnapshot variables;
+    if ( qe->hasVariables ) {
+        for ( size_t i = 0; i < qe->variableCount; ++i ) {
+            variables << &qe->variables[i];
+        }
+        entry.variables = &variables;
+    }
+
+    entry.backtrace = qe->backtrace;
+    qe->backtrace = 0; // now owned by entry
+
+    m_trace->addEntry( entry );
+}
+
+void AsyncWriter::releaseThreadBuffer( void *buffer )
+{
+    static_cast<ThreadBuffer *>( buffer )->abandoned.store( 1 );
+}
+
+TRACELIB_NAMESPACE_END
+
@@ -0,0 +1,93 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_ASYNCWRITER_H
+#define TRACELIB_ASYNCWRITER_H
+
+#include "tracelib_config.h"
+#include "atomic.h"
+#include "config.h" // for uint64_t
+#include "configuration.h" // for BufferingConfiguration
+#include "mutex.h"
+#include "thread.h"
+
+#include <vector>
+
+TRACELIB_NAMESPACE_BEGIN
+
+class Log;
+class Trace;
+struct TraceEntry;
+struct QueuedEntry;
+struct ThreadBuffer;
+
+/* Decouples the traced threads from the serializer and the output. Each
+ * traced thread copies its entries into a private lock-free ring buffer; a
+ * single writer thread drains all buffers and hands the entries back to
+ * Trace::addEntry, so that only the writer thread ever contends for the
+ * serializer and output mutexes.
+ */
+class AsyncWriter : private Thread
+{
+public:
+    AsyncWriter( Trace *trace, Log *log );
+    virtual ~AsyncWriter();
+
+    void setConfiguration( const BufferingConfiguration &cfg );
+    bool isEnabled() const { return m_enabled.load() != 0; }
+
+    // Called by the traced threads; takes ownership of the entry's backtrace.
+    bool enqueue( TraceEntry &entry );
+
+    // Writes all entries which were enqueued before this call.
+    void flush();
+
+private:
+    virtual void run();
+
+    ThreadBuffer *bufferForCurrentThread();
+    bool drain();
+    void reportDroppedEntries( bool force );
+    void writeEntry( QueuedEntry *qe );
+
+    static void releaseThreadBuffer( void *buffer );
+
+    Trace *m_trace;
+    Log *m_log;
+
+    AtomicInt m_enabled;
+    AtomicInt m_running;
+    AtomicInt m_bufferSize;
+    AtomicInt m_overflowPolicy;
+    AtomicInt m_dropped;
+
+    ThreadLocalPointer m_currentBuffer;
+    std::vector<ThreadBuffer *> m_buffers;
+    Mutex m_buffersMutex;
+    Mutex m_drainMutex;
+    WaitCondition m_dataAvailable;
+    WaitCondition m_spaceAvailable;
+    unsigned long m_reportedDrops;
+    uint64_t m_lastDropReport;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_ASYNCWRITER_H)
+
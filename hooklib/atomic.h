@@ -0,0 +1,94 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_ATOMIC_H
+#define TRACELIB_ATOMIC_H
+
+#include "tracelib_config.h"
+
+#ifdef _MSC_VER
+#  include <windows.h>
+#  include <intrin.h>
+#endif
+
+TRACELIB_NAMESPACE_BEGIN
+
+/* Accessors for shared words which live in public structures (like
+ * TracePoint::state) and hence cannot be an AtomicInt.
+ */
+#if defined(__GNUC__)
+inline long atomicLoadRelaxed( const volatile long *p ) { return __atomic_load_n( p, __ATOMIC_RELAXED ); }
+inline void atomicStore( volatile long *p, long value ) { __atomic_store_n( p, value, __ATOMIC_RELEASE ); }
+inline long atomicFetchAndAdd( volatile long *p, long value ) { return __atomic_fetch_add( p, value, __ATOMIC_SEQ_CST ); }
+inline bool atomicTestAndSet( volatile long *p, long expected, long value ) {
+    return __atomic_compare_exchange_n( p, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+}
+#elif defined(_MSC_VER)
+inline long atomicLoadRelaxed( const volatile long *p ) { return *p; }
+inline void atomicStore( volatile long *p, long value ) { _ReadWriteBarrier(); *p = value; }
+inline long atomicFetchAndAdd( volatile long *p, long value ) { return ::InterlockedExchangeAdd( p, value ); }
+inline bool atomicTestAndSet( volatile long *p, long expected, long value ) {
+    return ::InterlockedCompareExchange( p, value, expected ) == expected;
+}
+#else
+#  error "Unsupported compiler!"
+#endif
+
+/* A machine word which can be shared between threads without locking.
+ * load() has acquire semantics and store() has release semantics, which is
+ * all that the single-producer/single-consumer structures in tracelib need.
+ */
+class AtomicInt
+{
+public:
+    explicit AtomicInt( long value = 0 ) : m_value( value ) { }
+
+#if defined(__GNUC__)
+    long loadRelaxed() const { return __atomic_load_n( &m_value, __ATOMIC_RELAXED ); }
+    long load() const { return __atomic_load_n( &m_value, __ATOMIC_ACQUIRE ); }
+    void store( long value ) { __atomic_store_n( &m_value, value, __ATOMIC_RELEASE ); }
+    long fetchAndAdd( long value ) { return __atomic_fetch_add( &m_value, value, __ATOMIC_SEQ_CST ); }
+    bool testAndSet( long expected, long value ) {
+        return __atomic_compare_exchange_n( &m_value, &expected, value, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+    }
+#elif defined(_MSC_VER)
+    // Accesses to volatile variables have acquire/release semantics with MSVC
+    long loadRelaxed() const { return m_value; }
+    long load() const { long v = m_value; _ReadWriteBarrier(); return v; }
+    void store( long value ) { _ReadWriteBarrier(); m_value = value; }
+    long fetchAndAdd( long value ) { return ::InterlockedExchangeAdd( &m_value, value ); }
+    bool testAndSet( long expected, long value ) {
+        return ::InterlockedCompareExchange( &m_value, value, expected ) == expected;
+    }
+#else
+#  error "Unsupported compiler!"
+#endif
+
+private:
+    AtomicInt( const AtomicInt &other ); // disabled
+    void operator=( const AtomicInt &rhs ); // disabled
+
+    volatile long m_value;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_ATOMIC_H)
+
@@ -26,17 +26,28 @@ using namespace std;
 TRACELIB_NAMESPACE_BEGIN
 
 Backtrace::Backtrace( const vector<StackFrame> &frames )
-    : m_frames( frames )
+    : m_frames( frames ),
+    m_symbolized( true )
+{
+}
+
+Backtrace::Backtrace( const vector<void *> &addresses )
+    : m_addresses( addresses ),
+    m_symbolized( false )
 {
 }
 
 size_t Backtrace::depth() const
 {
-    return m_frames.size();
+    return m_symbolized ? m_frames.size() : m_addresses.size();
 }
 
 const StackFrame &Backtrace::frame( size_t depth ) const
 {
+    if ( !m_symbolized ) {
+        symbolize();
+        m_symbolized = true;
+    }
     assert( depth < m_frames.size() );
     return m_frames[depth];
 }
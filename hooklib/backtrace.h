@@ -39,6 +39,11 @@ struct StackFrame
 
 class BacktraceGenerator;
 
+/* On platforms where BacktraceGenerator just records the program counters,
+ * the frames are symbolized when they are accessed for the first time. That
+ * is usually done when the entry is serialized, i.e. by the AsyncWriter
+ * thread if buffering is enabled, and not by the traced thread.
+ */
 class Backtrace
 {
     friend class BacktraceGenerator;
@@ -50,7 +55,13 @@ public:
     const StackFrame &frame( size_t depth ) const;
 
 private:
-    std::vector<StackFrame> m_frames;
+    explicit Backtrace( const std::vector<void *> &addresses );
+
+    void symbolize() const;
+
+    std::vector<void *> m_addresses;
+    mutable std::vector<StackFrame> m_frames;
+    mutable bool m_symbolized;
 };
 
 class BacktraceGenerator
@@ -61,6 +72,19 @@ public:
 
     Backtrace generate( size_t skipInnermostFrames );
 
+    struct CacheStatistics {
+        CacheStatistics() : hits( 0 ), misses( 0 ), size( 0 ), capacity( 0 ) { }
+        size_t hits;
+        size_t misses;
+        size_t size;
+        size_t capacity;
+    };
+
+    /* Lookups in the cache of symbolized frames which is shared by all
+     * generators of the process; all zero if frames are not cached.
+     */
+    static CacheStatistics cacheStatistics();
+
 private:
     BacktraceGenerator( const BacktraceGenerator &other );
     void operator=( const BacktraceGenerator &rhs );
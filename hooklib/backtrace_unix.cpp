@@ -21,7 +21,11 @@
 
 #include <config.h>
 
+#include <algorithm>
 #include <cassert>
+#include <list>
+#include <map>
+#include <set>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -44,9 +48,10 @@ using namespace std;
 
 TRACELIB_NAMESPACE_BEGIN
 
-static int trace_ref_count;
+// Protects all of the static data below
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_mutex_t trace_mutex;
+static int trace_ref_count;
 
 static char *symbol_buffer;
 static size_t symbol_buffer_length;
@@ -90,28 +95,50 @@ struct BfdSymbol {
     unsigned int offset;
 };
 
-static void findAddressInSection( bfd *abfd, asection *section, void *data )
-{
-    BfdSymbol *bfd_sym = (BfdSymbol *)data;
+/* The allocated sections of self_bfd, sorted by address, so that the section
+ * containing a program counter can be found with a binary search.
+ */
+struct SectionRange {
+    bfd_vma vma;
+    bfd_size_type size;
+    asection *section;
 
-    if ( bfd_sym->found )
-        return;
+    bool operator<( const SectionRange &other ) const { return vma < other.vma; }
+};
 
-    if ( ( bfd_get_section_flags( abfd, section ) & SEC_ALLOC) == 0 )
-        return;
+static vector<SectionRange> self_sections;
 
-    bfd_vma vma = bfd_get_section_vma( abfd, section );
-    if ( bfd_sym->pc < vma )
+static void collectSection( bfd *abfd, asection *section, void * )
+{
+    // .tbss would overlap the sections following it and contains no code
+    const flagword flags = bfd_get_section_flags( abfd, section );
+    if ( ( flags & SEC_ALLOC ) == 0 || ( flags & SEC_THREAD_LOCAL ) != 0 )
         return;
 
-    bfd_size_type size = bfd_get_section_size( section );
-    if ( bfd_sym->pc >= vma + size )
-        return;
+    SectionRange range;
+    range.vma = bfd_get_section_vma( abfd, section );
+    range.size = bfd_get_section_size( section );
+    range.section = section;
+    self_sections.push_back( range );
+}
+
+static void setupSectionTable()
+{
+    bfd_map_over_sections( self_bfd, collectSection, NULL );
+    sort( self_sections.begin(), self_sections.end() );
+}
 
-    bfd_sym->offset = bfd_sym->pc - vma;
-    bfd_sym->found = bfd_find_nearest_line( abfd,
-            section, self_symbols,  bfd_sym->pc - vma,
-            &bfd_sym->filename, &bfd_sym->functionname, &bfd_sym->linenr );
+static const SectionRange *findSection( bfd_vma pc )
+{
+    SectionRange key;
+    key.vma = pc;
+    vector<SectionRange>::const_iterator it = upper_bound( self_sections.begin(), self_sections.end(), key );
+    if ( it == self_sections.begin() )
+        return NULL;
+    --it;
+    if ( pc >= it->vma + it->size )
+        return NULL;
+    return &*it;
 }
 
 static bool bfdAddressInfo( bfd_vma addr, StackFrame *frame )
@@ -119,7 +146,13 @@ static bool bfdAddressInfo( bfd_vma addr, StackFrame *frame )
     BfdSymbol bfd_sym;
     bfd_sym.pc = addr; //bfd_scan_vma( addr, NULL, 16 );
     bfd_sym.found = false;
-    bfd_map_over_sections( self_bfd, findAddressInSection, &bfd_sym );
+    const SectionRange *range = findSection( bfd_sym.pc );
+    if ( range ) {
+        bfd_sym.offset = bfd_sym.pc - range->vma;
+        bfd_sym.found = bfd_find_nearest_line( self_bfd,
+                range->section, self_symbols, bfd_sym.offset,
+                &bfd_sym.filename, &bfd_sym.functionname, &bfd_sym.linenr );
+    }
     if ( bfd_sym.found ) {
         if ( bfd_sym.functionname ) {
             char *demangle = bfd_demangle( self_bfd,
@@ -198,48 +231,150 @@ static bool parseLine( const string line, StackFrame *frame )
 }
 #endif
 
-static void readBacktrace( std::vector<StackFrame> &trace, size_t skip
-#ifdef __sun
-        ,ucontext_t *context
-#endif
-)
-{
 #if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
-    void *array[50];
-    size_t size = backtrace(array, sizeof(array)/sizeof(void*));
-    if ( size > 0 && size < sizeof ( array ) / sizeof ( void* ) ) {
+static const int MaxBacktraceDepth = 50;
+
+/* Symbolized frames by program counter. Code which is executed often tends
+ * to yield the same backtraces over and over again, so most frames are
+ * found here. The module, function and file names are interned since the
+ * same few strings are shared by many frames.
+ */
+class FrameCache
+{
+public:
+    static const size_t Capacity = 4096;
+
+    FrameCache() : m_hits( 0 ), m_misses( 0 ) { }
+
+    bool lookup( void *address, StackFrame *frame ) {
+        std::map<void *, Entries::iterator>::iterator it = m_index.find( address );
+        if ( it == m_index.end() ) {
+            ++m_misses;
+            return false;
+        }
+        ++m_hits;
+        m_entries.splice( m_entries.begin(), m_entries, it->second );
+
+        const CachedFrame &cachedFrame = it->second->second;
+        frame->module = *cachedFrame.module;
+        frame->function = *cachedFrame.function;
+        frame->functionOffset = cachedFrame.functionOffset;
+        frame->sourceFile = *cachedFrame.sourceFile;
+        frame->lineNumber = cachedFrame.lineNumber;
+        return true;
+    }
+
+    void insert( void *address, const StackFrame &frame ) {
+        if ( m_index.size() == Capacity ) {
+            m_index.erase( m_entries.back().first );
+            m_entries.pop_back();
+        }
+
+        CachedFrame cachedFrame;
+        cachedFrame.module = intern( frame.module );
+        cachedFrame.function = intern( frame.function );
+        cachedFrame.functionOffset = frame.functionOffset;
+        cachedFrame.sourceFile = intern( frame.sourceFile );
+        cachedFrame.lineNumber = frame.lineNumber;
+        m_entries.push_front( std::make_pair( address, cachedFrame ) );
+        m_index[address] = m_entries.begin();
+    }
+
+    void clear() {
+        m_index.clear();
+        m_entries.clear();
+        m_strings.clear();
+    }
+
+    BacktraceGenerator::CacheStatistics statistics() const {
+        BacktraceGenerator::CacheStatistics stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.size = m_index.size();
+        stats.capacity = Capacity;
+        return stats;
+    }
+
+private:
+    struct CachedFrame {
+        const string *module;
+        const string *function;
+        size_t functionOffset;
+        const string *sourceFile;
+        size_t lineNumber;
+    };
+
+    /* Strings are not released when the last frame using them is evicted;
+     * there are only as many of them as there are symbols and source files
+     * in the process.
+     */
+    const string *intern( const string &s ) {
+        return &*m_strings.insert( s ).first;
+    }
+
+    typedef std::list<std::pair<void *, CachedFrame> > Entries;
+    Entries m_entries;
+    std::map<void *, Entries::iterator> m_index;
+    std::set<string> m_strings;
+    size_t m_hits;
+    size_t m_misses;
+};
+
+static FrameCache frame_cache;
+
+static void symbolizeAddresses( const std::vector<void *> &addresses, std::vector<StackFrame> &frames )
+{
+    frames.resize( addresses.size() );
+
+    std::vector<size_t> uncached;
+    for ( size_t i = 0; i < addresses.size(); ++i ) {
+        if ( !frame_cache.lookup( addresses[i], &frames[i] ) ) {
+            uncached.push_back( i );
+        }
+    }
+    if ( uncached.empty() ) {
+        return;
+    }
+
 #if HAVE_BFD_H && HAVE_DEMANGLE_H
-        if ( self_symbols ) {
-            for (size_t i = skip; i < size; ++i) {
-                StackFrame frame;
-                if ( !bfdAddressInfo( (bfd_vma)array[i], &frame ) ) {
-                    fprintf( stderr, "err (%d) %p\n", i, array[i] );
-                    frame.function = "??";
-                }
-                trace.push_back( frame );
+    if ( self_symbols ) {
+        for ( size_t i = 0; i < uncached.size(); ++i ) {
+            StackFrame &frame = frames[uncached[i]];
+            if ( !bfdAddressInfo( (bfd_vma)addresses[uncached[i]], &frame ) ) {
+                fprintf( stderr, "err (%d) %p\n", int( uncached[i] ), addresses[uncached[i]] );
+                frame.function = "??";
             }
-        } else {
-#endif
-            char **strs = backtrace_symbols(array, size);
-            if (strs) {
-                for (size_t i = skip; i < size; ++i) {
-                    StackFrame frame;
-                    if ( !parseLine( strs[i], &frame ) ) {
-                        fprintf( stderr, "err (%d) %s\n", int(i), strs[i] );
-                        frame.function = "??";
-                    }
-                    trace.push_back( frame );
-                }
-                free(strs);
-            }
-#if HAVE_BFD_H && HAVE_DEMANGLE_H
+            frame_cache.insert( addresses[uncached[i]], frame );
         }
+        return;
+    }
 #endif
+
+    std::vector<void *> uncachedAddresses;
+    for ( size_t i = 0; i < uncached.size(); ++i ) {
+        uncachedAddresses.push_back( addresses[uncached[i]] );
     }
-#elif defined(__sun)
-    walkcontext( context, buildBackTrace, (void*)&trace );
+    char **strs = backtrace_symbols( &uncachedAddresses[0], uncachedAddresses.size() );
+    for ( size_t i = 0; i < uncached.size(); ++i ) {
+        StackFrame &frame = frames[uncached[i]];
+        if ( !strs || !parseLine( strs[i], &frame ) ) {
+            fprintf( stderr, "err (%d) %s\n", int( uncached[i] ), strs ? strs[i] : "" );
+            frame.function = "??";
+        }
+        frame_cache.insert( addresses[uncached[i]], frame );
+    }
+    free( strs );
+}
 #endif
+
+#if !defined(__GNUC__) && defined(__sun)
+static void readBacktrace( std::vector<StackFrame> &trace, size_t skip )
+{
+    ucontext_t context;
+    getcontext( &context );
+    walkcontext( &context, buildBackTrace, (void*)&trace );
 }
+#endif
 
 static void setupSymbolTable()
 {
@@ -266,6 +401,7 @@ static void setupSymbolTable()
                 else
                     symcnt = bfd_canonicalize_symtab( self_bfd, self_symbols );
                 if ( symcnt >= 0 ) {
+                    setupSectionTable();
                     success = true;
                 } else {
                     free( self_symbols );
@@ -286,6 +422,7 @@ static void cleanupSymbolTable()
 {
 #if HAVE_BFD_H && HAVE_DEMANGLE_H
     if ( self_bfd ) {
+        self_sections.clear();
         bfd_close( self_bfd );
         self_bfd = NULL;
         if ( self_symbols ) {
@@ -298,33 +435,90 @@ static void cleanupSymbolTable()
 
 BacktraceGenerator::BacktraceGenerator()
 {
+    pthread_mutex_lock( &trace_mutex );
     if ( !trace_ref_count++ ) {
-        pthread_mutex_init( &trace_mutex, NULL );
         symbol_buffer = (char *)malloc( 4096 );
         symbol_buffer_length = 4096;
         setupSymbolTable();
+#if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
+        // The first call might load libgcc, so don't do that while tracing
+        void *dummy[1];
+        backtrace( dummy, 1 );
+#endif
     }
+    pthread_mutex_unlock( &trace_mutex );
 }
 
 BacktraceGenerator::~BacktraceGenerator()
 {
+    pthread_mutex_lock( &trace_mutex );
     if ( ! --trace_ref_count ) {
-        pthread_mutex_destroy( &trace_mutex );
         free( symbol_buffer );
         symbol_buffer = NULL;
         cleanupSymbolTable();
+#if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
+        frame_cache.clear();
+#endif
     }
+    pthread_mutex_unlock( &trace_mutex );
 }
 
+BacktraceGenerator::CacheStatistics BacktraceGenerator::cacheStatistics()
+{
+    CacheStatistics stats;
+#if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
+    pthread_mutex_lock( &trace_mutex );
+    stats = frame_cache.statistics();
+    pthread_mutex_unlock( &trace_mutex );
+#endif
+    return stats;
+}
+
+/* Only records the program counters; see Backtrace::symbolize(). */
 Backtrace BacktraceGenerator::generate( size_t skipInnermostFrames )
 {
+#if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
+    void *addresses[MaxBacktraceDepth];
+    const size_t size = backtrace( addresses, MaxBacktraceDepth );
+    const size_t skip = skipInnermostFrames + 1; // this function
+    if ( size <= skip ) {
+        return Backtrace( std::vector<void *>() );
+    }
+    return Backtrace( std::vector<void *>( addresses + skip, addresses + size ) );
+#else
     std::vector<StackFrame> trace;
-
+# if defined(__sun)
     pthread_mutex_lock( &trace_mutex );
     readBacktrace( trace, skipInnermostFrames + 2 );
     pthread_mutex_unlock( &trace_mutex );
-
+# endif
     return Backtrace( trace );
+#endif
+}
+
+/* The modules are looked up when symbolizing, so frames of libraries which
+ * were unloaded after the backtrace was recorded are not resolved
+ * correctly.
+ */
+void Backtrace::symbolize() const
+{
+#if defined(__GNUC__) && defined(HAVE_EXECINFO_H)
+    pthread_mutex_lock( &trace_mutex );
+    if ( trace_ref_count > 0 ) {
+        symbolizeAddresses( m_addresses, m_frames );
+    } else {
+        // All generators are gone and with them the symbol tables
+        m_frames.assign( m_addresses.size(), StackFrame() );
+        for ( size_t i = 0; i < m_addresses.size(); ++i ) {
+            char buf[32];
+            snprintf( buf, sizeof( buf ), "[%p]", m_addresses[i] );
+            m_frames[i].function = buf;
+        }
+    }
+    pthread_mutex_unlock( &trace_mutex );
+#else
+    m_frames.assign( m_addresses.size(), StackFrame() );
+#endif
 }
 
 TRACELIB_NAMESPACE_END
@@ -115,5 +115,16 @@ Backtrace BacktraceGenerator::generate( size_t skipInnermostFrames )
     return bt;
 }
 
+BacktraceGenerator::CacheStatistics BacktraceGenerator::cacheStatistics()
+{
+    return CacheStatistics();
+}
+
+// Not needed since generate() symbolizes the frames right away
+void Backtrace::symbolize() const
+{
+    m_frames.assign( m_addresses.size(), StackFrame() );
+}
+
 TRACELIB_NAMESPACE_END
 
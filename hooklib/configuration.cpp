@@ -198,6 +198,13 @@ bool Configuration::readProcessElement( TiXmlElement *processElement )
             continue;
         }
 
+        if ( e->ValueStr() == "buffering" ) {
+            if ( !readBufferingElement( e ) ) {
+                return false;
+            }
+            continue;
+        }
+
         m_log->writeError( "Tracelib Configuration: while reading %s: unexpected child element '%s' found inside <process>.", m_fileName.c_str(), processElement->Value() );
     }
     return true;
@@ -229,6 +236,11 @@ const StorageConfiguration &Configuration::storageConfiguration() const
     return m_storageConfiguration;
 }
 
+const BufferingConfiguration &Configuration::bufferingConfiguration() const
+{
+    return m_bufferingConfiguration;
+}
+
 const vector<TracePointSet *> &Configuration::configuredTracePointSets() const
 {
     return m_configuredTracePointSets;
@@ -418,6 +430,21 @@ Serializer *Configuration::createSerializerFromElement( TiXmlElement *e )
         return serializer;
     }
 
+    if ( serializerType == "binary" ) {
+        for ( TiXmlElement *optionElement = e->FirstChildElement(); optionElement; optionElement = optionElement->NextSiblingElement() ) {
+            if ( optionElement->ValueStr() != "option" ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Unexpected element '%s' in <serializer> element of type binary found.", m_fileName.c_str(), optionElement->Value() );
+                return 0;
+            }
+
+            string optionName;
+            optionElement->QueryValueAttribute( "name", &optionName );
+            m_log->writeError( "Tracelib Configuration: while reading %s: Unknown <option> element with name '%s' found in binary serializer; ignoring this.", m_fileName.c_str(), optionName.c_str() );
+        }
+        m_log->writeStatus( "Tracelib Configuration: using binary serializer" );
+        return new BinarySerializer;
+    }
+
     m_log->writeError( "Tracelib Configuration: while reading %s: <serializer> element with unknown type '%s' found.", m_fileName.c_str(), serializerType.c_str() );
     return 0;
 }
@@ -438,6 +465,45 @@ TracePointSet *Configuration::createTracePointSetFromElement( TiXmlElement *e )
         return 0;
     }
 
+    long sampleInterval = 1;
+    string sampleAttr;
+    if ( e->QueryValueAttribute( "sample", &sampleAttr ) == TIXML_SUCCESS ) {
+        istringstream str( sampleAttr );
+        long numerator = 0;
+        char slash = 0;
+        if ( !( str >> numerator >> slash >> sampleInterval ) || !str.eof() ||
+             numerator != 1 || slash != '/' || sampleInterval < 1 ) {
+            m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for sample= attribute of <tracepointset> element, expected 1/N", m_fileName.c_str(), sampleAttr.c_str() );
+            return 0;
+        }
+    }
+
+    long maxRate = 0;
+    long ratePeriod = 1000;
+    string maxRateAttr;
+    if ( e->QueryValueAttribute( "maxrate", &maxRateAttr ) == TIXML_SUCCESS ) {
+        istringstream str( maxRateAttr );
+        char slash = 0;
+        string unit;
+        if ( str >> maxRate >> slash >> unit && maxRate > 0 && slash == '/' ) {
+            if ( unit == "s" ) {
+                ratePeriod = 1000;
+            } else if ( unit == "min" ) {
+                ratePeriod = 60 * 1000;
+            } else if ( unit == "h" ) {
+                ratePeriod = 60 * 60 * 1000;
+            } else {
+                ratePeriod = 0;
+            }
+        } else {
+            ratePeriod = 0;
+        }
+        if ( ratePeriod == 0 ) {
+            m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for maxrate= attribute of <tracepointset> element, expected N/s, N/min or N/h", m_fileName.c_str(), maxRateAttr.c_str() );
+            return 0;
+        }
+    }
+
     TiXmlElement *filterElement = e->FirstChildElement();
     if ( !filterElement ) {
         m_log->writeError( "Tracelib Configuration: while reading %s: No filter element specified for <tracepointset> element", m_fileName.c_str() );
@@ -463,7 +529,9 @@ TracePointSet *Configuration::createTracePointSetFromElement( TiXmlElement *e )
         actions |= TracePointSet::YieldVariables;
     }
 
-    return new TracePointSet( filter, actions );
+    TracePointSet *tracePointSet = new TracePointSet( filter, actions );
+    tracePointSet->setThrottling( sampleInterval, maxRate, ratePeriod );
+    return tracePointSet;
 }
 
 Output *Configuration::createOutputFromElement( TiXmlElement *e )
@@ -530,9 +598,65 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
         return new FileOutput( m_log, filename );
     }
 
+    if ( outputType == "mmapfile" ) {
+#ifdef _WIN32
+        m_log->writeError( "Tracelib Configuration: while reading %s: <output> elements of type mmapfile are not supported on this platform.", m_fileName.c_str() );
+        return 0;
+#else
+        std::string filename;
+        bool relativePathIsRelativeToUserHome = false;
+        size_t segmentSize = MmapFileOutput::DefaultSegmentSize;
+        unsigned long maxSegments = 0;
+        for ( TiXmlElement *optionElement = e->FirstChildElement(); optionElement; optionElement = optionElement->NextSiblingElement() ) {
+            if ( optionElement->ValueStr() != "option" ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Unexpected element '%s' in <output> element of type mmapfile found.", m_fileName.c_str(), optionElement->Value() );
+                return 0;
+            }
+
+            string optionName;
+            if ( optionElement->QueryValueAttribute( "name", &optionName ) != TIXML_SUCCESS ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Failed to read name property of <option> element; ignoring this.", m_fileName.c_str() );
+                continue;
+            }
+
+            if ( optionName == "filename" ) {
+                filename = getText( optionElement ); // XXX Consider encoding issues
+            } else if ( optionName == "relativeToUserHome" ) {
+                relativePathIsRelativeToUserHome = getText( optionElement ) == "true";
+            } else if ( optionName == "segmentSize" ) {
+                istringstream str( getText( optionElement ) );
+                if ( !( str >> segmentSize ) || segmentSize == 0 ) {
+                    m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for 'segmentSize' option of mmapfile output; using default.", m_fileName.c_str(), getText( optionElement ).c_str() );
+                    segmentSize = MmapFileOutput::DefaultSegmentSize;
+                }
+            } else if ( optionName == "maxSegments" ) {
+                istringstream str( getText( optionElement ) );
+                if ( !( str >> maxSegments ) ) {
+                    m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for 'maxSegments' option of mmapfile output; keeping all segments.", m_fileName.c_str(), getText( optionElement ).c_str() );
+                    maxSegments = 0;
+                }
+            } else {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Unknown <option> element with name '%s' found in mmapfile output; ignoring this.", m_fileName.c_str(), optionName.c_str() );
+                continue;
+            }
+        }
+
+        if ( filename.empty() ) {
+            m_log->writeError( "Tracelib Configuration: while reading %s: No 'filename' option specified for <output> element of type mmapfile.", m_fileName.c_str() );
+            return 0;
+        }
+        if( !isAbsolute( filename ) && relativePathIsRelativeToUserHome ) {
+            filename = userHome() + pathSeparator() + filename;
+        }
+        m_log->writeStatus( "Tracelib Configuration: using memory mapped file output to %s (segment size %lu, max. segments %lu)", filename.c_str(), (unsigned long)segmentSize, maxSegments );
+        return new MmapFileOutput( m_log, filename, segmentSize, maxSegments );
+#endif
+    }
+
     if ( outputType == "tcp" ) {
         string hostname;
         unsigned short port = TRACELIB_DEFAULT_PORT;
+        size_t maxQueuedBytes = NetworkOutput::DefaultMaxQueuedBytes;
         for ( TiXmlElement *optionElement = e->FirstChildElement(); optionElement; optionElement = optionElement->NextSiblingElement() ) {
             if ( optionElement->ValueStr() != "option" ) {
                 m_log->writeError( "Tracelib Configuration: while reading %s: Unexpected element '%s' in <output> element of type tcp found.", m_fileName.c_str(), optionElement->Value() );
@@ -550,6 +674,12 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
             } else if ( optionName == "port" ) {
                 istringstream str( getText( optionElement ) );
                 str >> port; // XXX Error handling for non-numeric port numbers
+            } else if ( optionName == "maxQueuedBytes" ) {
+                istringstream str( getText( optionElement ) );
+                if ( !( str >> maxQueuedBytes ) || maxQueuedBytes == 0 ) {
+                    m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for 'maxQueuedBytes' option of tcp output; using default.", m_fileName.c_str(), getText( optionElement ).c_str() );
+                    maxQueuedBytes = NetworkOutput::DefaultMaxQueuedBytes;
+                }
             } else {
                 m_log->writeError( "Tracelib Configuration: while reading %s: Unknown <option> element with name '%s' found in tcp output; ignoring this.", m_fileName.c_str(), optionName.c_str() );
                 continue;
@@ -567,7 +697,7 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
         }
 
         m_log->writeStatus( "Tracelib Configuration: using TCP/IP output, remote = %s:%d", hostname.c_str(), port );
-        return new NetworkOutput( m_log, hostname.c_str(), port );
+        return new NetworkOutput( m_log, hostname.c_str(), port, maxQueuedBytes );
     }
 
     m_log->writeError( "Tracelib Configuration: while reading %s: Unknown type '%s' specified for <output> element", m_fileName.c_str(), outputType.c_str() );
@@ -654,5 +784,39 @@ bool Configuration::readStorageElement( TiXmlElement *storageElem )
     return true;
 }
 
+bool Configuration::readBufferingElement( TiXmlElement *e )
+{
+    if ( m_bufferingConfiguration.enabled ) {
+        m_log->writeError( "Tracelib Configuration: while reading %s: found multiple <buffering> elements in <process> element.", m_fileName.c_str() );
+        return false;
+    }
+
+    string sizeAttr;
+    if ( e->QueryValueAttribute( "size", &sizeAttr ) == TIXML_SUCCESS ) {
+        istringstream str( sizeAttr );
+        unsigned int size = 0;
+        if ( !( str >> size ) || size == 0 ) {
+            m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for size= attribute of <buffering> element", m_fileName.c_str(), sizeAttr.c_str() );
+            return false;
+        }
+        m_bufferingConfiguration.bufferSize = size;
+    }
+
+    string overflowAttr = "block";
+    e->QueryValueAttribute( "overflow", &overflowAttr );
+    if ( overflowAttr == "block" ) {
+        m_bufferingConfiguration.overflowPolicy = BufferingConfiguration::BlockThread;
+    } else if ( overflowAttr == "drop" ) {
+        m_bufferingConfiguration.overflowPolicy = BufferingConfiguration::DropEntries;
+    } else {
+        m_log->writeError( "Tracelib Configuration: while reading %s: Invalid value '%s' for overflow= attribute of <buffering> element", m_fileName.c_str(), overflowAttr.c_str() );
+        return false;
+    }
+
+    m_bufferingConfiguration.enabled = true;
+    m_log->writeStatus( "Tracelib Configuration: using per-thread buffers of %u entries (overflow=%s)", m_bufferingConfiguration.bufferSize, overflowAttr.c_str() );
+    return true;
+}
+
 TRACELIB_NAMESPACE_END
 
@@ -49,6 +49,25 @@ struct StorageConfiguration {
     std::string archiveDirectoryName;
 };
 
+struct BufferingConfiguration {
+    static const unsigned int DefaultBufferSize = 4096;
+
+    enum OverflowPolicy {
+        DropEntries,
+        BlockThread
+    };
+
+    BufferingConfiguration()
+        : enabled( false ),
+          bufferSize( DefaultBufferSize ),
+          overflowPolicy( BlockThread )
+    { }
+
+    bool enabled;
+    unsigned int bufferSize;
+    OverflowPolicy overflowPolicy;
+};
+
 struct TraceKey
 {
     TraceKey() : enabled( true ) { }
@@ -70,6 +89,7 @@ public:
     static Configuration *fromMarkup( const std::string &markup, Log *log );
 
     const StorageConfiguration &storageConfiguration() const;
+    const BufferingConfiguration &bufferingConfiguration() const;
     const std::vector<TracePointSet *> &configuredTracePointSets() const;
     Serializer *configuredSerializer();
     Output *configuredOutput();
@@ -89,6 +109,7 @@ private:
     bool readProcessElement( TiXmlElement *e );
     bool readTraceKeysElement( TiXmlElement *e );
     bool readStorageElement( TiXmlElement *e );
+    bool readBufferingElement( TiXmlElement *e );
 
     std::string m_fileName;
     std::vector<TracePointSet *> m_configuredTracePointSets;
@@ -97,6 +118,7 @@ private:
     Log *m_log;
     std::vector<TraceKey> m_configuredTraceKeys;
     StorageConfiguration m_storageConfiguration;
+    BufferingConfiguration m_bufferingConfiguration;
 };
 
 TRACELIB_NAMESPACE_END
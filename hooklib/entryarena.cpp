@@ -0,0 +1,158 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entryarena.h"
+#include "thread.h"
+
+#include <cassert>
+#include <cstdlib>
+
+TRACELIB_NAMESPACE_BEGIN
+
+static const size_t DefaultChunkSize = 4096;
+static const size_t Alignment = 16;
+
+static size_t alignedSize( size_t size )
+{
+    return ( size + Alignment - 1 ) & ~( Alignment - 1 );
+}
+
+struct EntryArena::Chunk
+{
+    Chunk *previous;
+    size_t size;
+    size_t used;
+};
+
+static void destroyEntryArena( void *arena )
+{
+    delete static_cast<EntryArena *>( arena );
+}
+
+// On Windows there is no thread exit hook for the slot, so the (small) arena
+// of every thread which ever recorded variables is leaked when it exits.
+static ThreadLocalPointer g_entryArenas( destroyEntryArena );
+
+EntryArena *EntryArena::current()
+{
+    EntryArena *arena = static_cast<EntryArena *>( g_entryArenas.get() );
+    if ( !arena ) {
+        arena = new EntryArena;
+        g_entryArenas.set( arena );
+    }
+    return arena;
+}
+
+EntryArena::EntryArena()
+    : m_current( allocateChunk( DefaultChunkSize ) ),
+    m_spare( 0 )
+{
+}
+
+EntryArena::~EntryArena()
+{
+    while ( m_current ) {
+        Chunk *previous = m_current->previous;
+        free( m_current );
+        m_current = previous;
+    }
+    free( m_spare );
+}
+
+EntryArena::Chunk *EntryArena::allocateChunk( size_t size )
+{
+    Chunk *chunk = static_cast<Chunk *>( malloc( alignedSize( sizeof( Chunk ) ) + size ) );
+    if ( !chunk ) {
+        return 0;
+    }
+    chunk->previous = 0;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+char *EntryArena::chunkData( Chunk *chunk )
+{
+    return reinterpret_cast<char *>( chunk ) + alignedSize( sizeof( Chunk ) );
+}
+
+void *EntryArena::allocate( size_t size )
+{
+    size = alignedSize( size );
+    if ( !m_current || m_current->used + size > m_current->size ) {
+        Chunk *chunk = 0;
+        if ( m_spare && m_spare->size >= size ) {
+            chunk = m_spare;
+            m_spare = 0;
+        } else {
+            size_t chunkSize = m_current ? m_current->size * 2 : DefaultChunkSize;
+            while ( chunkSize < size ) {
+                chunkSize *= 2;
+            }
+            chunk = allocateChunk( chunkSize );
+            if ( !chunk ) {
+                return 0;
+            }
+        }
+        chunk->previous = m_current;
+        chunk->used = 0;
+        m_current = chunk;
+    }
+
+    void *p = chunkData( m_current ) + m_current->used;
+    m_current->used += size;
+    return p;
+}
+
+void *EntryArena::mark() const
+{
+    if ( !m_current ) {
+        return 0;
+    }
+    return chunkData( m_current ) + m_current->used;
+}
+
+void EntryArena::release( void *mark )
+{
+    char *p = static_cast<char *>( mark );
+    while ( m_current ) {
+        char *data = chunkData( m_current );
+        if ( p >= data && p <= data + m_current->used ) {
+            m_current->used = p - data;
+            return;
+        }
+        retireCurrentChunk();
+    }
+    assert( !mark || !"EntryArena::release: unknown mark" );
+}
+
+void EntryArena::retireCurrentChunk()
+{
+    Chunk *chunk = m_current;
+    m_current = chunk->previous;
+    if ( m_spare && m_spare->size >= chunk->size ) {
+        free( chunk );
+    } else {
+        free( m_spare );
+        m_spare = chunk;
+    }
+}
+
+TRACELIB_NAMESPACE_END
+
@@ -0,0 +1,66 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_ENTRYARENA_H
+#define TRACELIB_ENTRYARENA_H
+
+#include "tracelib_config.h"
+
+#include <cstddef>
+
+TRACELIB_NAMESPACE_BEGIN
+
+/* A bump allocator for the short-lived objects created while a single trace
+ * entry is recorded (the Variable<T> converters of the TRACELIB_VAR macro).
+ * Memory is handed out from a list of chunks and returned in LIFO order by
+ * resetting to a mark which was obtained earlier. The most recently released
+ * chunk is kept around so that recording entries does not hit the heap once
+ * the arena reached its working size.
+ */
+class EntryArena
+{
+public:
+    static EntryArena *current();
+
+    EntryArena();
+    ~EntryArena();
+
+    void *allocate( size_t size );
+
+    void *mark() const;
+    void release( void *mark );
+
+private:
+    EntryArena( const EntryArena &other ); // disabled
+    void operator=( const EntryArena &rhs ); // disabled
+
+    struct Chunk;
+
+    static Chunk *allocateChunk( size_t size );
+    static char *chunkData( Chunk *chunk );
+    void retireCurrentChunk();
+
+    Chunk *m_current;
+    Chunk *m_spare;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_ENTRYARENA_H)
+
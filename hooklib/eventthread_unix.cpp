@@ -18,38 +18,223 @@
  */
 
 #include "eventthread_unix.h"
+#include "config.h" // for uint64_t
 #include "mutex.h"
 
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <list>
+#include <algorithm>
+#include <deque>
 #include <map>
+#include <vector>
 
-static bool operator < ( const timeval &tv1, const timeval &tv2 )
-{
-    return tv1.tv_sec < tv2.tv_sec ||
-        ( tv1.tv_sec == tv2.tv_sec && tv1.tv_usec < tv2.tv_usec );
-}
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#endif
 
 TRACELIB_NAMESPACE_BEGIN
 
 typedef std::map<int, FileEventObserver *> FileObserverList;
-typedef struct _TimeOut { EventObserver *observer; int timeout; } TimeOut;
-typedef std::list<TimeOut> TimeOutList;
-typedef std::map<timeval, TimeOutList> TimeOutMap;
 
-static const char PostTask = 'p';
-static const char SendTask = 's';
+struct TimeOut {
+    uint64_t due; // milliseconds on the monotonic clock
+    unsigned long sequence; // keeps timeouts which are due at the same time in order
+    EventObserver *observer;
+};
+
+// Orders the timeout heap so that the earliest timeout is at the front
+struct LaterTimeOut {
+    bool operator()( const TimeOut &a, const TimeOut &b ) const {
+        return a.due > b.due || ( a.due == b.due && a.sequence > b.sequence );
+    }
+};
+
+typedef std::vector<TimeOut> TimeOutHeap;
+
+struct QueuedTask {
+    Task *task;
+    bool wantsResponse;
+};
+
+typedef std::deque<QueuedTask> TaskQueue;
+
 static const char NoError = '0';
 
+static uint64_t monotonicMilliSeconds()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* A descriptor reported by Poller::wait(); 'watch' holds the FileEvent
+ * flags which are ready. Errors and hangups are reported as both readable
+ * and writable, like select() does, so that the observers notice them on
+ * their next read or write.
+ */
+struct ReadyFd {
+    int fd;
+    int watch;
+    bool invalid;
+};
+
+class Poller
+{
+public:
+    virtual ~Poller() {}
+
+    // Sets the FileEvent flags to wait for on fd; 0 stops watching it.
+    virtual void setWatch( int fd, int watch ) = 0;
+
+    // Returns -1 and leaves errno set on failure.
+    virtual int wait( int timeoutMs, std::vector<ReadyFd> &ready ) = 0;
+};
+
+class PollPoller : public Poller
+{
+public:
+    void setWatch( int fd, int watch );
+    int wait( int timeoutMs, std::vector<ReadyFd> &ready );
+
+private:
+    std::map<int, int> m_watches;
+    std::vector<struct pollfd> m_pollFds;
+};
+
+void PollPoller::setWatch( int fd, int watch )
+{
+    if ( watch ) {
+        m_watches[fd] = watch;
+    } else {
+        m_watches.erase( fd );
+    }
+}
+
+int PollPoller::wait( int timeoutMs, std::vector<ReadyFd> &ready )
+{
+    m_pollFds.clear();
+    const std::map<int, int>::const_iterator e = m_watches.end();
+    for ( std::map<int, int>::const_iterator it = m_watches.begin(); it != e; ++it ) {
+        struct pollfd pfd;
+        pfd.fd = it->first;
+        pfd.events = 0;
+        if ( it->second & FileEvent::FileRead )
+            pfd.events |= POLLIN;
+        if ( it->second & FileEvent::FileWrite )
+            pfd.events |= POLLOUT;
+        pfd.revents = 0;
+        m_pollFds.push_back( pfd );
+    }
+
+    int retval = poll( m_pollFds.empty() ? NULL : &m_pollFds[0], m_pollFds.size(), timeoutMs );
+    if ( retval <= 0 )
+        return retval;
+
+    for ( size_t i = 0; i < m_pollFds.size(); ++i ) {
+        const short revents = m_pollFds[i].revents;
+        if ( !revents )
+            continue;
+        ReadyFd r;
+        r.fd = m_pollFds[i].fd;
+        r.watch = 0;
+        r.invalid = ( revents & POLLNVAL ) != 0;
+        if ( revents & ( POLLIN | POLLERR | POLLHUP ) )
+            r.watch |= FileEvent::FileRead;
+        if ( revents & ( POLLOUT | POLLERR | POLLHUP ) )
+            r.watch |= FileEvent::FileWrite;
+        ready.push_back( r );
+    }
+    return retval;
+}
+
+#ifdef __linux__
+class EpollPoller : public Poller
+{
+public:
+    static EpollPoller *create();
+    ~EpollPoller();
+
+    void setWatch( int fd, int watch );
+    int wait( int timeoutMs, std::vector<ReadyFd> &ready );
+
+private:
+    EpollPoller( int epollFd ) : m_epollFd( epollFd ) {}
+
+    int m_epollFd;
+};
+
+EpollPoller *EpollPoller::create()
+{
+    int fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( fd == -1 )
+        return NULL;
+    return new EpollPoller( fd );
+}
+
+EpollPoller::~EpollPoller()
+{
+    close( m_epollFd );
+}
+
+void EpollPoller::setWatch( int fd, int watch )
+{
+    // Observers may close their descriptor before they stop watching it,
+    // the kernel already dropped it from the epoll set then.
+    if ( !watch ) {
+        epoll_ctl( m_epollFd, EPOLL_CTL_DEL, fd, NULL );
+        return;
+    }
+
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof( ev ) );
+    if ( watch & FileEvent::FileRead )
+        ev.events |= EPOLLIN;
+    if ( watch & FileEvent::FileWrite )
+        ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+    if ( epoll_ctl( m_epollFd, EPOLL_CTL_MOD, fd, &ev ) == -1 && errno == ENOENT ) {
+        epoll_ctl( m_epollFd, EPOLL_CTL_ADD, fd, &ev );
+    }
+}
+
+int EpollPoller::wait( int timeoutMs, std::vector<ReadyFd> &ready )
+{
+    struct epoll_event events[64];
+    int retval = epoll_wait( m_epollFd, events, sizeof( events ) / sizeof( events[0] ), timeoutMs );
+    for ( int i = 0; i < retval; ++i ) {
+        ReadyFd r;
+        r.fd = events[i].data.fd;
+        r.watch = 0;
+        r.invalid = false;
+        if ( events[i].events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) )
+            r.watch |= FileEvent::FileRead;
+        if ( events[i].events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) )
+            r.watch |= FileEvent::FileWrite;
+        ready.push_back( r );
+    }
+    return retval;
+}
+#endif
+
+static Poller *createPoller()
+{
+#ifdef __linux__
+    if ( Poller *poller = EpollPoller::create() )
+        return poller;
+#endif
+    return new PollPoller;
+}
+
 
 class EventContext : public FileEventObserver
 {
@@ -60,19 +245,35 @@ public:
     void handleEvent( EventContext*, Event *event );
 
     int countMonitors();
-    int getFDSets( fd_set *rfds, fd_set *wfds );
+    void updateWatch( int fd );
+
+    bool createWakeup();
+    void wakeUp();
+    void drainWakeup();
 
     pthread_t event_list_thread;
     bool keep_running;
 
-    int command_pipe[2];
+    // Tasks are queued here and the event thread is woken up through
+    // wakeup_fd (an eventfd on Linux, otherwise the read end of a pipe
+    // whose write end is wakeup_write_fd). Responses of sent tasks are
+    // delivered through confirm_pipe.
+    Mutex task_mutex;
+    TaskQueue tasks;
+    int wakeup_fd;
+    int wakeup_write_fd;
+
     int confirm_pipe[2];
     Mutex pipe_mutex;
 
+    Poller *poller;
+    std::vector<ReadyFd> ready_fds;
+
     FileObserverList m_read_list;
     FileObserverList m_write_list;
 
-    TimeOutMap m_timeout_map;
+    TimeOutHeap m_timeouts;
+    unsigned long m_timeout_sequence;
 };
 
 
@@ -96,190 +297,125 @@ static void closePipe( int *fd )
     fd[0] = fd[1] = -1;
 }
 
-static int getFDSet( FileObserverList &list, fd_set *fds )
+static void setNonBlocking( int fd )
 {
-    int max = -1;
-    FD_ZERO( fds );
-    const FileObserverList::iterator e = list.end();
-    for ( FileObserverList::iterator it = list.begin(); it != e; ++it ) {
-        FD_SET( it->first, fds );
-        if ( it->first > max )
-            max = it->first;
-
-    }
-    return max;
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
 }
 
-static int
-handleFDSet( EventContext *ctx, FileObserverList &list, fd_set *fds, FileEvent::EventWatch watch )
+static void addToTimeOut( EventContext *ctx, uint64_t now, EventObserver *obs, int ms )
 {
-    int handled = 0;
-
-    const FileObserverList::iterator e = list.end();
-    for ( FileObserverList::iterator it = list.begin(); it != e; ) {
-        int fd = it->first;
-        EventObserver *obs = it->second;
-        ++it;
-        if ( FD_ISSET( fd, fds ) ) {
-            FileEvent event( fd, 0, watch );
-            obs->handleEvent( ctx, &event );
-            ++handled;
-        }
-    }
-
-    return handled;
+    TimeOut timeout;
+    timeout.due = now + ms;
+    timeout.sequence = ctx->m_timeout_sequence++;
+    timeout.observer = obs;
+    ctx->m_timeouts.push_back( timeout );
+    std::push_heap( ctx->m_timeouts.begin(), ctx->m_timeouts.end(), LaterTimeOut() );
 }
 
-static bool
-handleError( EventContext *ctx, FileObserverList &list, FileEvent::EventWatch watch )
+static void removeFromTimeOut( EventContext *ctx, const EventObserver *observer )
 {
-    const FileObserverList::iterator e = list.end();
-    for ( FileObserverList::iterator it = list.begin(); it != e; ++it ) {
-        int fd = it->first;
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 0;
-
-        fd_set fds;
-        FD_ZERO( &fds );
-        FD_SET( fd, &fds );
-
-        int retval;
-        do {
-            if ( FileEvent::FileRead == watch )
-                retval = select( fd + 1, &fds, NULL, 0L, &tv );
-            else
-                retval = select( fd + 1, NULL, &fds, 0L, &tv );
-        } while ( retval < 0 && errno == EINTR );
-
-        if ( retval < 0 && errno != EINTR ) {
-            EventObserver *observer = it->second;
-            list.erase( it );
-            FileEvent event( fd, errno, FileEvent::Error );
-            observer->handleEvent( ctx, &event );
-            return true;
+    TimeOutHeap &heap = ctx->m_timeouts;
+    //not yet guaranteed that an observer is added only once, so remove all
+    for ( TimeOutHeap::iterator it = heap.begin(); it != heap.end(); ) {
+        if ( it->observer == observer ) {
+            it = heap.erase( it );
+        } else {
+            ++it;
         }
     }
-    return false;
+    std::make_heap( heap.begin(), heap.end(), LaterTimeOut() );
 }
 
-static void
-addToTimeOut( TimeOutMap &map, const timeval &now, EventObserver *obs, int ms )
+static void handleTimeout( EventContext *ctx, uint64_t now )
 {
-    timeval next;
-    timeval add;
-    if ( ms >= 1000 ) {
-        add.tv_sec = ms / 1000;
-        ms %= 1000;
-    } else {
-        add.tv_sec = 0;
-    }
-    add.tv_usec = ms * 1000;
-    timeradd( &now, &add, &next );
-
-    TimeOutMap::iterator it = map.find( next );
-    TimeOut timeout = { obs, ms };
-    if ( it == map.end() ) {
-        TimeOutList tl;
-        tl.push_back( timeout );
-        map[next] = tl;
-    } else {
-        it->second.push_back( timeout );
+    TimeOutHeap &heap = ctx->m_timeouts;
+    while ( !heap.empty() && heap.front().due <= now ) {
+        std::pop_heap( heap.begin(), heap.end(), LaterTimeOut() );
+        TimeOut timeout = heap.back();
+        heap.pop_back();
+
+        TimerEvent event;
+        timeout.observer->handleEvent( ctx, &event );
     }
 }
 
-static void removeFromTimeOut( TimeOutMap &map, const EventObserver *observer )
+static void dispatchReadyFd( EventContext *data, const ReadyFd &r )
 {
-    const TimeOutMap::iterator e = map.end();
-    for ( TimeOutMap::iterator it = map.begin(); it != e; )
-    {
-        TimeOutMap::iterator next = it;
-        ++next;
+    if ( r.fd == data->wakeup_fd ) {
+        FileEvent event( r.fd, 0, FileEvent::FileRead );
+        data->handleEvent( data, &event );
+        return;
+    }
 
-        const TimeOutList::iterator te = it->second.end();
-        for ( TimeOutList::iterator ti = it->second.begin(); ti != te; )
-        {
-            if ( ti->observer == observer ) {
-                ti = it->second.erase( ti );
-                if ( it->second.size() == 0 )
-                    map.erase( it );
-                //return; not yet guaranteed that an observer is add only once
-            } else {
-                ++ti;
-            }
+    if ( r.invalid ) {
+        FileObserverList::iterator it = data->m_read_list.find( r.fd );
+        EventObserver *observer = NULL;
+        if ( it != data->m_read_list.end() ) {
+            observer = it->second;
+            data->m_read_list.erase( it );
         }
-
-        it = next;
+        it = data->m_write_list.find( r.fd );
+        if ( it != data->m_write_list.end() ) {
+            observer = it->second;
+            data->m_write_list.erase( it );
+        }
+        data->updateWatch( r.fd );
+        if ( observer ) {
+            FileEvent event( r.fd, EBADF, FileEvent::Error );
+            observer->handleEvent( data, &event );
+        }
+        return;
     }
-}
-
-static void handleTimeout( EventContext *ctx, const timeval &now )
-{
-    const TimeOutMap::iterator e = ctx->m_timeout_map.end();
-    for ( TimeOutMap::iterator i = ctx->m_timeout_map.begin(); i != e; ) {
-        TimeOutMap::iterator succ = i;
-        ++succ;
 
-        if ( now < i->first )
-            break;
-
-        const TimeOutList::iterator te = i->second.end();
-        for ( TimeOutList::iterator ti = i->second.begin(); ti != te; )
-        {
-            TimeOut timeout = *ti;
-            ti = i->second.erase( ti );
-
-            if ( timeout.timeout > 0 ) {
-                addToTimeOut( ctx->m_timeout_map, now,
-                        timeout.observer, timeout.timeout );
-            }
-
-            TimerEvent event;
-            timeout.observer->handleEvent( ctx, &event );
+    // Observers may stop watching or even close the descriptor while
+    // handling the read event, so look up the write observer afterwards.
+    if ( r.watch & FileEvent::FileRead ) {
+        FileObserverList::iterator it = data->m_read_list.find( r.fd );
+        if ( it != data->m_read_list.end() ) {
+            FileEvent event( r.fd, 0, FileEvent::FileRead );
+            it->second->handleEvent( data, &event );
+        }
+    }
+    if ( r.watch & FileEvent::FileWrite ) {
+        FileObserverList::iterator it = data->m_write_list.find( r.fd );
+        if ( it != data->m_write_list.end() ) {
+            FileEvent event( r.fd, 0, FileEvent::FileWrite );
+            it->second->handleEvent( data, &event );
         }
-
-        ctx->m_timeout_map.erase( i );
-        i = succ;
     }
 }
 
-static int processFds( EventContext *data, int nds, fd_set *rfds, fd_set *wfds )
+static int processFds( EventContext *data )
 {
-    timeval tv;
-    timeval *cur = NULL;
-    TimeOutMap::iterator it = data->m_timeout_map.begin();
-    if ( it != data->m_timeout_map.end() ) {
-        timeval now;
-        gettimeofday( &now, NULL );
+    int timeoutMs = -1;
+    if ( !data->m_timeouts.empty() ) {
+        uint64_t now = monotonicMilliSeconds();
         handleTimeout( data, now );
 
-        it = data->m_timeout_map.begin();
-        if ( it != data->m_timeout_map.end() ) {
-            timersub( &it->first, &now, &tv );
-            cur = &tv;
+        if ( !data->m_timeouts.empty() ) {
+            const uint64_t due = data->m_timeouts.front().due;
+            timeoutMs = due > now ? (int)( due - now ) : 0;
         }
     }
 
-    int retval = select( nds, rfds, wfds, NULL, cur );
+    std::vector<ReadyFd> &ready = data->ready_fds;
+    ready.clear();
+    int retval = data->poller->wait( timeoutMs, ready );
     if ( retval == -1 ) {
         if ( errno != EINTR ) {
-            if ( !handleError( data, data->m_read_list, FileEvent::FileRead ) &&
-                    !handleError( data, data->m_write_list, FileEvent::FileWrite ) ) {
-                fprintf( stderr, "Unknown error in %s: %s\n",
-                        __FUNCTION__,
-                        strerror( errno ) );
-                return -1;
-            }
-        }
-        retval = 0; // tell caller we didn't do anything
-    } else if ( retval > 0 ) {
-        if ( FD_ISSET( data->command_pipe[0], rfds ) ) {
-            FileEvent event( data->command_pipe[0], 0, FileEvent::FileRead );
-            data->handleEvent( data, &event );
-        } else {
-            handleFDSet( data, data->m_read_list, rfds, FileEvent::FileRead );
-            handleFDSet( data, data->m_write_list, wfds, FileEvent::FileWrite );
+            fprintf( stderr, "Unknown error in %s: %s\n",
+                    __FUNCTION__,
+                    strerror( errno ) );
+            return -1;
         }
+        return 0; // tell caller we didn't do anything
+    }
+
+    // Copy the list since handlers may run nested event loops (see
+    // EventThreadUnix::processEvents) which reuse ready_fds.
+    const std::vector<ReadyFd> readyFds( ready );
+    for ( size_t i = 0; i < readyFds.size(); ++i ) {
+        dispatchReadyFd( data, readyFds[i] );
     }
     return retval;
 }
@@ -290,15 +426,9 @@ static void *unixEventProc( void *user_data )
 
     write( data->confirm_pipe[1], &NoError, 1 );
 
-    fd_set rfds;
-    fd_set wfds;
-
-    int nds = data->getFDSets( &rfds, &wfds );
-    while ( data->keep_running && nds > 0 ) {
-        if ( processFds( data, nds, &rfds, &wfds ) < 0 )
+    while ( data->keep_running ) {
+        if ( processFds( data ) < 0 )
             break;
-
-        nds = data->getFDSets( &rfds, &wfds );
     }
 
     write( data->confirm_pipe[1], &NoError, 1 );
@@ -306,25 +436,32 @@ static void *unixEventProc( void *user_data )
     return NULL;
 }
 
-EventContext::EventContext() : keep_running( true )
+EventContext::EventContext()
+    : keep_running( true ),
+    wakeup_fd( -1 ),
+    wakeup_write_fd( -1 ),
+    poller( createPoller() ),
+    m_timeout_sequence( 0 )
 {
-    if ( pipe( command_pipe ) != 0 ) {
-        command_pipe[0] = command_pipe[1] = -1;
+    confirm_pipe[0] = confirm_pipe[1] = -1;
+
+    if ( !createWakeup() ) {
         fprintf( stderr, "%s %s", __FUNCTION__, strerror( errno ) );
         return;
     }
     if ( pipe( confirm_pipe ) != 0 ) {
         confirm_pipe[0] = confirm_pipe[1] = -1;
         fprintf( stderr, "%s %s", __FUNCTION__, strerror( errno ) );
-        goto pipe1_out;
+        goto wakeup_out;
     }
 
-    m_read_list[command_pipe[0]] = this;
+    m_read_list[wakeup_fd] = this;
+    updateWatch( wakeup_fd );
 
     if ( pthread_create( &event_list_thread, NULL, unixEventProc, this ) ) {
         fprintf( stderr, "Couldn't create the event thread" );
         event_list_thread = 0;
-        goto pipe2_out;
+        goto pipe_out;
     }
 
     char response;
@@ -332,55 +469,103 @@ EventContext::EventContext() : keep_running( true )
         return; // success
     }
 
-pipe2_out:
+pipe_out:
     closePipe( confirm_pipe );
-pipe1_out:
-    closePipe( command_pipe );
+wakeup_out:
+    if ( wakeup_write_fd != wakeup_fd )
+        close( wakeup_write_fd );
+    close( wakeup_fd );
+    wakeup_fd = wakeup_write_fd = -1;
 }
 
 EventContext::~EventContext()
 {
-    closePipe( command_pipe );
     closePipe( confirm_pipe );
+    if ( wakeup_fd > -1 ) {
+        if ( wakeup_write_fd != wakeup_fd )
+            close( wakeup_write_fd );
+        close( wakeup_fd );
+    }
+    delete poller;
+}
+
+bool EventContext::createWakeup()
+{
+#ifdef __linux__
+    wakeup_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( wakeup_fd > -1 ) {
+        wakeup_write_fd = wakeup_fd;
+        return true;
+    }
+#endif
+    int fds[2];
+    if ( pipe( fds ) != 0 )
+        return false;
+    setNonBlocking( fds[0] );
+    setNonBlocking( fds[1] );
+    wakeup_fd = fds[0];
+    wakeup_write_fd = fds[1];
+    return true;
+}
+
+void EventContext::wakeUp()
+{
+    if ( wakeup_write_fd == wakeup_fd ) {
+        const uint64_t one = 1;
+        write( wakeup_write_fd, &one, sizeof( one ) );
+    } else {
+        write( wakeup_write_fd, &NoError, 1 );
+    }
+}
+
+void EventContext::drainWakeup()
+{
+    char buf[64];
+    while ( read( wakeup_fd, buf, sizeof( buf ) ) > 0 ) {
+        if ( wakeup_write_fd == wakeup_fd )
+            break; // an eventfd is reset by a single read
+    }
 }
 
 int EventContext::countMonitors()
 {
     // ### not really counting all timers
-    return m_read_list.size() + m_write_list.size() - 1 + m_timeout_map.size();
+    return m_read_list.size() + m_write_list.size() - 1 + m_timeouts.size();
 }
 
-int EventContext::getFDSets( fd_set *rfds, fd_set *wfds )
+void EventContext::updateWatch( int fd )
 {
-    int rmax = getFDSet( m_read_list, rfds );
-    int wmax = getFDSet( m_write_list, wfds );
-
-    return 1 + ( rmax > wmax ? rmax : wmax );
+    int watch = 0;
+    if ( m_read_list.find( fd ) != m_read_list.end() )
+        watch |= FileEvent::FileRead;
+    if ( m_write_list.find( fd ) != m_write_list.end() )
+        watch |= FileEvent::FileWrite;
+    poller->setWatch( fd, watch );
 }
 
 void EventContext::handleEvent( EventContext*, Event *event )
 {
     FileEvent *fe = (FileEvent *)event;
     if ( FileEvent::Error == fe->watch ) {
-        /* TODO: handle unlikely error with pipe communication */
+        /* TODO: handle unlikely error with the wakeup descriptor */
         fprintf( stderr, "%s: %s\n", __FUNCTION__, strerror( fe->err ) );
     } else {
-        char cmd;
-        if ( read( fe->fd, &cmd, sizeof ( cmd ) ) == sizeof ( cmd ) ) {
-            Task *task;
-            switch ( cmd ) {
-            case 'p':
-                if ( read( fe->fd, &task, sizeof( task ) ) == sizeof( task ) ) {
-                    task->exec( this );
-                    delete task;
-                }
-                break;
-            case 's':
-                if ( read( fe->fd, &task, sizeof( task ) ) == sizeof( task ) ) {
-                    void *result = task->exec( this );
-                    write( confirm_pipe[1], &result, sizeof ( result ) );
-                }
-                break;
+        drainWakeup();
+
+        TaskQueue queued;
+        {
+            MutexLocker locker( task_mutex );
+            queued.swap( tasks );
+        }
+
+        const TaskQueue::iterator e = queued.end();
+        for ( TaskQueue::iterator it = queued.begin(); it != e; ++it ) {
+            if ( it->wantsResponse ) {
+                void *result = it->task->exec( this );
+                write( confirm_pipe[1], &result, sizeof ( result ) );
+            } else {
+                it->task->exec( this );
+                delete it->task;
             }
         }
     }
@@ -396,6 +581,7 @@ void *AddIOObserverTask::exec( EventContext *data )
     if ( watch_flags & FileEvent::FileWrite ) {
         data->m_write_list[fd] = observer;
     }
+    data->updateWatch( fd );
     return NULL;
 }
 
@@ -407,6 +593,7 @@ void *RemoveIOObserverTask::exec( EventContext *data )
     if ( watch_flags & FileEvent::FileWrite ) {
         data->m_write_list.erase( fd );
     }
+    data->updateWatch( fd );
     return (void *)(long) data->countMonitors();
 }
 
@@ -420,11 +607,9 @@ void RemoveIOObserverTask::checkForLast()
 void *TimerTask::exec( EventContext *data )
 {
     if ( add ) {
-        timeval now;
-        gettimeofday( &now, NULL );
-        addToTimeOut( data->m_timeout_map, now, observer, timeout );
+        addToTimeOut( data, monotonicMilliSeconds(), observer, timeout );
     } else {
-        removeFromTimeOut( data->m_timeout_map, observer );
+        removeFromTimeOut( data, observer );
     }
     return (void *)(long)data->countMonitors();
 }
@@ -443,9 +628,16 @@ EventThreadUnix::~EventThreadUnix()
 void EventThreadUnix::postTask( Task *task )
 {
     if ( running() ) {
-        MutexLocker locker( d->pipe_mutex );
-        write( d->command_pipe[1], &PostTask, sizeof ( PostTask ) );
-        write( d->command_pipe[1], &task, sizeof ( task ) );
+        QueuedTask queued = { task, false };
+        bool wasEmpty;
+        {
+            MutexLocker locker( d->task_mutex );
+            wasEmpty = d->tasks.empty();
+            d->tasks.push_back( queued );
+        }
+        // The event thread is already woken up if there were queued tasks
+        if ( wasEmpty )
+            d->wakeUp();
     }
 }
 
@@ -454,8 +646,15 @@ void *EventThreadUnix::sendTask( Task *task )
     if ( running() ) {
         MutexLocker locker( d->pipe_mutex );
 
-        write( d->command_pipe[1], &SendTask, sizeof ( SendTask ) );
-        write( d->command_pipe[1], &task, sizeof ( task ) );
+        QueuedTask queued = { task, true };
+        bool wasEmpty;
+        {
+            MutexLocker taskLocker( d->task_mutex );
+            wasEmpty = d->tasks.empty();
+            d->tasks.push_back( queued );
+        }
+        if ( wasEmpty )
+            d->wakeUp();
 
         void *response;
         read( d->confirm_pipe[0], &response, sizeof ( response ) );
@@ -478,7 +677,7 @@ void EventThreadUnix::commandChannels( int *in, int *out )
 
 bool EventThreadUnix::running()
 {
-    return m_self && m_self->d->command_pipe[1] > -1;
+    return m_self && m_self->d->wakeup_fd > -1;
 }
 
 void EventThreadUnix::stop()
@@ -500,17 +699,12 @@ ThreadId EventThreadUnix::threadId() const
 
 int EventThreadUnix::processEvents( EventContext *ctx )
 {
-    fd_set rfds;
-    fd_set wfds;
-    int nds = ctx->getFDSets( &rfds, &wfds );
-
-    if ( !ctx->keep_running || nds <= 0 )
+    if ( !ctx->keep_running )
         return -1;
 
-    return processFds( ctx, nds, &rfds, &wfds );
+    return processFds( ctx );
 }
 
 EventThreadUnix *EventThreadUnix::m_self;
 
 TRACELIB_NAMESPACE_END
-
@@ -0,0 +1,286 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output.h"
+#include "log.h"
+#include "config.h" // for uint64_t
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+TRACELIB_NAMESPACE_BEGIN
+
+/* Segment file format; all integers are little endian.
+ *
+ * A segment starts with a header of HeaderSize bytes:
+ *
+ *   offset  0: SegmentMagic
+ *   offset  4: format version (32 bit)
+ *   offset  8: header size (32 bit)
+ *   offset 12: flags (32 bit), see SegmentFlags
+ *   offset 16: sequence number of the segment (64 bit)
+ *   offset 24: size the segment was created with (64 bit)
+ *
+ * It is followed by the records, each of which is a 32 bit length followed by
+ * that many bytes of serialized data, padded to a multiple of four bytes. A
+ * length of 0 (or the end of the file) terminates the list of records. The
+ * length is stored after the data, so a crash while writing an entry never
+ * yields a partial record.
+ *
+ * Since a new output (and serializer) is created whenever the configuration
+ * is reloaded, every output starts a new stream in a new segment; readers
+ * need to reset their state for segments with the StartsStream flag. With a
+ * binary serializer, every segment starts a new stream (see startsStream())
+ * so that each one can be decoded even if older segments were removed. The
+ * records written by the XML serializer are self-contained anyway.
+ *
+ * See server/segmentfilereader.cpp for the reader.
+ */
+static const char SegmentMagic[4] = { 'T', 'R', 'S', 'G' };
+static const unsigned int SegmentFormatVersion = 1;
+static const size_t HeaderSize = 32;
+static const size_t RecordAlignment = 4;
+static const size_t MinimumSegmentSize = 4096;
+
+enum SegmentFlags {
+    StartsStream = 0x1
+};
+
+static void putLittleEndian( char *p, uint64_t value, size_t bytes )
+{
+    for ( size_t i = 0; i < bytes; ++i ) {
+        p[i] = static_cast<char>( ( value >> ( i * 8 ) ) & 0xff );
+    }
+}
+
+// Yields the sequence numbers of the existing segments of filename
+static vector<unsigned long> existingSegments( const string &filename )
+{
+    const string::size_type slash = filename.rfind( '/' );
+    const string dir = slash == string::npos ? string( "." ) : filename.substr( 0, slash + 1 );
+    const string prefix = ( slash == string::npos ? filename : filename.substr( slash + 1 ) ) + ".";
+
+    vector<unsigned long> sequenceNumbers;
+    DIR *d = opendir( dir.c_str() );
+    if ( !d ) {
+        return sequenceNumbers;
+    }
+    while ( struct dirent *e = readdir( d ) ) {
+        if ( strncmp( e->d_name, prefix.c_str(), prefix.size() ) != 0 ) {
+            continue;
+        }
+        const char *digits = e->d_name + prefix.size();
+        char *end;
+        const unsigned long n = strtoul( digits, &end, 10 );
+        if ( end != digits && *end == '\0' ) {
+            sequenceNumbers.push_back( n );
+        }
+    }
+    closedir( d );
+    return sequenceNumbers;
+}
+
+MmapFileOutput::MmapFileOutput( Log *log, const string &filename,
+                                size_t segmentSize, unsigned long maxSegments )
+    : m_filename( filename ),
+    m_segmentSize( segmentSize < MinimumSegmentSize ? MinimumSegmentSize : segmentSize ),
+    m_maxSegments( maxSegments ),
+    m_log( log ),
+    m_fd( -1 ),
+    m_segment( 0 ),
+    m_cursor( 0 ),
+    m_sequenceNumber( 0 ),
+    m_droppedEntries( 0 ),
+    m_binaryMode( false )
+{
+}
+
+MmapFileOutput::~MmapFileOutput()
+{
+    closeSegment();
+    if ( m_droppedEntries > 0 ) {
+        m_log->writeStatus( "Memory mapped file output to %s: %lu entries dropped",
+                            m_filename.c_str(), m_droppedEntries );
+    }
+}
+
+bool MmapFileOutput::canWrite() const
+{
+    return m_segment != 0;
+}
+
+static size_t recordSize( size_t dataSize )
+{
+    return ( sizeof( uint32_t ) + dataSize + RecordAlignment - 1 ) & ~( RecordAlignment - 1 );
+}
+
+bool MmapFileOutput::startsStream( size_t size ) const
+{
+    if ( !m_binaryMode || !m_segment ) {
+        return false;
+    }
+    return m_cursor == HeaderSize || m_cursor + recordSize( size ) > m_segmentSize;
+}
+
+bool MmapFileOutput::open()
+{
+    if ( m_segment ) {
+        return true;
+    }
+
+    // Never overwrite segments of earlier runs; they may be all that is left
+    // of a crashed process.
+    const vector<unsigned long> sequenceNumbers = existingSegments( m_filename );
+    for ( size_t i = 0; i < sequenceNumbers.size(); ++i ) {
+        if ( sequenceNumbers[i] >= m_sequenceNumber ) {
+            m_sequenceNumber = sequenceNumbers[i] + 1;
+        }
+    }
+    if ( m_maxSegments > 0 ) {
+        for ( size_t i = 0; i < sequenceNumbers.size(); ++i ) {
+            if ( sequenceNumbers[i] + m_maxSegments <= m_sequenceNumber ) {
+                unlink( segmentFileName( sequenceNumbers[i] ).c_str() );
+            }
+        }
+    }
+    return openSegment( true );
+}
+
+string MmapFileOutput::segmentFileName( unsigned long sequenceNumber ) const
+{
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%06lu", sequenceNumber );
+    return m_filename + suffix;
+}
+
+bool MmapFileOutput::openSegment( bool startsStream )
+{
+    const string fileName = segmentFileName( m_sequenceNumber );
+    m_fd = ::open( fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+    if ( m_fd == -1 ) {
+        m_log->writeError( "Failed to create segment file %s: %s", fileName.c_str(), strerror( errno ) );
+        return false;
+    }
+
+    /* Allocate the blocks right away; running out of disk space when writing
+     * to the mapping would raise SIGBUS in the traced application.
+     */
+#if defined(__linux__)
+    const int err = posix_fallocate( m_fd, 0, m_segmentSize );
+#else
+    const int err = ftruncate( m_fd, m_segmentSize ) == 0 ? 0 : errno;
+#endif
+    if ( err != 0 ) {
+        m_log->writeError( "Failed to allocate %lu bytes for segment file %s: %s",
+                           (unsigned long)m_segmentSize, fileName.c_str(), strerror( err ) );
+        ::close( m_fd );
+        m_fd = -1;
+        unlink( fileName.c_str() );
+        return false;
+    }
+
+    void *p = mmap( 0, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if ( p == MAP_FAILED ) {
+        m_log->writeError( "Failed to map segment file %s: %s", fileName.c_str(), strerror( errno ) );
+        ::close( m_fd );
+        m_fd = -1;
+        unlink( fileName.c_str() );
+        return false;
+    }
+    m_segment = static_cast<char *>( p );
+
+    memcpy( m_segment, SegmentMagic, sizeof( SegmentMagic ) );
+    putLittleEndian( m_segment + 4, SegmentFormatVersion, 4 );
+    putLittleEndian( m_segment + 8, HeaderSize, 4 );
+    putLittleEndian( m_segment + 12, startsStream ? StartsStream : 0, 4 );
+    putLittleEndian( m_segment + 16, m_sequenceNumber, 8 );
+    putLittleEndian( m_segment + 24, m_segmentSize, 8 );
+    m_cursor = HeaderSize;
+
+    if ( m_maxSegments > 0 && m_sequenceNumber >= m_maxSegments ) {
+        unlink( segmentFileName( m_sequenceNumber - m_maxSegments ).c_str() );
+    }
+    return true;
+}
+
+void MmapFileOutput::closeSegment()
+{
+    if ( !m_segment ) {
+        return;
+    }
+    munmap( m_segment, m_segmentSize );
+    m_segment = 0;
+
+    // Give back the space which was not used
+    if ( ftruncate( m_fd, m_cursor ) != 0 ) {
+        m_log->writeError( "Failed to truncate segment file %s: %s",
+                           segmentFileName( m_sequenceNumber ).c_str(), strerror( errno ) );
+    }
+    ::close( m_fd );
+    m_fd = -1;
+}
+
+void MmapFileOutput::write( const vector<char> &data )
+{
+    if ( !m_segment || data.empty() ) {
+        return;
+    }
+
+    const size_t size = recordSize( data.size() );
+
+    /* Start a new segment even if the record does not fit into an empty one
+     * either; the serializer started a new stream for it, so the records
+     * after it must not go to the current segment.
+     */
+    if ( m_cursor > HeaderSize && m_cursor + size > m_segmentSize ) {
+        closeSegment();
+        ++m_sequenceNumber;
+        if ( !openSegment( m_binaryMode ) ) {
+            ++m_droppedEntries;
+            return;
+        }
+    }
+
+    if ( m_cursor + size > m_segmentSize ) {
+        ++m_droppedEntries;
+        return;
+    }
+
+    char *record = m_segment + m_cursor;
+    memcpy( record + sizeof( uint32_t ), &data[0], data.size() );
+
+    // Publish the record by storing its length last, in one aligned store.
+    uint32_t length;
+    putLittleEndian( reinterpret_cast<char *>( &length ), data.size(), sizeof( length ) );
+    __atomic_store_n( reinterpret_cast<uint32_t *>( record ), length, __ATOMIC_RELEASE );
+
+    m_cursor += size;
+}
+
+TRACELIB_NAMESPACE_END
+
@@ -92,9 +92,12 @@ static size_t writeTo( int fd, const char *data, const int length, Log *log )
     return (size_t)written;
 }
 
-NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port )
+/* This implementation sends synchronously, so there is no queue which
+ * maxQueuedBytes could limit.
+ */
+NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port, size_t )
     : m_host( host ), m_port( port ), m_socket( -1 ), m_log( log ),
-    m_lastConnectionAttemptFailed( false ), d( 0 )
+    d( 0 ), m_lastConnectionAttemptFailed( false ), m_startsStream( false )
 {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -125,6 +128,8 @@ bool NetworkOutput::open()
         m_socket = connectTo( m_host, m_port, m_log );
         if ( m_socket == -1 ) {
             m_lastConnectionAttemptFailed = true;
+        } else {
+            m_startsStream = true;
         }
     }
     return m_socket != -1;
@@ -138,12 +143,17 @@ bool NetworkOutput::canWrite() const
 void NetworkOutput::write( const vector<char> &data )
 {
     if ( m_socket != -1 ) {
+        m_startsStream = false;
         if ( writeTo( m_socket, &data[0], data.size(), m_log ) < data.size() ) {
             close();
         }
     }
 }
 
+void NetworkOutput::setBinaryMode( bool )
+{
+}
+
 void NetworkOutput::close()
 {
 #ifdef _WIN32
@@ -19,7 +19,10 @@
 
 #include "output.h"
 #include "log.h"
+#include "config.h" // for uint64_t
 #include "eventthread_unix.h"
+#include "mutex.h"
+#include "thread.h"
 
 #include <arpa/inet.h>
 #include <string.h>
@@ -28,18 +31,22 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
 
-#include <list>
+#include <deque>
 
 using namespace std;
 
 TRACELIB_NAMESPACE_BEGIN
 
+// Number of buffers handed to a single writev() call
+static const int MaxIoVectors = 64;
+
 class NetworkOutputPrivate : public FileEventObserver {
 public:
-    typedef std::list< std::vector<char> * > BufferList;
+    typedef std::deque< std::vector<char> * > BufferList;
 
     // Only used in event thread
     BufferList buffers;
@@ -69,29 +76,47 @@ public:
     };
     NetworkOutputState network_state;
 
-    NetworkOutputPrivate( const string h, unsigned short p, Log *log );
+    // Shared between both threads, guarded by queue_mutex. The calling
+    // thread appends to 'pending' and only wakes up the event thread if it
+    // did not do so already, the event thread moves the pending buffers
+    // over to 'buffers'. queued_bytes covers all data which was not
+    // completely sent yet.
+    Mutex queue_mutex;
+    WaitCondition queue_space;
+    BufferList pending;
+    size_t queued_bytes;
+    size_t max_queued_bytes;
+    bool flush_posted;
+    bool failed;
+    bool block_when_full;
+    uint64_t enqueued_bytes;
+    uint64_t dropped_bytes;
+    uint64_t dropped_entries;
+
+    NetworkOutputPrivate( const string h, unsigned short p, Log *log, size_t maxQueuedBytes );
     ~NetworkOutputPrivate();
 
     // Only used in NetworkOutput calling thread
     void connect();
     void close();
+    bool enqueue( const std::vector<char> &data );
 
     // Only used in event thread
     void clear();
+    void fail();
     void addObserver( EventContext *ctx, int watch );
     void removeObserver( EventContext *ctx, int watch );
     void endClosing( EventContext *ctx );
-    bool write( EventContext *ctx, std::vector<char>* buffer );
+    void takePending( EventContext *ctx );
+    void releaseWritten( size_t written );
     void handleEvent( EventContext*, Event *event );
 };
 
-class WriteDataTask : public Task
+class FlushQueueTask : public Task
 {
     NetworkOutputPrivate *observer;
-    vector<char> *data;
 public:
-    WriteDataTask( NetworkOutputPrivate *obs, vector<char> *d )
-        : observer( obs ), data( d )
+    FlushQueueTask( NetworkOutputPrivate *obs ) : observer( obs )
     {}
 
     void *exec( EventContext* );
@@ -108,7 +133,7 @@ public:
 };
 
 
-NetworkOutputPrivate::NetworkOutputPrivate( const string h, unsigned short p, Log *_log )
+NetworkOutputPrivate::NetworkOutputPrivate( const string h, unsigned short p, Log *_log, size_t maxQueuedBytes )
  : host( h ),
    port( p ),
    notify_on_close( true ),
@@ -117,7 +142,15 @@ NetworkOutputPrivate::NetworkOutputPrivate( const string h, unsigned short p, Lo
    buf_pos( 0),
    watching( FileEvent::Error ),
    state( NotConnected ),
-   network_state( Idle )
+   network_state( Idle ),
+   queued_bytes( 0 ),
+   max_queued_bytes( maxQueuedBytes ),
+   flush_posted( false ),
+   failed( false ),
+   block_when_full( false ),
+   enqueued_bytes( 0 ),
+   dropped_bytes( 0 ),
+   dropped_entries( 0 )
 {}
 
 NetworkOutputPrivate::~NetworkOutputPrivate()
@@ -134,6 +167,7 @@ void NetworkOutputPrivate::connect()
     struct hostent *he = gethostbyname( host.c_str() );
     if ( !he ) {
         log->writeError( "connect: host '%s' not found\n", host.c_str() );
+        failed = true;
         return;
     }
 
@@ -156,6 +190,7 @@ void NetworkOutputPrivate::connect()
         log->writeError( "connect to %s: %s", host.c_str(), strerror( errno ) );
         ::close( m_socket );
         m_socket = -1;
+        failed = true;
     }
 }
 
@@ -181,27 +216,37 @@ void NetworkOutputPrivate::handleEvent( EventContext *ctx, Event *event )
                 removeObserver( ctx, FileEvent::FileRead );
             }
             if ( buffers.size() ) {
-                int total_written = 0;
-                BufferList::iterator e = buffers.end();
-                for ( BufferList::iterator it = buffers.begin(); it != e; ) {
-                    vector<char> *buf = *it;
-
-                    int nr = ::write( fe->fd, &(*buf)[0] + buf_pos, buf->size() - buf_pos );
+                size_t total_written = 0;
+                bool would_block = false;
+                while ( !buffers.empty() ) {
+                    struct iovec iov[MaxIoVectors];
+                    int count = 0;
+                    size_t expected = 0;
+                    BufferList::iterator e = buffers.end();
+                    for ( BufferList::iterator it = buffers.begin(); it != e && count < MaxIoVectors; ++it ) {
+                        vector<char> *buf = *it;
+                        const size_t offset = count == 0 ? buf_pos : 0;
+                        iov[count].iov_base = &(*buf)[0] + offset;
+                        iov[count].iov_len = buf->size() - offset;
+                        expected += iov[count].iov_len;
+                        ++count;
+                    }
+
+                    ssize_t nr = ::writev( fe->fd, iov, count );
+                    if ( nr < 0 && ( errno == EINTR || errno == EAGAIN ) ) {
+                        would_block = true; // try again on the next event
+                        break;
+                    }
                     if ( nr <= 0 )
                         break;
 
                     total_written += nr;
-                    buf_pos += nr;
-                    if ( buf_pos != (ssize_t)buf->size() )
+                    releaseWritten( nr );
+                    if ( (size_t)nr != expected )
                         break;
-
-                    delete buf;
-                    it = buffers.erase( it );
-                    buf_pos = 0;
                 }
-                if ( !total_written ) {
-                    clear(); // clears buffers, FileWrite observer below removed
-                    state = Error;
+                if ( !total_written && !would_block ) {
+                    fail(); // clears buffers, FileWrite observer below removed
                 }
             }
             if ( buffers.size() == 0 ) {
@@ -214,15 +259,13 @@ void NetworkOutputPrivate::handleEvent( EventContext *ctx, Event *event )
             log->writeError( "Connect error to %s %d %d",
                     host.c_str(), fe->fd, m_socket );
             removeObserver( ctx, FileEvent::FileReadWrite );
-            clear();
-            state = Error;
+            fail();
         } else if ( FileEvent::Error == fe->watch ) {
             log->writeError( "Network error to %s: %s %d",
                     host.c_str(), strerror( fe->err ), fe->fd );
             if ( Connecting == state )
                 removeObserver( ctx, FileEvent::FileWrite );
-            clear();
-            state = Error;
+            fail();
             watching = FileEvent::Error;
         }
     } else { //TimerEventType
@@ -232,18 +275,92 @@ void NetworkOutputPrivate::handleEvent( EventContext *ctx, Event *event )
     }
 }
 
-bool NetworkOutputPrivate::write( EventContext *ctx, std::vector<char>* buffer )
+void NetworkOutputPrivate::takePending( EventContext *ctx )
 {
+    {
+        MutexLocker locker( queue_mutex );
+        flush_posted = false;
+        buffers.insert( buffers.end(), pending.begin(), pending.end() );
+        pending.clear();
+    }
+
     if ( state > NotConnected && state < Closing ) {
-        buffers.push_back( buffer );
-        if ( !(watching & FileEvent::FileWrite ) ) {
+        if ( buffers.size() && !(watching & FileEvent::FileWrite ) ) {
             buf_pos = 0;
             addObserver( ctx, FileEvent::FileWrite );
         }
+    } else if ( state != Closing ) {
+        fail();
+    }
+}
+
+void NetworkOutputPrivate::releaseWritten( size_t written )
+{
+    size_t released = 0;
+    while ( written > 0 ) {
+        vector<char> *buf = buffers.front();
+        const size_t left = buf->size() - buf_pos;
+        if ( written < left ) {
+            buf_pos += written;
+            break;
+        }
+        written -= left;
+        released += buf->size();
+        delete buf;
+        buffers.pop_front();
+        buf_pos = 0;
+    }
+
+    if ( released > 0 ) {
+        MutexLocker locker( queue_mutex );
+        queued_bytes -= released;
+        queue_space.wakeAll();
+    }
+}
+
+bool NetworkOutputPrivate::enqueue( const vector<char> &data )
+{
+    if ( data.empty() ) {
         return true;
     }
-    delete buffer;
-    return false;
+
+    bool postFlush = false;
+    bool firstDrop = false;
+    queue_mutex.lock();
+    if ( block_when_full ) {
+        // Dropping data would corrupt a binary stream, so wait for the event
+        // thread instead. A single entry may exceed the limit on its own.
+        while ( !failed && queued_bytes > 0 && queued_bytes + data.size() > max_queued_bytes ) {
+            queue_mutex.unlock();
+            queue_space.wait( 100 );
+            queue_mutex.lock();
+        }
+    }
+    if ( failed ) {
+        queue_mutex.unlock();
+        return false;
+    }
+    if ( queued_bytes > 0 && queued_bytes + data.size() > max_queued_bytes ) {
+        dropped_bytes += data.size();
+        firstDrop = ++dropped_entries == 1;
+    } else {
+        pending.push_back( new vector<char>( data ) );
+        queued_bytes += data.size();
+        enqueued_bytes += data.size();
+        postFlush = !flush_posted;
+        flush_posted = true;
+    }
+    queue_mutex.unlock();
+
+    if ( firstDrop ) {
+        // The totals are logged when the output is destroyed
+        log->writeError( "Network output to %s: more than %lu bytes queued, dropping entries",
+                host.c_str(), (unsigned long)max_queued_bytes );
+    }
+    if ( postFlush ) {
+        EventThreadUnix::self()->postTask( new FlushQueueTask( this ) );
+    }
+    return true;
 }
 
 void NetworkOutputPrivate::close()
@@ -294,19 +411,42 @@ void NetworkOutputPrivate::clear()
         m_socket = -1;
         state = NotConnected;
     }
+
+    size_t released = 0;
     BufferList::iterator e = buffers.end();
-    for ( BufferList::iterator it = buffers.begin(); it != e; ) {
+    for ( BufferList::iterator it = buffers.begin(); it != e; ++it ) {
+        released += (*it)->size();
         delete *it;
-        it = buffers.erase( it );
     }
+    buffers.clear();
+    buf_pos = 0;
+
+    MutexLocker locker( queue_mutex );
+    e = pending.end();
+    for ( BufferList::iterator it = pending.begin(); it != e; ++it ) {
+        released += (*it)->size();
+        delete *it;
+    }
+    pending.clear();
+    queued_bytes -= released;
+    queue_space.wakeAll();
 }
 
+void NetworkOutputPrivate::fail()
+{
+    clear();
+    state = Error;
 
-void *WriteDataTask::exec( EventContext *ctx )
+    MutexLocker locker( queue_mutex );
+    failed = true;
+    queue_space.wakeAll();
+}
+
+
+void *FlushQueueTask::exec( EventContext *ctx )
 {
-    return observer->write( ctx, data )
-        ? (void*)(long)NetworkOutputPrivate::Opened
-        : (void*)(long)NetworkOutputPrivate::Failure;
+    observer->takePending( ctx );
+    return NULL;
 }
 
 
@@ -323,21 +463,29 @@ void *SocketClosingTask::exec( EventContext *ctx )
 }
 
 
-NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port )
+NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port, size_t maxQueuedBytes )
     : m_host( host ), m_port( port ), m_socket( -1 ), m_log( log ),
-    d( new NetworkOutputPrivate( host, port, log ) )
+    d( new NetworkOutputPrivate( host, port, log, maxQueuedBytes ) ),
+    m_startsStream( false )
 {
 }
 
 NetworkOutput::~NetworkOutput()
 {
+    if ( d->network_state != NetworkOutputPrivate::Idle ) {
+        m_log->writeStatus( "Network output to %s: %llu bytes queued, %llu bytes in %llu entries dropped",
+                m_host.c_str(), (unsigned long long)d->enqueued_bytes,
+                (unsigned long long)d->dropped_bytes, (unsigned long long)d->dropped_entries );
+    }
     delete d;
 }
 
 bool NetworkOutput::open()
 {
-    if ( d->network_state == NetworkOutputPrivate::Idle )
+    if ( d->network_state == NetworkOutputPrivate::Idle ) {
         d->connect();
+        m_startsStream = NetworkOutputPrivate::Opened == d->network_state;
+    }
 
     return NetworkOutputPrivate::Opened == d->network_state;
 }
@@ -350,16 +498,18 @@ bool NetworkOutput::canWrite() const
 
 void NetworkOutput::write( const vector<char> &data )
 {
-    if ( NetworkOutputPrivate::Opened == d->network_state ) {
-        vector<char> *buf = new vector<char>( data );
-        //buf->swap( data );
-        WriteDataTask task( d, buf );
-        d->network_state =
-            (NetworkOutputPrivate::NetworkOutputState)(long)
-            EventThreadUnix::self()->sendTask( &task );
+    m_startsStream = false;
+    if ( NetworkOutputPrivate::Opened == d->network_state && !d->enqueue( data ) ) {
+        d->network_state = NetworkOutputPrivate::Failure;
     }
 }
 
+void NetworkOutput::setBinaryMode( bool binaryMode )
+{
+    MutexLocker locker( d->queue_mutex );
+    d->block_when_full = binaryMode;
+}
+
 void NetworkOutput::close()
 {
     if ( NetworkOutputPrivate::Opened == d->network_state ) {
@@ -36,16 +36,24 @@ Output::~Output()
 {
 }
 
+StdoutOutput::StdoutOutput()
+    : m_binaryMode( false )
+{
+}
+
 void StdoutOutput::write( const vector<char> &data )
 {
-    vector<char> nullTerminatedData = data;
-    nullTerminatedData.push_back( '\0' );
-    fprintf(stdout, "%s\n", &nullTerminatedData[0]);
-    fflush(stdout);
+    if ( !data.empty() ) {
+        fwrite( &data[0], 1, data.size(), stdout );
+    }
+    if ( !m_binaryMode ) {
+        fputc( '\n', stdout );
+    }
+    fflush( stdout );
 }
 
 FileOutput::FileOutput( Log *log, const string& filename )
-    : m_filename( filename ), m_file( 0 ), m_log( log )
+    : m_filename( filename ), m_file( 0 ), m_log( log ), m_binaryMode( false )
 {
 }
 
@@ -66,7 +74,7 @@ bool FileOutput::canWrite() const
 
 bool FileOutput::open()
 {
-    m_file = fopen( m_filename.c_str(), "w" );
+    m_file = fopen( m_filename.c_str(), m_binaryMode ? "wb" : "w" );
     if( !m_file ) {
         m_log->writeError( "Failed to open file!: %s", strerror( errno ) );
         return false;
@@ -77,9 +85,12 @@ bool FileOutput::open()
 void FileOutput::write( const vector<char> &data )
 {
     if( m_file ) {
-        vector<char> nullTerminatedData = data;
-        nullTerminatedData.push_back( '\0' );
-        fprintf( m_file, "%s\n", &nullTerminatedData[0] );
+        if( !data.empty() ) {
+            fwrite( &data[0], 1, data.size(), m_file );
+        }
+        if( !m_binaryMode ) {
+            fputc( '\n', m_file );
+        }
         fflush( m_file );
     }
 }
@@ -97,6 +108,14 @@ void MultiplexingOutput::write( const vector<char> &data )
     }
 }
 
+void MultiplexingOutput::setBinaryMode( bool binaryMode )
+{
+    vector<Output *>::const_iterator it, end = m_outputs.end();
+    for ( it = m_outputs.begin(); it != end; ++it ) {
+        ( *it )->setBinaryMode( binaryMode );
+    }
+}
+
 MultiplexingOutput::~MultiplexingOutput()
 {
     vector<Output *>::const_iterator it, end = m_outputs.end();
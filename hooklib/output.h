@@ -40,6 +40,15 @@ public:
     virtual bool canWrite() const { return true; }
     virtual void write( const std::vector<char> &data ) = 0;
 
+    // Binary data is written as-is instead of being terminated by a newline
+    virtual void setBinaryMode( bool binaryMode ) { }
+
+    /* Whether writing size bytes starts a part of the output which has to be
+     * decodable on its own, like a new segment file. The serializer has to
+     * start a new stream for such data.
+     */
+    virtual bool startsStream( size_t size ) const { return false; }
+
 protected:
     Output();
 
@@ -51,7 +60,13 @@ private:
 class StdoutOutput : public Output
 {
 public:
+    StdoutOutput();
+
     virtual void write( const std::vector<char> &data );
+    virtual void setBinaryMode( bool binaryMode ) { m_binaryMode = binaryMode; }
+
+private:
+    bool m_binaryMode;
 };
 
 class FileOutput : public Output
@@ -59,12 +74,56 @@ class FileOutput : public Output
     std::string m_filename;
     FILE* m_file;
     Log *m_log;
+    bool m_binaryMode;
 public:
     FileOutput( Log *erroLog, const std::string& filename );
     virtual ~FileOutput();
     virtual void write( const std::vector<char> &data );
     virtual bool open();
     virtual bool canWrite() const;
+    virtual void setBinaryMode( bool binaryMode ) { m_binaryMode = binaryMode; }
+};
+
+/* Appends each entry as a length-prefixed record to a pre-sized, memory
+ * mapped segment file and starts a new segment when the current one is full.
+ * Writing an entry is just a memcpy; the data survives a crash of the
+ * process since the mapped pages are owned by the kernel. See
+ * mmapfileoutput_unix.cpp for the file format.
+ */
+class MmapFileOutput : public Output
+{
+public:
+    static const size_t DefaultSegmentSize = 16 * 1024 * 1024;
+
+    /* Segments are named <filename>.<sequence number>; unless maxSegments is
+     * 0, the oldest ones are removed so that at most maxSegments are kept.
+     */
+    MmapFileOutput( Log *log, const std::string &filename,
+                    size_t segmentSize = DefaultSegmentSize,
+                    unsigned long maxSegments = 0 );
+    virtual ~MmapFileOutput();
+
+    virtual bool open();
+    virtual bool canWrite() const;
+    virtual void write( const std::vector<char> &data );
+    virtual void setBinaryMode( bool binaryMode ) { m_binaryMode = binaryMode; }
+    virtual bool startsStream( size_t size ) const;
+
+private:
+    bool openSegment( bool startsStream );
+    void closeSegment();
+    std::string segmentFileName( unsigned long sequenceNumber ) const;
+
+    std::string m_filename;
+    size_t m_segmentSize;
+    unsigned long m_maxSegments;
+    Log *m_log;
+    int m_fd;
+    char *m_segment;
+    size_t m_cursor;
+    unsigned long m_sequenceNumber;
+    unsigned long m_droppedEntries;
+    bool m_binaryMode;
 };
 
 class MultiplexingOutput : public Output
@@ -75,6 +134,7 @@ public:
     void addOutput( Output *output );
 
     virtual void write( const std::vector<char> &data );
+    virtual void setBinaryMode( bool binaryMode );
 
 private:
     std::vector<Output *> m_outputs;
@@ -88,16 +148,26 @@ class NetworkOutput : public Output
     Log *m_log;
     NetworkOutputPrivate *d;
     bool m_lastConnectionAttemptFailed;
+    // Set while nothing was written over the current connection
+    bool m_startsStream;
 
     void close();
 
 public:
-    NetworkOutput( Log *log, const std::string &remoteHost, unsigned short remotePort );
+    // Upper bound for the data which was handed to write() but not sent yet
+    static const size_t DefaultMaxQueuedBytes = 8 * 1024 * 1024;
+
+    NetworkOutput( Log *log, const std::string &remoteHost, unsigned short remotePort,
+                   size_t maxQueuedBytes = DefaultMaxQueuedBytes );
     virtual ~NetworkOutput();
 
     virtual bool open();
     virtual bool canWrite() const;
     virtual void write( const std::vector<char> &data );
+    virtual void setBinaryMode( bool binaryMode );
+
+    // Each connection is a new stream for the server
+    virtual bool startsStream( size_t ) const { return m_startsStream; }
 };
 
 TRACELIB_NAMESPACE_END
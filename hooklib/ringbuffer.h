@@ -0,0 +1,101 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_RINGBUFFER_H
+#define TRACELIB_RINGBUFFER_H
+
+#include "tracelib_config.h"
+#include "atomic.h"
+
+#include <cstddef>
+
+TRACELIB_NAMESPACE_BEGIN
+
+/* A bounded, lock-free queue for exactly one producer thread and exactly one
+ * consumer thread. The capacity is rounded up to the next power of two.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer( size_t capacity )
+        : m_slots( 0 ),
+        m_mask( 0 )
+    {
+        size_t n = 1;
+        while ( n < capacity ) {
+            n <<= 1;
+        }
+        m_slots = new T[n];
+        m_mask = n - 1;
+    }
+
+    ~RingBuffer() {
+        delete [] m_slots;
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    // May be called by either thread; the result is only a snapshot.
+    size_t size() const {
+        return (unsigned long)m_head.load() - (unsigned long)m_tail.load();
+    }
+
+    // Producer side; yields false if the buffer is full.
+    bool push( const T &v ) {
+        const unsigned long head = m_head.loadRelaxed();
+        if ( head - (unsigned long)m_tail.load() > m_mask ) {
+            return false;
+        }
+        m_slots[head & m_mask] = v;
+        m_head.store( head + 1 );
+        return true;
+    }
+
+    // Consumer side; yields false if the buffer is empty.
+    bool pop( T *v ) {
+        const unsigned long tail = m_tail.loadRelaxed();
+        if ( (unsigned long)m_head.load() == tail ) {
+            return false;
+        }
+        *v = m_slots[tail & m_mask];
+        m_tail.store( tail + 1 );
+        return true;
+    }
+
+private:
+    RingBuffer( const RingBuffer &other ); // disabled
+    void operator=( const RingBuffer &rhs ); // disabled
+
+    T *m_slots;
+    unsigned long m_mask;
+
+    // Keep the two indices on separate cache lines so that producer and
+    // consumer don't keep invalidating each other's caches.
+    AtomicInt m_head;
+    char m_padding[64];
+    AtomicInt m_tail;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_RINGBUFFER_H)
+
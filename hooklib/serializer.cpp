@@ -23,7 +23,7 @@
 #include "configuration.h"
 #include "timehelper.h" // for timeToString
 
-#include <string.h> // for strlen
+#include <string.h> // for strlen, memcpy
 
 #include <sstream>
 
@@ -307,5 +307,257 @@ string XMLSerializer::convertVariable( const char *n, const VariableValue &v ) c
     return str.str();
 }
 
-TRACELIB_NAMESPACE_END
+const char BinarySerializer::BinaryStreamMagic[4] = { '\0', 'T', 'R', 'B' };
+
+static void writeVarint( vector<char> &out, uint64_t v )
+{
+    while ( v >= 0x80 ) {
+        out.push_back( static_cast<char>( ( v & 0x7f ) | 0x80 ) );
+        v >>= 7;
+    }
+    out.push_back( static_cast<char>( v ) );
+}
+
+static void writeSignedVarint( vector<char> &out, vlonglong v )
+{
+    // zigzag encoding so that small negative numbers stay small, too
+    writeVarint( out, ( static_cast<uint64_t>( v ) << 1 ) ^ static_cast<uint64_t>( v >> 63 ) );
+}
+
+static void writeString( vector<char> &out, const char *s, size_t len )
+{
+    writeVarint( out, len );
+    out.insert( out.end(), s, s + len );
+}
+
+static void writeString( vector<char> &out, const char *s )
+{
+    writeString( out, s ? s : "", s ? strlen( s ) : 0 );
+}
+
+static void writeString( vector<char> &out, const string &s )
+{
+    writeString( out, s.data(), s.size() );
+}
+
+static void writeDouble( vector<char> &out, double v )
+{
+    uint64_t bits;
+    memcpy( &bits, &v, sizeof( bits ) );
+    for ( int i = 0; i < 8; ++i ) {
+        out.push_back( static_cast<char>( bits & 0xff ) );
+        bits >>= 8;
+    }
+}
+
+static void appendRecord( vector<char> &out, const vector<char> &record )
+{
+    writeVarint( out, record.size() );
+    out.insert( out.end(), record.begin(), record.end() );
+}
+
+BinarySerializer::BinarySerializer()
+    : m_wroteHeader( false ),
+    m_storageConfigurationChanged( true ),
+    m_lastTimeStamp( 0 )
+{
+}
+
+void BinarySerializer::setStorageConfiguration( const StorageConfiguration &cfg )
+{
+    m_cfg = cfg;
+    m_storageConfigurationChanged = true;
+}
+
+void BinarySerializer::restartStream()
+{
+    m_wroteHeader = false;
+    m_tracePointIds.clear();
+    m_sentTraceKeys.clear();
+    m_storageConfigurationChanged = true;
+    m_lastTimeStamp = 0;
+}
+
+void BinarySerializer::writeHeaderIfNeeded( vector<char> &out )
+{
+    if ( m_wroteHeader ) {
+        return;
+    }
+    m_wroteHeader = true;
+
+    out.insert( out.end(), BinaryStreamMagic, BinaryStreamMagic + sizeof( BinaryStreamMagic ) );
+    writeVarint( out, FormatVersion );
+
+    static string myProcessName = Configuration::currentProcessName();
+
+    vector<char> record;
+    record.push_back( ProcessRecord );
+    writeVarint( record, TraceEntry::process.id );
+    writeVarint( record, TraceEntry::process.startTime );
+    writeString( record, myProcessName );
+    appendRecord( out, record );
+}
+
+unsigned int BinarySerializer::tracePointId( const TracePoint *tracePoint, vector<char> &out )
+{
+    map<const TracePoint *, unsigned int>::const_iterator it = m_tracePointIds.find( tracePoint );
+    if ( it != m_tracePointIds.end() ) {
+        return it->second;
+    }
+
+    const unsigned int id = m_tracePointIds.size() + 1;
+    m_tracePointIds[tracePoint] = id;
+
+    vector<char> record;
+    record.push_back( TracePointRecord );
+    writeVarint( record, id );
+    writeVarint( record, tracePoint->type );
+    writeVarint( record, tracePoint->lineno );
+    writeString( record, tracePoint->sourceFile );
+    writeString( record, tracePoint->functionName );
+    writeString( record, tracePoint->groupName );
+    appendRecord( out, record );
+
+    return id;
+}
+
+void BinarySerializer::writeTraceKeysIfChanged( const vector<TraceKey> &keys, vector<char> &out )
+{
+    bool changed = keys.size() != m_sentTraceKeys.size();
+    for ( size_t i = 0; !changed && i < keys.size(); ++i ) {
+        changed = keys[i].enabled != m_sentTraceKeys[i].enabled ||
+                  keys[i].name != m_sentTraceKeys[i].name;
+    }
+    if ( !changed ) {
+        return;
+    }
+    m_sentTraceKeys = keys;
+
+    vector<char> record;
+    record.push_back( TraceKeysRecord );
+    writeVarint( record, keys.size() );
+    vector<TraceKey>::const_iterator it, end = keys.end();
+    for ( it = keys.begin(); it != end; ++it ) {
+        record.push_back( it->enabled ? 1 : 0 );
+        writeString( record, it->name );
+    }
+    appendRecord( out, record );
+}
 
+void BinarySerializer::writeStorageConfigurationIfChanged( vector<char> &out )
+{
+    if ( !m_storageConfigurationChanged ) {
+        return;
+    }
+    m_storageConfigurationChanged = false;
+
+    vector<char> record;
+    record.push_back( StorageConfigurationRecord );
+    writeVarint( record, m_cfg.maximumTraceSize );
+    writeVarint( record, m_cfg.shrinkPercentage );
+    writeString( record, m_cfg.archiveDirectoryName );
+    appendRecord( out, record );
+}
+
+void BinarySerializer::writeVariable( const char *name, const VariableValue &v, vector<char> &record ) const
+{
+    writeString( record, name );
+    record.push_back( static_cast<char>( v.type() ) );
+    switch ( v.type() ) {
+        case VariableType::String:
+            writeString( record, v.asString() );
+            break;
+        case VariableType::Number:
+            record.push_back( v.isSignedNumber() ? 1 : 0 );
+            if ( v.isSignedNumber() ) {
+                writeSignedVarint( record, static_cast<vlonglong>( v.asNumber() ) );
+            } else {
+                writeVarint( record, v.asNumber() );
+            }
+            break;
+        case VariableType::Float:
+            writeDouble( record, static_cast<double>( v.asFloat() ) );
+            break;
+        case VariableType::Boolean:
+            record.push_back( v.asBoolean() ? 1 : 0 );
+            break;
+        default:
+            assert( !"Unreachable" );
+    }
+}
+
+vector<char> BinarySerializer::serialize( const TraceEntry &entry )
+{
+    vector<char> out;
+    writeHeaderIfNeeded( out );
+    writeTraceKeysIfChanged( entry.process.availableTraceKeys, out );
+    writeStorageConfigurationIfChanged( out );
+    const unsigned int id = tracePointId( entry.tracePoint, out );
+
+    vector<char> record;
+    record.push_back( EntryRecord );
+    writeVarint( record, id );
+    writeVarint( record, entry.threadId );
+    // Entries may be written out of order by different threads, hence signed
+    writeSignedVarint( record, static_cast<vlonglong>( entry.timeStamp - m_lastTimeStamp ) );
+    m_lastTimeStamp = entry.timeStamp;
+    writeVarint( record, entry.stackPosition );
+
+    char flags = 0;
+    if ( entry.message ) {
+        flags |= HasMessage;
+    }
+    if ( entry.variables ) {
+        flags |= HasVariables;
+    }
+    if ( entry.backtrace ) {
+        flags |= HasBacktrace;
+    }
+    record.push_back( flags );
+
+    if ( entry.message ) {
+        writeString( record, entry.message );
+    }
+
+    if ( entry.variables ) {
+        writeVarint( record, entry.variables->size() );
+        for ( size_t i = 0; i < entry.variables->size(); ++i ) {
+            AbstractVariable *v = (*entry.variables)[i];
+            writeVariable( v->name(), v->value(), record );
+        }
+    }
+
+    if ( entry.backtrace ) {
+        writeVarint( record, entry.backtrace->depth() );
+        for ( size_t i = 0; i < entry.backtrace->depth(); ++i ) {
+            const StackFrame &frame = entry.backtrace->frame( i );
+            writeString( record, frame.module );
+            writeString( record, frame.function );
+            writeVarint( record, frame.functionOffset );
+            writeString( record, frame.sourceFile );
+            writeVarint( record, frame.lineNumber );
+        }
+    }
+
+    appendRecord( out, record );
+    return out;
+}
+
+vector<char> BinarySerializer::serialize( const ProcessShutdownEvent &ev )
+{
+    vector<char> out;
+    writeHeaderIfNeeded( out );
+
+    static string myProcessName = Configuration::currentProcessName();
+
+    vector<char> record;
+    record.push_back( ShutdownRecord );
+    writeVarint( record, ev.process->id );
+    writeVarint( record, ev.process->startTime );
+    writeVarint( record, ev.shutdownTime );
+    writeString( record, myProcessName );
+    appendRecord( out, record );
+    return out;
+}
+
+TRACELIB_NAMESPACE_END
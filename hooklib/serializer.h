@@ -22,14 +22,17 @@
 
 #include "tracelib_config.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
 #include "configuration.h" // for StorageConfiguration
+#include "config.h" // for uint64_t
 
 TRACELIB_NAMESPACE_BEGIN
 
 struct TraceEntry;
+struct TracePoint;
 struct ProcessShutdownEvent;
 class VariableValue;
 
@@ -43,6 +46,14 @@ public:
 
     virtual void setStorageConfiguration( const StorageConfiguration &cfg ) { }
 
+    // Binary serializers need outputs which don't append newlines
+    virtual bool isBinary() const { return false; }
+
+    /* Forgets what was written so far, so that the next serialized data can
+     * be decoded without any of the earlier data.
+     */
+    virtual void restartStream() { }
+
 protected:
     Serializer();
 
@@ -87,6 +98,65 @@ private:
     StorageConfiguration m_cfg;
 };
 
+/* Writes a compact stream of length-prefixed records. All integers are
+ * unsigned LEB128 varints (signed ones are zigzag encoded first), strings are
+ * a varint length followed by the UTF-8 bytes. The stream starts with the
+ * BinaryStreamMagic bytes followed by the format version.
+ *
+ * Data which rarely changes (the process information, the storage
+ * configuration, trace keys and the static data of each trace point) is only
+ * written when it was not sent yet or changed; entries refer to trace points
+ * by an ID. Since a new serializer (and a new output) gets created whenever
+ * the configuration is reloaded, each output sees a self-contained stream.
+ *
+ * See server/binarycontenthandler.cpp for the decoder.
+ */
+class BinarySerializer : public Serializer
+{
+public:
+    static const char BinaryStreamMagic[4];
+    static const unsigned int FormatVersion = 1;
+
+    enum RecordType {
+        ProcessRecord = 1,
+        TracePointRecord = 2,
+        StorageConfigurationRecord = 3,
+        TraceKeysRecord = 4,
+        EntryRecord = 5,
+        ShutdownRecord = 6
+    };
+
+    enum EntryFlags {
+        HasMessage = 0x01,
+        HasVariables = 0x02,
+        HasBacktrace = 0x04
+    };
+
+    BinarySerializer();
+
+    virtual std::vector<char> serialize( const TraceEntry &entry );
+    virtual std::vector<char> serialize( const ProcessShutdownEvent &ev );
+
+    virtual void setStorageConfiguration( const StorageConfiguration &cfg );
+
+    virtual bool isBinary() const { return true; }
+    virtual void restartStream();
+
+private:
+    void writeHeaderIfNeeded( std::vector<char> &out );
+    unsigned int tracePointId( const TracePoint *tracePoint, std::vector<char> &out );
+    void writeTraceKeysIfChanged( const std::vector<TraceKey> &keys, std::vector<char> &out );
+    void writeStorageConfigurationIfChanged( std::vector<char> &out );
+    void writeVariable( const char *name, const VariableValue &v, std::vector<char> &record ) const;
+
+    bool m_wroteHeader;
+    std::map<const TracePoint *, unsigned int> m_tracePointIds;
+    std::vector<TraceKey> m_sentTraceKeys;
+    StorageConfiguration m_cfg;
+    bool m_storageConfigurationChanged;
+    uint64_t m_lastTimeStamp;
+};
+
 TRACELIB_NAMESPACE_END
 
 #endif // !defined(TRACELIB_SERIALIZER_H)
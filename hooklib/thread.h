@@ -0,0 +1,100 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_THREAD_H
+#define TRACELIB_THREAD_H
+
+#include "tracelib_config.h"
+
+TRACELIB_NAMESPACE_BEGIN
+
+struct ThreadHandle;
+struct WaitConditionHandle;
+struct ThreadLocalPointerHandle;
+
+class Thread
+{
+    friend struct ThreadHandle;
+
+public:
+    virtual ~Thread();
+
+    bool start();
+    void wait();
+
+    static void sleep( unsigned int milliSeconds );
+
+protected:
+    Thread();
+
+    virtual void run() = 0;
+
+private:
+    Thread( const Thread &other ); // disabled
+    void operator=( const Thread &rhs ); // disabled
+
+    ThreadHandle *m_handle;
+};
+
+/* A simple event which one thread can use to sleep until it is either woken
+ * up by another thread or the given time elapsed. Wakeups are not counted, so
+ * callers have to re-check their condition after wait() returns.
+ */
+class WaitCondition
+{
+public:
+    WaitCondition();
+    ~WaitCondition();
+
+    void wait( unsigned int milliSeconds );
+    void wakeAll();
+
+private:
+    WaitCondition( const WaitCondition &other ); // disabled
+    void operator=( const WaitCondition &rhs ); // disabled
+
+    WaitConditionHandle *m_handle;
+};
+
+/* A pointer which has a separate value in each thread. If a destructor
+ * function is given, it is invoked for non-null values when the owning thread
+ * exits (on platforms which support this).
+ */
+class ThreadLocalPointer
+{
+public:
+    typedef void (*Destructor)( void * );
+
+    explicit ThreadLocalPointer( Destructor destructor = 0 );
+    ~ThreadLocalPointer();
+
+    void *get() const;
+    void set( void *p );
+
+private:
+    ThreadLocalPointer( const ThreadLocalPointer &other ); // disabled
+    void operator=( const ThreadLocalPointer &rhs ); // disabled
+
+    ThreadLocalPointerHandle *m_handle;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_THREAD_H)
+
@@ -0,0 +1,152 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+TRACELIB_NAMESPACE_BEGIN
+
+struct ThreadHandle {
+    static void *threadProc( void *user_data ) {
+        static_cast<Thread *>( user_data )->run();
+        return NULL;
+    }
+
+    pthread_t thread;
+    bool running;
+};
+
+struct WaitConditionHandle {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signalled;
+};
+
+struct ThreadLocalPointerHandle {
+    pthread_key_t key;
+};
+
+Thread::Thread() : m_handle( new ThreadHandle )
+{
+    m_handle->running = false;
+}
+
+Thread::~Thread()
+{
+    wait();
+    delete m_handle;
+}
+
+bool Thread::start()
+{
+    if ( m_handle->running ) {
+        return true;
+    }
+    m_handle->running = pthread_create( &m_handle->thread, NULL, ThreadHandle::threadProc, this ) == 0;
+    return m_handle->running;
+}
+
+void Thread::wait()
+{
+    if ( m_handle->running ) {
+        pthread_join( m_handle->thread, NULL );
+        m_handle->running = false;
+    }
+}
+
+void Thread::sleep( unsigned int milliSeconds )
+{
+    timespec ts;
+    ts.tv_sec = milliSeconds / 1000;
+    ts.tv_nsec = ( milliSeconds % 1000 ) * 1000000L;
+    while ( nanosleep( &ts, &ts ) == -1 && errno == EINTR )
+        ;
+}
+
+WaitCondition::WaitCondition() : m_handle( new WaitConditionHandle )
+{
+    pthread_mutex_init( &m_handle->mutex, NULL );
+    pthread_cond_init( &m_handle->cond, NULL );
+    m_handle->signalled = false;
+}
+
+WaitCondition::~WaitCondition()
+{
+    pthread_cond_destroy( &m_handle->cond );
+    pthread_mutex_destroy( &m_handle->mutex );
+    delete m_handle;
+}
+
+void WaitCondition::wait( unsigned int milliSeconds )
+{
+    timeval now;
+    gettimeofday( &now, NULL );
+
+    timespec deadline;
+    deadline.tv_sec = now.tv_sec + milliSeconds / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000L + ( milliSeconds % 1000 ) * 1000000L;
+    if ( deadline.tv_nsec >= 1000000000L ) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock( &m_handle->mutex );
+    if ( !m_handle->signalled ) {
+        pthread_cond_timedwait( &m_handle->cond, &m_handle->mutex, &deadline );
+    }
+    m_handle->signalled = false;
+    pthread_mutex_unlock( &m_handle->mutex );
+}
+
+void WaitCondition::wakeAll()
+{
+    pthread_mutex_lock( &m_handle->mutex );
+    m_handle->signalled = true;
+    pthread_cond_broadcast( &m_handle->cond );
+    pthread_mutex_unlock( &m_handle->mutex );
+}
+
+ThreadLocalPointer::ThreadLocalPointer( Destructor destructor )
+    : m_handle( new ThreadLocalPointerHandle )
+{
+    pthread_key_create( &m_handle->key, destructor );
+}
+
+ThreadLocalPointer::~ThreadLocalPointer()
+{
+    pthread_key_delete( m_handle->key );
+    delete m_handle;
+}
+
+void *ThreadLocalPointer::get() const
+{
+    return pthread_getspecific( m_handle->key );
+}
+
+void ThreadLocalPointer::set( void *p )
+{
+    pthread_setspecific( m_handle->key, p );
+}
+
+TRACELIB_NAMESPACE_END
+
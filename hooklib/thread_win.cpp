@@ -0,0 +1,123 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread.h"
+
+#include <windows.h>
+
+TRACELIB_NAMESPACE_BEGIN
+
+struct ThreadHandle {
+    static DWORD WINAPI threadProc( LPVOID lpParameter ) {
+        static_cast<Thread *>( lpParameter )->run();
+        return 0;
+    }
+
+    HANDLE thread;
+};
+
+struct WaitConditionHandle {
+    HANDLE event;
+};
+
+struct ThreadLocalPointerHandle {
+    DWORD index;
+};
+
+Thread::Thread() : m_handle( new ThreadHandle )
+{
+    m_handle->thread = 0;
+}
+
+Thread::~Thread()
+{
+    wait();
+    delete m_handle;
+}
+
+bool Thread::start()
+{
+    if ( m_handle->thread ) {
+        return true;
+    }
+    m_handle->thread = ::CreateThread( NULL, 0, ThreadHandle::threadProc, this, 0, NULL );
+    return m_handle->thread != 0;
+}
+
+void Thread::wait()
+{
+    if ( m_handle->thread ) {
+        ::WaitForSingleObject( m_handle->thread, INFINITE );
+        ::CloseHandle( m_handle->thread );
+        m_handle->thread = 0;
+    }
+}
+
+void Thread::sleep( unsigned int milliSeconds )
+{
+    ::Sleep( milliSeconds );
+}
+
+WaitCondition::WaitCondition() : m_handle( new WaitConditionHandle )
+{
+    m_handle->event = ::CreateEvent( NULL, FALSE, FALSE, NULL );
+}
+
+WaitCondition::~WaitCondition()
+{
+    ::CloseHandle( m_handle->event );
+    delete m_handle;
+}
+
+void WaitCondition::wait( unsigned int milliSeconds )
+{
+    ::WaitForSingleObject( m_handle->event, milliSeconds );
+}
+
+void WaitCondition::wakeAll()
+{
+    ::SetEvent( m_handle->event );
+}
+
+// Windows has no destructor callbacks for TLS slots; values set by threads
+// which exit are simply never released.
+ThreadLocalPointer::ThreadLocalPointer( Destructor )
+    : m_handle( new ThreadLocalPointerHandle )
+{
+    m_handle->index = ::TlsAlloc();
+}
+
+ThreadLocalPointer::~ThreadLocalPointer()
+{
+    ::TlsFree( m_handle->index );
+    delete m_handle;
+}
+
+void *ThreadLocalPointer::get() const
+{
+    return ::TlsGetValue( m_handle->index );
+}
+
+void ThreadLocalPointer::set( void *p )
+{
+    ::TlsSetValue( m_handle->index, p );
+}
+
+TRACELIB_NAMESPACE_END
+
@@ -18,6 +18,7 @@
  */
 
 #include "trace.h"
+#include "asyncwriter.h"
 #include "configuration.h"
 #include "crashhandler.h"
 #include "filter.h"
@@ -65,7 +66,10 @@ const struct CrashHandlerInstaller {
 
 TracePointSet::TracePointSet( Filter *filter, unsigned int actions )
     : m_filter( filter ),
-    m_actions( actions )
+    m_actions( actions ),
+    m_sampleInterval( 1 ),
+    m_maxRate( 0 ),
+    m_ratePeriod( 1000 )
 {
 }
 
@@ -82,6 +86,13 @@ unsigned int TracePointSet::actionForTracePoint( const TracePoint *tracePoint )
     return IgnoreTracePoint;
 }
 
+void TracePointSet::setThrottling( long sampleInterval, long maxRate, long ratePeriod )
+{
+    m_sampleInterval = sampleInterval;
+    m_maxRate = maxRate;
+    m_ratePeriod = ratePeriod;
+}
+
 TracedProcess TraceEntry::process = {
     getCurrentProcessId(),
     getCurrentProcessStartTime(),
@@ -105,10 +116,25 @@ TraceEntry::TraceEntry( const TracePoint *tracePoint_, const char *msg )
 {
 }
 
+/* Used for entries which were recorded in one thread but are written by
+ * another one (see AsyncWriter), so the per-thread fields are passed in.
+ */
+TraceEntry::TraceEntry( const TracePoint *tracePoint_, const char *msg,
+                        ThreadId threadId_, uint64_t timeStamp_, size_t stackPosition_ )
+    : threadId( threadId_ ),
+    timeStamp( timeStamp_ ),
+    tracePoint( tracePoint_ ),
+    variables( 0 ),
+    backtrace( 0 ),
+    message( msg ),
+    stackPosition( stackPosition_ )
+{
+}
+
 TraceEntry::~TraceEntry()
 {
-    // variables are deleted on the caller side of the macros so the delete happens with the
-    // same C runtime as the allocation
+    // variables live in the entry arena of the recording thread (see
+    // makeConverter) and are released by the caller side of the macros
     delete backtrace;
 }
 
@@ -128,7 +154,9 @@ Trace::Trace()
     : m_serializer( 0 ),
     m_output( 0 ),
     m_configuration( 0 ),
+    m_configurationEpoch( 0 ),
     m_configFileMonitor( 0 ),
+    m_asyncWriter( 0 ),
     m_log( 0 ),
     m_errorOutput( 0 ),
     m_statusOutput( 0 )
@@ -166,6 +194,9 @@ Trace::~Trace()
 {
     ShutdownNotifier::self().removeObserver( this );
 
+    // Writes any pending entries, so it has to go before serializer and output
+    delete m_asyncWriter;
+
     {
         MutexLocker serializerLocker( m_serializerMutex );
         delete m_serializer;
@@ -193,14 +224,20 @@ void Trace::reloadConfiguration( const string &fileName )
     m_log->writeStatus( "Trace::reloadConfiguration: reading configuration file from '%s'", fileName.c_str() );
     Configuration *cfg = Configuration::fromFile( fileName, m_log );
     if ( cfg ) {
-        setSerializer( cfg->configuredSerializer() );
-        setOutput( cfg->configuredOutput() );
+        Serializer *serializer = cfg->configuredSerializer();
+        Output *output = cfg->configuredOutput();
+        if ( serializer && output ) {
+            output->setBinaryMode( serializer->isBinary() );
+        }
+        setSerializer( serializer );
+        setOutput( output );
         {
             MutexLocker configurationLocker( m_configurationMutex );
             deleteRange( m_tracePointSets.begin(), m_tracePointSets.end() );
             m_tracePointSets = cfg->configuredTracePointSets();
             delete m_configuration;
             m_configuration = cfg;
+            advanceConfigurationEpoch();
         }
 
         {
@@ -210,6 +247,17 @@ void Trace::reloadConfiguration( const string &fileName )
             }
         }
 
+        /* The writer thread is kept alive once it was started even if
+         * buffering gets disabled again; trace points which are currently
+         * being visited might still hand entries to it.
+         */
+        if ( !m_asyncWriter && cfg->bufferingConfiguration().enabled ) {
+            m_asyncWriter = new AsyncWriter( this, m_log );
+        }
+        if ( m_asyncWriter ) {
+            m_asyncWriter->setConfiguration( cfg->bufferingConfiguration() );
+        }
+
         /* If any trace keys are given in the XML file, they also implicitely
          * filter out all those trace entries which do not have any of the
          * specified keys. A feature requested by Siemens.
@@ -239,6 +287,9 @@ void Trace::reloadConfiguration( const string &fileName )
             }
         }
     } else {
+        if ( m_asyncWriter ) {
+            m_asyncWriter->setConfiguration( BufferingConfiguration() );
+        }
         setSerializer( 0 );
         setOutput( 0 );
         {
@@ -247,9 +298,12 @@ void Trace::reloadConfiguration( const string &fileName )
             m_tracePointSets.clear();
             delete m_configuration;
             m_configuration = 0;
+            advanceConfigurationEpoch();
         }
         TraceEntry::process.availableTraceKeys.clear();
     }
+    configureRegisteredTracePoints();
+
     if( m_configuration ) {
         m_log->writeStatus( "Trace::reloadConfiguration: configuration updated with serializer: %s and output: %s",
                             (m_serializer ? "yes" : "no"),
@@ -257,18 +311,36 @@ void Trace::reloadConfiguration( const string &fileName )
     }
 }
 
-void Trace::configureTracePoint( TracePoint *tracePoint ) const
+/* Makes all trace points reconfigure themselves on their next visit. Trace
+ * points are configured while holding m_configurationMutex (which the caller
+ * holds as well), so they never tag a state with an epoch which is not
+ * current anymore.
+ */
+void Trace::advanceConfigurationEpoch()
 {
-    MutexLocker configurationLocker( m_configurationMutex );
-    tracePoint->lastUsedConfiguration = m_configuration;
+    const long epochMask = ~0UL >> ( TracePoint::EpochShift + 1 );
+    long epoch = ( ( m_configurationEpoch.loadRelaxed() >> TracePoint::EpochShift ) + 1 ) & epochMask;
+    if ( epoch == 0 ) {
+        // 0 is the epoch of trace points which were never configured
+        epoch = 1;
+    }
+    m_configurationEpoch.store( epoch << TracePoint::EpochShift );
+}
 
+/* Computes the state word of a trace point for the current configuration
+ * and stores it (along with the throttling settings, which have to be in
+ * place before the state says that they apply); the caller holds
+ * m_configurationMutex.
+ */
+long Trace::updateTracePointState( TracePoint *tracePoint ) const
+{
+    long state = m_configurationEpoch.loadRelaxed();
     if ( m_tracePointSets.empty() ) {
-        tracePoint->active = true;
-        return;
+        state |= TracePoint::Active;
+        atomicStore( &tracePoint->state, state );
+        return state;
     }
 
-    tracePoint->active = false;
-
     vector<TracePointSet *>::const_iterator it, end = m_tracePointSets.end();
     for ( it = m_tracePointSets.begin(); it != end; ++it ) {
         const unsigned int action = ( *it )->actionForTracePoint( tracePoint );
@@ -276,68 +348,214 @@ void Trace::configureTracePoint( TracePoint *tracePoint ) const
             continue;
         }
 
-        tracePoint->active = true;
-        tracePoint->backtracesEnabled = ( action & TracePointSet::YieldBacktrace ) == TracePointSet::YieldBacktrace;
-        tracePoint->variableSnapshotEnabled = ( action & TracePointSet::YieldVariables ) == TracePointSet::YieldVariables;
+        state |= TracePoint::Active;
+        if ( ( action & TracePointSet::YieldBacktrace ) == TracePointSet::YieldBacktrace ) {
+            state |= TracePoint::BacktracesEnabled;
+        }
+        if ( ( action & TracePointSet::YieldVariables ) == TracePointSet::YieldVariables ) {
+            state |= TracePoint::VariableSnapshotEnabled;
+        }
+        if ( ( *it )->isThrottled() ) {
+            TracePoint::Throttle &throttle = tracePoint->throttle;
+            atomicStore( &throttle.sampleInterval, ( *it )->sampleInterval() );
+            atomicStore( &throttle.maxRate, ( *it )->maxRate() );
+            atomicStore( &throttle.ratePeriod, ( *it )->ratePeriod() );
+            state |= TracePoint::Throttled;
+        }
+        break;
+    }
+    atomicStore( &tracePoint->state, state );
+    return state;
+}
 
-        m_log->writeStatus( "Trace::configureTracePoint: activating trace point at %s:%d (backtraces=%d, variables=%d)", tracePoint->sourceFile, tracePoint->lineno, tracePoint->backtracesEnabled, tracePoint->variableSnapshotEnabled );
+long Trace::configureTracePoint( TracePoint *tracePoint ) const
+{
+    MutexLocker configurationLocker( m_configurationMutex );
 
-        return;
+    const long state = updateTracePointState( tracePoint );
+
+    if ( !m_tracePointSets.empty() ) {
+        if ( state & TracePoint::Active ) {
+            m_log->writeStatus( "Trace::configureTracePoint: activating trace point at %s:%d (backtraces=%d, variables=%d, throttled=%d)", tracePoint->sourceFile, tracePoint->lineno, ( state & TracePoint::BacktracesEnabled ) != 0, ( state & TracePoint::VariableSnapshotEnabled ) != 0, ( state & TracePoint::Throttled ) != 0 );
+        } else {
+            m_log->writeStatus( "Trace::configureTracePoint: trace point at %s:%d is not active", tracePoint->sourceFile, tracePoint->lineno );
+        }
+    }
+    return state;
+}
+
+/* Configures all trace points which were visited so far right away, instead
+ * of having each of them take m_configurationMutex on its next visit.
+ */
+void Trace::configureRegisteredTracePoints()
+{
+    MutexLocker configurationLocker( m_configurationMutex );
+    const size_t count = TracePointRegistry::self().forEachTracePoint( this );
+    m_log->writeStatus( "Trace::configureRegisteredTracePoints: configured %lu trace points", (unsigned long)count );
+}
+
+void Trace::handleTracePoint( TracePoint *tracePoint )
+{
+    updateTracePointState( tracePoint );
+}
+
+/* Decides whether a hit of a throttled trace point is recorded. The rate is
+ * limited per fixed window of 'ratePeriod' milliseconds; a thread which
+ * notices that a new window started resets the counter, so a few hits more
+ * than allowed might get through when several threads race for that.
+ */
+static bool acceptThrottledVisit( TracePoint *tracePoint )
+{
+    TracePoint::Throttle &throttle = tracePoint->throttle;
+
+    const unsigned long sampleInterval = atomicLoadRelaxed( &throttle.sampleInterval );
+    if ( sampleInterval > 1 ) {
+        const unsigned long hit = atomicFetchAndAdd( &throttle.hitCount, 1 );
+        if ( hit % sampleInterval != 0 ) {
+            atomicFetchAndAdd( &throttle.droppedHits, 1 );
+            return false;
+        }
     }
 
-    m_log->writeStatus( "Trace::configureTracePoint: trace point at %s:%d is not active", tracePoint->sourceFile, tracePoint->lineno );
+    const long maxRate = atomicLoadRelaxed( &throttle.maxRate );
+    if ( maxRate > 0 ) {
+        const long window = long( now() / atomicLoadRelaxed( &throttle.ratePeriod ) );
+        const long currentWindow = atomicLoadRelaxed( &throttle.rateWindow );
+        if ( currentWindow != window &&
+             atomicTestAndSet( &throttle.rateWindow, currentWindow, window ) ) {
+            atomicStore( &throttle.rateCount, 0 );
+        }
+        if ( atomicFetchAndAdd( &throttle.rateCount, 1 ) >= maxRate ) {
+            atomicFetchAndAdd( &throttle.droppedHits, 1 );
+            return false;
+        }
+    }
+    return true;
 }
 
 // configures the trace point if necessary and tells us if it's
-// supposed to be visited.
+// supposed to be visited. For a trace point which is configured already
+// this is just a lock-free comparison of its state word with the current
+// configuration epoch.
 bool Trace::advanceVisit( TracePoint *tracePoint ) const
 {
-    if ( tracePoint->lastUsedConfiguration != m_configuration ) {
-        configureTracePoint( tracePoint );
+    long state = atomicLoadRelaxed( &tracePoint->state );
+    if ( ( state & ~TracePoint::FlagMask ) != m_configurationEpoch.loadRelaxed() ) {
+        state = configureTracePoint( tracePoint );
+    }
+
+    if ( !( state & TracePoint::Active ) || !m_serializer || !m_output ) {
+        return false;
+    }
+    return !( state & TracePoint::Throttled ) || acceptThrottledVisit( tracePoint );
+}
+
+/* Hits of a throttled trace point which were not recorded are reported as
+ * an entry of that trace point, at most once per DroppedHitsReportInterval
+ * unless 'force' is set.
+ */
+static const long DroppedHitsReportInterval = 1000;
+
+void Trace::reportDroppedHits( const TracePoint *tracePoint, bool force )
+{
+    TracePoint::Throttle &throttle = tracePoint->throttle;
+    if ( atomicLoadRelaxed( &throttle.droppedHits ) == 0 ) {
+        return;
+    }
+
+    if ( !force ) {
+        const long window = long( now() / DroppedHitsReportInterval );
+        const long reportWindow = atomicLoadRelaxed( &throttle.reportWindow );
+        if ( reportWindow == window ||
+             !atomicTestAndSet( &throttle.reportWindow, reportWindow, window ) ) {
+            return;
+        }
     }
 
-    return tracePoint->active && m_serializer && m_output;
+    // Hits dropped while reporting are left for the next report
+    const long droppedHits = atomicLoadRelaxed( &throttle.droppedHits );
+    atomicFetchAndAdd( &throttle.droppedHits, -droppedHits );
+
+    StringBuilder msg;
+    msg << "Dropped " << droppedHits << " hits of this trace point due to sampling or rate limiting";
+    TraceEntry entry( tracePoint, msg );
+
+    AsyncWriter *asyncWriter = m_asyncWriter;
+    if ( !force && asyncWriter && asyncWriter->isEnabled() ) {
+        asyncWriter->enqueue( entry );
+    } else {
+        addEntry( entry );
+    }
 }
 
+/* Reports the hits which were dropped since the last report for all trace
+ * points; the registry keeps them from being destroyed meanwhile.
+ */
+class Trace::DroppedHitsReporter : public RegisteredTracePointHandler
+{
+public:
+    explicit DroppedHitsReporter( Trace *trace ) : m_trace( trace ) { }
+
+    virtual void handleTracePoint( TracePoint *tracePoint ) {
+        m_trace->reportDroppedHits( tracePoint, true );
+    }
+
+private:
+    Trace *m_trace;
+};
+
 void Trace::visitTracePoint( const TracePoint *tracePoint,
                              const char *msg,
                              VariableSnapshot *variables )
 {
-    {
-        MutexLocker outputLocker( m_outputMutex );
-        if ( !m_output || ( !m_output->canWrite() && !m_output->open() ) ) {
-            return;
-        }
+    const long state = atomicLoadRelaxed( &tracePoint->state );
+
+    if ( state & TracePoint::Throttled ) {
+        reportDroppedHits( tracePoint, false );
     }
 
     TraceEntry entry( tracePoint, msg );
-    if ( tracePoint->backtracesEnabled ) {
+    if ( state & TracePoint::BacktracesEnabled ) {
         entry.backtrace = new Backtrace( m_backtraceGenerator.generate( 1 /* omit this function in backtrace */ ) );
     }
 
-    if ( tracePoint->variableSnapshotEnabled ) {
+    if ( state & TracePoint::VariableSnapshotEnabled ) {
         entry.variables = variables;
     }
 
-    addEntry( entry );
+    AsyncWriter *asyncWriter = m_asyncWriter;
+    if ( asyncWriter && asyncWriter->isEnabled() ) {
+        asyncWriter->enqueue( entry );
+    } else {
+        addEntry( entry );
+    }
 }
 
 void Trace::addEntry( const TraceEntry &entry )
 {
+    /* Serialize and write while holding both locks: serializers like the
+     * binary one only write some data once, so everything they return has to
+     * arrive at the output, in order. Check the output before serializing for
+     * the same reason.
+     */
+    MutexLocker serializerLocker( m_serializerMutex );
+    if ( !m_serializer ) {
+        return;
+    }
+
+    MutexLocker outputLocker( m_outputMutex );
+    if ( !m_output || ( !m_output->canWrite() && !m_output->open() ) ) {
+        return;
+    }
+
     vector<char> data;
-    {
-        MutexLocker serializerLocker( m_serializerMutex );
-        if ( !m_serializer ) {
-            return;
-        }
-        data = m_serializer->serialize( entry );
+    m_serializer->serialize( entry ).swap( data );
+    if ( m_output->startsStream( data.size() ) ) {
+        m_serializer->restartStream();
+        m_serializer->serialize( entry ).swap( data );
     }
 
     if ( !data.empty() ) {
-        MutexLocker outputLocker( m_outputMutex );
-        if ( !m_output || ( !m_output->canWrite() && !m_output->open() ) ) {
-            return;
-        }
         m_output->write( data );
     }
 }
@@ -365,22 +583,41 @@ void Trace::handleProcessShutdown()
 {
     m_log->writeStatus( "Trace::handleProcessShutdown: detected process shutdown" );
 
+    const BacktraceGenerator::CacheStatistics stats = BacktraceGenerator::cacheStatistics();
+    if ( stats.hits + stats.misses > 0 ) {
+        m_log->writeStatus( "Trace::handleProcessShutdown: backtrace frame cache: %lu hits, %lu misses (%d%% hit rate), %lu of %lu entries used",
+                            (unsigned long)stats.hits, (unsigned long)stats.misses,
+                            int( stats.hits * 100 / ( stats.hits + stats.misses ) ),
+                            (unsigned long)stats.size, (unsigned long)stats.capacity );
+    }
+
+    // Make sure the shutdown event comes after all buffered entries
+    if ( m_asyncWriter ) {
+        m_asyncWriter->flush();
+    }
+
+    DroppedHitsReporter droppedHitsReporter( this );
+    TracePointRegistry::self().forEachTracePoint( &droppedHitsReporter );
+
     ProcessShutdownEvent ev;
 
-    vector<char> data;
-    {
-        MutexLocker serializerLocker( m_serializerMutex );
-        if ( !m_serializer ) {
-            return;
-        }
+    MutexLocker serializerLocker( m_serializerMutex );
+    if ( !m_serializer ) {
+        return;
+    }
+
+    MutexLocker outputLocker( m_outputMutex );
+    if ( !m_output || ( !m_output->canWrite() && !m_output->open() ) ) {
+        return;
+    }
+
+    vector<char> data = m_serializer->serialize( ev );
+    if ( m_output->startsStream( data.size() ) ) {
+        m_serializer->restartStream();
         data = m_serializer->serialize( ev );
     }
 
     if ( !data.empty() ) {
-        MutexLocker outputLocker( m_outputMutex );
-        if ( !m_output || ( !m_output->canWrite() && !m_output->open() ) ) {
-            return;
-        }
         m_output->write( data );
 
         /* Delete the output object to make sure it flushes any data which
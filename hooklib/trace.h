@@ -21,12 +21,14 @@
 #define TRACELIB_TRACE_H
 
 #include "tracelib_config.h"
+#include "atomic.h"
 #include "backtrace.h"
 #include "configuration.h" // for TraceKey
 #include "filemodificationmonitor.h"
 #include "getcurrentthreadid.h"
 #include "mutex.h"
 #include "shutdownnotifier.h"
+#include "tracepointregistry.h"
 #include "variabledumping.h"
 #include "config.h" // for uint64_t
 
@@ -34,6 +36,7 @@
 
 TRACELIB_NAMESPACE_BEGIN
 
+class AsyncWriter;
 class Filter;
 class Output;
 class Serializer;
@@ -57,12 +60,25 @@ public:
 
     unsigned int actionForTracePoint( const TracePoint *tracePoint );
 
+    /* Only every sampleInterval-th hit of a trace point in this set is
+     * recorded, and no more than maxRate hits per ratePeriod milliseconds
+     * (unless maxRate is 0).
+     */
+    void setThrottling( long sampleInterval, long maxRate, long ratePeriod );
+    bool isThrottled() const { return m_sampleInterval > 1 || m_maxRate > 0; }
+    long sampleInterval() const { return m_sampleInterval; }
+    long maxRate() const { return m_maxRate; }
+    long ratePeriod() const { return m_ratePeriod; }
+
 private:
     TracePointSet( const TracePointSet &other );
     void operator=( const TracePointSet &rhs );
 
     Filter *m_filter;
     const unsigned int m_actions;
+    long m_sampleInterval;
+    long m_maxRate;
+    long m_ratePeriod;
 };
 
 struct TracedProcess
@@ -76,6 +92,8 @@ struct TracedProcess
 struct TraceEntry
 {
     TraceEntry( const TracePoint *tracePoint_, const char *msg = 0 );
+    TraceEntry( const TracePoint *tracePoint_, const char *msg,
+                ThreadId threadId_, uint64_t timeStamp_, size_t stackPosition_ );
     ~TraceEntry();
 
     static TracedProcess process;
@@ -97,13 +115,14 @@ struct ProcessShutdownEvent
 };
 
 
-class Trace : public FileModificationMonitorObserver, public ShutdownNotifierObserver
+class Trace : public FileModificationMonitorObserver, public ShutdownNotifierObserver,
+              private RegisteredTracePointHandler
 {
 public:
     Trace();
     ~Trace();
 
-    void configureTracePoint( TracePoint *tracePoint ) const;
+    long configureTracePoint( TracePoint *tracePoint ) const;
     bool advanceVisit( TracePoint *tracePoint ) const;
     void visitTracePoint( const TracePoint *tracePoint,
                           const char *msg = 0,
@@ -123,6 +142,15 @@ private:
     void operator=( const Trace &trace );
 
     void reloadConfiguration( const std::string &fileName );
+    void advanceConfigurationEpoch();
+    long updateTracePointState( TracePoint *tracePoint ) const;
+    void configureRegisteredTracePoints();
+    void reportDroppedHits( const TracePoint *tracePoint, bool force );
+
+    virtual void handleTracePoint( TracePoint *tracePoint );
+
+    class DroppedHitsReporter;
+    friend class DroppedHitsReporter;
 
     Serializer *m_serializer;
     Mutex m_serializerMutex;
@@ -131,8 +159,10 @@ private:
     std::vector<TracePointSet *> m_tracePointSets;
     Configuration *m_configuration;
     mutable Mutex m_configurationMutex;
+    AtomicInt m_configurationEpoch;
     BacktraceGenerator m_backtraceGenerator;
     FileModificationMonitor *m_configFileMonitor;
+    AsyncWriter *m_asyncWriter;
     Log *m_log;
     LogOutput *m_errorOutput;
     LogOutput *m_statusOutput;
@@ -1,5 +1,6 @@
 #include "tracelib.h"
 #include "trace.h"
+#include "entryarena.h"
 
 TRACELIB_NAMESPACE_BEGIN
 
@@ -15,5 +16,20 @@ void visitTracePoint( const TracePoint *tracePoint,
     getActiveTrace()->visitTracePoint( tracePoint, msg, variables );
 }
 
+void *allocateEntryMemory( size_t size )
+{
+    return EntryArena::current()->allocate( size );
+}
+
+void *enterEntryArena()
+{
+    return EntryArena::current()->mark();
+}
+
+void leaveEntryArena( void *mark )
+{
+    EntryArena::current()->release( mark );
+}
+
 TRACELIB_NAMESPACE_END
 
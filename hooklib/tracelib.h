@@ -26,6 +26,7 @@
 #include "variabledumping.h"
 
 #include <cstddef>
+#include <cstring>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -70,12 +71,11 @@
 { \
     static TRACELIB_NAMESPACE_IDENT(TracePoint) tracePoint(TRACELIB_NAMESPACE_IDENT(TracePointType)::Watch, TRACELIB_CURRENT_FILE_NAME, TRACELIB_CURRENT_LINE_NUMBER, TRACELIB_CURRENT_FUNCTION_NAME, key); \
     if ( TRACELIB_NAMESPACE_IDENT(advanceVisit)( &tracePoint ) ) { \
-        TRACELIB_NAMESPACE_IDENT(VariableSnapshot) *variableSnapshot = new TRACELIB_NAMESPACE_IDENT(VariableSnapshot); \
-        (*variableSnapshot) << vars; \
+        TRACELIB_NAMESPACE_IDENT(EntryArenaScope) entryArenaScope; \
+        TRACELIB_NAMESPACE_IDENT(VariableSnapshot) variableSnapshot; \
+        variableSnapshot << vars; \
         msg \
-        TRACELIB_NAMESPACE_IDENT(visitTracePoint)( &tracePoint, msgBuilder, variableSnapshot ); \
-        for ( size_t i = 0; i < variableSnapshot->size(); ++i ) delete (*variableSnapshot)[i]; \
-        delete variableSnapshot; \
+        TRACELIB_NAMESPACE_IDENT(visitTracePoint)( &tracePoint, msgBuilder, &variableSnapshot ); \
     } \
 }
 #  define TRACELIB_VISIT_TRACEPOINT(type, key, msg) \
@@ -87,7 +87,7 @@
     } \
 }
 #  define TRACELIB_VISIT_TRACEPOINT_STREAM(VisitorType, type, key) \
-    static TRACELIB_NAMESPACE_IDENT(TracePoint) TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER)( (type), TRACELIB_CURRENT_FILE_NAME, TRACELIB_CURRENT_LINE_NUMBER, TRACELIB_CURRENT_FUNCTION_NAME, (key) ); TRACELIB_NAMESPACE_IDENT(VisitorType) TRACELIB_TOKEN_GLUE(tracePointVisitor, TRACELIB_CURRENT_LINE_NUMBER)( &TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER) ); if ( TRACELIB_NAMESPACE_IDENT(advanceVisit)( &TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER) ) ) (TRACELIB_TOKEN_GLUE(tracePointVisitor, TRACELIB_CURRENT_LINE_NUMBER))
+    static TRACELIB_NAMESPACE_IDENT(TracePoint) TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER)( (type), TRACELIB_CURRENT_FILE_NAME, TRACELIB_CURRENT_LINE_NUMBER, TRACELIB_CURRENT_FUNCTION_NAME, (key) ); TRACELIB_NAMESPACE_IDENT(VisitorType) TRACELIB_TOKEN_GLUE(tracePointVisitor, TRACELIB_CURRENT_LINE_NUMBER)( &TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER) ); if ( TRACELIB_NAMESPACE_IDENT(advanceVisit)( &TRACELIB_TOKEN_GLUE(tracePoint, TRACELIB_CURRENT_LINE_NUMBER) ) && TRACELIB_TOKEN_GLUE(tracePointVisitor, TRACELIB_CURRENT_LINE_NUMBER).beginEntry() ) (TRACELIB_TOKEN_GLUE(tracePointVisitor, TRACELIB_CURRENT_LINE_NUMBER))
 #  define TRACELIB_VAR_IMPL(v) TRACELIB_NAMESPACE_IDENT(makeConverter)(#v, v)
 #else
 #  define TRACELIB_VISIT_TRACEPOINT_VARS(key, vars, msg) (void)0;
@@ -100,37 +100,70 @@
 
 /* All the _IMPL macros which are referenced from the public macros listed
  * in tracelib_config.h; these macros are just convenience wrappers around
- * the above core macros.
+ * the above core macros. Those below TRACELIB_MINIMUM_LEVEL are no-ops.
  */
-#define TRACELIB_DEBUG_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, 0, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_DEBUG_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
-#define TRACELIB_DEBUG_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, key, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_DEBUG_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
-
-#define TRACELIB_ERROR_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, 0, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_ERROR_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
-#define TRACELIB_ERROR_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, key, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_ERROR_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
-
-#define TRACELIB_TRACE_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, 0, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_TRACE_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
-#define TRACELIB_TRACE_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, key, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_TRACE_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
-
-#define TRACELIB_WATCH_IMPL(vars)                   TRACELIB_VISIT_TRACEPOINT_VARS(0, vars, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_WATCH_MSG_IMPL(msg, vars)          TRACELIB_VISIT_TRACEPOINT_VARS(0, vars, TRACELIB_CREATE_MESSAGE_VAR(msg))
-#define TRACELIB_WATCH_KEY_IMPL(key, vars)          TRACELIB_VISIT_TRACEPOINT_VARS(key, vars, TRACELIB_CREATE_NULL_VAR)
-#define TRACELIB_WATCH_KEY_MSG_IMPL(key, msg, vars) TRACELIB_VISIT_TRACEPOINT_VARS(key, vars, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#define TRACELIB_DISABLED_TRACEPOINT_STREAM if (false) (TRACELIB_NAMESPACE_IDENT(TracePointVisitor)( NULL ))
+
+#if TRACELIB_MINIMUM_LEVEL <= TRACELIB_LEVEL_DEBUG
+#  define TRACELIB_DEBUG_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, 0, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_DEBUG_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_DEBUG_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, key, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_DEBUG_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_DEBUG_STREAM_IMPL(key)       TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, (key))
+#else
+#  define TRACELIB_DEBUG_IMPL                   (void)0;
+#  define TRACELIB_DEBUG_MSG_IMPL(msg)          (void)0;
+#  define TRACELIB_DEBUG_KEY_IMPL(key)          (void)0;
+#  define TRACELIB_DEBUG_KEY_MSG_IMPL(key, msg) (void)0;
+#  define TRACELIB_DEBUG_STREAM_IMPL(key)       TRACELIB_DISABLED_TRACEPOINT_STREAM
+#endif
+
+#if TRACELIB_MINIMUM_LEVEL <= TRACELIB_LEVEL_ERROR
+#  define TRACELIB_ERROR_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, 0, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_ERROR_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_ERROR_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, key, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_ERROR_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_ERROR_STREAM_IMPL(key)       TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, (key))
+#else
+#  define TRACELIB_ERROR_IMPL                   (void)0;
+#  define TRACELIB_ERROR_MSG_IMPL(msg)          (void)0;
+#  define TRACELIB_ERROR_KEY_IMPL(key)          (void)0;
+#  define TRACELIB_ERROR_KEY_MSG_IMPL(key, msg) (void)0;
+#  define TRACELIB_ERROR_STREAM_IMPL(key)       TRACELIB_DISABLED_TRACEPOINT_STREAM
+#endif
+
+#if TRACELIB_MINIMUM_LEVEL <= TRACELIB_LEVEL_TRACE
+#  define TRACELIB_TRACE_IMPL                   TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, 0, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_TRACE_MSG_IMPL(msg)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, 0, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_TRACE_KEY_IMPL(key)          TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, key, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_TRACE_KEY_MSG_IMPL(key, msg) TRACELIB_VISIT_TRACEPOINT(TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, key, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_TRACE_STREAM_IMPL(key)       TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, (key))
+#else
+#  define TRACELIB_TRACE_IMPL                   (void)0;
+#  define TRACELIB_TRACE_MSG_IMPL(msg)          (void)0;
+#  define TRACELIB_TRACE_KEY_IMPL(key)          (void)0;
+#  define TRACELIB_TRACE_KEY_MSG_IMPL(key, msg) (void)0;
+#  define TRACELIB_TRACE_STREAM_IMPL(key)       TRACELIB_DISABLED_TRACEPOINT_STREAM
+#endif
+
+#if TRACELIB_MINIMUM_LEVEL <= TRACELIB_LEVEL_WATCH
+#  define TRACELIB_WATCH_IMPL(vars)                   TRACELIB_VISIT_TRACEPOINT_VARS(0, vars, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_WATCH_MSG_IMPL(msg, vars)          TRACELIB_VISIT_TRACEPOINT_VARS(0, vars, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_WATCH_KEY_IMPL(key, vars)          TRACELIB_VISIT_TRACEPOINT_VARS(key, vars, TRACELIB_CREATE_NULL_VAR)
+#  define TRACELIB_WATCH_KEY_MSG_IMPL(key, msg, vars) TRACELIB_VISIT_TRACEPOINT_VARS(key, vars, TRACELIB_CREATE_MESSAGE_VAR(msg))
+#  define TRACELIB_WATCH_STREAM_IMPL(key)             TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Watch, (key))
+#else
+#  define TRACELIB_WATCH_IMPL(vars)                   (void)0;
+#  define TRACELIB_WATCH_MSG_IMPL(msg, vars)          (void)0;
+#  define TRACELIB_WATCH_KEY_IMPL(key, vars)          (void)0;
+#  define TRACELIB_WATCH_KEY_MSG_IMPL(key, msg, vars) (void)0;
+#  define TRACELIB_WATCH_STREAM_IMPL(key)             TRACELIB_DISABLED_TRACEPOINT_STREAM
+#endif
 
 #define TRACELIB_VALUE_IMPL(v) #v << "=" << v
 
 #define TRACELIB_STREAM_END_IMPL TRACELIB_NAMESPACE_IDENT(StreamEnd())
 
-#define TRACELIB_DEBUG_STREAM_IMPL(key) TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug, (key))
-#define TRACELIB_ERROR_STREAM_IMPL(key) TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Error, (key))
-#define TRACELIB_TRACE_STREAM_IMPL(key) TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Log, (key))
-#define TRACELIB_WATCH_STREAM_IMPL(key) TRACELIB_VISIT_TRACEPOINT_STREAM(TracePointVisitor, TRACELIB_NAMESPACE_IDENT(TracePointType)::Watch, (key))
-
 TRACELIB_NAMESPACE_BEGIN
 
 template <class Iterator>
@@ -147,27 +180,88 @@ inline std::string variableValueAsString( const VariableValue &v )
     return &buf[0];
 }
 
+/* Formats trace messages into an inline buffer; only messages which do not
+ * fit into it cause a heap allocation.
+ */
 class StringBuilder
 {
 public:
-    StringBuilder() { }
+    StringBuilder()
+        : m_data( m_inlineBuffer ),
+        m_size( 0 ),
+        m_capacity( sizeof( m_inlineBuffer ) )
+    {
+        m_inlineBuffer[0] = '\0';
+    }
+
+    ~StringBuilder() {
+        if ( m_data != m_inlineBuffer ) {
+            delete [] m_data;
+        }
+    }
 
     inline operator const char *() {
-        m_s = m_stream.str();
-        return m_s.c_str();
+        return m_data;
     }
 
-    StringBuilder &operator<<( const VariableValue &v ) {
-        m_stream << variableValueAsString( v );
+    StringBuilder &append( const char *s, size_t len ) {
+        if ( m_size + len >= m_capacity ) {
+            reserve( m_size + len + 1 );
+        }
+        memcpy( m_data + m_size, s, len );
+        m_size += len;
+        m_data[m_size] = '\0';
         return *this;
     }
 
+    StringBuilder &operator<<( const char *s ) {
+        return s ? append( s, strlen( s ) ) : *this;
+    }
+
+    StringBuilder &operator<<( char *s ) {
+        return *this << static_cast<const char *>( s );
+    }
+
+    StringBuilder &operator<<( const std::string &s ) {
+        return append( s.data(), s.size() );
+    }
+
+    StringBuilder &operator<<( char c ) {
+        return c != '\0' ? append( &c, 1 ) : *this;
+    }
+
+    StringBuilder &operator<<( const VariableValue &v ) {
+        if ( v.type() == VariableType::String ) {
+            return *this << v.asString();
+        }
+        char buf[64];
+        VariableValue::convertToString( v, buf, sizeof( buf ) );
+        buf[sizeof( buf ) - 1] = '\0';
+        return *this << buf;
+    }
+
 private:
     StringBuilder( const StringBuilder &other );
     void operator=( const StringBuilder &rhs );
 
-    std::string m_s;
-    std::ostringstream m_stream;
+    void reserve( size_t capacity ) {
+        size_t newCapacity = m_capacity * 2;
+        if ( newCapacity < capacity ) {
+            newCapacity = capacity;
+        }
+        char *newData = new char[newCapacity];
+        memcpy( newData, m_data, m_size + 1 );
+        if ( m_data != m_inlineBuffer ) {
+            delete [] m_data;
+        }
+        m_data = newData;
+        m_capacity = newCapacity;
+    }
+
+    char m_inlineBuffer[256];
+    char *m_data;
+    size_t m_size;
+    size_t m_capacity;
 };
 
 template <class T>
@@ -188,35 +282,56 @@ class TracePointVisitor {
 public:
     inline TracePointVisitor( TracePoint *tracePoint )
         : m_tracePoint( tracePoint )
-        , m_stream( 0 )
-        , m_variables( 0 )
+        , m_arenaMark( 0 )
+        , m_inEntry( false )
     { }
     inline ~TracePointVisitor() {
-        if( m_variables ) {
-            for ( size_t i = 0; i < m_variables->size(); ++i ) delete (*m_variables)[i];
-            delete m_variables;
+        if ( m_inEntry ) {
+            leaveEntryArena( m_arenaMark );
         }
-        delete m_stream;
+    }
+
+    // Called by TRACELIB_VISIT_TRACEPOINT_STREAM once the trace point turned
+    // out to be active, before any of the streamed values are evaluated.
+    inline bool beginEntry() {
+        m_arenaMark = enterEntryArena();
+        m_inEntry = true;
+        return true;
     }
 
     inline TracePointVisitor &operator<<( const VariableValue &v ) {
-        if( !m_stream ) {
-            m_stream = new std::ostringstream();
-        }
-        (*m_stream) << variableValueAsString( v );
+        m_message << v;
+        return *this;
+    }
+
+    inline TracePointVisitor &operator<<( const char *s ) {
+        m_message << s;
+        return *this;
+    }
+
+    inline TracePointVisitor &operator<<( char *s ) {
+        m_message << s;
+        return *this;
+    }
+
+    inline TracePointVisitor &operator<<( const std::string &s ) {
+        m_message << s;
+        return *this;
+    }
+
+    inline TracePointVisitor &operator<<( char c ) {
+        m_message << c;
         return *this;
     }
 
     inline TracePointVisitor &addVariable( AbstractVariable *v ) {
-        if ( !m_variables )
-            m_variables = new VariableSnapshot;
-        (*m_variables) << v;
+        m_variables << v;
         return *this;
     }
 
     void flush() {
-        if( m_tracePoint->active ) {
-            visitTracePoint( m_tracePoint, m_stream ? m_stream->str().c_str() : "", m_variables );
+        if( m_tracePoint->isActive() ) {
+            visitTracePoint( m_tracePoint, m_message, m_variables.size() > 0 ? &m_variables : 0 );
         }
     }
 
@@ -225,8 +340,10 @@ private:
     void operator=( const TracePointVisitor &rhs );
 
     TracePoint *m_tracePoint;
-    std::ostringstream *m_stream;
-    VariableSnapshot *m_variables;
+    void *m_arenaMark;
+    bool m_inEntry;
+    StringBuilder m_message;
+    VariableSnapshot m_variables;
 };
 
 // Keep these before the template functions below otherwise the compiler will try to put 'AbstractVariable *'
@@ -92,7 +92,7 @@
  * \li #TRACELIB_NAMESPACE_IDENT fully-qualifies the given identifier using the
  * tracelib namespace
  *
- * There are also two macros available for performing some build-time
+ * There are also three macros available for performing some build-time
  * configuration:
  *
  * \li #TRACELIB_DEFAULT_PORT contains the default port to be used when
@@ -100,6 +100,8 @@
  * in the configuration file.
  * \li #TRACELIB_DEFAULT_CONFIGFILE_NAME contains the name of the default
  * configuration file to use in case no other name was specified at runtime.
+ * \li #TRACELIB_MINIMUM_LEVEL can be defined when building an application to
+ * compile out all trace points below a given level.
  */
 
 /**
@@ -203,6 +205,33 @@
  */
 #define TRACELIB_DEFAULT_CONFIGFILE_NAME "tracelib.xml"
 
+/* Levels of the trace point macros, see #TRACELIB_MINIMUM_LEVEL. */
+#define TRACELIB_LEVEL_DEBUG 1
+#define TRACELIB_LEVEL_WATCH 2
+#define TRACELIB_LEVEL_TRACE 3
+#define TRACELIB_LEVEL_ERROR 4
+
+/**
+ * @brief Lowest level of trace points which are compiled into the application.
+ *
+ * The trace point macros of each kind have a level; in increasing order these
+ * are TRACELIB_LEVEL_DEBUG (the TRACELIB_DEBUG* macros), TRACELIB_LEVEL_WATCH
+ * (TRACELIB_WATCH*), TRACELIB_LEVEL_TRACE (TRACELIB_TRACE*) and
+ * TRACELIB_LEVEL_ERROR (TRACELIB_ERROR*). Macros with a level below
+ * TRACELIB_MINIMUM_LEVEL expand to nothing, just like all of them do if
+ * TRACELIB_DISABLE_TRACE_CODE is defined. Their arguments are not evaluated.
+ *
+ * By default, all trace points are compiled in. To build a release version
+ * without the debug and watch points, define the macro when compiling:
+ *
+ * \code
+ * g++ -DTRACELIB_MINIMUM_LEVEL=TRACELIB_LEVEL_TRACE ...
+ * \endcode
+ */
+#ifndef TRACELIB_MINIMUM_LEVEL
+#  define TRACELIB_MINIMUM_LEVEL TRACELIB_LEVEL_DEBUG
+#endif
+
 /**
  * @brief Add a debug entry to the current thread's trace.
  *
@@ -39,31 +39,76 @@ struct TracePointType {
     }
 };
 
-class Configuration;
+struct TracePoint;
+
+/* Trace points add themselves to the TracePointRegistry when they are
+ * constructed, i.e. when they are visited for the first time, so that they
+ * can all be reconfigured in one go when the configuration changes.
+ */
+TRACELIB_EXPORT void registerTracePoint( TracePoint *tracePoint );
+TRACELIB_EXPORT void unregisterTracePoint( TracePoint *tracePoint );
 
 struct TracePoint {
+    /* Bits of the 'state' word; the remaining upper bits hold the epoch of
+     * the configuration which the flags were computed for.
+     */
+    static const long Active = 0x1;
+    static const long BacktracesEnabled = 0x2;
+    static const long VariableSnapshotEnabled = 0x4;
+    static const long Throttled = 0x8;
+    static const long FlagMask = 0xF;
+    static const int EpochShift = 4;
+
+    /* Settings and counters for trace points whose <tracepointset> samples
+     * the hits or limits their rate (see acceptThrottledVisit() in trace.cpp).
+     * The settings are written along with 'state'.
+     */
+    struct Throttle {
+        volatile long sampleInterval; // record every n-th hit
+        volatile long maxRate; // 0 means unlimited
+        volatile long ratePeriod; // in milliseconds
+        volatile long hitCount;
+        volatile long rateWindow;
+        volatile long rateCount;
+        volatile long droppedHits;
+        volatile long reportWindow;
+    };
+
     TRACELIB_EXPORT TracePoint( TracePointType::Value type_, const char *sourceFile_, unsigned int lineno_, const char *functionName_, const char *groupName_ )
         : type( type_ ),
         sourceFile( sourceFile_ ),
         lineno( lineno_ ),
         functionName( functionName_ ),
         groupName( groupName_ ),
-        lastUsedConfiguration( 0 ),
-        active( false ),
-        backtracesEnabled( false ),
-        variableSnapshotEnabled( false )
+        state( 0 ),
+        throttle()
     {
+        registerTracePoint( this );
     }
 
+    ~TracePoint() {
+        unregisterTracePoint( this );
+    }
+
+    bool isActive() const { return ( state & Active ) != 0; }
+
     const TracePointType::Value type;
     const char * const sourceFile;
     const unsigned int lineno;
     const char * const functionName;
     const char * const groupName;
-    const Configuration *lastUsedConfiguration;
-    bool active;
-    bool backtracesEnabled;
-    bool variableSnapshotEnabled;
+    /* Written by Trace::configureTracePoint() while other threads read
+     * it without locking; epoch 0 means 'not configured yet'.
+     */
+    volatile long state;
+    /* Updated from const contexts like visitTracePoint(), since it only
+     * holds counters.
+     */
+    mutable Throttle throttle;
+
+private:
+    TracePoint( const TracePoint &other ); // disabled
+    void operator=( const TracePoint &rhs ); // disabled
 };
 
 TRACELIB_NAMESPACE_END
@@ -0,0 +1,77 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracepointregistry.h"
+#include "tracepoint.h"
+
+using namespace std;
+
+TRACELIB_NAMESPACE_BEGIN
+
+void registerTracePoint( TracePoint *tracePoint )
+{
+    TracePointRegistry::self().addTracePoint( tracePoint );
+}
+
+void unregisterTracePoint( TracePoint *tracePoint )
+{
+    TracePointRegistry::self().removeTracePoint( tracePoint );
+}
+
+RegisteredTracePointHandler::~RegisteredTracePointHandler()
+{
+}
+
+/* Never destroyed, since trace points (which unregister themselves) might be
+ * destroyed after all other static objects.
+ */
+TracePointRegistry &TracePointRegistry::self()
+{
+    static TracePointRegistry *instance = new TracePointRegistry;
+    return *instance;
+}
+
+TracePointRegistry::TracePointRegistry()
+{
+}
+
+void TracePointRegistry::addTracePoint( TracePoint *tracePoint )
+{
+    MutexLocker locker( m_mutex );
+    m_tracePoints.insert( tracePoint );
+}
+
+void TracePointRegistry::removeTracePoint( TracePoint *tracePoint )
+{
+    MutexLocker locker( m_mutex );
+    m_tracePoints.erase( tracePoint );
+}
+
+size_t TracePointRegistry::forEachTracePoint( RegisteredTracePointHandler *handler )
+{
+    MutexLocker locker( m_mutex );
+    set<TracePoint *>::const_iterator it, end = m_tracePoints.end();
+    for ( it = m_tracePoints.begin(); it != end; ++it ) {
+        handler->handleTracePoint( *it );
+    }
+    return m_tracePoints.size();
+}
+
+TRACELIB_NAMESPACE_END
+
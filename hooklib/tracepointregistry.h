@@ -0,0 +1,70 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_TRACEPOINTREGISTRY_H
+#define TRACELIB_TRACEPOINTREGISTRY_H
+
+#include "tracelib_config.h"
+#include "mutex.h"
+
+#include <set>
+#include <stddef.h>
+
+TRACELIB_NAMESPACE_BEGIN
+
+struct TracePoint;
+
+class RegisteredTracePointHandler
+{
+public:
+    virtual ~RegisteredTracePointHandler();
+
+    virtual void handleTracePoint( TracePoint *tracePoint ) = 0;
+};
+
+/* Knows all trace points of the process which were constructed (i.e.
+ * visited at least once) and not destroyed yet, including those of
+ * libraries which were loaded later on.
+ */
+class TracePointRegistry
+{
+public:
+    static TracePointRegistry &self();
+
+    void addTracePoint( TracePoint *tracePoint );
+    void removeTracePoint( TracePoint *tracePoint );
+
+    /* Calls the handler for every registered trace point and yields their
+     * number. Trace points cannot be added or removed meanwhile.
+     */
+    size_t forEachTracePoint( RegisteredTracePointHandler *handler );
+
+private:
+    TracePointRegistry();
+    TracePointRegistry( const TracePointRegistry &other ); // disabled
+    void operator=( const TracePointRegistry &rhs ); // disabled
+
+    Mutex m_mutex;
+    std::set<TracePoint *> m_tracePoints;
+};
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_TRACEPOINTREGISTRY_H)
+
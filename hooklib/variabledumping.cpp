@@ -20,8 +20,9 @@
 #include "variabledumping.h"
 
 #include <cassert>
-#include <cstdlib> // for free
-#include <cstring> // for strncpy, strdup
+#include <cstdlib> // for free, malloc
+#include <cstring> // for memcpy, strlen, strncpy, strdup
+#include <stdio.h> // for snprintf
 
 using namespace std;
 
@@ -69,42 +70,61 @@ VariableValue VariableValue::floatValue( long double v )
     return var;
 }
 
-std::string stringRep( const VariableValue &v )
+#if defined(_MSC_VER)
+#define snprintf _snprintf
+#endif
+
+size_t VariableValue::convertToString( const VariableValue &v, char *buf, size_t bufsize )
 {
     // XXX The list of variable types is duplicated in variabletypes.def
-    ostringstream stream;
+    char numberBuf[64];
+    const char *s = numberBuf;
     switch ( v.type() ) {
         case VariableType::String:
-            return v.asString();
+            s = v.asString();
+            break;
         case VariableType::Number:
-            if( v.isSignedNumber() ) {
-                stream << static_cast<vlonglong>( v.asNumber() );
+            if ( v.isSignedNumber() ) {
+                snprintf( numberBuf, sizeof( numberBuf ), "%lld", static_cast<vlonglong>( v.asNumber() ) );
             } else {
-                stream << v.asNumber();
+                snprintf( numberBuf, sizeof( numberBuf ), "%llu", v.asNumber() );
             }
-            return stream.str();
+            break;
         case VariableType::Float:
-            stream << v.asFloat();
-            return stream.str();
+            snprintf( numberBuf, sizeof( numberBuf ), "%Lg", v.asFloat() );
+            break;
         case VariableType::Boolean:
-            return v.asBoolean() ? "true" : "false";
+            s = v.asBoolean() ? "true" : "false";
+            break;
         case VariableType::Unknown:
-            assert( !"stringRep on Unknown VariableType" );
+            assert( !"convertToString on Unknown VariableType" );
+            numberBuf[0] = '\0';
+            break;
     }
-    assert( !"Unreachable" );
-    return string();
-}
+    numberBuf[sizeof( numberBuf ) - 1] = '\0';
 
-size_t VariableValue::convertToString( const VariableValue &v, char *buf, size_t bufsize )
-{
-    const std::string s = stringRep( v );
     if ( bufsize == 0 ) {
-        return s.size() + 1;
+        return strlen( s ) + 1;
     }
-    strncpy( buf, s.c_str(), bufsize );
+    strncpy( buf, s, bufsize );
     return bufsize;
 }
 
+#if defined(_MSC_VER)
+#undef snprintf
+#endif
+
+std::string stringRep( const VariableValue &v )
+{
+    if ( v.type() == VariableType::String ) {
+        return v.asString();
+    }
+    char buf[64];
+    VariableValue::convertToString( v, buf, sizeof( buf ) );
+    buf[sizeof( buf ) - 1] = '\0';
+    return buf;
+}
+
 VariableValue::VariableValue( const VariableValue &other )
     : m_type( other.m_type ),
     m_primitiveValue( other.m_primitiveValue ),
@@ -122,66 +142,28 @@ VariableValue::~VariableValue()
     }
 }
 
-VariableType::Value VariableValue::type() const
-{
-    return m_type;
-}
-
-const char *VariableValue::asString() const
-{
-    return m_primitiveValue.string;
-}
-
-vulonglong VariableValue::asNumber() const
-{
-    return m_primitiveValue.number;
-}
-
-bool VariableValue::asBoolean() const
-{
-    return m_primitiveValue.boolean;
-}
-
-long double VariableValue::asFloat() const
-{
-    return m_primitiveValue.float_;
-}
-
-bool VariableValue::isSignedNumber() const
-{
-    return m_isSignedNumber;
-}
-
 VariableValue::VariableValue()
     : m_type( VariableType::Unknown )
 {
 }
 
-VariableSnapshot::VariableSnapshot()
-    : m_variables( new std::vector<AbstractVariable *> )
+void VariableSnapshot::grow()
 {
+    const size_t newCapacity = m_capacity * 2;
+    AbstractVariable **newVariables = static_cast<AbstractVariable **>( malloc( newCapacity * sizeof( AbstractVariable * ) ) );
+    memcpy( newVariables, m_variables, m_size * sizeof( AbstractVariable * ) );
+    if ( m_variables != m_inlineVariables ) {
+        free( m_variables );
+    }
+    m_variables = newVariables;
+    m_capacity = newCapacity;
 }
 
-VariableSnapshot::~VariableSnapshot()
-{
-}
-
-
-VariableSnapshot &VariableSnapshot::operator<<( AbstractVariable *v )
-{
-    m_variables->push_back( v );
-    return *this;
-}
-
-size_t VariableSnapshot::size() const
-{
-    return m_variables->size();
-}
-
-
-AbstractVariable *&VariableSnapshot::operator[]( size_t idx )
+void VariableSnapshot::releaseStorage()
 {
-    return (*m_variables)[idx];
+    free( m_variables );
+    m_variables = m_inlineVariables;
+    m_capacity = InlineCapacity;
 }
 
 TRACELIB_NAMESPACE_END
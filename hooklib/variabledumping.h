@@ -26,8 +26,7 @@
 #include <stdio.h> // for snprintf
 
 #include <cstddef>
-#include <memory>
-#include <sstream>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -87,12 +86,12 @@ public:
     TRACELIB_EXPORT VariableValue( const VariableValue &other );
     TRACELIB_EXPORT ~VariableValue();
 
-    VariableType::Value type() const;
-    const char *asString() const;
-    vulonglong asNumber() const;
-    bool asBoolean() const;
-    long double asFloat() const;
-    bool isSignedNumber() const;
+    VariableType::Value type() const { return m_type; }
+    const char *asString() const { return m_primitiveValue.string; }
+    vulonglong asNumber() const { return m_primitiveValue.number; }
+    bool asBoolean() const { return m_primitiveValue.boolean; }
+    long double asFloat() const { return m_primitiveValue.float_; }
+    bool isSignedNumber() const { return m_isSignedNumber; }
 
 private:
     VariableValue();
@@ -151,26 +150,43 @@ TRACELIB_SPECIALIZE_CONVERSION_INTEGRAL(unsigned __int16, vulonglong)
 TRACELIB_SPECIALIZE_CONVERSION_INTEGRAL(unsigned __int32, vulonglong)
 #endif
 
-#define TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(T) \
+template <>
+inline VariableValue convertVariable( const char *val ) {
+    return VariableValue::stringValue( val ? val : "" );
+}
+
+#define TRACELIB_SPECIALIZE_CONVERSION_STRING(T) \
 template <> \
 inline VariableValue convertVariable( T val ) { \
-    std::ostringstream str; \
-    str << val; \
-    return VariableValue::stringValue( str.str().c_str() ); \
+    return convertVariable<const char *>( reinterpret_cast<const char *>( val ) ); \
 }
 
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(char)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(signed char)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(unsigned char)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(signed char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(unsigned char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(const char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(const signed char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(const unsigned char *)
-TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM(std::string)
+TRACELIB_SPECIALIZE_CONVERSION_STRING(char *)
+TRACELIB_SPECIALIZE_CONVERSION_STRING(signed char *)
+TRACELIB_SPECIALIZE_CONVERSION_STRING(unsigned char *)
+TRACELIB_SPECIALIZE_CONVERSION_STRING(const signed char *)
+TRACELIB_SPECIALIZE_CONVERSION_STRING(const unsigned char *)
+
+#undef TRACELIB_SPECIALIZE_CONVERSION_STRING
+
+#define TRACELIB_SPECIALIZE_CONVERSION_CHARACTER(T) \
+template <> \
+inline VariableValue convertVariable( T val ) { \
+    const char s[2] = { static_cast<char>( val ), '\0' }; \
+    return VariableValue::stringValue( s ); \
+}
+
+TRACELIB_SPECIALIZE_CONVERSION_CHARACTER(char)
+TRACELIB_SPECIALIZE_CONVERSION_CHARACTER(signed char)
+TRACELIB_SPECIALIZE_CONVERSION_CHARACTER(unsigned char)
+
+#undef TRACELIB_SPECIALIZE_CONVERSION_CHARACTER
+
+template <>
+inline VariableValue convertVariable( std::string val ) {
+    return VariableValue::stringValue( val.c_str() );
+}
 
-#undef TRACELIB_SPECIALIZE_CONVERSION_USING_SSTREAM
 
 #if defined(_MSC_VER)
 #define snprintf _snprintf
@@ -221,24 +237,75 @@ private:
     const T &m_o;
 };
 
+/* The objects created by makeConverter() only live as long as the trace entry
+ * they belong to, so they are taken from a per-thread arena instead of the
+ * heap. Everything allocated after enterEntryArena() is released again by the
+ * matching leaveEntryArena() call; no destructors are run, which is fine
+ * since Variable<T> merely holds a name and a reference.
+ */
+TRACELIB_EXPORT void *allocateEntryMemory( size_t size );
+TRACELIB_EXPORT void *enterEntryArena();
+TRACELIB_EXPORT void leaveEntryArena( void *mark );
+
+class EntryArenaScope
+{
+public:
+    EntryArenaScope() : m_mark( enterEntryArena() ) { }
+    ~EntryArenaScope() { leaveEntryArena( m_mark ); }
+
+private:
+    EntryArenaScope( const EntryArenaScope &other ); // disabled
+    void operator=( const EntryArenaScope &rhs ); // disabled
+
+    void *m_mark;
+};
+
 template <typename T>
 AbstractVariable *makeConverter( const char *name, const T &o ) {
-    return new Variable<T>( name, o );
+    return new ( allocateEntryMemory( sizeof( Variable<T> ) ) ) Variable<T>( name, o );
 }
 
+/* Holds the variables of a single trace entry; the first few are stored
+ * inline so that the common case does not need any allocation.
+ */
 class VariableSnapshot
 {
 public:
-    TRACELIB_EXPORT VariableSnapshot();
-    TRACELIB_EXPORT ~VariableSnapshot();
+    VariableSnapshot()
+        : m_variables( m_inlineVariables ),
+        m_size( 0 ),
+        m_capacity( InlineCapacity )
+    { }
+    ~VariableSnapshot() {
+        if ( m_variables != m_inlineVariables ) {
+            releaseStorage();
+        }
+    }
 
-    TRACELIB_EXPORT VariableSnapshot &operator<<( AbstractVariable *v );
+    VariableSnapshot &operator<<( AbstractVariable *v ) {
+        if ( m_size == m_capacity ) {
+            grow();
+        }
+        m_variables[m_size++] = v;
+        return *this;
+    }
 
-    TRACELIB_EXPORT size_t size() const;
-    TRACELIB_EXPORT AbstractVariable *&operator[]( size_t idx );
+    size_t size() const { return m_size; }
+    AbstractVariable *&operator[]( size_t idx ) { return m_variables[idx]; }
 
 private:
-    std::auto_ptr<std::vector<AbstractVariable *> > m_variables;
+    VariableSnapshot( const VariableSnapshot &other ); // disabled
+    void operator=( const VariableSnapshot &rhs ); // disabled
+
+    TRACELIB_EXPORT void grow();
+    TRACELIB_EXPORT void releaseStorage();
+
+    enum { InlineCapacity = 8 };
+
+    AbstractVariable *m_inlineVariables[InlineCapacity];
+    AbstractVariable **m_variables;
+    size_t m_size;
+    size_t m_capacity;
 };
 
 TRACELIB_NAMESPACE_END
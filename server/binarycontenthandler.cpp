@@ -0,0 +1,320 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binarycontenthandler.h"
+
+#include <cstring>
+
+// Must match the definitions in hooklib/serializer.h
+static const char BinaryStreamMagic[4] = { '\0', 'T', 'R', 'B' };
+static const quint64 SupportedFormatVersion = 1;
+
+/* Larger records are rejected instead of being buffered until they are
+ * complete, so that corrupt data cannot make a connection hog memory.
+ */
+static const quint64 MaxRecordSize = 64 * 1024 * 1024;
+
+enum RecordType {
+    ProcessRecord = 1,
+    TracePointRecord = 2,
+    StorageConfigurationRecord = 3,
+    TraceKeysRecord = 4,
+    EntryRecord = 5,
+    ShutdownRecord = 6
+};
+
+enum EntryFlags {
+    HasMessage = 0x01,
+    HasVariables = 0x02,
+    HasBacktrace = 0x04
+};
+
+// Yields false if the data ends before the varint is complete.
+static bool readVarint( const char **pos, const char *end, quint64 *value )
+{
+    quint64 result = 0;
+    for ( int shift = 0; *pos + shift / 7 < end; shift += 7 ) {
+        const unsigned char byte = static_cast<unsigned char>( ( *pos )[shift / 7] );
+        if ( shift > 63 ) {
+            throw BinaryParseException( QString::fromLatin1( "Invalid varint encountered in binary trace data" ) );
+        }
+        result |= static_cast<quint64>( byte & 0x7f ) << shift;
+        if ( !( byte & 0x80 ) ) {
+            *pos += shift / 7 + 1;
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+class BinaryContentHandler::RecordReader
+{
+public:
+    RecordReader( const char *begin, const char *end )
+        : m_pos( begin ), m_end( end )
+    {
+    }
+
+    quint64 varint() {
+        quint64 v;
+        if ( !readVarint( &m_pos, m_end, &v ) ) {
+            throwTruncated();
+        }
+        return v;
+    }
+
+    qint64 signedVarint() {
+        const quint64 v = varint();
+        return static_cast<qint64>( v >> 1 ) ^ -static_cast<qint64>( v & 1 );
+    }
+
+    unsigned char byte() {
+        if ( m_pos == m_end ) {
+            throwTruncated();
+        }
+        return static_cast<unsigned char>( *m_pos++ );
+    }
+
+    QString string() {
+        const quint64 len = varint();
+        if ( len > static_cast<quint64>( m_end - m_pos ) ) {
+            throwTruncated();
+        }
+        const QString s = QString::fromUtf8( m_pos, static_cast<int>( len ) );
+        m_pos += len;
+        return s;
+    }
+
+    double floatingPoint() {
+        quint64 bits = 0;
+        for ( int i = 0; i < 8; ++i ) {
+            bits |= static_cast<quint64>( byte() ) << ( i * 8 );
+        }
+        double v;
+        memcpy( &v, &bits, sizeof( v ) );
+        return v;
+    }
+
+private:
+    void throwTruncated() const {
+        throw BinaryParseException( QString::fromLatin1( "Truncated record encountered in binary trace data" ) );
+    }
+
+    const char *m_pos;
+    const char *m_end;
+};
+
+BinaryContentHandler::BinaryContentHandler( XmlParseEventsHandler *handler )
+    : m_handler( handler ),
+    m_readHeader( false ),
+    m_pid( 0 ),
+    m_lastTimeStamp( 0 )
+{
+}
+
+bool BinaryContentHandler::isBinaryStream( const QByteArray &data )
+{
+    // An XML document can never start with a NUL byte
+    return !data.isEmpty() && data.at( 0 ) == BinaryStreamMagic[0];
+}
+
+void BinaryContentHandler::addData( const QByteArray &data )
+{
+    m_buffer.append( data );
+}
+
+void BinaryContentHandler::continueParsing()
+{
+    const char *begin = m_buffer.constData();
+    const char *end = begin + m_buffer.size();
+    const char *pos = begin;
+
+    if ( !m_readHeader ) {
+        if ( end - pos < static_cast<int>( sizeof( BinaryStreamMagic ) ) ) {
+            return;
+        }
+        if ( memcmp( pos, BinaryStreamMagic, sizeof( BinaryStreamMagic ) ) != 0 ) {
+            throw BinaryParseException( QString::fromLatin1( "Binary trace data does not start with the expected header" ) );
+        }
+        const char *versionPos = pos + sizeof( BinaryStreamMagic );
+        quint64 version;
+        if ( !readVarint( &versionPos, end, &version ) ) {
+            return;
+        }
+        if ( version != SupportedFormatVersion ) {
+            throw BinaryParseException( QString::fromLatin1( "Unsupported binary trace format version %1" ).arg( version ) );
+        }
+        pos = versionPos;
+        m_readHeader = true;
+    }
+
+    while ( pos < end ) {
+        const char *recordPos = pos;
+        quint64 len;
+        if ( !readVarint( &recordPos, end, &len ) ) {
+            break;
+        }
+        if ( len > MaxRecordSize ) {
+            throw BinaryParseException( QString::fromLatin1( "Record of %1 bytes exceeds the maximum record size in binary trace data" ).arg( len ) );
+        }
+        if ( len > static_cast<quint64>( end - recordPos ) ) {
+            break;
+        }
+
+        RecordReader reader( recordPos, recordPos + len );
+        pos = recordPos + len;
+        handleRecord( reader );
+    }
+
+    m_buffer.remove( 0, static_cast<int>( pos - begin ) );
+}
+
+void BinaryContentHandler::handleRecord( RecordReader &reader )
+{
+    switch ( reader.byte() ) {
+        case ProcessRecord:
+            m_pid = reader.varint();
+            m_processStartTime = QDateTime::fromMSecsSinceEpoch( reader.varint() );
+            m_processName = reader.string();
+            break;
+        case TracePointRecord: {
+            const quint64 id = reader.varint();
+            TracePointInfo info;
+            info.type = reader.varint();
+            info.lineno = reader.varint();
+            info.path = reader.string();
+            info.function = reader.string();
+            info.groupName = reader.string();
+            m_tracePoints.insert( id, info );
+            break;
+        }
+        case StorageConfigurationRecord: {
+            StorageConfiguration cfg;
+            cfg.maximumSize = reader.varint();
+            cfg.shrinkBy = reader.varint();
+            cfg.archiveDir = reader.string();
+            m_handler->applyStorageConfiguration( cfg );
+            break;
+        }
+        case TraceKeysRecord: {
+            m_traceKeys.clear();
+            const quint64 count = reader.varint();
+            for ( quint64 i = 0; i < count; ++i ) {
+                TraceKey key;
+                key.enabled = reader.byte() != 0;
+                key.name = reader.string();
+                m_traceKeys.append( key );
+            }
+            break;
+        }
+        case EntryRecord:
+            handleEntryRecord( reader );
+            break;
+        case ShutdownRecord: {
+            ProcessShutdownEvent ev;
+            ev.pid = reader.varint();
+            ev.startTime = QDateTime::fromMSecsSinceEpoch( reader.varint() );
+            ev.stopTime = QDateTime::fromMSecsSinceEpoch( reader.varint() );
+            ev.name = reader.string();
+            m_handler->handleShutdownEvent( ev );
+            break;
+        }
+        default:
+            // Records of unknown type are skipped so that newer tracelib
+            // versions can add records without breaking older servers.
+            break;
+    }
+}
+
+void BinaryContentHandler::handleEntryRecord( RecordReader &reader )
+{
+    const quint64 tracePointId = reader.varint();
+    QHash<quint64, TracePointInfo>::ConstIterator tracePoint = m_tracePoints.constFind( tracePointId );
+    if ( tracePoint == m_tracePoints.constEnd() ) {
+        throw BinaryParseException( QString::fromLatin1( "Entry refers to unknown trace point %1" ).arg( tracePointId ) );
+    }
+
+    TraceEntry entry;
+    entry.pid = m_pid;
+    entry.processStartTime = m_processStartTime;
+    entry.processName = m_processName;
+    entry.traceKeys = m_traceKeys;
+    entry.type = tracePoint->type;
+    entry.path = tracePoint->path;
+    entry.lineno = tracePoint->lineno;
+    entry.function = tracePoint->function;
+    entry.groupName = tracePoint->groupName;
+
+    entry.tid = reader.varint();
+    m_lastTimeStamp += reader.signedVarint();
+    entry.timestamp = QDateTime::fromMSecsSinceEpoch( m_lastTimeStamp );
+    entry.stackPosition = reader.varint();
+
+    const unsigned char flags = reader.byte();
+    if ( flags & HasMessage ) {
+        entry.message = reader.string();
+    }
+
+    if ( flags & HasVariables ) {
+        const quint64 count = reader.varint();
+        for ( quint64 i = 0; i < count; ++i ) {
+            Variable var;
+            var.name = reader.string();
+            var.type = static_cast<TRACELIB_NAMESPACE_IDENT(VariableType)::Value>( reader.byte() );
+            // Use the same textual representation as the XML serializer
+            switch ( var.type ) {
+                case TRACELIB_NAMESPACE_IDENT(VariableType)::String:
+                    var.value = reader.string();
+                    break;
+                case TRACELIB_NAMESPACE_IDENT(VariableType)::Number:
+                    if ( reader.byte() ) {
+                        var.value = QString::number( reader.signedVarint() );
+                    } else {
+                        var.value = QString::number( reader.varint() );
+                    }
+                    break;
+                case TRACELIB_NAMESPACE_IDENT(VariableType)::Float:
+                    var.value = QString::number( reader.floatingPoint(), 'g', 6 );
+                    break;
+                case TRACELIB_NAMESPACE_IDENT(VariableType)::Boolean:
+                    var.value = QString::number( reader.byte() );
+                    break;
+                default:
+                    throw BinaryParseException( QString::fromLatin1( "Variable of unknown type %1 encountered" ).arg( var.type ) );
+            }
+            entry.variables.append( var );
+        }
+    }
+
+    if ( flags & HasBacktrace ) {
+        const quint64 depth = reader.varint();
+        for ( quint64 i = 0; i < depth; ++i ) {
+            StackFrame frame;
+            frame.module = reader.string();
+            frame.function = reader.string();
+            frame.functionOffset = reader.varint();
+            frame.sourceFile = reader.string();
+            frame.lineNumber = reader.varint();
+            entry.backtrace.append( frame );
+        }
+    }
+
+    m_handler->handleTraceEntry( entry );
+}
@@ -0,0 +1,77 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_BINARYCONTENTHANDLER_H
+#define TRACER_BINARYCONTENTHANDLER_H
+
+#include "xmlcontenthandler.h"
+
+#include <QHash>
+
+class BinaryParseException : public std::runtime_error
+{
+public:
+    BinaryParseException( const QString &what )
+        : std::runtime_error( what.toUtf8().constData() )
+    {
+    }
+};
+
+/* Decodes the stream written by the binary serializer of tracelib (see
+ * hooklib/serializer.h) and passes the decoded entries to the same
+ * XmlParseEventsHandler interface which the XmlContentHandler uses.
+ */
+class BinaryContentHandler
+{
+public:
+    BinaryContentHandler( XmlParseEventsHandler *handler );
+
+    static bool isBinaryStream( const QByteArray &data );
+
+    void addData( const QByteArray &data );
+
+    void continueParsing();
+
+private:
+    struct TracePointInfo
+    {
+        unsigned int type;
+        unsigned long lineno;
+        QString path;
+        QString function;
+        QString groupName;
+    };
+
+    class RecordReader;
+
+    void handleRecord( RecordReader &reader );
+    void handleEntryRecord( RecordReader &reader );
+
+    XmlParseEventsHandler *m_handler;
+    QByteArray m_buffer;
+    bool m_readHeader;
+    QHash<quint64, TracePointInfo> m_tracePoints;
+    unsigned int m_pid;
+    QDateTime m_processStartTime;
+    QString m_processName;
+    QList<TraceKey> m_traceKeys;
+    quint64 m_lastTimeStamp;
+};
+
+#endif // TRACER_BINARYCONTENTHANDLER_H
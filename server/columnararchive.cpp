@@ -0,0 +1,773 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "columnararchive.h"
+
+#include "database.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+/* File layout:
+ *   magic, format version
+ *   blocks: one compressed byte array per column (see Column)
+ *   footer: compressed dictionary tables and block index
+ *   offset of the footer, magic
+ */
+static const char Magic[] = "TRACEARC";
+static const int MagicSize = sizeof( Magic ) - 1;
+static const quint32 FormatVersion = 1;
+static const QDataStream::Version StreamVersion = QDataStream::Qt_5_0;
+
+static const char ArchiveSuffix[] = ".tracearchive";
+
+// Tables referenced by trace entries, stored row by row in the footer
+static const char * const dictionaryTables[] = {
+    "trace_point_group",
+    "path_name",
+    "function_name",
+    "trace_point",
+    "process",
+    "traced_thread",
+    "frame"
+};
+
+enum Column {
+    IdColumn,            // delta to previous id
+    TimestampColumn,     // delta to previous timestamp (milliseconds)
+    TracePointColumn,    // block dictionary of trace point ids, then indices
+    ThreadColumn,        // block dictionary of traced thread ids, then indices
+    StackPositionColumn,
+    MessageColumn,       // UTF-8, length + 1 (0 for NULL) followed by the bytes
+    VariableColumn,      // count, then name, value and type of each variable
+    BacktraceColumn,     // count, then the frame ids ordered by depth
+    ColumnCount
+};
+
+struct BlockInfo
+{
+    qint64 offset;
+    quint32 entryCount;
+    quint64 minId;
+    quint64 maxId;
+    qint64 minTimestamp;
+    qint64 maxTimestamp;
+};
+
+static QDataStream &operator<<( QDataStream &stream, const BlockInfo &info )
+{
+    stream << info.offset << info.entryCount
+           << info.minId << info.maxId
+           << info.minTimestamp << info.maxTimestamp;
+    return stream;
+}
+
+static QDataStream &operator>>( QDataStream &stream, BlockInfo &info )
+{
+    stream >> info.offset >> info.entryCount
+           >> info.minId >> info.maxId
+           >> info.minTimestamp >> info.maxTimestamp;
+    return stream;
+}
+
+namespace {
+
+// Variable length integers, 7 bits per byte
+class ColumnWriter
+{
+public:
+    void writeUInt( quint64 v ) {
+        while ( v >= 0x80 ) {
+            m_data.append( char( ( v & 0x7f ) | 0x80 ) );
+            v >>= 7;
+        }
+        m_data.append( char( v ) );
+    }
+
+    // Zigzag encoded, so that small negative deltas stay short
+    void writeInt( qint64 v ) {
+        writeUInt( ( quint64( v ) << 1 ) ^ quint64( v >> 63 ) );
+    }
+
+    void writeString( const QString &s ) {
+        if ( s.isNull() ) {
+            writeUInt( 0 );
+            return;
+        }
+        const QByteArray utf8 = s.toUtf8();
+        writeUInt( quint64( utf8.size() ) + 1 );
+        m_data.append( utf8 );
+    }
+
+    QByteArray compressed() const { return qCompress( m_data ); }
+
+private:
+    QByteArray m_data;
+};
+
+class ColumnReader
+{
+public:
+    explicit ColumnReader( const QByteArray &compressedData )
+        : m_data( qUncompress( compressedData ) )
+        , m_pos( 0 )
+        , m_ok( !m_data.isEmpty() )
+    { }
+
+    bool ok() const { return m_ok; }
+
+    quint64 readUInt() {
+        quint64 v = 0;
+        for ( int shift = 0; shift < 64; shift += 7 ) {
+            if ( m_pos >= m_data.size() ) {
+                break;
+            }
+            const uchar c = uchar( m_data[m_pos++] );
+            v |= quint64( c & 0x7f ) << shift;
+            if ( !( c & 0x80 ) ) {
+                return v;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    qint64 readInt() {
+        const quint64 v = readUInt();
+        return qint64( v >> 1 ) ^ -qint64( v & 1 );
+    }
+
+    QString readString() {
+        const quint64 length = readUInt();
+        if ( length == 0 ) {
+            return QString();
+        }
+        if ( length - 1 > quint64( m_data.size() - m_pos ) ) {
+            m_ok = false;
+            return QString();
+        }
+        const QString s = QString::fromUtf8( m_data.constData() + m_pos, int( length - 1 ) );
+        m_pos += int( length - 1 );
+        return s.isNull() ? QString( "" ) : s;
+    }
+
+    // Reads the dictionary of a dictionary coded column
+    QVector<quint64> readDictionary() {
+        QVector<quint64> dictionary;
+        const quint64 size = readUInt();
+        for ( quint64 i = 0; i < size && m_ok; ++i ) {
+            dictionary.append( readUInt() );
+        }
+        return dictionary;
+    }
+
+    quint64 readCoded( const QVector<quint64> &dictionary ) {
+        const quint64 index = readUInt();
+        if ( index >= quint64( dictionary.size() ) ) {
+            m_ok = false;
+            return 0;
+        }
+        return dictionary[int( index )];
+    }
+
+private:
+    const QByteArray m_data;
+    int m_pos;
+    bool m_ok;
+};
+
+// Column of ids which are replaced by their index in a dictionary
+class DictionaryColumnWriter
+{
+public:
+    void add( quint64 id ) {
+        QHash<quint64, quint64>::ConstIterator it = m_indices.constFind( id );
+        if ( it == m_indices.constEnd() ) {
+            it = m_indices.insert( id, quint64( m_dictionary.size() ) );
+            m_dictionary.append( id );
+        }
+        m_codes.append( *it );
+    }
+
+    QByteArray compressed() const {
+        ColumnWriter w;
+        w.writeUInt( quint64( m_dictionary.size() ) );
+        for ( int i = 0; i < m_dictionary.size(); ++i ) {
+            w.writeUInt( m_dictionary[i] );
+        }
+        for ( int i = 0; i < m_codes.size(); ++i ) {
+            w.writeUInt( m_codes[i] );
+        }
+        return w.compressed();
+    }
+
+private:
+    QHash<quint64, quint64> m_indices;
+    QVector<quint64> m_dictionary;
+    QVector<quint64> m_codes;
+};
+
+struct EntryRow
+{
+    quint64 id;
+    qint64 timestamp;
+    quint64 tracePointId;
+    quint64 threadId;
+    quint64 stackPosition;
+    QString message;
+};
+
+struct VariableRow
+{
+    QString name;
+    QString value;
+    quint64 type;
+};
+
+}
+
+static QString queryError( const QSqlQuery &query )
+{
+    return QObject::tr( "Executing SQL command '%1' failed: %2" )
+        .arg( query.lastQuery() )
+        .arg( query.lastError().text() );
+}
+
+static bool writeBlock( QSqlDatabase db, const QVector<EntryRow> &rows,
+                        QDataStream &stream, QList<BlockInfo> *blocks,
+                        QString *errMsg )
+{
+    const QString idRange = QString( "BETWEEN %1 AND %2" ).arg( rows.first().id ).arg( rows.last().id );
+
+    QHash<quint64, QList<VariableRow> > variables;
+    {
+        QSqlQuery query( db );
+        query.setForwardOnly( true );
+        if ( !query.exec( "SELECT trace_entry_id, name, value, type FROM variable WHERE trace_entry_id " + idRange + " ORDER BY trace_entry_id, rowid;" ) ) {
+            *errMsg = queryError( query );
+            return false;
+        }
+        while ( query.next() ) {
+            VariableRow v;
+            v.name = query.value( 1 ).toString();
+            v.value = query.value( 2 ).toString();
+            v.type = query.value( 3 ).toULongLong();
+            variables[query.value( 0 ).toULongLong()].append( v );
+        }
+    }
+
+    QHash<quint64, QList<quint64> > backtraces;
+    {
+        QSqlQuery query( db );
+        query.setForwardOnly( true );
+        if ( !query.exec( "SELECT trace_entry_id, frame_id FROM stackframe WHERE trace_entry_id " + idRange + " ORDER BY trace_entry_id, depth;" ) ) {
+            *errMsg = queryError( query );
+            return false;
+        }
+        while ( query.next() ) {
+            backtraces[query.value( 0 ).toULongLong()].append( query.value( 1 ).toULongLong() );
+        }
+    }
+
+    ColumnWriter ids, timestamps, stackPositions, messages, variableValues, frames;
+    DictionaryColumnWriter tracePoints, threads;
+
+    BlockInfo info;
+    info.offset = stream.device()->pos();
+    info.entryCount = quint32( rows.size() );
+    info.minId = rows.first().id;
+    info.maxId = rows.last().id;
+    info.minTimestamp = info.maxTimestamp = rows.first().timestamp;
+
+    quint64 previousId = 0;
+    qint64 previousTimestamp = 0;
+    QVector<EntryRow>::ConstIterator it, end = rows.end();
+    for ( it = rows.begin(); it != end; ++it ) {
+        ids.writeUInt( it->id - previousId );
+        previousId = it->id;
+        timestamps.writeInt( it->timestamp - previousTimestamp );
+        previousTimestamp = it->timestamp;
+        info.minTimestamp = qMin( info.minTimestamp, it->timestamp );
+        info.maxTimestamp = qMax( info.maxTimestamp, it->timestamp );
+
+        tracePoints.add( it->tracePointId );
+        threads.add( it->threadId );
+        stackPositions.writeUInt( it->stackPosition );
+        messages.writeString( it->message );
+
+        const QList<VariableRow> entryVariables = variables.value( it->id );
+        variableValues.writeUInt( quint64( entryVariables.size() ) );
+        QList<VariableRow>::ConstIterator vit, vend = entryVariables.end();
+        for ( vit = entryVariables.begin(); vit != vend; ++vit ) {
+            variableValues.writeString( vit->name );
+            variableValues.writeString( vit->value );
+            variableValues.writeUInt( vit->type );
+        }
+
+        const QList<quint64> backtrace = backtraces.value( it->id );
+        frames.writeUInt( quint64( backtrace.size() ) );
+        QList<quint64>::ConstIterator fit, fend = backtrace.end();
+        for ( fit = backtrace.begin(); fit != fend; ++fit ) {
+            frames.writeUInt( *fit );
+        }
+    }
+
+    // Same order as the Column enum
+    stream << ids.compressed()
+           << timestamps.compressed()
+           << tracePoints.compressed()
+           << threads.compressed()
+           << stackPositions.compressed()
+           << messages.compressed()
+           << variableValues.compressed()
+           << frames.compressed();
+    if ( stream.status() != QDataStream::Ok ) {
+        *errMsg = stream.device()->errorString();
+        return false;
+    }
+
+    blocks->append( info );
+    return true;
+}
+
+static bool writeFooter( QSqlDatabase db, const QList<BlockInfo> &blocks,
+                         QDataStream &stream, QString *errMsg )
+{
+    QByteArray footer;
+    {
+        QDataStream footerStream( &footer, QIODevice::WriteOnly );
+        footerStream.setVersion( StreamVersion );
+        for ( unsigned i = 0; i < sizeof( dictionaryTables ) / sizeof( dictionaryTables[0] ); ++i ) {
+            QSqlQuery query( db );
+            query.setForwardOnly( true );
+            if ( !query.exec( QString( "SELECT * FROM %1 ORDER BY id;" ).arg( dictionaryTables[i] ) ) ) {
+                *errMsg = queryError( query );
+                return false;
+            }
+            const int columnCount = query.record().count();
+            QList<QVariant> values;
+            quint32 rowCount = 0;
+            while ( query.next() ) {
+                for ( int c = 0; c < columnCount; ++c ) {
+                    values.append( query.value( c ) );
+                }
+                ++rowCount;
+            }
+            footerStream << quint32( columnCount ) << rowCount;
+            QList<QVariant>::ConstIterator it, end = values.end();
+            for ( it = values.begin(); it != end; ++it ) {
+                footerStream << *it;
+            }
+        }
+        footerStream << quint32( blocks.size() );
+        QList<BlockInfo>::ConstIterator it, end = blocks.end();
+        for ( it = blocks.begin(); it != end; ++it ) {
+            footerStream << *it;
+        }
+    }
+
+    const quint64 footerOffset = stream.device()->pos();
+    stream << qCompress( footer ) << footerOffset;
+    stream.writeRawData( Magic, MagicSize );
+    if ( stream.status() != QDataStream::Ok ) {
+        *errMsg = stream.device()->errorString();
+        return false;
+    }
+    return true;
+}
+
+static bool writeArchive( QSqlDatabase db, QFile *file, QString *errMsg )
+{
+    QDataStream stream( file );
+    stream.setVersion( StreamVersion );
+    stream.writeRawData( Magic, MagicSize );
+    stream << FormatVersion;
+
+    QSqlQuery query( db );
+    query.setForwardOnly( true );
+    if ( !query.exec( "SELECT id, timestamp, trace_point_id, traced_thread_id, stack_position, message FROM trace_entry ORDER BY id;" ) ) {
+        *errMsg = queryError( query );
+        return false;
+    }
+
+    QList<BlockInfo> blocks;
+    QVector<EntryRow> rows;
+    rows.reserve( ColumnarArchive::BlockEntries );
+    while ( true ) {
+        const bool atEnd = !query.next();
+        if ( !atEnd ) {
+            EntryRow row;
+            row.id = query.value( 0 ).toULongLong();
+            row.timestamp = query.value( 1 ).toLongLong();
+            row.tracePointId = query.value( 2 ).toULongLong();
+            row.threadId = query.value( 3 ).toULongLong();
+            row.stackPosition = query.value( 4 ).toULongLong();
+            row.message = query.value( 5 ).toString();
+            rows.append( row );
+        }
+        if ( rows.size() == ColumnarArchive::BlockEntries || ( atEnd && !rows.isEmpty() ) ) {
+            if ( !writeBlock( db, rows, stream, &blocks, errMsg ) ) {
+                return false;
+            }
+            rows.clear();
+        }
+        if ( atEnd ) {
+            break;
+        }
+    }
+
+    return writeFooter( db, blocks, stream, errMsg );
+}
+
+bool ColumnarArchive::isArchive( const QString &fileName )
+{
+#ifdef Q_OS_WIN
+    const Qt::CaseSensitivity sensitivity = Qt::CaseInsensitive;
+#else
+    const Qt::CaseSensitivity sensitivity = Qt::CaseSensitive;
+#endif
+    return fileName.endsWith( ArchiveSuffix, sensitivity );
+}
+
+QString ColumnarArchive::archiveFileNameFor( const QString &databaseFileName )
+{
+    const QFileInfo fi( databaseFileName );
+    return fi.path() + "/" + fi.completeBaseName() + ArchiveSuffix;
+}
+
+// Written to a temporary file first, so that an archive is always complete
+bool ColumnarArchive::write( QSqlDatabase db, const QString &fileName, QString *errMsg )
+{
+    const QString partFileName = fileName + ".part";
+    QFile file( partFileName );
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+        *errMsg = QObject::tr( "Failed to create %1: %2" ).arg( partFileName ).arg( file.errorString() );
+        return false;
+    }
+
+    const bool written = writeArchive( db, &file, errMsg );
+    file.close();
+    if ( !written ) {
+        file.remove();
+        return false;
+    }
+
+    QFile::remove( fileName );
+    if ( !file.rename( fileName ) ) {
+        *errMsg = QObject::tr( "Failed to rename %1 to %2: %3" ).arg( partFileName ).arg( fileName ).arg( file.errorString() );
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+static bool readMagic( QDataStream &stream )
+{
+    char magic[MagicSize];
+    return stream.readRawData( magic, MagicSize ) == MagicSize
+        && qstrncmp( magic, Magic, MagicSize ) == 0;
+}
+
+static QByteArray readFooter( QFile *file, QString *errMsg )
+{
+    QDataStream stream( file );
+    stream.setVersion( StreamVersion );
+
+    quint32 version = 0;
+    if ( !readMagic( stream ) || ( stream >> version ).status() != QDataStream::Ok ) {
+        *errMsg = QObject::tr( "%1 is not a trace archive" ).arg( file->fileName() );
+        return QByteArray();
+    }
+    if ( version != FormatVersion ) {
+        *errMsg = QObject::tr( "%1 uses the unsupported archive format version %2" ).arg( file->fileName() ).arg( version );
+        return QByteArray();
+    }
+
+    quint64 footerOffset = 0;
+    QByteArray footer;
+    const qint64 trailerSize = qint64( sizeof( footerOffset ) ) + MagicSize;
+    if ( file->size() >= trailerSize && file->seek( file->size() - trailerSize ) ) {
+        stream >> footerOffset;
+        if ( readMagic( stream ) && file->seek( qint64( footerOffset ) ) ) {
+            QByteArray compressedFooter;
+            stream >> compressedFooter;
+            footer = qUncompress( compressedFooter );
+        }
+    }
+    if ( footer.isEmpty() ) {
+        *errMsg = QObject::tr( "Trace archive %1 is truncated or corrupt" ).arg( file->fileName() );
+    }
+    return footer;
+}
+
+static void restoreDictionaryTables( Transaction *transaction, QSqlDatabase db, QDataStream &footer )
+{
+    for ( unsigned i = 0; i < sizeof( dictionaryTables ) / sizeof( dictionaryTables[0] ); ++i ) {
+        quint32 columnCount = 0;
+        quint32 rowCount = 0;
+        footer >> columnCount >> rowCount;
+        if ( footer.status() != QDataStream::Ok || columnCount == 0 ) {
+            throw runtime_error( "dictionary tables are corrupt" );
+        }
+
+        QStringList placeholders;
+        for ( quint32 c = 0; c < columnCount; ++c ) {
+            placeholders << "?";
+        }
+        QSqlQuery insert( db );
+        insert.prepare( QString( "INSERT INTO %1 VALUES(%2);" ).arg( dictionaryTables[i] ).arg( placeholders.join( "," ) ) );
+        for ( quint32 r = 0; r < rowCount && footer.status() == QDataStream::Ok; ++r ) {
+            for ( quint32 c = 0; c < columnCount; ++c ) {
+                QVariant value;
+                footer >> value;
+                insert.bindValue( int( c ), value );
+            }
+            transaction->exec( insert );
+        }
+    }
+}
+
+struct EntryInserts
+{
+    explicit EntryInserts( QSqlDatabase db )
+        : entry( db ), variable( db ), stackframe( db )
+    {
+        entry.prepare( "INSERT INTO trace_entry (id, traced_thread_id, timestamp, trace_point_id, message, stack_position) VALUES(?, ?, ?, ?, ?, ?);" );
+        variable.prepare( "INSERT INTO variable (trace_entry_id, name, value, type) VALUES(?, ?, ?, ?);" );
+        stackframe.prepare( "INSERT INTO stackframe (trace_entry_id, depth, frame_id) VALUES(?, ?, ?);" );
+    }
+
+    QSqlQuery entry;
+    QSqlQuery variable;
+    QSqlQuery stackframe;
+};
+
+// Restores the entries of a block with timestamps between fromMsecs and toMsecs
+static void restoreBlock( Transaction *transaction, EntryInserts *inserts,
+                          QDataStream &stream, const BlockInfo &info,
+                          qint64 fromMsecs, qint64 toMsecs )
+{
+    QByteArray columns[ColumnCount];
+    for ( int i = 0; i < ColumnCount; ++i ) {
+        stream >> columns[i];
+    }
+    if ( stream.status() != QDataStream::Ok ) {
+        throw runtime_error( "block is truncated" );
+    }
+
+    ColumnReader ids( columns[IdColumn] );
+    ColumnReader timestamps( columns[TimestampColumn] );
+    ColumnReader tracePoints( columns[TracePointColumn] );
+    ColumnReader threads( columns[ThreadColumn] );
+    ColumnReader stackPositions( columns[StackPositionColumn] );
+    ColumnReader messages( columns[MessageColumn] );
+    ColumnReader variables( columns[VariableColumn] );
+    ColumnReader frames( columns[BacktraceColumn] );
+    const QVector<quint64> tracePointIds = tracePoints.readDictionary();
+    const QVector<quint64> threadIds = threads.readDictionary();
+
+    quint64 id = 0;
+    qint64 timestamp = 0;
+    for ( quint32 i = 0; i < info.entryCount; ++i ) {
+        id += ids.readUInt();
+        timestamp += timestamps.readInt();
+        const quint64 tracePointId = tracePoints.readCoded( tracePointIds );
+        const quint64 threadId = threads.readCoded( threadIds );
+        const quint64 stackPosition = stackPositions.readUInt();
+        const QString message = messages.readString();
+
+        QList<VariableRow> entryVariables;
+        const quint64 variableCount = variables.readUInt();
+        for ( quint64 v = 0; v < variableCount && variables.ok(); ++v ) {
+            VariableRow row;
+            row.name = variables.readString();
+            row.value = variables.readString();
+            row.type = variables.readUInt();
+            entryVariables.append( row );
+        }
+
+        QList<quint64> backtrace;
+        const quint64 frameCount = frames.readUInt();
+        for ( quint64 f = 0; f < frameCount && frames.ok(); ++f ) {
+            backtrace.append( frames.readUInt() );
+        }
+
+        if ( !ids.ok() || !timestamps.ok() || !tracePoints.ok() || !threads.ok() ||
+             !stackPositions.ok() || !messages.ok() || !variables.ok() || !frames.ok() ) {
+            throw runtime_error( "block is corrupt" );
+        }
+
+        if ( timestamp < fromMsecs || timestamp > toMsecs ) {
+            continue;
+        }
+
+        inserts->entry.bindValue( 0, id );
+        inserts->entry.bindValue( 1, threadId );
+        inserts->entry.bindValue( 2, timestamp );
+        inserts->entry.bindValue( 3, tracePointId );
+        inserts->entry.bindValue( 4, message );
+        inserts->entry.bindValue( 5, stackPosition );
+        transaction->exec( inserts->entry );
+
+        QList<VariableRow>::ConstIterator vit, vend = entryVariables.end();
+        for ( vit = entryVariables.begin(); vit != vend; ++vit ) {
+            inserts->variable.bindValue( 0, id );
+            inserts->variable.bindValue( 1, vit->name );
+            inserts->variable.bindValue( 2, vit->value );
+            inserts->variable.bindValue( 3, vit->type );
+            transaction->exec( inserts->variable );
+        }
+
+        for ( int depth = 0; depth < backtrace.size(); ++depth ) {
+            inserts->stackframe.bindValue( 0, id );
+            inserts->stackframe.bindValue( 1, depth );
+            inserts->stackframe.bindValue( 2, backtrace[depth] );
+            transaction->exec( inserts->stackframe );
+        }
+    }
+}
+
+static bool restoreEntries( QSqlDatabase db, QFile *file, const QByteArray &footer,
+                            const QDateTime &from, const QDateTime &to,
+                            QString *errMsg )
+{
+    const qint64 fromMsecs = from.isValid() ? from.toMSecsSinceEpoch() : numeric_limits<qint64>::min();
+    const qint64 toMsecs = to.isValid() ? to.toMSecsSinceEpoch() : numeric_limits<qint64>::max();
+
+    QDataStream footerStream( footer );
+    footerStream.setVersion( StreamVersion );
+    QDataStream stream( file );
+    stream.setVersion( StreamVersion );
+
+    try {
+        Transaction transaction( db );
+        restoreDictionaryTables( &transaction, db, footerStream );
+
+        quint32 blockCount = 0;
+        footerStream >> blockCount;
+        QList<BlockInfo> blocks;
+        for ( quint32 i = 0; i < blockCount && footerStream.status() == QDataStream::Ok; ++i ) {
+            BlockInfo info;
+            footerStream >> info;
+            blocks.append( info );
+        }
+        if ( footerStream.status() != QDataStream::Ok ) {
+            throw runtime_error( "block index is corrupt" );
+        }
+
+        EntryInserts inserts( db );
+        QList<BlockInfo>::ConstIterator it, end = blocks.end();
+        for ( it = blocks.begin(); it != end; ++it ) {
+            // Only blocks overlapping the time range are read at all
+            if ( it->maxTimestamp < fromMsecs || it->minTimestamp > toMsecs ) {
+                continue;
+            }
+            if ( !file->seek( it->offset ) ) {
+                throw runtime_error( "block offset is out of range" );
+            }
+            restoreBlock( &transaction, &inserts, stream, *it, fromMsecs, toMsecs );
+        }
+        transaction.commit();
+    } catch ( const runtime_error &e ) {
+        *errMsg = QObject::tr( "Failed to read trace archive %1: %2" ).arg( file->fileName() ).arg( e.what() );
+        return false;
+    }
+    return true;
+}
+
+QSqlDatabase ColumnarArchive::extract( const QString &fileName,
+                                       const QString &databaseFileName,
+                                       QString *errMsg,
+                                       const QDateTime &from,
+                                       const QDateTime &to )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) ) {
+        *errMsg = QObject::tr( "Failed to open trace archive %1: %2" ).arg( fileName ).arg( file.errorString() );
+        return QSqlDatabase();
+    }
+
+    const QByteArray footer = readFooter( &file, errMsg );
+    if ( footer.isEmpty() ) {
+        return QSqlDatabase();
+    }
+
+    {
+        QSqlDatabase db = Database::create( databaseFileName, errMsg );
+        if ( !db.isValid() ) {
+            return QSqlDatabase();
+        }
+        if ( restoreEntries( db, &file, footer, from, to, errMsg ) &&
+             Database::buildWatchLatest( db, errMsg ) ) {
+            QString indexErrMsg;
+            if ( Database::hasTextIndex( db ) && !Database::buildTextIndex( db, &indexErrMsg ) ) {
+                qWarning() << "Failed to build full-text index for" << fileName << ":" << indexErrMsg;
+            }
+            return db;
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase( databaseFileName );
+    return QSqlDatabase();
+}
+
+ColumnarArchiveConverter::ColumnarArchiveConverter( const QString &databaseFileName )
+    : m_databaseFileName( databaseFileName )
+{
+}
+
+void ColumnarArchiveConverter::run()
+{
+    const QString archiveFileName = ColumnarArchive::archiveFileNameFor( m_databaseFileName );
+    QString errMsg;
+    bool written = false;
+    {
+        QSqlDatabase db = Database::open( m_databaseFileName, &errMsg );
+        if ( db.isValid() ) {
+            written = ColumnarArchive::write( db, archiveFileName, &errMsg );
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase( m_databaseFileName );
+
+    if ( !written ) {
+        qWarning() << "Failed to convert archive database" << m_databaseFileName
+                   << "to" << archiveFileName << ":" << errMsg;
+        return;
+    }
+    if ( !QFile::remove( m_databaseFileName ) ) {
+        qWarning() << "Failed to remove archive database" << m_databaseFileName
+                   << "after converting it to" << archiveFileName;
+    }
+}
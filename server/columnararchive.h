@@ -0,0 +1,81 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_COLUMNARARCHIVE_H
+#define TRACER_COLUMNARARCHIVE_H
+
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QString>
+#include <QThread>
+
+/* Cold storage for archived trace entries. Instead of rows, an archive
+ * file holds blocks of up to BlockEntries entries in which each column is
+ * stored (and compressed) separately: ids and timestamps are delta
+ * encoded, trace point and thread ids are coded through a dictionary per
+ * block. The trace points, threads, processes etc. the entries refer to
+ * are kept in a footer, together with an index recording the offset and
+ * the id and timestamp ranges of each block, so that reading a time range
+ * only decompresses the blocks overlapping it.
+ *
+ * Archives are read-only; tools working on trace databases open them by
+ * extracting (a time range of) the entries into a new database.
+ */
+class ColumnarArchive
+{
+public:
+    static const int BlockEntries = 16384;
+
+    // Checks the file name suffix, see Database::isValidFileName
+    static bool isArchive( const QString &fileName );
+    // Name of the archive replacing the given archive database
+    static QString archiveFileNameFor( const QString &databaseFileName );
+
+    static bool write( QSqlDatabase db, const QString &fileName, QString *errMsg );
+
+    /* Creates a trace database with the given file name holding the
+     * archived entries with timestamps between from and to; invalid
+     * QDateTime values do not limit the range.
+     */
+    static QSqlDatabase extract( const QString &fileName,
+                                 const QString &databaseFileName,
+                                 QString *errMsg,
+                                 const QDateTime &from = QDateTime(),
+                                 const QDateTime &to = QDateTime() );
+};
+
+/* Converts an archive database written by the DatabaseFeeder into a
+ * columnar archive in the background, removing the database on success.
+ */
+class ColumnarArchiveConverter : public QThread
+{
+public:
+    explicit ColumnarArchiveConverter( const QString &databaseFileName );
+
+protected:
+    virtual void run();
+
+private:
+    ColumnarArchiveConverter( const ColumnarArchiveConverter &other ); // disabled
+    void operator=( const ColumnarArchiveConverter &rhs ); // disabled
+
+    const QString m_databaseFileName;
+};
+
+#endif // TRACER_COLUMNARARCHIVE_H
@@ -39,7 +39,8 @@ public:
 
 Transaction::Transaction( QSqlDatabase db )
     : m_query( db ),
-    m_commitChanges( true )
+    m_commitChanges( true ),
+    m_finished( false )
 {
     m_query.setForwardOnly( true );
     m_query.exec( "BEGIN TRANSACTION;" );
@@ -47,7 +48,22 @@ Transaction::Transaction( QSqlDatabase db )
 
 Transaction::~Transaction()
 {
-    m_query.exec( m_commitChanges ? "COMMIT;" : "ROLLBACK;" );
+    if ( !m_finished ) {
+        m_query.exec( m_commitChanges ? "COMMIT;" : "ROLLBACK;" );
+    }
+}
+
+void Transaction::commit()
+{
+    assert( m_commitChanges && !m_finished );
+    if ( !m_query.exec( "COMMIT;" ) ) {
+        m_commitChanges = false;
+        throw SQLTransactionException( QString( "Failed to store entries in database: committing transaction failed: %1" )
+                                        .arg( m_query.lastError().text() ),
+                                       m_query.lastError().text(),
+                                       m_query.lastError().number() );
+    }
+    m_finished = true;
 }
 
 QVariant Transaction::exec( const QString &statement )
@@ -79,7 +95,41 @@ QVariant Transaction::insert( const QString &statement )
     return m_query.lastInsertId();
 }
 
-const int Database::expectedVersion = 5;
+static SQLTransactionException preparedQueryFailed( const QSqlQuery &query )
+{
+    return SQLTransactionException( QString( "Failed to store entry in database: executing SQL command '%1' failed: %2" )
+                                     .arg( query.lastQuery() ).arg( query.lastError().text() ),
+                                    query.lastError().text(),
+                                    query.lastError().number() );
+}
+
+QVariant Transaction::exec( QSqlQuery &preparedQuery )
+{
+    if ( !preparedQuery.exec() ) {
+        m_commitChanges = false;
+        throw preparedQueryFailed( preparedQuery );
+    }
+    QVariant result;
+    if ( preparedQuery.next() ) {
+        result = preparedQuery.value( 0 );
+    }
+    // Resets the statement so that it does not keep the database locked
+    preparedQuery.finish();
+    return result;
+}
+
+QVariant Transaction::insert( QSqlQuery &preparedQuery )
+{
+    if ( !preparedQuery.exec() ) {
+        m_commitChanges = false;
+        throw preparedQueryFailed( preparedQuery );
+    }
+
+    assert( preparedQuery.driver()->hasFeature( QSqlDriver::LastInsertId ) );
+    return preparedQuery.lastInsertId();
+}
+
+const int Database::expectedVersion = 7;
 
 static const char * const schemaStatements[] = {
     "CREATE TABLE schema_downgrade (from_version INTEGER,"
@@ -119,14 +169,28 @@ static const char * const schemaStatements[] = {
     " type INTEGER);",
     "CREATE TABLE stackframe (trace_entry_id INTEGER,"
     " depth INTEGER,"
+    " frame_id INTEGER);",
+    "CREATE TABLE frame (id INTEGER PRIMARY KEY AUTOINCREMENT,"
     " module_name TEXT,"
     " function_name TEXT,"
     " offset INTEGER,"
     " file_name TEXT,"
-    " line INTEGER);",
+    " line INTEGER,"
+    " UNIQUE(module_name, function_name, offset, file_name, line));",
     "CREATE TABLE trace_point_group(id INTEGER PRIMARY KEY AUTOINCREMENT,"
     " name TEXT,"
-    " UNIQUE(name));"
+    " UNIQUE(name));",
+    "CREATE TABLE watch_latest (trace_point_id INTEGER,"
+    " traced_thread_id INTEGER,"
+    " trace_entry_id INTEGER,"
+    " UNIQUE(trace_point_id, traced_thread_id));",
+    // covers the latest entry per trace point and thread lookups
+    "CREATE INDEX trace_entry_trace_point_index ON trace_entry(trace_point_id, traced_thread_id, id);",
+    "CREATE INDEX trace_entry_traced_thread_index ON trace_entry(traced_thread_id);",
+    "CREATE INDEX trace_entry_timestamp_index ON trace_entry(timestamp);",
+    "CREATE INDEX variable_trace_entry_index ON variable(trace_entry_id);",
+    // covers Database::backtraceForEntry
+    "CREATE INDEX stackframe_trace_entry_index ON stackframe(trace_entry_id, depth, frame_id);"
 };
 
 static const char * const downgradeStatementsInsert[] = {
@@ -135,7 +199,9 @@ static const char * const downgradeStatementsInsert[] = {
     "INSERT INTO schema_downgrade VALUES(2, 'NOT IMPLEMENTED');",
     "INSERT INTO schema_downgrade VALUES(3, 'NOT IMPLEMENTED');",
     "INSERT INTO schema_downgrade VALUES(4, 'NOT IMPLEMENTED');",
-    "INSERT INTO schema_downgrade VALUES(5, 'NOT IMPLEMENTED');"
+    "INSERT INTO schema_downgrade VALUES(5, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(6, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(7, 'DROP TABLE watch_latest;');"
 
 };
 
@@ -224,6 +290,11 @@ QSqlDatabase Database::create(const QString &fileName,
 
     query.exec("COMMIT;");
 
+    QString indexErrMsg;
+    if (!buildTextIndex(db, &indexErrMsg)) {
+        qWarning() << "Full-text index not available, searching messages will be slow:" << indexErrMsg;
+    }
+
     return db;
 }
 
@@ -373,6 +444,56 @@ static bool upgradeToVersion5(QSqlDatabase db, QString *errMsg)
     return true;
 }
 
+static bool upgradeToVersion6(QSqlDatabase db, QString *errMsg)
+{
+    const char* const statements[] = {
+	"BEGIN TRANSACTION;",
+	"CREATE TABLE frame (id INTEGER PRIMARY KEY AUTOINCREMENT, module_name TEXT, function_name TEXT, offset INTEGER, file_name TEXT, line INTEGER, UNIQUE(module_name, function_name, offset, file_name, line));",
+	"INSERT INTO frame SELECT DISTINCT NULL, module_name, function_name, offset, file_name, line FROM stackframe;",
+	"ALTER TABLE stackframe RENAME TO stackframe_backup;",
+	"CREATE TABLE stackframe (trace_entry_id INTEGER, depth INTEGER, frame_id INTEGER);",
+	"INSERT INTO stackframe SELECT stackframe_backup.trace_entry_id, stackframe_backup.depth, frame.id FROM stackframe_backup, frame"
+	" WHERE frame.module_name IS stackframe_backup.module_name AND frame.function_name IS stackframe_backup.function_name"
+	" AND frame.offset IS stackframe_backup.offset AND frame.file_name IS stackframe_backup.file_name AND frame.line IS stackframe_backup.line;",
+	"DROP TABLE stackframe_backup;",
+	"CREATE INDEX trace_entry_trace_point_index ON trace_entry(trace_point_id, traced_thread_id, id);",
+	"CREATE INDEX trace_entry_traced_thread_index ON trace_entry(traced_thread_id);",
+	"CREATE INDEX trace_entry_timestamp_index ON trace_entry(timestamp);",
+	"CREATE INDEX variable_trace_entry_index ON variable(trace_entry_id);",
+	"CREATE INDEX stackframe_trace_entry_index ON stackframe(trace_entry_id, depth, frame_id);",
+	downgradeStatementsInsert[6],
+	"COMMIT;" };
+    QSqlQuery query(db);
+    for (unsigned i = 0; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
+static bool upgradeToVersion7(QSqlDatabase db, QString *errMsg)
+{
+    const char* const statements[] = {
+	"BEGIN TRANSACTION;",
+	"CREATE TABLE watch_latest (trace_point_id INTEGER, traced_thread_id INTEGER, trace_entry_id INTEGER, UNIQUE(trace_point_id, traced_thread_id));",
+	"INSERT INTO watch_latest SELECT trace_point_id, traced_thread_id, MAX(id) FROM trace_entry"
+	" WHERE id IN (SELECT trace_entry_id FROM variable) GROUP BY trace_point_id, traced_thread_id;",
+	downgradeStatementsInsert[7],
+	"COMMIT;" };
+    QSqlQuery query(db);
+    for (unsigned i = 0; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
 static bool upgradeVersion(QSqlDatabase db, int version,
 			   QString *errMsg)
 {
@@ -382,6 +503,10 @@ static bool upgradeVersion(QSqlDatabase db, int version,
     case 4:
     return upgradeToVersion5(db, errMsg);
 	break;
+    case 5:
+	return upgradeToVersion6(db, errMsg);
+    case 6:
+	return upgradeToVersion7(db, errMsg);
     default:
 	*errMsg = QObject::tr("Automatic upgrade to version %1 is not implemented");
 	return false;
@@ -405,6 +530,14 @@ bool Database::upgrade(QSqlDatabase db, QString *errMsg)
 	if (!upgradeVersion(db, v, errMsg))
 	    return false;
     }
+
+    // Databases of older versions lack the (optional) full-text index
+    if (!hasTextIndex(db)) {
+        QString indexErrMsg;
+        if (!buildTextIndex(db, &indexErrMsg)) {
+            qWarning() << "Full-text index not available, searching messages will be slow:" << indexErrMsg;
+        }
+    }
     return true;
 }
 
@@ -430,17 +563,20 @@ QList<StackFrame> Database::backtraceForEntry(QSqlDatabase db,
 {
     const QString statement = QString(
                       "SELECT"
-                      " module_name,"
-                      " function_name,"
-                      " offset,"
-                      " file_name,"
-                      " line "
+                      " frame.module_name,"
+                      " frame.function_name,"
+                      " frame.offset,"
+                      " frame.file_name,"
+                      " frame.line "
                       "FROM"
-                      " stackframe "
+                      " stackframe,"
+                      " frame "
                       "WHERE"
-                      " trace_entry_id=%1 "
+                      " stackframe.trace_entry_id=%1 "
+                      "AND"
+                      " frame.id = stackframe.frame_id "
                       "ORDER BY"
-                      " depth" ).arg( entryId );
+                      " stackframe.depth" ).arg( entryId );
 
     QSqlQuery q( db );
     q.setForwardOnly( true );
@@ -507,8 +643,12 @@ void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
      * with a WHERE clause.
      */
     if ( nMostRecent == 0 ) {
+        const bool textIndex = hasTextIndex( db );
         Transaction transaction( db );
         transaction.exec( "DELETE FROM trace_entry;" );
+        if ( textIndex ) {
+            transaction.exec( "INSERT INTO trace_entry_text(trace_entry_text) VALUES('delete-all');" );
+        }
 
         // Resets all AUTOINCREMENT fields in trace_entry to zero
         transaction.exec( "DELETE FROM sqlite_sequence WHERE name='trace_entry';" );
@@ -520,6 +660,8 @@ void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
         transaction.exec( "DELETE FROM traced_thread;" );
         transaction.exec( "DELETE FROM variable;" );
         transaction.exec( "DELETE FROM stackframe;" );
+        transaction.exec( "DELETE FROM frame;" );
+        transaction.exec( "DELETE FROM watch_latest;" );
 #if 0 // cache for the user's convenenience
         transaction.exec( "DELETE FROM trace_point_group;" );
 #endif
@@ -529,6 +671,60 @@ void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
                   "entries not implemented yet!";
 }
 
+bool Database::hasTextIndex(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+    return query.exec("SELECT rowid FROM trace_entry_text LIMIT 0;");
+}
+
+bool Database::buildTextIndex(QSqlDatabase db, QString *errMsg)
+{
+    try {
+        Transaction transaction(db);
+        // Recreated, so indexes storing their own copy of the messages go away
+        transaction.exec("DROP TABLE IF EXISTS trace_entry_text;");
+        transaction.exec("CREATE VIRTUAL TABLE trace_entry_text"
+                         " USING fts5(message, content='trace_entry', content_rowid='id',"
+                         " tokenize='trigram');");
+        transaction.exec("INSERT INTO trace_entry_text(trace_entry_text) VALUES('rebuild');");
+        transaction.commit();
+    } catch (const SQLTransactionException &e) {
+        *errMsg = e.driverMessage();
+        return false;
+    }
+    return true;
+}
+
+bool Database::buildWatchLatest(QSqlDatabase db, QString *errMsg)
+{
+    try {
+        Transaction transaction(db);
+        transaction.exec("DELETE FROM watch_latest;");
+        transaction.exec("INSERT INTO watch_latest"
+                         " SELECT trace_point_id, traced_thread_id, MAX(id) FROM trace_entry"
+                         " WHERE id IN (SELECT trace_entry_id FROM variable)"
+                         " GROUP BY trace_point_id, traced_thread_id;");
+        transaction.commit();
+    } catch (const SQLTransactionException &e) {
+        *errMsg = e.driverMessage();
+        return false;
+    }
+    return true;
+}
+
+QString Database::messageContains(QSqlDatabase db,
+                                  const QString &entryIdField,
+                                  const QString &messageField,
+                                  const QString &text)
+{
+    // Trigrams do not help with shorter patterns
+    if (text.length() >= 3 && hasTextIndex(db)) {
+        return QString("%1 IN (SELECT rowid FROM trace_entry_text WHERE message LIKE '%%2%')")
+            .arg(entryIdField).arg(text);
+    }
+    return QString("%1 LIKE '%%2%'").arg(messageField).arg(text);
+}
+
 QList<TracedApplicationInfo> Database::tracedApplications(QSqlDatabase db)
 {
     const QString statement = QString(
@@ -132,12 +132,20 @@ public:
     QVariant exec( const QString &statement );
     QVariant insert( const QString &statement );
 
+    // Variants for statements which were prepared and had their values bound
+    QVariant exec( QSqlQuery &preparedQuery );
+    QVariant insert( QSqlQuery &preparedQuery );
+
+    // Commits right away (instead of in the destructor) so that errors can be reported
+    void commit();
+
 private:
     Transaction( const Transaction &other );
     void operator=( const Transaction &rhs );
 
     QSqlQuery m_query;
     bool m_commitChanges;
+    bool m_finished;
 };
 
 class Database
@@ -167,6 +175,31 @@ public:
     static void addGroupId(QSqlDatabase db, const QString &id);
 #endif
     static void trimTo(QSqlDatabase db, size_t nMostRecent);
+
+    /* Optional full-text index over the messages of trace entries (FTS5
+     * with the trigram tokenizer, so it serves LIKE '%...%' patterns). It
+     * is created along with new databases and when upgrading older ones,
+     * but missing with SQLite builds lacking FTS5, so callers have to fall
+     * back to plain LIKE then. The index reads the messages from
+     * trace_entry (external content) instead of storing a copy, so rows
+     * must be removed from it with the FTS5 'delete' command before the
+     * trace entries themselves are deleted.
+     */
+    static bool hasTextIndex(QSqlDatabase db);
+    // Creates the index if needed and (re)fills it from the trace entries
+    static bool buildTextIndex(QSqlDatabase db, QString *errMsg);
+    // SQL condition for entries whose message contains the given text
+    static QString messageContains(QSqlDatabase db,
+                                   const QString &entryIdField,
+                                   const QString &messageField,
+                                   const QString &text);
+
+    /* The watch_latest table holds the latest entry carrying variables for
+     * every trace point and thread, i.e. the current state of all watched
+     * variables. The feeder keeps it up to date; this recomputes it from
+     * the trace entries.
+     */
+    static bool buildWatchLatest(QSqlDatabase db, QString *errMsg);
     static QList<TracedApplicationInfo> tracedApplications(QSqlDatabase db);
 
     // Special cased since QSql* will loose the milliseconds of a QDateTime value
@@ -19,10 +19,13 @@
 
 #include "databasefeeder.h"
 
+#include "columnararchive.h"
 #include "database.h"
-#include "lru_cache.h"
 
+#include <QDebug>
 #include <QDir>
+#include <QHash>
+#include <QScopedPointer>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
@@ -33,535 +36,916 @@
 
 using namespace std;
 
-static bool getGroupId( QSqlDatabase db, Transaction *transaction, const QString &name, unsigned int *id )
+/* Maps values like path names to the ids of their rows. The tables hold
+ * all rows which were looked up or loaded so far (see EntryStore::loadCaches),
+ * so that storing an entry usually does not need to query the database at
+ * all; a table which reaches its maximum size is cleared.
+ */
+template <typename KeyType>
+class InternTable
 {
-    QVariant v = transaction->exec( QString( "SELECT id FROM trace_point_group WHERE name=%1;" ).arg( Database::formatValue( db, name ) ) );
-    if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO trace_point_group VALUES(NULL, %1);" ).arg( Database::formatValue( db, name ) ) );
-    }
-
-    if ( !id ) {
-        return true;
-    }
+public:
+    explicit InternTable( int maxSize ) : m_maxSize( maxSize ), m_hits( 0 ), m_misses( 0 ) { }
 
-    bool ok;
-    *id = v.toUInt( &ok );
-    return ok;
-}
+    void clear() { m_ids.clear(); }
+    bool isFull() const { return m_ids.size() >= m_maxSize; }
+    int size() const { return m_ids.size(); }
+    qulonglong hits() const { return m_hits; }
+    qulonglong misses() const { return m_misses; }
 
-class TraceKeyCache {
-public:
-    void update( QSqlDatabase db, Transaction *transaction,
-         const QString &groupName,
-         const QList<TraceKey> &traceKeys ) {
-        QList<TraceKey>::ConstIterator it, end = traceKeys.end();
-        for ( it = traceKeys.begin(); it != end; ++it ) {
-            if ( m_map.find( (*it).name ) == m_map.end() ) {
-                registerGroupName( db, transaction, (*it).name );
-            }
-        }
-        // in case the entry comes with a name not listed in the
-        // AUT-side configuration file
-        if ( !groupName.isNull() && m_map.find( groupName ) == m_map.end() ) {
-            registerGroupName( db, transaction, groupName );
-        }
-    }
-    void clear() {
-        m_map.clear();
-    }
-    unsigned int fetch( const QString &name ) const {
-        std::map<QString, unsigned int>::const_iterator it = m_map.find( name );
-        if ( it == m_map.end() ) {
-            throw runtime_error( QString( "Failed to find trace point group %1 in cache" ).arg( name ).toUtf8().constData() );
+    const unsigned int *find( const KeyType &key )
+    {
+        typename QHash<KeyType, unsigned int>::ConstIterator it = m_ids.constFind( key );
+        if ( it == m_ids.constEnd() ) {
+            ++m_misses;
+            return 0;
         }
-        return (*it).second;
+        ++m_hits;
+        return &it.value();
     }
-private:
-    void registerGroupName( QSqlDatabase db, Transaction *transaction, const QString &name )
+
+    void insert( const KeyType &key, unsigned int id )
     {
-        unsigned int id;
-        if ( !getGroupId( db, transaction, name, &id ) ) {
-            throw runtime_error( "Read non-numeric trace point group id from database - corrupt database?" );
+        if ( isFull() ) {
+            m_ids.clear();
         }
-        m_map[name] = id;
+        m_ids.insert( key, id );
     }
 
-    std::map<QString, unsigned int> m_map;
-} traceKeyCache;
+private:
+    QHash<KeyType, unsigned int> m_ids;
+    const int m_maxSize;
+    qulonglong m_hits;
+    qulonglong m_misses;
+};
 
-template <typename KeyType, typename IdType, int CacheSize = 10>
-class StorageCache
+static inline uint combineHash( uint seed, uint h )
 {
-public:
-    StorageCache() : m_lru( CacheSize ) { }
-    void clear()
-    {
-    m_lru.clear();
-    }
-protected:
-    typedef KeyType CacheKey;
+    return seed ^ ( h + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 ) );
+}
+
+// ### some portable, ready-made tuple template type would be nice
+struct TracePointTuple
+{
+    unsigned int type;
+    unsigned int pathId;
+    unsigned long lineno;
+    unsigned int functionId;
+    unsigned int groupId;
 
-    IdType* checkCache( const KeyType &key )
+    bool operator==(const TracePointTuple &tp) const
     {
-    return m_lru.fetch_ptr( key );
+        return type == tp.type && pathId == tp.pathId && lineno == tp.lineno &&
+               functionId == tp.functionId && groupId == tp.groupId;
     }
-    void cache( const KeyType &key, IdType id )
+};
+
+static inline uint qHash( const TracePointTuple &tp, uint seed = 0 )
+{
+    seed = combineHash( seed, qHash( tp.type ) );
+    seed = combineHash( seed, qHash( tp.pathId ) );
+    seed = combineHash( seed, qHash( quint64( tp.lineno ) ) );
+    seed = combineHash( seed, qHash( tp.functionId ) );
+    return combineHash( seed, qHash( tp.groupId ) );
+}
+
+struct FrameTuple
+{
+    QString module;
+    QString function;
+    size_t functionOffset;
+    QString sourceFile;
+    size_t lineNumber;
+
+    bool operator==(const FrameTuple &f) const
     {
-    m_lru.insert( key, id );
+        return functionOffset == f.functionOffset && lineNumber == f.lineNumber &&
+               function == f.function && sourceFile == f.sourceFile && module == f.module;
     }
+};
+
+static inline uint qHash( const FrameTuple &f, uint seed = 0 )
+{
+    seed = combineHash( seed, qHash( quint64( f.functionOffset ) ) );
+    seed = combineHash( seed, qHash( quint64( f.lineNumber ) ) );
+    seed = combineHash( seed, qHash( f.function ) );
+    seed = combineHash( seed, qHash( f.sourceFile ) );
+    return combineHash( seed, qHash( f.module ) );
+}
+
+/* Writes trace entries into one database. All statements are prepared
+ * once so that SQLite does not need to parse them again for every
+ * entry; the ids of paths, functions etc. are cached, starting with the
+ * ones which are in the database already. The cached ids are only valid
+ * for the database the store was created for, and they have to be
+ * reloaded via reloadCaches() whenever rows are deleted or a transaction
+ * is rolled back.
+ */
+class EntryStore
+{
+public:
+    EntryStore( QSqlDatabase db, int maxCachedIds );
+
+    void store( Transaction *transaction, const TraceEntry &e );
+    void clearCaches();
+    void reloadCaches();
+    DatabaseFeeder::CacheStatistics cacheStatistics() const;
+    // See Database::hasTextIndex
+    bool hasTextIndex() const { return m_hasTextIndex; }
 
 private:
-    LRUCache<KeyType, IdType> m_lru;
+    EntryStore( const EntryStore &other ); // disabled
+    void operator=( const EntryStore &rhs ); // disabled
+
+    QSqlQuery prepare( const char *statement );
+    void loadCaches();
+
+    unsigned int storeGroup( Transaction *transaction, const QString &groupName,
+                             const QList<TraceKey> &traceKeys );
+    unsigned int registerGroupName( Transaction *transaction, const QString &name );
+    unsigned int storePath( Transaction *transaction, const QString &path );
+    unsigned int storeFunction( Transaction *transaction, const QString &function );
+    unsigned int storeProcess( Transaction *transaction, const QString &processName,
+                               unsigned int pid, const QDateTime &processStartTime );
+    unsigned int storeThread( Transaction *transaction, unsigned int processId,
+                              unsigned int tid );
+    unsigned int storeTracePoint( Transaction *transaction, unsigned int type,
+                                  unsigned int pathId, unsigned long lineno,
+                                  unsigned int functionId, unsigned int groupId );
+    unsigned int storeFrame( Transaction *transaction, const StackFrame &frame );
+
+    QSqlDatabase m_db;
+    const bool m_hasTextIndex;
+
+    QSqlQuery m_selectGroup;
+    QSqlQuery m_insertGroup;
+    QSqlQuery m_selectPath;
+    QSqlQuery m_insertPath;
+    QSqlQuery m_selectFunction;
+    QSqlQuery m_insertFunction;
+    QSqlQuery m_selectProcess;
+    QSqlQuery m_insertProcess;
+    QSqlQuery m_selectThread;
+    QSqlQuery m_insertThread;
+    QSqlQuery m_selectTracePoint;
+    QSqlQuery m_insertTracePoint;
+    QSqlQuery m_insertTraceEntry;
+    QSqlQuery m_insertVariable;
+    QSqlQuery m_selectFrame;
+    QSqlQuery m_insertFrame;
+    QSqlQuery m_insertStackFrame;
+    QSqlQuery m_insertEntryText;
+    QSqlQuery m_upsertWatchLatest;
+
+    InternTable<QString> m_groupCache;
+    InternTable<QString> m_pathCache;
+    InternTable<QString> m_functionCache;
+    InternTable<QPair<QString, unsigned int> > m_processCache;
+    InternTable<QPair<unsigned int, unsigned int> > m_threadCache;
+    InternTable<TracePointTuple> m_tracePointCache;
+    InternTable<FrameTuple> m_frameCache;
+    const int m_maxCachedIds;
 };
 
-class PathCache : public StorageCache<QString, unsigned int> {
-public:
-    unsigned int store( QSqlDatabase db, Transaction *transaction,
-            const QString &path )
-    {
-    unsigned int *cachedId = checkCache( path );
-    if ( cachedId )
-        return *cachedId;
-    QVariant v = transaction->exec( QString( "SELECT id FROM path_name WHERE name=%1;" ).arg( Database::formatValue( db, path ) ) );
-    if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO path_name VALUES(NULL, %1);" ).arg( Database::formatValue( db, path ) ) );
+EntryStore::EntryStore( QSqlDatabase db, int maxCachedIds )
+    : m_db( db ),
+    m_hasTextIndex( Database::hasTextIndex( db ) ),
+    m_selectGroup( prepare( "SELECT id FROM trace_point_group WHERE name=?;" ) ),
+    m_insertGroup( prepare( "INSERT INTO trace_point_group VALUES(NULL, ?);" ) ),
+    m_selectPath( prepare( "SELECT id FROM path_name WHERE name=?;" ) ),
+    m_insertPath( prepare( "INSERT INTO path_name VALUES(NULL, ?);" ) ),
+    m_selectFunction( prepare( "SELECT id FROM function_name WHERE name=?;" ) ),
+    m_insertFunction( prepare( "INSERT INTO function_name VALUES(NULL, ?);" ) ),
+    m_selectProcess( prepare( "SELECT id FROM process WHERE pid=? AND start_time=?;" ) ),
+    m_insertProcess( prepare( "INSERT INTO process VALUES(NULL, ?, ?, ?, 0);" ) ),
+    m_selectThread( prepare( "SELECT id FROM traced_thread WHERE process_id=? AND tid=?;" ) ),
+    m_insertThread( prepare( "INSERT INTO traced_thread VALUES(NULL, ?, ?);" ) ),
+    m_selectTracePoint( prepare( "SELECT id FROM trace_point WHERE type=? AND path_id=? AND line=? AND function_id=? AND group_id=?;" ) ),
+    m_insertTracePoint( prepare( "INSERT INTO trace_point VALUES(NULL, ?, ?, ?, ?, ?);" ) ),
+    m_insertTraceEntry( prepare( "INSERT INTO trace_entry VALUES(NULL, ?, ?, ?, ?, ?);" ) ),
+    m_insertVariable( prepare( "INSERT INTO variable VALUES(?, ?, ?, ?);" ) ),
+    m_selectFrame( prepare( "SELECT id FROM frame WHERE module_name IS ? AND function_name IS ? AND offset IS ? AND file_name IS ? AND line IS ?;" ) ),
+    m_insertFrame( prepare( "INSERT INTO frame VALUES(NULL, ?, ?, ?, ?, ?);" ) ),
+    m_insertStackFrame( prepare( "INSERT INTO stackframe VALUES(?, ?, ?);" ) ),
+    m_insertEntryText( m_hasTextIndex ? prepare( "INSERT INTO trace_entry_text(rowid, message) VALUES(?, ?);" ) : QSqlQuery( db ) ),
+    m_upsertWatchLatest( prepare( "INSERT OR REPLACE INTO watch_latest VALUES(?, ?, ?);" ) ),
+    m_groupCache( maxCachedIds ),
+    m_pathCache( maxCachedIds ),
+    m_functionCache( maxCachedIds ),
+    m_processCache( maxCachedIds ),
+    m_threadCache( maxCachedIds ),
+    m_tracePointCache( maxCachedIds ),
+    m_frameCache( maxCachedIds ),
+    m_maxCachedIds( maxCachedIds )
+{
+    loadCaches();
+}
+
+QSqlQuery EntryStore::prepare( const char *statement )
+{
+    QSqlQuery q( m_db );
+    q.setForwardOnly( true );
+    if ( !q.prepare( QString::fromLatin1( statement ) ) ) {
+        throw runtime_error( QString( "Failed to prepare SQL command '%1': %2" ).arg( statement ).arg( q.lastError().text() ).toUtf8().constData() );
     }
-    bool ok;
-    unsigned int pathId = v.toUInt( &ok );
-    if ( !ok ) {
-        throw runtime_error( "Failed to store entry in database: read non-numeric path id from database - corrupt database?" );
+    return q;
+}
+
+void EntryStore::clearCaches()
+{
+    m_groupCache.clear();
+    m_pathCache.clear();
+    m_functionCache.clear();
+    m_processCache.clear();
+    m_threadCache.clear();
+    m_tracePointCache.clear();
+    m_frameCache.clear();
+}
+
+/* Fills the caches with the most recently added rows of each table, these
+ * are the ones which are most likely to be used by the next entries.
+ */
+void EntryStore::loadCaches()
+{
+    QSqlQuery q( m_db );
+    q.setForwardOnly( true );
+    const QString limit = QString( " ORDER BY id DESC LIMIT %1;" ).arg( m_maxCachedIds );
+
+    if ( q.exec( "SELECT id, name FROM trace_point_group" + limit ) ) {
+        while ( q.next() ) {
+            m_groupCache.insert( q.value( 1 ).toString(), q.value( 0 ).toUInt() );
+        }
     }
-    cache( path, pathId );
-    return pathId;
+    if ( q.exec( "SELECT id, name FROM path_name" + limit ) ) {
+        while ( q.next() ) {
+            m_pathCache.insert( q.value( 1 ).toString(), q.value( 0 ).toUInt() );
+        }
     }
-} pathCache;
-
-class FunctionCache : public StorageCache<QString, unsigned int> {
-public:
-    unsigned int store( QSqlDatabase db, Transaction *transaction,
-            const QString &function )
-    {
-    unsigned int *cachedId = checkCache( function );
-    if ( cachedId )
-        return *cachedId;
-    QVariant v = transaction->exec( QString( "SELECT id FROM function_name WHERE name=%1;" ).arg( Database::formatValue( db, function ) ) );
-    if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO function_name VALUES(NULL, %1);" ).arg( Database::formatValue( db, function ) ) );
+    if ( q.exec( "SELECT id, name FROM function_name" + limit ) ) {
+        while ( q.next() ) {
+            m_functionCache.insert( q.value( 1 ).toString(), q.value( 0 ).toUInt() );
+        }
     }
-    bool ok;
-    unsigned int functionId = v.toUInt( &ok );
-    if ( !ok ) {
-        throw runtime_error( "Failed to store entry in database: read non-numeric function id from database - corrupt database?" );
+    if ( q.exec( "SELECT id, name, pid FROM process" + limit ) ) {
+        while ( q.next() ) {
+            m_processCache.insert( qMakePair( q.value( 1 ).toString(), q.value( 2 ).toUInt() ),
+                                   q.value( 0 ).toUInt() );
+        }
     }
-    cache( function, functionId );
-    return functionId;
+    if ( q.exec( "SELECT id, process_id, tid FROM traced_thread" + limit ) ) {
+        while ( q.next() ) {
+            m_threadCache.insert( qMakePair( q.value( 1 ).toUInt(), q.value( 2 ).toUInt() ),
+                                  q.value( 0 ).toUInt() );
+        }
     }
-} functionCache;
+    if ( q.exec( "SELECT id, type, path_id, line, function_id, group_id FROM trace_point" + limit ) ) {
+        while ( q.next() ) {
+            TracePointTuple key;
+            key.type = q.value( 1 ).toUInt();
+            key.pathId = q.value( 2 ).toUInt();
+            key.lineno = q.value( 3 ).toULongLong();
+            key.functionId = q.value( 4 ).toUInt();
+            key.groupId = q.value( 5 ).toUInt();
+            m_tracePointCache.insert( key, q.value( 0 ).toUInt() );
+        }
+    }
+    if ( q.exec( "SELECT id, module_name, function_name, offset, file_name, line FROM frame" + limit ) ) {
+        while ( q.next() ) {
+            FrameTuple key;
+            key.module = q.value( 1 ).toString();
+            key.function = q.value( 2 ).toString();
+            key.functionOffset = q.value( 3 ).toULongLong();
+            key.sourceFile = q.value( 4 ).toString();
+            key.lineNumber = q.value( 5 ).toULongLong();
+            m_frameCache.insert( key, q.value( 0 ).toUInt() );
+        }
+    }
+}
 
-class ProcessCache : public StorageCache<std::pair<QString, unsigned int>,
-                     unsigned int>
+void EntryStore::reloadCaches()
 {
-public:
-    unsigned int store( QSqlDatabase db, Transaction *transaction,
-            const QString &processName,
-            unsigned int pid,
-            const QDateTime &processStartTime )
-    {
-    CacheKey key( processName, pid );
-    unsigned int *cachedId = checkCache( key );
-    if ( cachedId )
-        return *cachedId;
-    QVariant v = transaction->exec( QString( "SELECT id FROM process WHERE pid=%1 AND start_time=%2;" ).arg( pid ).arg( Database::formatValue( db, processStartTime ) ) );
+    clearCaches();
+    loadCaches();
+}
+
+DatabaseFeeder::CacheStatistics EntryStore::cacheStatistics() const
+{
+    DatabaseFeeder::CacheStatistics stats;
+    stats.hits = m_groupCache.hits() + m_pathCache.hits() + m_functionCache.hits() +
+                 m_processCache.hits() + m_threadCache.hits() +
+                 m_tracePointCache.hits() + m_frameCache.hits();
+    stats.misses = m_groupCache.misses() + m_pathCache.misses() + m_functionCache.misses() +
+                   m_processCache.misses() + m_threadCache.misses() +
+                   m_tracePointCache.misses() + m_frameCache.misses();
+    stats.size = m_groupCache.size() + m_pathCache.size() + m_functionCache.size() +
+                 m_processCache.size() + m_threadCache.size() +
+                 m_tracePointCache.size() + m_frameCache.size();
+    return stats;
+}
+
+static unsigned int fetchOrInsert( Transaction *transaction, QSqlQuery &select, QSqlQuery &insert,
+                                   const char *what )
+{
+    QVariant v = transaction->exec( select );
     if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO process VALUES(NULL, %1, %2, %3, 0);" ).arg( Database::formatValue( db, processName ) ).arg( pid ).arg( Database::formatValue( db, processStartTime ) ) );
+        v = transaction->insert( insert );
     }
     bool ok;
-    unsigned int processId = v.toUInt( &ok );
+    const unsigned int id = v.toUInt( &ok );
     if ( !ok ) {
-        throw runtime_error( "Failed to store entry in database: read non-numeric process id from database - corrupt database?" );
+        throw runtime_error( QString( "Failed to store entry in database: read non-numeric %1 id from database - corrupt database?" ).arg( what ).toUtf8().constData() );
     }
-    cache( key, processId );
-    return processId;
-    }
-} processCache;
+    return id;
+}
 
-class ThreadCache : public StorageCache<std::pair<unsigned int, unsigned int>,
-                    unsigned int>
+unsigned int EntryStore::registerGroupName( Transaction *transaction, const QString &name )
 {
-public:
-    unsigned int store( QSqlDatabase db, Transaction *transaction,
-            unsigned int processId,
-            unsigned int tid )
-    {
-    CacheKey key( processId, tid );
-    unsigned int *cachedId = checkCache( key );
-    if ( cachedId )
-        return *cachedId;
+    m_selectGroup.bindValue( 0, name );
+    m_insertGroup.bindValue( 0, name );
+    const unsigned int id = fetchOrInsert( transaction, m_selectGroup, m_insertGroup, "trace point group" );
+    m_groupCache.insert( name, id );
+    return id;
+}
 
-    QVariant v = transaction->exec( QString( "SELECT id FROM traced_thread WHERE process_id=%1 AND tid=%2;" ).arg( processId ).arg( tid ) );
-    if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO traced_thread VALUES(NULL, %1, %2);" ).arg( processId ).arg( tid ) );
+unsigned int EntryStore::storeGroup( Transaction *transaction,
+                                     const QString &groupName,
+                                     const QList<TraceKey> &traceKeys )
+{
+    QList<TraceKey>::ConstIterator it, end = traceKeys.end();
+    for ( it = traceKeys.begin(); it != end; ++it ) {
+        if ( !m_groupCache.find( (*it).name ) ) {
+            registerGroupName( transaction, (*it).name );
+        }
     }
-    bool ok;
-    unsigned int threadId = v.toUInt( &ok );
-    if ( !ok ) {
-        throw runtime_error( "Failed to store entry in database: read non-numeric traced thread id from database - corrupt database?" );
+
+    if ( groupName.isNull() ) {
+        return 0;
     }
-    cache( key, threadId );
-    return threadId;
+
+    // in case the entry comes with a name not listed in the
+    // AUT-side configuration file
+    const unsigned int *cachedId = m_groupCache.find( groupName );
+    if ( !cachedId ) {
+        return registerGroupName( transaction, groupName );
     }
-} threadCache;
+    return *cachedId;
+}
 
-static unsigned int storeGroup( QSqlDatabase db, Transaction *transaction,
-                const QString &groupName,
-                const QList<TraceKey> &traceKeys )
+unsigned int EntryStore::storePath( Transaction *transaction, const QString &path )
 {
-    traceKeyCache.update( db, transaction, groupName, traceKeys );
+    const unsigned int *cachedId = m_pathCache.find( path );
+    if ( cachedId )
+        return *cachedId;
+    m_selectPath.bindValue( 0, path );
+    m_insertPath.bindValue( 0, path );
+    const unsigned int pathId = fetchOrInsert( transaction, m_selectPath, m_insertPath, "path" );
+    m_pathCache.insert( path, pathId );
+    return pathId;
+}
 
-    unsigned int groupId = 0;
-    if ( !groupName.isNull() ) {
-    groupId = traceKeyCache.fetch( groupName );
-    }
-    return groupId;
+unsigned int EntryStore::storeFunction( Transaction *transaction, const QString &function )
+{
+    const unsigned int *cachedId = m_functionCache.find( function );
+    if ( cachedId )
+        return *cachedId;
+    m_selectFunction.bindValue( 0, function );
+    m_insertFunction.bindValue( 0, function );
+    const unsigned int functionId = fetchOrInsert( transaction, m_selectFunction, m_insertFunction, "function" );
+    m_functionCache.insert( function, functionId );
+    return functionId;
 }
 
-// ### some portable, ready-made tuple template type would be nice
-struct TracePointTuple
+unsigned int EntryStore::storeProcess( Transaction *transaction,
+                                       const QString &processName,
+                                       unsigned int pid,
+                                       const QDateTime &processStartTime )
 {
-    unsigned int type;
-    unsigned int pathId;
-    unsigned long lineno;
-    unsigned int functionId;
-    unsigned int groupId;
+    const QPair<QString, unsigned int> key( processName, pid );
+    const unsigned int *cachedId = m_processCache.find( key );
+    if ( cachedId )
+        return *cachedId;
+    // QSql* would loose the milliseconds of a QDateTime value, see Database::formatValue
+    const qint64 startTime = processStartTime.toMSecsSinceEpoch();
+    m_selectProcess.bindValue( 0, pid );
+    m_selectProcess.bindValue( 1, startTime );
+    m_insertProcess.bindValue( 0, processName );
+    m_insertProcess.bindValue( 1, pid );
+    m_insertProcess.bindValue( 2, startTime );
+    const unsigned int processId = fetchOrInsert( transaction, m_selectProcess, m_insertProcess, "process" );
+    m_processCache.insert( key, processId );
+    return processId;
+}
 
-    bool operator<(const TracePointTuple &tp) const
-    {
-        if ( type != tp.type ) return type < tp.type;
-        if ( pathId != tp.pathId ) return pathId < tp.pathId;
-        if ( lineno != tp.lineno ) return lineno < tp.lineno;
-        if ( functionId != tp.functionId ) return functionId < tp.functionId;
-        if ( groupId != tp.groupId ) return groupId < tp.groupId;
-        return false;
-    };
-};
+unsigned int EntryStore::storeThread( Transaction *transaction,
+                                      unsigned int processId,
+                                      unsigned int tid )
+{
+    const QPair<unsigned int, unsigned int> key( processId, tid );
+    const unsigned int *cachedId = m_threadCache.find( key );
+    if ( cachedId )
+        return *cachedId;
+    m_selectThread.bindValue( 0, processId );
+    m_selectThread.bindValue( 1, tid );
+    m_insertThread.bindValue( 0, processId );
+    m_insertThread.bindValue( 1, tid );
+    const unsigned int threadId = fetchOrInsert( transaction, m_selectThread, m_insertThread, "traced thread" );
+    m_threadCache.insert( key, threadId );
+    return threadId;
+}
 
-class TracePointCache : public StorageCache<TracePointTuple,
-                        unsigned int>
+unsigned int EntryStore::storeTracePoint( Transaction *transaction,
+                                          unsigned int type,
+                                          unsigned int pathId,
+                                          unsigned long lineno,
+                                          unsigned int functionId,
+                                          unsigned int groupId )
 {
-public:
-    unsigned int store( QSqlDatabase db, Transaction *transaction,
-            unsigned int type,
-            unsigned int pathId,
-            unsigned long lineno,
-            unsigned int functionId,
-            unsigned int groupId )
-    {
-    CacheKey key;
+    TracePointTuple key;
     key.type = type;
     key.pathId = pathId;
     key.lineno = lineno;
     key.functionId = functionId;
     key.groupId = groupId;
-    unsigned int *cachedId = checkCache( key );
+    const unsigned int *cachedId = m_tracePointCache.find( key );
     if ( cachedId )
         return *cachedId;
-    QVariant v = transaction->exec( QString( "SELECT id FROM trace_point WHERE type=%1 AND path_id=%2 AND line=%3 AND function_id=%4 AND group_id=%5;" ).arg( type ).arg( pathId ).arg( lineno ).arg( functionId ).arg( groupId ) );
-    if ( !v.isValid() ) {
-        v = transaction->insert( QString( "INSERT INTO trace_point VALUES(NULL, %1, %2, %3, %4, %5);" ).arg( type ).arg( pathId ).arg( lineno ).arg( functionId ).arg( groupId ) );
+    QSqlQuery *queries[] = { &m_selectTracePoint, &m_insertTracePoint };
+    for ( int i = 0; i < 2; ++i ) {
+        queries[i]->bindValue( 0, type );
+        queries[i]->bindValue( 1, pathId );
+        queries[i]->bindValue( 2, qulonglong( lineno ) );
+        queries[i]->bindValue( 3, functionId );
+        queries[i]->bindValue( 4, groupId );
     }
-    bool ok;
-    unsigned int tracepointId = v.toUInt( &ok );
-    if ( !ok ) {
-        throw runtime_error( "Failed to store entry in database: read non-numeric tracepoint id from database - corrupt database?" );
-    }
-    cache( key, tracepointId );
+    const unsigned int tracepointId = fetchOrInsert( transaction, m_selectTracePoint, m_insertTracePoint, "tracepoint" );
+    m_tracePointCache.insert( key, tracepointId );
     return tracepointId;
-    }
-} tracePointCache;
+}
 
-static unsigned int storeTraceEntry( QSqlDatabase db, Transaction *transaction,
-                     unsigned int threadId,
-                     const QDateTime &timestamp,
-                     unsigned int pointId,
-                     const QString &message,
-                     unsigned long stackPosition )
+unsigned int EntryStore::storeFrame( Transaction *transaction, const StackFrame &frame )
 {
-    return transaction->insert( QString( "INSERT INTO trace_entry VALUES(NULL, " + QString::number( threadId )
-                                         + ", " + Database::formatValue( db, timestamp )
-                                         + ", " + QString::number( pointId )
-                                         + ", " + Database::formatValue( db, message )
-                                         + ", " + QString::number( stackPosition )
-                                         + ")" ) ).toUInt();
+    FrameTuple key;
+    key.module = frame.module;
+    key.function = frame.function;
+    key.functionOffset = frame.functionOffset;
+    key.sourceFile = frame.sourceFile;
+    key.lineNumber = frame.lineNumber;
+    const unsigned int *cachedId = m_frameCache.find( key );
+    if ( cachedId )
+        return *cachedId;
+    QSqlQuery *queries[] = { &m_selectFrame, &m_insertFrame };
+    for ( int i = 0; i < 2; ++i ) {
+        queries[i]->bindValue( 0, frame.module );
+        queries[i]->bindValue( 1, frame.function );
+        queries[i]->bindValue( 2, qulonglong( frame.functionOffset ) );
+        queries[i]->bindValue( 3, frame.sourceFile );
+        queries[i]->bindValue( 4, qulonglong( frame.lineNumber ) );
+    }
+    const unsigned int frameId = fetchOrInsert( transaction, m_selectFrame, m_insertFrame, "stack frame" );
+    m_frameCache.insert( key, frameId );
+    return frameId;
 }
 
-static void storeVariables( QSqlDatabase db, Transaction *transaction,
-                unsigned int traceentryId,
-                const QList<Variable> &variables )
+void EntryStore::store( Transaction *transaction, const TraceEntry &e )
 {
-    QList<Variable>::ConstIterator it, end = variables.end();
-    for ( it = variables.begin(); it != end; ++it ) {
-        transaction->exec( QString( "INSERT INTO variable VALUES(" + QString::number( traceentryId )
-                                    + ", " + Database::formatValue( db, it->name )
-                                    + ", " + Database::formatValue( db, it->value )
-                                    + ", " + QString::number( it->type )
-                                    + ")" ) );
+    const unsigned int pathId = storePath( transaction, e.path );
+    const unsigned int functionId = storeFunction( transaction, e.function );
+    const unsigned int processId = storeProcess( transaction, e.processName,
+                                                 e.pid, e.processStartTime );
+    const unsigned int threadId = storeThread( transaction, processId, e.tid );
+    const unsigned int groupId = storeGroup( transaction, e.groupName, e.traceKeys );
+    const unsigned int tracepointId = storeTracePoint( transaction,
+                                                       e.type, pathId, e.lineno,
+                                                       functionId, groupId );
+
+    m_insertTraceEntry.bindValue( 0, threadId );
+    m_insertTraceEntry.bindValue( 1, e.timestamp.toMSecsSinceEpoch() );
+    m_insertTraceEntry.bindValue( 2, tracepointId );
+    m_insertTraceEntry.bindValue( 3, e.message );
+    m_insertTraceEntry.bindValue( 4, qulonglong( e.stackPosition ) );
+    const unsigned int traceentryId = transaction->insert( m_insertTraceEntry ).toUInt();
+
+    QList<Variable>::ConstIterator it, end = e.variables.end();
+    for ( it = e.variables.begin(); it != end; ++it ) {
+        m_insertVariable.bindValue( 0, traceentryId );
+        m_insertVariable.bindValue( 1, it->name );
+        m_insertVariable.bindValue( 2, it->value );
+        m_insertVariable.bindValue( 3, int( it->type ) );
+        transaction->exec( m_insertVariable );
+    }
+
+    // See Database::buildWatchLatest
+    if ( !e.variables.isEmpty() ) {
+        m_upsertWatchLatest.bindValue( 0, tracepointId );
+        m_upsertWatchLatest.bindValue( 1, threadId );
+        m_upsertWatchLatest.bindValue( 2, traceentryId );
+        transaction->exec( m_upsertWatchLatest );
     }
-}
 
-static void storeBacktrace( QSqlDatabase db, Transaction *transaction,
-                unsigned int traceentryId,
-                const QList<StackFrame> &backtrace )
+    if ( m_hasTextIndex ) {
+        m_insertEntryText.bindValue( 0, traceentryId );
+        m_insertEntryText.bindValue( 1, e.message );
+        transaction->exec( m_insertEntryText );
+    }
 
-{
     unsigned int depthCount = 0;
-    QList<StackFrame>::ConstIterator it, end = backtrace.end();
-    for ( it = backtrace.begin(); it != end; ++it, ++depthCount ) {
-        transaction->exec( QString( "INSERT INTO stackframe VALUES(" + QString::number( traceentryId )
-                                    + ", " + QString::number( depthCount )
-                                    + ", " + Database::formatValue( db, it->module )
-                                    + ", " + Database::formatValue( db, it->function )
-                                    + ", " + QString::number( it->functionOffset )
-                                    + ", " + Database::formatValue( db, it->sourceFile )
-                                    + ", " + QString::number( it->lineNumber )
-                                    + ")" ) );
-    }
-}
-
-static void storeEntry( QSqlDatabase db, Transaction *transaction, const TraceEntry &e )
-{
-    unsigned int pathId = pathCache.store( db, transaction, e.path );
-    unsigned int functionId = functionCache.store( db, transaction, e.function );
-    unsigned int processId = processCache.store( db, transaction, e.processName,
-                         e.pid, e.processStartTime );
-    unsigned int threadId = threadCache.store( db, transaction, processId, e.tid );
-    unsigned int groupId = storeGroup( db, transaction,
-                       e.groupName,
-                       e.traceKeys );
-    unsigned int tracepointId = tracePointCache.store( db, transaction,
-                               e.type, pathId, e.lineno,
-                               functionId, groupId );
-    unsigned int traceentryId = storeTraceEntry( db, transaction,
-                         threadId,
-                         e.timestamp,
-                         tracepointId,
-                         e.message,
-                         e.stackPosition );
-    storeVariables( db, transaction, traceentryId, e.variables );
-    storeBacktrace( db, transaction, traceentryId, e.backtrace );
+    QList<StackFrame>::ConstIterator fit, fend = e.backtrace.end();
+    for ( fit = e.backtrace.begin(); fit != fend; ++fit, ++depthCount ) {
+        const unsigned int frameId = storeFrame( transaction, *fit );
+        m_insertStackFrame.bindValue( 0, traceentryId );
+        m_insertStackFrame.bindValue( 1, depthCount );
+        m_insertStackFrame.bindValue( 2, frameId );
+        transaction->exec( m_insertStackFrame );
+    }
 }
 
+/* Archives are numbered; archive databases are replaced by columnar
+ * archives once they are complete, so the next number is derived from the
+ * highest one in use instead of from the number of files.
+ */
 static QString archiveFileName( const QString &archiveDirName, const QString &currentFileName )
 {
     const QDir archiveDir( archiveDirName );
+    const QString fileName = QFileInfo( currentFileName ).fileName();
+    const QString columnarFileName = QFileInfo( ColumnarArchive::archiveFileNameFor( currentFileName ) ).fileName();
 
     const QStringList entries = archiveDir.entryList( QStringList()
-                                                      << "*-" + QFileInfo( currentFileName ).fileName() );
+                                                      << "*-" + fileName
+                                                      << "*-" + columnarFileName );
+    int lastNumber = 0;
+    QStringList::ConstIterator it, end = entries.end();
+    for ( it = entries.begin(); it != end; ++it ) {
+        bool ok;
+        const int number = it->section( '-', 0, 0 ).toInt( &ok );
+        if ( ok && number > lastNumber ) {
+            lastNumber = number;
+        }
+    }
     return QString( "%1/%2-%3" )
         .arg( archiveDirName )
-        .arg( entries.size() + 1 )
-        .arg( QFileInfo( currentFileName ).fileName() );
+        .arg( lastNumber + 1 )
+        .arg( fileName );
 }
 
-static void archiveEntries( QSqlDatabase db, unsigned short percentage, const QString &archiveDir )
+static qulonglong pragmaValue( QSqlDatabase db, const char *pragma )
 {
-    if ( percentage == 0 ) {
-        return;
+    QSqlQuery q = db.exec( QString( "PRAGMA %1;" ).arg( pragma ) );
+    if ( !q.next() ) {
+        return 0;
     }
+    return q.value( 0 ).toULongLong();
+}
 
-    if ( percentage > 100 ) {
-        percentage = 100;
+/* Archiving moves the oldest entries into a new database in the archive
+ * directory, which is attached to the trace database as 'archive' for the
+ * time being. The rows keep their ids, so each table can be copied with a
+ * single INSERT ... SELECT per chunk of entries. Rows of trace points,
+ * functions etc. which are not referenced anymore are only deleted when
+ * all chunks were moved, so the ids cached by the EntryStore stay valid
+ * until then. Finally, the archive database is converted into a columnar
+ * archive in the background.
+ */
+bool DatabaseFeeder::aboveHighWaterMark() const
+{
+    if ( m_maxPageCount == 0 ) {
+        return false;
     }
+    const qulonglong usedPages = pragmaValue( m_db, "page_count" ) - pragmaValue( m_db, "freelist_count" );
+    return usedPages * 100 >= m_maxPageCount * ArchiveHighWaterPercentage;
+}
+
+bool DatabaseFeeder::startArchiving()
+{
+    assert( m_archiveFileName.isEmpty() );
 
-    Transaction transaction( db );
-    qulonglong numCopy = 0;
+    qulonglong firstId = 0;
+    qulonglong lastId = 0;
     {
-        QVariant v = transaction.exec( QString( "SELECT ROUND(COUNT(id) / 100.0 * %1) FROM trace_entry;" ).arg( percentage ) );
-        bool ok;
-        numCopy = v.toULongLong( &ok );
-        if ( !ok ) {
-            throw runtime_error( "Failed to count number of entries to archive" );
+        QSqlQuery q = m_db.exec( "SELECT MIN(id), MAX(id) FROM trace_entry;" );
+        if ( !q.next() || q.value( 0 ).isNull() ) {
+            return false;
         }
+        firstId = q.value( 0 ).toULongLong();
+        lastId = q.value( 1 ).toULongLong();
+    }
+
+    if ( !QDir().mkpath( m_archiveDir ) ) {
+        throw runtime_error( QString( "Failed to create archive database: creating archive directory %1 failed" ).arg( m_archiveDir ).toUtf8().constData() );
     }
 
-    QString connName;
+    const QString fn = archiveFileName( m_archiveDir, m_db.databaseName() );
     {
-        QSqlDatabase archiveDB;
+        QString connName;
         {
-            if ( !QDir().mkpath( archiveDir ) ) {
-                throw runtime_error( QString( "Failed to create archive database: creating archive directory %1 failed" ).arg( archiveDir ).toUtf8().constData() );
-            }
-
-            const QString fn = archiveFileName( archiveDir, db.databaseName() );
             QString errorMsg;
-            archiveDB = Database::create( fn, &errorMsg );
+            QSqlDatabase archiveDB = Database::create( fn, &errorMsg );
             if ( !archiveDB.isValid() ) {
                 throw runtime_error( QString( "Failed to create database in %1: %2" ).arg( fn ).arg( errorMsg ).toUtf8().constData() );
             }
+            connName = archiveDB.connectionName();
+            archiveDB.close();
         }
-        connName = archiveDB.connectionName();
+        QSqlDatabase::removeDatabase( connName );
+    }
 
-        {
-            QString query = QString( "SELECT"
-                            " trace_entry.id,"
-                            " process.pid,"
-                            " process.start_time,"
-                            " process.name,"
-                            " traced_thread.tid,"
-                            " trace_entry.timestamp,"
-                            " trace_point.type,"
-                            " path_name.name,"
-                            " trace_point.line,"
-                            " trace_point.group_id,"
-                            " function_name.name,"
-                            " trace_entry.message, "
-                            " trace_entry.stack_position "
-                            "FROM"
-                            " trace_entry,"
-                            " trace_point,"
-                            " path_name,"
-                            " function_name,"
-                            " process,"
-                            " traced_thread "
-                            "WHERE"
-                            " trace_entry.trace_point_id = trace_point.id "
-                            "AND"
-                            " trace_point.function_id = function_name.id "
-                            "AND"
-                            " trace_point.path_id = path_name.id "
-                            "AND"
-                            " trace_entry.traced_thread_id = traced_thread.id "
-                            "AND"
-                            " traced_thread.process_id = process.id "
-                            "ORDER BY"
-                            " trace_entry.id "
-                            "LIMIT"
-                            " %1" ).arg( numCopy );
-
-            QSqlQuery q( db );
-            q.setForwardOnly( true );
-            if ( !q.exec( query ) ) {
-                throw runtime_error( QString( "Cannot archive trace data: failed to extract entry data: %1" ).arg( q.lastError().text() ).toUtf8().constData() );
-            }
+    QSqlQuery attach( m_db );
+    if ( !attach.prepare( "ATTACH DATABASE ? AS archive;" ) ) {
+        throw runtime_error( QString( "Failed to attach archive database %1: %2" ).arg( fn ).arg( attach.lastError().text() ).toUtf8().constData() );
+    }
+    attach.bindValue( 0, fn );
+    if ( !attach.exec() ) {
+        throw runtime_error( QString( "Failed to attach archive database %1: %2" ).arg( fn ).arg( attach.lastError().text() ).toUtf8().constData() );
+    }
 
-            Transaction archiveTransaction( archiveDB );
-            while ( q.next() ) {
-                qulonglong id = q.value( 0 ).toULongLong();
-
-                TraceEntry e;
-                e.pid = q.value( 1 ).toUInt();
-                e.processStartTime = QDateTime::fromMSecsSinceEpoch( q.value( 2 ).toLongLong() );
-                e.processName = q.value( 3 ).toString();
-                e.tid = q.value( 4 ).toUInt();
-                e.timestamp = QDateTime::fromMSecsSinceEpoch( q.value( 5 ).toLongLong() );
-                e.type = q.value( 6 ).toUInt();
-                e.path = q.value( 7 ).toString();
-                e.lineno = q.value( 8 ).toULongLong();
-
-                const int groupId = q.value( 9 ).toInt();
-                if ( groupId != 0 ) {
-                    QSqlQuery gq( db );
-                    gq.setForwardOnly( true );
-                    if ( gq.exec( QString( "SELECT name FROM trace_point_group WHERE id = %1" ).arg( groupId ) ) ) {
-                        if ( gq.next() ) {
-                            e.groupName = gq.value( 0 ).toString();
-                        }
-                    }
-                }
+    const qulonglong numMove = qMax( ( lastId - firstId + 1 ) * m_shrinkBy / 100, qulonglong( 1 ) );
+    m_archiveFileName = fn;
+    m_archivedUpToId = firstId - 1;
+    m_archiveLastId = firstId + numMove - 1;
+    return true;
+}
 
-                e.function = q.value( 10 ).toString();
-                e.message = q.value( 11 ).toString();
-                e.stackPosition = q.value( 12 ).toULongLong();
-                e.backtrace = Database::backtraceForEntry( db, id );
-
-                {
-                    QSqlQuery vq( db );
-                    vq.setForwardOnly( true );
-                    if ( vq.exec( QString( "SELECT "
-                                    " name,"
-                                    " type,"
-                                    " value "
-                                    "FROM "
-                                    " variable "
-                                    "WHERE"
-                                    " trace_entry_id = %1" ).arg( id ) ) ) {
-                        while ( vq.next() ) {
-                            Variable v;
-                            v.name = vq.value( 0 ).toString();
-                            v.type = (TRACELIB_NAMESPACE_IDENT(VariableType)::Value)( vq.value( 1 ).toInt() );
-                            v.value = vq.value( 2 ).toString();
-                            e.variables.append( v );
-                        }
-                    }
-                }
-                ::storeEntry( archiveDB, &archiveTransaction, e );
-            }
-        }
-    }
+void DatabaseFeeder::archiveChunk()
+{
+    assert( !m_archiveFileName.isEmpty() );
 
+    const qulonglong lastId = qMin( m_archivedUpToId + ArchiveChunkEntries, m_archiveLastId );
+    const QString idRange = QString( "BETWEEN %1 AND %2" ).arg( m_archivedUpToId + 1 ).arg( lastId );
+    const QString tracePoints = "FROM main.trace_point WHERE id IN (SELECT trace_point_id FROM main.trace_entry WHERE id " + idRange + ")";
+    const QString threads = "FROM main.traced_thread WHERE id IN (SELECT traced_thread_id FROM main.trace_entry WHERE id " + idRange + ")";
+
+    /* If this fails, the transaction is rolled back and the archive stays
+     * attached, so the next call moves the same chunk into the same archive.
+     */
     {
-        transaction.exec( QString( "DELETE FROM trace_entry WHERE id IN (SELECT id FROM trace_entry ORDER BY id LIMIT %1);" ).arg( numCopy ) );
+        Transaction transaction( m_db );
+        transaction.exec( "INSERT OR IGNORE INTO archive.trace_point_group SELECT * FROM main.trace_point_group WHERE id IN (SELECT group_id " + tracePoints + ");" );
+        transaction.exec( "INSERT OR IGNORE INTO archive.path_name SELECT * FROM main.path_name WHERE id IN (SELECT path_id " + tracePoints + ");" );
+        transaction.exec( "INSERT OR IGNORE INTO archive.function_name SELECT * FROM main.function_name WHERE id IN (SELECT function_id " + tracePoints + ");" );
+        transaction.exec( "INSERT OR IGNORE INTO archive.trace_point SELECT * " + tracePoints + ";" );
+        // Replaces rows copied before, the end time might have been set meanwhile
+        transaction.exec( "INSERT OR REPLACE INTO archive.process SELECT * FROM main.process WHERE id IN (SELECT process_id " + threads + ");" );
+        transaction.exec( "INSERT OR IGNORE INTO archive.traced_thread SELECT * " + threads + ";" );
+        transaction.exec( "INSERT OR IGNORE INTO archive.frame SELECT * FROM main.frame WHERE id IN (SELECT frame_id FROM main.stackframe WHERE trace_entry_id " + idRange + ");" );
+        transaction.exec( "INSERT INTO archive.trace_entry SELECT * FROM main.trace_entry WHERE id " + idRange + ";" );
+        transaction.exec( "INSERT INTO archive.variable SELECT * FROM main.variable WHERE trace_entry_id " + idRange + ";" );
+        transaction.exec( "INSERT INTO archive.stackframe SELECT * FROM main.stackframe WHERE trace_entry_id " + idRange + ";" );
+        // Chunks are archived in ascending order, so later chunks replace the rows
+        transaction.exec( "INSERT OR REPLACE INTO archive.watch_latest SELECT trace_point_id, traced_thread_id, MAX(id) FROM main.trace_entry"
+                          " WHERE id IN (SELECT trace_entry_id FROM main.variable WHERE trace_entry_id " + idRange + ")"
+                          " GROUP BY trace_point_id, traced_thread_id;" );
+        transaction.exec( "DELETE FROM main.watch_latest WHERE trace_entry_id " + idRange + ";" );
+        if ( m_store->hasTextIndex() ) {
+            transaction.exec( "INSERT INTO archive.trace_entry_text(rowid, message) SELECT id, message FROM main.trace_entry WHERE id " + idRange + ";" );
+            transaction.exec( "INSERT INTO main.trace_entry_text(trace_entry_text, rowid, message) SELECT 'delete', id, message FROM main.trace_entry WHERE id " + idRange + ";" );
+        }
 
-        transaction.exec( QString( "DELETE FROM trace_point WHERE id NOT IN (SELECT trace_point_id FROM trace_entry);" ) );
-        tracePointCache.clear();
+        transaction.exec( "DELETE FROM main.variable WHERE trace_entry_id " + idRange + ";" );
+        transaction.exec( "DELETE FROM main.stackframe WHERE trace_entry_id " + idRange + ";" );
+        transaction.exec( "DELETE FROM main.trace_entry WHERE id " + idRange + ";" );
+        transaction.commit();
+    }
 
-        transaction.exec( QString( "DELETE FROM function_name WHERE id NOT IN (SELECT function_id FROM trace_point);" ) );
-        functionCache.clear();
+    m_archivedUpToId = lastId;
+    if ( m_archivedUpToId >= m_archiveLastId ) {
+        finishArchiving();
+    }
+}
+
+void DatabaseFeeder::finishArchiving()
+{
+    {
+        Transaction transaction( m_db );
+        transaction.exec( QString( "DELETE FROM main.trace_point WHERE id NOT IN (SELECT trace_point_id FROM main.trace_entry);" ) );
+        transaction.exec( QString( "DELETE FROM main.function_name WHERE id NOT IN (SELECT function_id FROM main.trace_point);" ) );
+        transaction.exec( QString( "DELETE FROM main.path_name WHERE id NOT IN (SELECT path_id FROM main.trace_point);" ) );
+        transaction.exec( QString( "DELETE FROM main.trace_point_group WHERE id NOT IN (SELECT group_id FROM main.trace_point);" ) );
+        transaction.exec( QString( "DELETE FROM main.traced_thread WHERE id NOT IN (SELECT traced_thread_id FROM main.trace_entry);" ) );
+        transaction.exec( QString( "DELETE FROM main.process WHERE id NOT IN (SELECT process_id FROM main.traced_thread);" ) );
+        transaction.exec( QString( "DELETE FROM main.frame WHERE id NOT IN (SELECT frame_id FROM main.stackframe);" ) );
+        transaction.commit();
+    }
+    cancelArchiving();
+    m_store->reloadCaches();
+    archivedEntries();
+}
 
-        transaction.exec( QString( "DELETE FROM path_name WHERE id NOT IN (SELECT path_id FROM trace_point);" ) );
-        pathCache.clear();
+void DatabaseFeeder::convertArchive( const QString &archiveFileName )
+{
+    QList<ColumnarArchiveConverter *>::Iterator it = m_archiveConverters.begin();
+    while ( it != m_archiveConverters.end() ) {
+        if ( ( *it )->isFinished() ) {
+            delete *it;
+            it = m_archiveConverters.erase( it );
+        } else {
+            ++it;
+        }
+    }
 
-        transaction.exec( QString( "DELETE FROM trace_point_group WHERE id NOT IN (SELECT group_id FROM trace_point);" ) );
-        traceKeyCache.clear();
+    ColumnarArchiveConverter *converter = new ColumnarArchiveConverter( archiveFileName );
+    converter->start( QThread::LowPriority );
+    m_archiveConverters.append( converter );
+}
 
-        transaction.exec( QString( "DELETE FROM traced_thread WHERE id NOT IN (SELECT traced_thread_id FROM trace_entry);" ) );
-        threadCache.clear();
+/* Stops archiving without deleting any rows which are not referenced
+ * anymore. The entries moved so far are converted like a complete archive.
+ */
+void DatabaseFeeder::cancelArchiving()
+{
+    if ( m_archiveFileName.isEmpty() ) {
+        return;
+    }
+    const QString archiveFileName = m_archiveFileName;
+    m_archiveFileName.clear();
 
-        transaction.exec( QString( "DELETE FROM process WHERE id NOT IN (SELECT process_id FROM traced_thread);" ) );
-        processCache.clear();
+    QSqlQuery detach( m_db );
+    if ( !detach.exec( "DETACH DATABASE archive;" ) ) {
+        qWarning() << "Failed to detach archive database:" << detach.lastError().text();
+    }
+    convertArchive( archiveFileName );
+}
 
-        transaction.exec( QString( "DELETE FROM variable WHERE trace_entry_id NOT IN (SELECT id FROM trace_entry);" ) );
-        transaction.exec( QString( "DELETE FROM stackframe WHERE trace_entry_id NOT IN (SELECT id FROM trace_entry);" ) );
+/* Moves one chunk of entries into the archive if archiving is in progress
+ * or the database is filled up to the high-water mark. Called after
+ * committing a batch, so that ingest is interleaved with archiving instead
+ * of waiting for all old entries to be moved.
+ */
+void DatabaseFeeder::archiveIncrementally()
+{
+    if ( m_archiveFileName.isEmpty() && ( !aboveHighWaterMark() || !startArchiving() ) ) {
+        return;
     }
-    QSqlDatabase::removeDatabase( connName );
+    archiveChunk();
 }
 
-DatabaseFeeder::DatabaseFeeder( QSqlDatabase db )
+DatabaseFeeder::DatabaseFeeder( QSqlDatabase db, int maxCachedIds )
     : m_db( db )
+    , m_store( 0 )
+    , m_transaction( 0 )
+    , m_lastCommitMsecs( 0 )
     , m_shrinkBy( 0 )
     , m_maximumSize( StorageConfiguration::UnlimitedTraceSize )
+    , m_maxPageCount( 0 )
+    , m_archivedUpToId( 0 )
+    , m_archiveLastId( 0 )
 {
     assert( m_db.isValid() );
     m_db.exec( "PRAGMA synchronous=OFF;");
+    m_store = new EntryStore( m_db, maxCachedIds );
+}
+
+DatabaseFeeder::~DatabaseFeeder()
+{
+    try {
+        flushPendingEntries();
+    } catch ( const runtime_error &e ) {
+        qWarning() << "Failed to store pending trace entries:" << e.what();
+    }
+    delete m_transaction;
+    delete m_store;
+    cancelArchiving();
+
+    QList<ColumnarArchiveConverter *>::ConstIterator it, end = m_archiveConverters.end();
+    for ( it = m_archiveConverters.begin(); it != end; ++it ) {
+        ( *it )->wait();
+        delete *it;
+    }
 }
 
 void DatabaseFeeder::trimDb()
 {
+    flushPendingEntries();
+    cancelArchiving();
     Database::trimTo( m_db, 0 );
+    m_store->reloadCaches();
 }
 
 // Definition taken from http://www.sqlite.org/c_interface.html
 #define SQLITE_FULL        13   /* Insertion failed because database is full */
 
-void DatabaseFeeder::handleTraceEntry( const TraceEntry &e )
+/* Stores the pending entries starting at the given index in the open
+ * batch transaction (opening a new one if needed). If the database ran
+ * full, the batch is rolled back, old entries are archived and the whole
+ * batch is written again. If a single entry cannot be stored, only that
+ * entry is dropped and the rest of the batch is written again; the error
+ * is thrown once that succeeded. Any other error discards the batch, so
+ * after an exception m_pendingEntries only holds entries which were
+ * stored.
+ */
+void DatabaseFeeder::storePendingEntries( int first, bool commit )
 {
-    try {
-        Transaction transaction( m_db );
-        ::storeEntry( m_db, &transaction, e );
-    } catch ( const SQLTransactionException &ex ) {
-        if ( ex.driverCode() == SQLITE_FULL ) {
-            archiveEntries( m_db, m_shrinkBy, m_archiveDir );
+    QScopedPointer<SQLTransactionException> droppedEntryError;
+    while ( true ) {
+        int i = first;
+        try {
+            if ( !m_transaction ) {
+                m_transaction = new Transaction( m_db );
+                m_batchAge.start();
+            }
+            for ( ; i < m_pendingEntries.size(); ++i ) {
+                m_store->store( m_transaction, m_pendingEntries[i] );
+            }
+            if ( commit ) {
+                m_transaction->commit();
+                delete m_transaction;
+                m_transaction = 0;
+            }
+            break;
+        } catch ( const SQLTransactionException &ex ) {
+            // Rolls back the batch, so ids cached meanwhile might be bogus
+            delete m_transaction;
+            m_transaction = 0;
+
+            if ( ex.driverCode() != SQLITE_FULL ) {
+                m_store->reloadCaches();
+                if ( i >= m_pendingEntries.size() ) {
+                    // Committing failed, not storing one of the entries
+                    m_pendingEntries.clear();
+                    throw;
+                }
+                m_pendingEntries.removeAt( i );
+                if ( !droppedEntryError ) {
+                    droppedEntryError.reset( new SQLTransactionException( ex ) );
+                }
+                first = 0;
+                continue;
+            }
+
+            /* Ingest outran the archiving which started at the high-water
+             * mark, so move all of the entries right away.
+             */
+            m_store->clearCaches();
+            if ( m_archiveFileName.isEmpty() && !startArchiving() ) {
+                m_store->reloadCaches();
+                m_pendingEntries.clear();
+                throw;
+            }
+            try {
+                while ( !m_archiveFileName.isEmpty() ) {
+                    archiveChunk();
+                }
+            } catch ( const runtime_error & ) {
+                m_store->reloadCaches();
+                m_pendingEntries.clear();
+                throw;
+            }
 
-            archivedEntries();
+            first = 0;
+        }
+    }
 
-            handleTraceEntry( e );
-        } else {
-            throw;
+    if ( droppedEntryError ) {
+        throw SQLTransactionException( *droppedEntryError );
+    }
+}
+
+DatabaseFeeder::CacheStatistics DatabaseFeeder::cacheStatistics() const
+{
+    return m_store->cacheStatistics();
+}
+
+void DatabaseFeeder::flushPendingEntries()
+{
+    if ( m_pendingEntries.isEmpty() ) {
+        return;
+    }
+
+    QElapsedTimer commitTimer;
+    commitTimer.start();
+    try {
+        storePendingEntries( m_pendingEntries.size(), true );
+    } catch ( const SQLTransactionException & ) {
+        // The entries which are left were committed nevertheless
+        if ( !m_pendingEntries.isEmpty() ) {
+            m_lastCommitMsecs = commitTimer.elapsed();
+            QList<TraceEntry> entries;
+            entries.swap( m_pendingEntries );
+            committedEntries( entries );
         }
+        throw;
+    }
+    m_lastCommitMsecs = commitTimer.elapsed();
+
+    QList<TraceEntry> entries;
+    entries.swap( m_pendingEntries );
+    committedEntries( entries );
+
+    archiveIncrementally();
+}
+
+void DatabaseFeeder::handleTraceEntry( const TraceEntry &e )
+{
+    m_pendingEntries.append( e );
+    storePendingEntries( m_pendingEntries.size() - 1, false );
+
+    if ( m_pendingEntries.size() >= MaxBatchEntries || m_batchAge.elapsed() >= MaxBatchMsecs ) {
+        flushPendingEntries();
     }
 }
 
 void DatabaseFeeder::handleShutdownEvent( const ProcessShutdownEvent &ev )
 {
+    flushPendingEntries();
+
     Transaction transaction( m_db );
     transaction.exec( QString( "UPDATE process SET end_time=%1 WHERE pid=%2 AND start_time=%3;" ).arg( Database::formatValue( m_db, ev.stopTime ) ).arg( ev.pid ).arg( Database::formatValue( m_db, ev.startTime ) ) );
 }
@@ -587,6 +971,7 @@ void DatabaseFeeder::applyStorageConfiguration( const StorageConfiguration &cfg
          * compiled with different settings.
          */
         m_db.exec( "PRAGMA max_page_count=1073741823" );
+        m_maxPageCount = 0;
         m_maximumSize = cfg.maximumSize;
         m_shrinkBy = shrinkBy;
         m_archiveDir = cfg.archiveDir;
@@ -632,6 +1017,7 @@ void DatabaseFeeder::applyStorageConfiguration( const StorageConfiguration &cfg
     }
 
     m_db.exec( QString( "PRAGMA max_page_count=%1" ).arg( maxPageCount ) );
+    m_maxPageCount = maxPageCount;
 
     m_maximumSize = cfg.maximumSize;
     m_shrinkBy = shrinkBy;
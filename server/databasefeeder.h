@@ -22,10 +22,52 @@
 
 #include "xmlcontenthandler.h"
 
+#include <QElapsedTimer>
+#include <QList>
+
+class ColumnarArchiveConverter;
+class EntryStore;
+class Transaction;
+
+/* Stores incoming trace entries in the database. Entries are grouped
+ * into batches which are written in a single transaction; a batch is
+ * committed once it holds MaxBatchEntries entries or once it is older
+ * than MaxBatchMsecs (checked whenever an entry arrives, so callers
+ * which may become idle should call flushPendingEntries() regularly).
+ */
 class DatabaseFeeder : public XmlParseEventsHandler
 {
 public:
-    DatabaseFeeder( QSqlDatabase db );
+    static const int MaxBatchEntries = 1000;
+    static const int MaxBatchMsecs = 100;
+    // Number of ids of paths, functions etc. which are cached per table
+    static const int DefaultMaxCachedIds = 65536;
+    /* Archiving starts once this percentage of the maximum database size
+     * is used; it moves ArchiveChunkEntries entries after each batch.
+     */
+    static const int ArchiveHighWaterPercentage = 90;
+    static const int ArchiveChunkEntries = 5000;
+
+    struct CacheStatistics
+    {
+        CacheStatistics() : hits( 0 ), misses( 0 ), size( 0 ) { }
+
+        qulonglong hits;
+        qulonglong misses;
+        int size;
+    };
+
+    DatabaseFeeder( QSqlDatabase db, int maxCachedIds = DefaultMaxCachedIds );
+    virtual ~DatabaseFeeder();
+
+    void flushPendingEntries();
+
+    // Time it took to write the most recently committed batch to disk
+    qint64 lastCommitMsecs() const { return m_lastCommitMsecs; }
+
+    // Lookups of path, function, trace point etc. ids in the caches
+    CacheStatistics cacheStatistics() const;
+
 protected:
     virtual void handleTraceEntry( const TraceEntry & );
     virtual void applyStorageConfiguration( const StorageConfiguration & );
@@ -33,13 +75,39 @@ protected:
 
     // Needed for the server to send out notifications to the GUI when entries are archived
     virtual void archivedEntries() {}
+    // Needed for the server to send out entries to the GUI once they are in the database
+    virtual void committedEntries( const QList<TraceEntry> & ) {}
     // Needed for the server subclass to nuke the database
     void trimDb();
 private:
+    DatabaseFeeder( const DatabaseFeeder &other ); // disabled
+    void operator=( const DatabaseFeeder &rhs ); // disabled
+
+    void storePendingEntries( int first, bool commit );
+
+    bool aboveHighWaterMark() const;
+    bool startArchiving();
+    void archiveChunk();
+    void finishArchiving();
+    void cancelArchiving();
+    void archiveIncrementally();
+    void convertArchive( const QString &archiveFileName );
+
     QSqlDatabase m_db;
+    EntryStore *m_store;
+    Transaction *m_transaction;
+    QList<TraceEntry> m_pendingEntries;
+    QElapsedTimer m_batchAge;
+    qint64 m_lastCommitMsecs;
     unsigned short m_shrinkBy;
     unsigned long m_maximumSize;
+    qulonglong m_maxPageCount;
     QString m_archiveDir;
+    // Attached as 'archive' while entries are being archived
+    QString m_archiveFileName;
+    qulonglong m_archivedUpToId;
+    qulonglong m_archiveLastId;
+    QList<ColumnarArchiveConverter *> m_archiveConverters;
 };
 
 #endif // TRACER_DATABASEFEEDER_H
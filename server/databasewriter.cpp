@@ -0,0 +1,260 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "databasewriter.h"
+
+#include "databasefeeder.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QSqlDatabase>
+
+#include <stdexcept>
+
+using namespace std;
+
+class DatabaseWriter::Feeder : public DatabaseFeeder
+{
+public:
+    Feeder( QSqlDatabase db, DatabaseWriter *writer )
+        : DatabaseFeeder( db ),
+        m_writer( writer )
+    {
+    }
+
+    void storeEntries( const QList<TraceEntry> &entries )
+    {
+        QList<TraceEntry>::ConstIterator it, end = entries.end();
+        for ( it = entries.begin(); it != end; ++it ) {
+            handleTraceEntry( *it );
+        }
+    }
+
+    void storeShutdownEvent( const ProcessShutdownEvent &ev ) { handleShutdownEvent( ev ); }
+    void applyConfiguration( const StorageConfiguration &cfg ) { applyStorageConfiguration( cfg ); }
+    void trim() { trimDb(); }
+
+protected:
+    virtual void committedEntries( const QList<TraceEntry> &entries )
+    {
+        m_writer->committedEntries( entries, lastCommitMsecs(), cacheStatistics() );
+    }
+
+    virtual void archivedEntries()
+    {
+        emit m_writer->entriesArchived();
+    }
+
+private:
+    DatabaseWriter *m_writer;
+};
+
+DatabaseWriter::DatabaseWriter( const QString &traceFile, QObject *parent )
+    : QThread( parent ),
+    m_traceFile( traceFile ),
+    m_stopRequested( false ),
+    m_acceptsCommands( true )
+{
+    qRegisterMetaType<QList<TraceEntry> >();
+    qRegisterMetaType<ProcessShutdownEvent>();
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    stop();
+}
+
+void DatabaseWriter::stop()
+{
+    {
+        QMutexLocker lock( &m_mutex );
+        m_stopRequested = true;
+        m_commandsQueued.wakeAll();
+    }
+    wait();
+}
+
+DatabaseWriter::Statistics DatabaseWriter::statistics() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_statistics;
+}
+
+void DatabaseWriter::addTraceEntries( const QList<TraceEntry> &entries )
+{
+    Command command;
+    command.type = Command::StoreEntries;
+    command.entries = entries;
+    enqueue( command );
+}
+
+void DatabaseWriter::addShutdownEvent( const ProcessShutdownEvent &ev )
+{
+    Command command;
+    command.type = Command::StoreShutdownEvent;
+    command.shutdownEvent = ev;
+    enqueue( command );
+}
+
+void DatabaseWriter::addStorageConfiguration( const StorageConfiguration &cfg )
+{
+    Command command;
+    command.type = Command::ApplyStorageConfiguration;
+    command.storageConfiguration = cfg;
+    enqueue( command );
+}
+
+void DatabaseWriter::trimDatabase()
+{
+    Command command;
+    command.type = Command::TrimDatabase;
+    enqueue( command );
+}
+
+void DatabaseWriter::enqueue( const Command &command )
+{
+    QMutexLocker lock( &m_mutex );
+    /* Blocking the networking thread stops it from reading, which in
+     * turn makes the traced process wait (or drop entries) instead of
+     * letting the server run out of memory.
+     */
+    while ( m_acceptsCommands && !m_stopRequested &&
+            m_statistics.queuedEntries + m_statistics.queuedCommands >= MaxQueuedEntries ) {
+        m_queueSpace.wait( &m_mutex );
+    }
+    if ( !m_acceptsCommands ) {
+        return;
+    }
+    m_commands.append( command );
+    ++m_statistics.queuedCommands;
+    m_statistics.queuedEntries += command.entries.size();
+    if ( m_statistics.queuedEntries > m_statistics.maxQueuedEntries ) {
+        m_statistics.maxQueuedEntries = m_statistics.queuedEntries;
+    }
+    m_commandsQueued.wakeOne();
+}
+
+void DatabaseWriter::committedEntries( const QList<TraceEntry> &entries, qint64 commitMsecs,
+                                       const DatabaseFeeder::CacheStatistics &cacheStatistics )
+{
+    {
+        QMutexLocker lock( &m_mutex );
+        m_statistics.storedEntries += entries.size();
+        m_statistics.lastCommitMsecs = commitMsecs;
+        m_statistics.cache = cacheStatistics;
+        if ( commitMsecs > m_statistics.maxCommitMsecs ) {
+            m_statistics.maxCommitMsecs = commitMsecs;
+        }
+        if ( commitMsecs >= SlowCommitMsecs ) {
+            qWarning() << "Storing" << entries.size() << "trace entries took" << commitMsecs << "ms,"
+                       << m_statistics.queuedEntries << "entries are waiting to be stored";
+        }
+    }
+    emit traceEntriesStored( entries );
+}
+
+void DatabaseWriter::execute( Feeder &feeder, const Command &command )
+{
+    try {
+        switch ( command.type ) {
+            case Command::StoreEntries:
+                feeder.storeEntries( command.entries );
+                break;
+            case Command::StoreShutdownEvent:
+                feeder.storeShutdownEvent( command.shutdownEvent );
+                emit shutdownEventStored( command.shutdownEvent );
+                break;
+            case Command::ApplyStorageConfiguration:
+                feeder.applyConfiguration( command.storageConfiguration );
+                break;
+            case Command::TrimDatabase:
+                feeder.trim();
+                emit databaseTrimmed();
+                break;
+        }
+    } catch ( const runtime_error &e ) {
+        qWarning() << e.what();
+    }
+}
+
+void DatabaseWriter::run()
+{
+    QString errMsg;
+    QSqlDatabase db = Database::open( m_traceFile, &errMsg );
+    if ( !db.isValid() ) {
+        qWarning() << "Failed to open trace database" << m_traceFile << ":" << errMsg;
+        QMutexLocker lock( &m_mutex );
+        m_acceptsCommands = false;
+        m_commands.clear();
+        m_statistics.queuedEntries = 0;
+        m_statistics.queuedCommands = 0;
+        m_queueSpace.wakeAll();
+        return;
+    }
+
+    {
+        Feeder feeder( db, this );
+        while ( true ) {
+            QList<Command> commands;
+            {
+                QMutexLocker lock( &m_mutex );
+                if ( m_commands.isEmpty() && !m_stopRequested ) {
+                    m_commandsQueued.wait( &m_mutex, DatabaseFeeder::MaxBatchMsecs );
+                }
+                if ( m_commands.isEmpty() && m_stopRequested ) {
+                    m_acceptsCommands = false;
+                    m_queueSpace.wakeAll();
+                    break;
+                }
+                commands.swap( m_commands );
+            }
+
+            if ( commands.isEmpty() ) {
+                // Nothing arrived for a while, commit what was received before
+                try {
+                    feeder.flushPendingEntries();
+                } catch ( const runtime_error &e ) {
+                    qWarning() << e.what();
+                }
+                continue;
+            }
+
+            QList<Command>::ConstIterator it, end = commands.end();
+            for ( it = commands.begin(); it != end; ++it ) {
+                execute( feeder, *it );
+
+                // Commands count against MaxQueuedEntries until they are executed
+                QMutexLocker lock( &m_mutex );
+                --m_statistics.queuedCommands;
+                m_statistics.queuedEntries -= it->entries.size();
+                m_queueSpace.wakeAll();
+            }
+        }
+
+        try {
+            feeder.flushPendingEntries();
+        } catch ( const runtime_error &e ) {
+            qWarning() << e.what();
+        }
+    }
+
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase( m_traceFile );
+}
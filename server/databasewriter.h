@@ -0,0 +1,127 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_DATABASEWRITER_H
+#define TRACER_DATABASEWRITER_H
+
+#include "database.h"
+#include "databasefeeder.h"
+#include "xmlcontenthandler.h"
+
+#include <QList>
+#include <QMetaType>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+// Passed from the writer thread to the server via queued connections
+Q_DECLARE_METATYPE( QList<TraceEntry> )
+Q_DECLARE_METATYPE( ProcessShutdownEvent )
+
+/* Owns the connection to the trace database and stores everything the
+ * networking threads decoded, so that neither reading from the traced
+ * processes nor serving the GUI has to wait for the disk. The add*()
+ * functions may be called from any thread; they block while more than
+ * MaxQueuedEntries entries and other commands are waiting to be executed.
+ */
+class DatabaseWriter : public QThread
+{
+    Q_OBJECT
+public:
+    static const int MaxQueuedEntries = 50000;
+    // Committing a batch taking longer than this is reported
+    static const int SlowCommitMsecs = 1000;
+
+    struct Statistics
+    {
+        Statistics()
+            : queuedEntries( 0 ),
+            maxQueuedEntries( 0 ),
+            queuedCommands( 0 ),
+            storedEntries( 0 ),
+            lastCommitMsecs( 0 ),
+            maxCommitMsecs( 0 )
+        { }
+
+        int queuedEntries;
+        int maxQueuedEntries;
+        // Commands which are not executed yet, including StoreEntries
+        int queuedCommands;
+        qulonglong storedEntries;
+        qint64 lastCommitMsecs;
+        qint64 maxCommitMsecs;
+        DatabaseFeeder::CacheStatistics cache;
+    };
+
+    DatabaseWriter( const QString &traceFile, QObject *parent = 0 );
+    virtual ~DatabaseWriter();
+
+    void addTraceEntries( const QList<TraceEntry> &entries );
+    void addShutdownEvent( const ProcessShutdownEvent &ev );
+    void addStorageConfiguration( const StorageConfiguration &cfg );
+    void trimDatabase();
+
+    // Stores everything queued so far and terminates the thread
+    void stop();
+
+    Statistics statistics() const;
+
+signals:
+    void traceEntriesStored( const QList<TraceEntry> &entries );
+    void shutdownEventStored( const ProcessShutdownEvent &ev );
+    void entriesArchived();
+    void databaseTrimmed();
+
+protected:
+    virtual void run();
+
+private:
+    DatabaseWriter( const DatabaseWriter &other ); // disabled
+    void operator=( const DatabaseWriter &rhs ); // disabled
+
+    class Feeder;
+    friend class Feeder;
+
+    struct Command
+    {
+        enum Type { StoreEntries, StoreShutdownEvent, ApplyStorageConfiguration, TrimDatabase };
+
+        Type type;
+        QList<TraceEntry> entries;
+        ProcessShutdownEvent shutdownEvent;
+        StorageConfiguration storageConfiguration;
+    };
+
+    void enqueue( const Command &command );
+    void execute( Feeder &feeder, const Command &command );
+    void committedEntries( const QList<TraceEntry> &entries, qint64 commitMsecs,
+                           const DatabaseFeeder::CacheStatistics &cacheStatistics );
+
+    const QString m_traceFile;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_commandsQueued;
+    QWaitCondition m_queueSpace;
+    QList<Command> m_commands;
+    bool m_stopRequested;
+    bool m_acceptsCommands;
+    Statistics m_statistics;
+};
+
+#endif // TRACER_DATABASEWRITER_H
@@ -91,11 +91,14 @@ int main( int argc, char **argv )
                                   "port", QString::number(TRACELIB_DEFAULT_PORT));
     QCommandLineOption guiportOption(QStringList() << "g" << "guiport", "Listening Port for the trace gui to connect to.",
                                      "guiport", QString::number(TRACELIB_DEFAULT_PORT + 1));
+    QCommandLineOption statisticsOption("statistics", "Print storage statistics every <seconds> seconds.",
+                                        "seconds", "0");
     opt.addHelpOption();
     opt.addVersionOption();
     opt.setApplicationDescription("Listens for trace library connections to store trace entries into a database");
     opt.addOption(portOption);
     opt.addOption(guiportOption);
+    opt.addOption(statisticsOption);
     opt.addPositionalArgument(".trace_file", "Trace database to store the trace entries into");
     opt.process(app);
 
@@ -124,25 +127,38 @@ int main( int argc, char **argv )
 		 << "' given." << endl;
 	    return Error::CommandLineArgs;
     }
+    int statisticsInterval = opt.value(statisticsOption).toInt(&ok);
+    if (!ok || statisticsInterval < 0) {
+        cout << "Invalid statistics interval '"
+             << opt.value(statisticsOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
     if (port == guiport) {
 	cout << "Trace port and GUI port have to be different." << endl;
 	return Error::CommandLineArgs;
     }
 
-    QSqlDatabase database;
-    if (QFile::exists(traceFile)) {
-        database = Database::open(traceFile, &errMsg);
-    } else {
-        database = Database::create(traceFile, &errMsg);
-    }
-    if (!database.isValid()) {
-        cout << "Failed to open log database: "
-             << errMsg.toLocal8Bit().constData()
-             << endl;
-        return Error::Database;
+    {
+        QSqlDatabase database;
+        if (QFile::exists(traceFile)) {
+            database = Database::open(traceFile, &errMsg);
+        } else {
+            database = Database::create(traceFile, &errMsg);
+        }
+        if (!database.isValid()) {
+            cout << "Failed to open log database: "
+                 << errMsg.toLocal8Bit().constData()
+                 << endl;
+            return Error::Database;
+        }
+        // The server opens its own connection in the database writer thread
+        database.close();
     }
+    QSqlDatabase::removeDatabase(traceFile);
 
-    Server server(traceFile, database, port, guiport);
+    Server server(traceFile, port, guiport);
+    server.setStatisticsInterval(statisticsInterval);
 
     return app.exec();
 }
@@ -0,0 +1,167 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "segmentfilereader.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+
+#include <cstring>
+
+// Must match the definitions in hooklib/mmapfileoutput_unix.cpp
+static const char SegmentMagic[4] = { 'T', 'R', 'S', 'G' };
+static const quint32 SupportedFormatVersion = 1;
+static const qint64 MinimumHeaderSize = 32;
+static const qint64 RecordAlignment = 4;
+
+enum SegmentFlags {
+    StartsStream = 0x1
+};
+
+static quint64 readLittleEndian( const uchar *p, int bytes )
+{
+    quint64 value = 0;
+    for ( int i = 0; i < bytes; ++i ) {
+        value |= static_cast<quint64>( p[i] ) << ( i * 8 );
+    }
+    return value;
+}
+
+SegmentFileReader::SegmentFileReader()
+    : m_data( 0 ),
+    m_size( 0 ),
+    m_pos( 0 ),
+    m_flags( 0 ),
+    m_sequenceNumber( 0 ),
+    m_truncated( false )
+{
+}
+
+SegmentFileReader::~SegmentFileReader()
+{
+    close();
+}
+
+bool SegmentFileReader::isSegmentFile( const QByteArray &data )
+{
+    return data.size() >= static_cast<int>( sizeof( SegmentMagic ) ) &&
+           memcmp( data.constData(), SegmentMagic, sizeof( SegmentMagic ) ) == 0;
+}
+
+QStringList SegmentFileReader::segmentFiles( const QString &baseName )
+{
+    const QFileInfo baseInfo( baseName );
+    const QDir dir = baseInfo.dir();
+    const QString prefix = baseInfo.fileName() + QLatin1Char( '.' );
+
+    QMap<quint64, QString> segments;
+    foreach ( const QString &fileName, dir.entryList( QStringList() << prefix + QLatin1String( "*" ), QDir::Files ) ) {
+        bool ok;
+        const quint64 n = fileName.mid( prefix.size() ).toULongLong( &ok );
+        if ( ok ) {
+            segments.insert( n, dir.filePath( fileName ) );
+        }
+    }
+    return segments.values();
+}
+
+bool SegmentFileReader::open( const QString &fileName, QString *errMsg )
+{
+    close();
+
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadOnly ) ) {
+        *errMsg = QString::fromLatin1( "Failed to open segment file %1: %2" ).arg( fileName ).arg( m_file.errorString() );
+        return false;
+    }
+    m_size = m_file.size();
+    if ( m_size < MinimumHeaderSize ) {
+        *errMsg = QString::fromLatin1( "Segment file %1 is too small" ).arg( fileName );
+        close();
+        return false;
+    }
+    m_data = m_file.map( 0, m_size );
+    if ( !m_data ) {
+        *errMsg = QString::fromLatin1( "Failed to map segment file %1: %2" ).arg( fileName ).arg( m_file.errorString() );
+        close();
+        return false;
+    }
+
+    if ( memcmp( m_data, SegmentMagic, sizeof( SegmentMagic ) ) != 0 ) {
+        *errMsg = QString::fromLatin1( "%1 is not a segment file" ).arg( fileName );
+        close();
+        return false;
+    }
+    const quint32 version = static_cast<quint32>( readLittleEndian( m_data + 4, 4 ) );
+    if ( version != SupportedFormatVersion ) {
+        *errMsg = QString::fromLatin1( "Segment file %1 has unsupported format version %2" ).arg( fileName ).arg( version );
+        close();
+        return false;
+    }
+    const qint64 headerSize = static_cast<qint64>( readLittleEndian( m_data + 8, 4 ) );
+    if ( headerSize < MinimumHeaderSize || headerSize > m_size ) {
+        *errMsg = QString::fromLatin1( "Segment file %1 has an invalid header" ).arg( fileName );
+        close();
+        return false;
+    }
+    m_flags = static_cast<quint32>( readLittleEndian( m_data + 12, 4 ) );
+    m_sequenceNumber = readLittleEndian( m_data + 16, 8 );
+    m_pos = headerSize;
+    return true;
+}
+
+void SegmentFileReader::close()
+{
+    if ( m_data ) {
+        m_file.unmap( const_cast<uchar *>( m_data ) );
+        m_data = 0;
+    }
+    m_file.close();
+    m_size = 0;
+    m_pos = 0;
+    m_flags = 0;
+    m_sequenceNumber = 0;
+    m_truncated = false;
+}
+
+bool SegmentFileReader::startsStream() const
+{
+    return ( m_flags & StartsStream ) != 0;
+}
+
+bool SegmentFileReader::readRecord( QByteArray *record )
+{
+    if ( !m_data || m_pos + 4 > m_size ) {
+        return false;
+    }
+    const qint64 length = static_cast<qint64>( readLittleEndian( m_data + m_pos, 4 ) );
+    if ( length == 0 ) {
+        // Rest of a segment which was not closed properly
+        return false;
+    }
+    if ( m_pos + 4 + length > m_size ) {
+        m_truncated = true;
+        return false;
+    }
+    *record = QByteArray( reinterpret_cast<const char *>( m_data + m_pos + 4 ), static_cast<int>( length ) );
+    m_pos += ( 4 + length + RecordAlignment - 1 ) & ~( RecordAlignment - 1 );
+    return true;
+}
+
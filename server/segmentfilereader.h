@@ -0,0 +1,72 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_SEGMENTFILEREADER_H
+#define TRACER_SEGMENTFILEREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QStringList>
+
+/* Reads the records of a segment file written by the mmapfile output of
+ * tracelib (see hooklib/mmapfileoutput_unix.cpp). Segments of a process which
+ * crashed are read up to the last complete record.
+ */
+class SegmentFileReader
+{
+public:
+    SegmentFileReader();
+    ~SegmentFileReader();
+
+    static bool isSegmentFile( const QByteArray &data );
+
+    // Yields the existing segments <baseName>.<n>, ordered by n
+    static QStringList segmentFiles( const QString &baseName );
+
+    bool open( const QString &fileName, QString *errMsg );
+    void close();
+
+    quint64 sequenceNumber() const { return m_sequenceNumber; }
+
+    /* Whether the segment starts a new stream, i.e. is the first one written
+     * by an output. Any decoder state of earlier segments is to be discarded.
+     */
+    bool startsStream() const;
+
+    // Yields false after the last record
+    bool readRecord( QByteArray *record );
+
+    // Whether the segment ends with a record which was not completely written
+    bool isTruncated() const { return m_truncated; }
+
+private:
+    SegmentFileReader( const SegmentFileReader &other ); // disabled
+    void operator=( const SegmentFileReader &rhs ); // disabled
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    quint32 m_flags;
+    quint64 m_sequenceNumber;
+    bool m_truncated;
+};
+
+#endif // TRACER_SEGMENTFILEREADER_H
+
@@ -29,38 +29,100 @@
 #include <QSqlDatabase>
 
 #include <cassert>
+#include <iostream>
 #include <stdexcept>
 
 using namespace std;
 
-ClientSocket::ClientSocket( QObject *parent )
-    : QTcpSocket( parent )
+ClientSocket::ClientSocket( DatabaseWriter *writer, QObject *parent )
+    : QTcpSocket( parent ),
+    m_writer( writer ),
+    m_format( UnknownFormat ),
+    m_xmlHandler( this ),
+    m_binaryHandler( this ),
+    m_receivedStorageConfiguration( false )
 {
     connect( this, SIGNAL( readyRead() ),
              this, SLOT( handleIncomingData() ) );
+    m_xmlHandler.addData( "<toplevel_trace_element>" );
 }
 
 void ClientSocket::handleIncomingData()
 {
     const QByteArray data = readAll();
     assert( !data.isEmpty() );
-    emit dataReceived( data );
+    if ( m_format == UnknownFormat ) {
+        m_format = BinaryContentHandler::isBinaryStream( data ) ? BinaryFormat : XmlFormat;
+    }
+    try {
+        if ( m_format == BinaryFormat ) {
+            m_binaryHandler.addData( data );
+            m_binaryHandler.continueParsing();
+        } else {
+            m_xmlHandler.addData( data );
+            m_xmlHandler.continueParsing();
+        }
+    } catch ( const runtime_error &e ) {
+        // The rest of the stream cannot be decoded anymore
+        qWarning() << e.what();
+        passPendingEntries();
+        abort();
+        return;
+    }
+    passPendingEntries();
 }
 
-NetworkingThread::NetworkingThread( int socketDescriptor, QObject *parent )
+void ClientSocket::handleTraceEntry( const TraceEntry &e )
+{
+    m_pendingEntries.append( e );
+}
+
+/* The XML serializer repeats the configuration in every entry, so only
+ * changes are passed on; otherwise every entry would end a chunk.
+ */
+void ClientSocket::applyStorageConfiguration( const StorageConfiguration &cfg )
+{
+    if ( m_receivedStorageConfiguration && m_storageConfiguration == cfg ) {
+        return;
+    }
+    m_receivedStorageConfiguration = true;
+    m_storageConfiguration = cfg;
+
+    passPendingEntries();
+    m_writer->addStorageConfiguration( cfg );
+}
+
+void ClientSocket::handleShutdownEvent( const ProcessShutdownEvent &ev )
+{
+    passPendingEntries();
+    m_writer->addShutdownEvent( ev );
+}
+
+/* Entries are passed on once per chunk of received data (instead of
+ * individually) to keep the contention on the writer's queue low.
+ */
+void ClientSocket::passPendingEntries()
+{
+    if ( m_pendingEntries.isEmpty() ) {
+        return;
+    }
+    QList<TraceEntry> entries;
+    entries.swap( m_pendingEntries );
+    m_writer->addTraceEntries( entries );
+}
+
+NetworkingThread::NetworkingThread( int socketDescriptor, DatabaseWriter *writer, QObject *parent )
     : QThread( parent ),
     m_socketDescriptor( socketDescriptor ),
+    m_writer( writer ),
     m_clientSocket( 0 )
 {
 }
 
 void NetworkingThread::run()
 {
-    m_clientSocket = new ClientSocket;
+    m_clientSocket = new ClientSocket( m_writer );
     m_clientSocket->setSocketDescriptor( m_socketDescriptor );
-    connect( m_clientSocket, SIGNAL( dataReceived( const QByteArray & ) ),
-             this, SIGNAL( dataReceived( const QByteArray & ) ),
-             Qt::QueuedConnection );
     connect( m_clientSocket, SIGNAL( disconnected() ),
              this, SLOT( quit() ),
              Qt::QueuedConnection  );
@@ -68,9 +130,10 @@ void NetworkingThread::run()
     delete m_clientSocket;
 }
 
-ServerSocket::ServerSocket( Server *server )
+ServerSocket::ServerSocket( Server *server, DatabaseWriter *writer )
     : QTcpServer( server ),
-    m_server( server )
+    m_server( server ),
+    m_writer( writer )
 {
 }
 
@@ -89,10 +152,9 @@ ServerSocket::~ServerSocket()
 void ServerSocket::incomingConnection( int socketDescriptor )
 {
     NetworkingThread *thread = new NetworkingThread( socketDescriptor,
+                                                     m_writer,
                                                      this );
     m_networkingThreads.push_back( thread );
-    connect( thread, SIGNAL( dataReceived( const QByteArray & ) ),
-             m_server, SLOT( handleIncomingData( const QByteArray & ) ) );
     connect( thread, SIGNAL( finished() ),
              thread, SLOT( deleteLater() ) );
     thread->start();
@@ -161,25 +223,66 @@ void GUIConnection::handleDisconnect()
 }
 
 Server::Server( const QString &traceFile,
-                QSqlDatabase database,
                 unsigned short port, unsigned short guiPort,
                 QObject *parent )
     : QObject( parent ),
-      DatabaseFeeder( database ),
       m_tcpServer( 0 ),
-      m_xmlHandler( this )
+      m_databaseWriter( 0 )
 {
     QFileInfo fi( traceFile );
     m_traceFile = QDir::toNativeSeparators( fi.canonicalFilePath() );
 
-    m_tcpServer = new ServerSocket( this );
+    m_databaseWriter = new DatabaseWriter( traceFile, this );
+    connect( m_databaseWriter, SIGNAL( traceEntriesStored( const QList<TraceEntry> & ) ),
+             SLOT( handleStoredEntries( const QList<TraceEntry> & ) ) );
+    connect( m_databaseWriter, SIGNAL( shutdownEventStored( const ProcessShutdownEvent & ) ),
+             SLOT( handleStoredShutdownEvent( const ProcessShutdownEvent & ) ) );
+    connect( m_databaseWriter, SIGNAL( entriesArchived() ), SLOT( handleArchivedEntries() ) );
+    connect( m_databaseWriter, SIGNAL( databaseTrimmed() ), SLOT( handleTrimmedDatabase() ) );
+    m_databaseWriter->start();
+
+    m_tcpServer = new ServerSocket( this, m_databaseWriter );
     m_tcpServer->listen( QHostAddress::Any, port );
 
     m_guiServer = new QTcpServer( this );
     connect( m_guiServer, SIGNAL( newConnection() ), SLOT( handleNewGUIConnection() ) );
     m_guiServer->listen( QHostAddress::LocalHost, guiPort );
 
-    m_xmlHandler.addData( "<toplevel_trace_element>" );
+    connect( &m_statisticsTimer, SIGNAL( timeout() ), SLOT( reportStatistics() ) );
+}
+
+Server::~Server()
+{
+    // Stop the networking threads first, they feed the database writer
+    delete m_tcpServer;
+
+    m_databaseWriter->stop();
+}
+
+DatabaseWriter::Statistics Server::statistics() const
+{
+    return m_databaseWriter->statistics();
+}
+
+void Server::setStatisticsInterval( int secs )
+{
+    if ( secs > 0 ) {
+        m_statisticsTimer.start( secs * 1000 );
+    } else {
+        m_statisticsTimer.stop();
+    }
+}
+
+void Server::reportStatistics()
+{
+    const DatabaseWriter::Statistics stats = statistics();
+    std::cout << "traced: Stored " << stats.storedEntries << " trace entries; "
+              << stats.queuedEntries << " entries in " << stats.queuedCommands << " commands queued"
+              << " (at most " << stats.maxQueuedEntries << " entries); "
+              << "last commit took " << stats.lastCommitMsecs << " ms"
+              << " (at most " << stats.maxCommitMsecs << " ms); "
+              << "id caches: " << stats.cache.hits << " hits, " << stats.cache.misses << " misses, "
+              << stats.cache.size << " ids cached" << std::endl;
 }
 
 // duplicated in gui/mainwindow.cpp
@@ -218,24 +321,26 @@ QByteArray serializeGUIClientData( ServerDatagramType type, const T &v ) {
     return serializeDatagram( type, &v );
 }
 
-void Server::handleTraceEntry( const TraceEntry &entry )
+/* Entries are only announced once they were committed; the GUI will
+ * query the database for them.
+ */
+void Server::handleStoredEntries( const QList<TraceEntry> &entries )
 {
-    DatabaseFeeder::handleTraceEntry( entry );
+    QList<TraceEntry>::ConstIterator entry, entriesEnd = entries.end();
+    for ( entry = entries.begin(); entry != entriesEnd; ++entry ) {
+        QByteArray serializedEntry = serializeGUIClientData( TraceEntryDatagram, *entry );
 
-    QByteArray serializedEntry = serializeGUIClientData( TraceEntryDatagram, entry );
+        QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
+        for ( it = m_guiConnections.begin(); it != end; ++it ) {
+            ( *it )->write( serializedEntry );
+        }
 
-    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
-    for ( it = m_guiConnections.begin(); it != end; ++it ) {
-        ( *it )->write( serializedEntry );
+        emit traceEntryReceived( *entry );
     }
-
-    emit traceEntryReceived( entry );
 }
 
-void Server::handleShutdownEvent( const ProcessShutdownEvent &ev )
+void Server::handleStoredShutdownEvent( const ProcessShutdownEvent &ev )
 {
-    DatabaseFeeder::handleShutdownEvent( ev );
-
     QByteArray serializedEvent = serializeGUIClientData( ProcessShutdownEventDatagram, ev );
 
     QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
@@ -246,17 +351,7 @@ void Server::handleShutdownEvent( const ProcessShutdownEvent &ev )
     emit processShutdown( ev );
 }
 
-void Server::handleIncomingData( const QByteArray &xmlData )
-{
-    try {
-        m_xmlHandler.addData( xmlData );
-        m_xmlHandler.continueParsing();
-    } catch ( const runtime_error &e ) {
-        qWarning() << e.what();
-    }
-}
-
-void Server::archivedEntries()
+void Server::handleArchivedEntries()
 {
     QByteArray serializedEntry = serializeGUIClientData( DatabaseNukeFinishedDatagram );
 
@@ -283,8 +378,11 @@ void Server::guiDisconnected( GUIConnection *c )
 
 void Server::nukeDatabase()
 {
-    trimDb();
+    m_databaseWriter->trimDatabase();
+}
 
+void Server::handleTrimmedDatabase()
+{
     QByteArray serializedEntry = serializeGUIClientData( DatabaseNukeFinishedDatagram );
 
     QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
@@ -27,39 +27,55 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QThread>
-#include <QXmlStreamReader>
+#include <QTimer>
 
 #include "database.h"
+#include "binarycontenthandler.h"
 #include "xmlcontenthandler.h"
-#include "databasefeeder.h"
+#include "databasewriter.h"
 
-class ClientSocket : public QTcpSocket
+/* Parses the trace data sent by one traced process; lives in the
+ * NetworkingThread of its connection so that only the decoded entries
+ * have to be passed on to the database writer.
+ */
+class ClientSocket : public QTcpSocket, public XmlParseEventsHandler
 {
     Q_OBJECT
 public:
-    ClientSocket( QObject *parent = 0 );
-
-signals:
-    void dataReceived( const QByteArray &data );
+    ClientSocket( DatabaseWriter *writer, QObject *parent = 0 );
 
 private slots:
     void handleIncomingData();
+
+private:
+    virtual void handleTraceEntry( const TraceEntry &e );
+    virtual void applyStorageConfiguration( const StorageConfiguration &cfg );
+    virtual void handleShutdownEvent( const ProcessShutdownEvent &ev );
+
+    void passPendingEntries();
+
+    enum StreamFormat { UnknownFormat, XmlFormat, BinaryFormat };
+    DatabaseWriter *m_writer;
+    StreamFormat m_format;
+    XmlContentHandler m_xmlHandler;
+    BinaryContentHandler m_binaryHandler;
+    QList<TraceEntry> m_pendingEntries;
+    bool m_receivedStorageConfiguration;
+    StorageConfiguration m_storageConfiguration;
 };
 
 class NetworkingThread : public QThread
 {
     Q_OBJECT
 public:
-    NetworkingThread( int socketDescriptor, QObject *parent = 0 );
-
-signals:
-    void dataReceived( const QByteArray &data );
+    NetworkingThread( int socketDescriptor, DatabaseWriter *writer, QObject *parent = 0 );
 
 protected:
     virtual void run();
 
 private:
     int m_socketDescriptor;
+    DatabaseWriter *m_writer;
     ClientSocket *m_clientSocket;
 };
 
@@ -68,7 +84,7 @@ class Server;
 class ServerSocket : public QTcpServer
 {
 public:
-    ServerSocket( Server *server );
+    ServerSocket( Server *server, DatabaseWriter *writer );
     ~ServerSocket();
 
 protected:
@@ -76,6 +92,7 @@ protected:
 
 private:
     Server *m_server;
+    DatabaseWriter *m_writer;
     QList<NetworkingThread *> m_networkingThreads;
 };
 
@@ -102,16 +119,19 @@ private:
     QTcpSocket *m_sock;
 };
 
-class Server : public QObject, public DatabaseFeeder
+class Server : public QObject
 {
     Q_OBJECT
 public:
     Server( const QString &traceFile,
-            QSqlDatabase database, unsigned short port, unsigned short guiPort,
+            unsigned short port, unsigned short guiPort,
             QObject *parent = 0 );
+    ~Server();
+
+    DatabaseWriter::Statistics statistics() const;
 
-public slots:
-    void handleIncomingData(const QByteArray &data);
+    // Prints statistics() every secs seconds; 0 disables the output
+    void setStatisticsInterval( int secs );
 
 signals:
     void traceEntryReceived( const TraceEntry &e );
@@ -121,19 +141,21 @@ private slots:
     void handleNewGUIConnection();
     void nukeDatabase();
     void guiDisconnected( GUIConnection *c );
+    void handleStoredEntries( const QList<TraceEntry> &entries );
+    void handleStoredShutdownEvent( const ProcessShutdownEvent &ev );
+    void handleArchivedEntries();
+    void handleTrimmedDatabase();
+    void reportStatistics();
 
 private:
     void handleDatagram( const QByteArray &datagram );
-    void handleTraceEntry( const TraceEntry &e );
-    void handleShutdownEvent( const ProcessShutdownEvent &ev );
-    void archivedEntries();
 
     QTcpServer *m_guiServer;
     ServerSocket *m_tcpServer;
-    XmlContentHandler m_xmlHandler;
-    bool m_receivedData;
     QString m_traceFile;
     QList<GUIConnection *> m_guiConnections;
+    DatabaseWriter *m_databaseWriter;
+    QTimer m_statisticsTimer;
 };
 
 #endif // !defined(TRACE_SERVER_H)
@@ -32,6 +32,12 @@ struct StorageConfiguration
           shrinkBy( 10 )
     { }
 
+    bool operator==( const StorageConfiguration &other ) const {
+        return maximumSize == other.maximumSize &&
+               shrinkBy == other.shrinkBy &&
+               archiveDir == other.archiveDir;
+    }
+
     unsigned long maximumSize;
     unsigned short shrinkBy;
     QString archiveDir;
@@ -59,6 +65,7 @@ private:
 class XmlParseEventsHandler
 {
     friend class XmlContentHandler;
+    friend class BinaryContentHandler;
 protected:
     virtual void handleTraceEntry( const TraceEntry& ) = 0;
     virtual void applyStorageConfiguration( const StorageConfiguration & ) = 0;
@@ -0,0 +1,292 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Encodes trace entries with the BinarySerializer of tracelib and verifies
+ * that the BinaryContentHandler of the server decodes them again.
+ */
+
+#include "config.h" // for uint64_t
+#include "tracelib.h"
+#include "backtrace.h"
+#include "configuration.h"
+#include "serializer.h"
+#include "trace.h"
+
+#include "../server/binarycontenthandler.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+static const uint64_t FirstTimeStamp = 1400000000000ULL;
+
+TRACELIB_NAMESPACE_BEGIN
+
+class ValueVariable : public AbstractVariable
+{
+public:
+    ValueVariable( const char *name, const VariableValue &value )
+        : m_name( name ), m_value( value ) { }
+
+    virtual const char *name() const { return m_name; }
+    virtual VariableValue value() const { return m_value; }
+
+private:
+    const char *m_name;
+    VariableValue m_value;
+};
+
+static void appendData( QByteArray *stream, const vector<char> &data )
+{
+    if ( !data.empty() ) {
+        stream->append( &data[0], static_cast<int>( data.size() ) );
+    }
+}
+
+/* Writes three entries: one with a variable of every type, one with a
+ * backtrace and one which is older than the one before it (as happens if
+ * threads write out of order), followed by a shutdown event.
+ */
+static QByteArray serializeEntries()
+{
+    static TracePoint watchPoint( TracePointType::Watch, "/src/test.cpp", 10, "watch()", "Vars" );
+    static TracePoint errorPoint( TracePointType::Error, "/src/test.cpp", 20, "error()", 0 );
+
+    TraceKey key;
+    key.name = "Vars";
+    key.enabled = true;
+    TraceEntry::process.availableTraceKeys.push_back( key );
+
+    StorageConfiguration cfg;
+    cfg.maximumTraceSize = 1000000;
+    cfg.shrinkPercentage = 25;
+    cfg.archiveDirectoryName = "/tmp/archive";
+
+    BinarySerializer serializer;
+    serializer.setStorageConfiguration( cfg );
+
+    QByteArray stream;
+
+    ValueVariable stringVar( "s", VariableValue::stringValue( "hello" ) );
+    ValueVariable signedVar( "i", VariableValue::numberValue( vlonglong( -42 ) ) );
+    ValueVariable unsignedVar( "u", VariableValue::numberValue( vulonglong( 18446744073709551615ULL ) ) );
+    ValueVariable floatVar( "f", VariableValue::floatValue( 3.5 ) );
+    ValueVariable booleanVar( "b", VariableValue::booleanValue( true ) );
+    VariableSnapshot variables;
+    variables << &stringVar << &signedVar << &unsignedVar << &floatVar << &booleanVar;
+
+    TraceEntry watchEntry( &watchPoint, "with variables", 1, FirstTimeStamp, 100 );
+    watchEntry.variables = &variables;
+    appendData( &stream, serializer.serialize( watchEntry ) );
+
+    vector<StackFrame> frames( 2 );
+    frames[0].module = "libfoo.so";
+    frames[0].function = "foo()";
+    frames[0].functionOffset = 16;
+    frames[0].sourceFile = "/src/foo.cpp";
+    frames[0].lineNumber = 42;
+    frames[1].module = "app";
+    frames[1].function = "main";
+    frames[1].functionOffset = 128;
+    TraceEntry errorEntry( &errorPoint, 0, 2, FirstTimeStamp + 1000, 200 );
+    errorEntry.backtrace = new Backtrace( frames );
+    appendData( &stream, serializer.serialize( errorEntry ) );
+
+    TraceEntry olderEntry( &watchPoint, "older", 1, FirstTimeStamp + 995, 300 );
+    appendData( &stream, serializer.serialize( olderEntry ) );
+
+    ProcessShutdownEvent ev;
+    appendData( &stream, serializer.serialize( ev ) );
+
+    return stream;
+}
+
+TRACELIB_NAMESPACE_END
+
+class EventCollector : public XmlParseEventsHandler
+{
+public:
+    QList<TraceEntry> entries;
+    QList<StorageConfiguration> storageConfigurations;
+    QList<ProcessShutdownEvent> shutdownEvents;
+
+protected:
+    virtual void handleTraceEntry( const TraceEntry &entry ) { entries.append( entry ); }
+    virtual void applyStorageConfiguration( const StorageConfiguration &cfg ) { storageConfigurations.append( cfg ); }
+    virtual void handleShutdownEvent( const ProcessShutdownEvent &ev ) { shutdownEvents.append( ev ); }
+};
+
+static void verifyDecodedStream( const EventCollector &collector )
+{
+    verify( "number of entries", 3, collector.entries.size() );
+    verify( "number of storage configurations", 1, collector.storageConfigurations.size() );
+    verify( "number of shutdown events", 1, collector.shutdownEvents.size() );
+    if ( collector.entries.size() != 3 || collector.storageConfigurations.size() != 1 ||
+         collector.shutdownEvents.size() != 1 ) {
+        return;
+    }
+
+    const StorageConfiguration &cfg = collector.storageConfigurations[0];
+    verify( "maximum size", 1000000UL, cfg.maximumSize );
+    verify( "shrink percentage", static_cast<unsigned short>( 25 ), cfg.shrinkBy );
+    verify( "archive directory", string( "/tmp/archive" ), cfg.archiveDir.toStdString() );
+
+    const TraceEntry &watchEntry = collector.entries[0];
+    verify( "pid", static_cast<unsigned int>( TRACELIB_NAMESPACE_IDENT(TraceEntry)::process.id ), watchEntry.pid );
+    verify( "type", static_cast<unsigned int>( TRACELIB_NAMESPACE_IDENT(TracePointType)::Watch ), watchEntry.type );
+    verify( "path", string( "/src/test.cpp" ), watchEntry.path.toStdString() );
+    verify( "line", 10UL, watchEntry.lineno );
+    verify( "function", string( "watch()" ), watchEntry.function.toStdString() );
+    verify( "group", string( "Vars" ), watchEntry.groupName.toStdString() );
+    verify( "thread", 1U, watchEntry.tid );
+    verify( "stack position", 100UL, watchEntry.stackPosition );
+    verify( "message", string( "with variables" ), watchEntry.message.toStdString() );
+    verify( "number of trace keys", 1, watchEntry.traceKeys.size() );
+    if ( watchEntry.traceKeys.size() == 1 ) {
+        verify( "trace key name", string( "Vars" ), watchEntry.traceKeys[0].name.toStdString() );
+        verify( "trace key enabled", true, watchEntry.traceKeys[0].enabled );
+    }
+    verify( "timestamp", static_cast<qint64>( FirstTimeStamp ), watchEntry.timestamp.toMSecsSinceEpoch() );
+
+    verify( "number of variables", 5, watchEntry.variables.size() );
+    if ( watchEntry.variables.size() == 5 ) {
+        static const char * const names[] = { "s", "i", "u", "f", "b" };
+        static const char * const values[] = { "hello", "-42", "18446744073709551615", "3.5", "1" };
+        static const TRACELIB_NAMESPACE_IDENT(VariableType)::Value types[] = {
+            TRACELIB_NAMESPACE_IDENT(VariableType)::String,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Number,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Number,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Float,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Boolean
+        };
+        for ( int i = 0; i < 5; ++i ) {
+            const Variable &var = watchEntry.variables[i];
+            verify( "variable name", string( names[i] ), var.name.toStdString() );
+            verify( "variable value", string( values[i] ), var.value.toStdString() );
+            verify( "variable type", types[i], var.type );
+        }
+    }
+    verify( "no backtrace", true, watchEntry.backtrace.isEmpty() );
+
+    const TraceEntry &errorEntry = collector.entries[1];
+    verify( "type", static_cast<unsigned int>( TRACELIB_NAMESPACE_IDENT(TracePointType)::Error ), errorEntry.type );
+    verify( "function", string( "error()" ), errorEntry.function.toStdString() );
+    verify( "no group", true, errorEntry.groupName.isEmpty() );
+    verify( "thread", 2U, errorEntry.tid );
+    verify( "no message", true, errorEntry.message.isNull() );
+    verify( "no variables", true, errorEntry.variables.isEmpty() );
+    verify( "timestamp", static_cast<qint64>( FirstTimeStamp + 1000 ), errorEntry.timestamp.toMSecsSinceEpoch() );
+    verify( "backtrace depth", 2, errorEntry.backtrace.size() );
+    if ( errorEntry.backtrace.size() == 2 ) {
+        const StackFrame &frame = errorEntry.backtrace[0];
+        verify( "frame module", string( "libfoo.so" ), frame.module.toStdString() );
+        verify( "frame function", string( "foo()" ), frame.function.toStdString() );
+        verify( "frame offset", static_cast<size_t>( 16 ), frame.functionOffset );
+        verify( "frame source file", string( "/src/foo.cpp" ), frame.sourceFile.toStdString() );
+        verify( "frame line", static_cast<size_t>( 42 ), frame.lineNumber );
+        verify( "frame without source", true, errorEntry.backtrace[1].sourceFile.isEmpty() );
+        verify( "frame offset", static_cast<size_t>( 128 ), errorEntry.backtrace[1].functionOffset );
+    }
+
+    const TraceEntry &olderEntry = collector.entries[2];
+    verify( "message", string( "older" ), olderEntry.message.toStdString() );
+    verify( "function of a known trace point", string( "watch()" ), olderEntry.function.toStdString() );
+    verify( "timestamp before the previous one", static_cast<qint64>( FirstTimeStamp + 995 ), olderEntry.timestamp.toMSecsSinceEpoch() );
+
+    verify( "shutdown pid", static_cast<unsigned int>( TRACELIB_NAMESPACE_IDENT(TraceEntry)::process.id ), collector.shutdownEvents[0].pid );
+}
+
+static void testRoundTrip()
+{
+    const QByteArray stream = TRACELIB_NAMESPACE_IDENT(serializeEntries)();
+    verify( "stream is detected as binary", true, BinaryContentHandler::isBinaryStream( stream ) );
+
+    EventCollector collector;
+    BinaryContentHandler handler( &collector );
+    try {
+        handler.addData( stream );
+        handler.continueParsing();
+    } catch ( const BinaryParseException &ex ) {
+        cout << "FAIL: decoding the stream: " << ex.what() << endl;
+        ++g_failureCount;
+    }
+    verifyDecodedStream( collector );
+}
+
+// Records and varints which arrive in pieces are decoded once complete
+static void testByteWiseRoundTrip()
+{
+    const QByteArray stream = TRACELIB_NAMESPACE_IDENT(serializeEntries)();
+
+    EventCollector collector;
+    BinaryContentHandler handler( &collector );
+    try {
+        for ( int i = 0; i < stream.size(); ++i ) {
+            handler.addData( stream.mid( i, 1 ) );
+            handler.continueParsing();
+        }
+    } catch ( const BinaryParseException &ex ) {
+        cout << "FAIL: decoding the stream byte by byte: " << ex.what() << endl;
+        ++g_failureCount;
+    }
+    verifyDecodedStream( collector );
+}
+
+static void testOversizedRecord()
+{
+    QByteArray stream( "\0TRB\x01", 5 );
+    // Length prefix of 2^40 bytes, followed by nothing
+    stream.append( "\x80\x80\x80\x80\x80\x20", 6 );
+
+    EventCollector collector;
+    BinaryContentHandler handler( &collector );
+    bool rejected = false;
+    try {
+        handler.addData( stream );
+        handler.continueParsing();
+    } catch ( const BinaryParseException & ) {
+        rejected = true;
+    }
+    verify( "oversized record is rejected", true, rejected );
+}
+
+int main()
+{
+    testRoundTrip();
+    testByteWiseRoundTrip();
+    testOversizedRecord();
+
+    cout << g_verificationCount << " verifications; "
+         << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
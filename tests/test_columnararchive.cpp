@@ -0,0 +1,342 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stores trace entries in a database, writes it into a columnar archive
+ * and verifies that extracting (a time range of) the archive yields the
+ * same entries again.
+ */
+
+#include "../server/columnararchive.h"
+#include "../server/database.h"
+#include "../server/databasefeeder.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSqlQuery>
+#include <QVariant>
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+// Spans several blocks, the last one being partially filled
+static const int EntryCount = ColumnarArchive::BlockEntries * 2 + 100;
+static const qint64 FirstTimeStamp = Q_INT64_C( 1400000000000 );
+static const qint64 TimeStampStep = 10;
+
+// Entries with special contents; all others have a numbered message
+enum {
+    NullMessageEntry = 0,
+    EmptyMessageEntry = 1,
+    VariablesEntry = 2,
+    BacktraceEntry = ColumnarArchive::BlockEntries + 5
+};
+
+class EntryWriter : public DatabaseFeeder
+{
+public:
+    explicit EntryWriter( QSqlDatabase db ) : DatabaseFeeder( db ) { }
+
+    void store( const TraceEntry &entry ) { handleTraceEntry( entry ); }
+};
+
+static TraceEntry makeEntry( int index )
+{
+    TraceEntry entry;
+    entry.pid = 4711;
+    entry.processStartTime = QDateTime::fromMSecsSinceEpoch( FirstTimeStamp - 1000 );
+    entry.processName = "test_columnararchive";
+    entry.tid = index % 3;
+    entry.timestamp = QDateTime::fromMSecsSinceEpoch( FirstTimeStamp + index * TimeStampStep );
+    entry.type = index % 2 == 0 ? 1 : 2;
+    entry.path = "/src/test.cpp";
+    entry.lineno = index % 2 == 0 ? 10 : 20;
+    entry.function = index % 2 == 0 ? "even()" : "odd()";
+    entry.stackPosition = index;
+
+    switch ( index ) {
+        case NullMessageEntry:
+            break;
+        case EmptyMessageEntry:
+            entry.message = QString( "" );
+            break;
+        case VariablesEntry: {
+            entry.message = "with variables";
+            Variable s;
+            s.name = "s";
+            s.type = TRACELIB_NAMESPACE_IDENT(VariableType)::String;
+            s.value = QString( "" );
+            entry.variables.append( s );
+            Variable n;
+            n.name = "n";
+            n.type = TRACELIB_NAMESPACE_IDENT(VariableType)::Number;
+            n.value = "-42";
+            entry.variables.append( n );
+            Variable b;
+            b.name = "b";
+            b.type = TRACELIB_NAMESPACE_IDENT(VariableType)::Boolean;
+            b.value = "1";
+            entry.variables.append( b );
+            break;
+        }
+        case BacktraceEntry: {
+            entry.message = "with backtrace";
+            StackFrame inner;
+            inner.module = "libfoo.so";
+            inner.function = "foo()";
+            inner.functionOffset = 16;
+            inner.sourceFile = "/src/foo.cpp";
+            inner.lineNumber = 42;
+            entry.backtrace.append( inner );
+            StackFrame outer;
+            outer.module = "app";
+            outer.function = "main";
+            outer.functionOffset = 128;
+            outer.lineNumber = 0;
+            entry.backtrace.append( outer );
+            break;
+        }
+        default:
+            entry.message = QString( "entry %1" ).arg( index );
+            break;
+    }
+    return entry;
+}
+
+static bool writeDatabase( const QString &fileName )
+{
+    {
+        QString errMsg;
+        QSqlDatabase db = Database::create( fileName, &errMsg );
+        if ( !db.isValid() ) {
+            cout << "FAIL: creating " << qPrintable( fileName ) << ": " << qPrintable( errMsg ) << endl;
+            ++g_failureCount;
+            return false;
+        }
+        {
+            EntryWriter writer( db );
+            for ( int i = 0; i < EntryCount; ++i ) {
+                writer.store( makeEntry( i ) );
+            }
+            writer.flushPendingEntries();
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase( fileName );
+    return true;
+}
+
+/* Compares the entries in the extracted database with the ones
+ * originally stored, expecting the entries first to last.
+ */
+static void verifyEntries( QSqlDatabase db, int first, int last )
+{
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    verify( "querying entries", true,
+            q.exec( "SELECT trace_entry.id, trace_entry.timestamp, trace_entry.message IS NULL, trace_entry.message,"
+                    " trace_entry.stack_position, traced_thread.tid, function_name.name "
+                    "FROM trace_entry, traced_thread, trace_point, function_name "
+                    "WHERE traced_thread.id = trace_entry.traced_thread_id"
+                    " AND trace_point.id = trace_entry.trace_point_id"
+                    " AND function_name.id = trace_point.function_id "
+                    "ORDER BY trace_entry.id;" ) );
+
+    int index = first;
+    bool entriesMatch = true;
+    while ( q.next() ) {
+        const TraceEntry expected = makeEntry( index );
+        // Ids are assigned from 1 in order of insertion
+        const bool matches = q.value( 0 ).toInt() == index + 1 &&
+                             q.value( 1 ).toLongLong() == expected.timestamp.toMSecsSinceEpoch() &&
+                             q.value( 2 ).toBool() == expected.message.isNull() &&
+                             q.value( 3 ).toString() == expected.message &&
+                             q.value( 4 ).toULongLong() == expected.stackPosition &&
+                             q.value( 5 ).toUInt() == expected.tid &&
+                             q.value( 6 ).toString() == expected.function;
+        if ( !matches && entriesMatch ) {
+            cout << "FAIL: first differing entry is " << index << endl;
+        }
+        entriesMatch = entriesMatch && matches;
+        ++index;
+    }
+    verify( "extracted entries match", true, entriesMatch );
+    verify( "number of extracted entries", last - first + 1, index - first );
+}
+
+static void verifySpecialEntries( QSqlDatabase db )
+{
+    {
+        QSqlQuery q( db );
+        q.exec( QString( "SELECT message IS NULL, message FROM trace_entry WHERE id IN (%1, %2) ORDER BY id;" )
+                .arg( NullMessageEntry + 1 ).arg( EmptyMessageEntry + 1 ) );
+        verify( "entry without message exists", true, q.next() );
+        verify( "message stays NULL", true, q.value( 0 ).toBool() );
+        verify( "entry with empty message exists", true, q.next() );
+        verify( "empty message is not NULL", false, q.value( 0 ).toBool() );
+        verify( "empty message stays empty", string(), q.value( 1 ).toString().toStdString() );
+    }
+
+    {
+        QSqlQuery q( db );
+        q.exec( QString( "SELECT name, value, value IS NULL, type FROM variable WHERE trace_entry_id = %1 ORDER BY rowid;" )
+                .arg( VariablesEntry + 1 ) );
+        static const char * const names[] = { "s", "n", "b" };
+        static const char * const values[] = { "", "-42", "1" };
+        static const int types[] = {
+            TRACELIB_NAMESPACE_IDENT(VariableType)::String,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Number,
+            TRACELIB_NAMESPACE_IDENT(VariableType)::Boolean
+        };
+        int count = 0;
+        while ( q.next() && count < 3 ) {
+            verify( "variable name", string( names[count] ), q.value( 0 ).toString().toStdString() );
+            verify( "variable value", string( values[count] ), q.value( 1 ).toString().toStdString() );
+            verify( "variable value is not NULL", false, q.value( 2 ).toBool() );
+            verify( "variable type", types[count], q.value( 3 ).toInt() );
+            ++count;
+        }
+        verify( "number of variables", 3, count );
+    }
+
+    {
+        QSqlQuery q( db );
+        q.exec( "SELECT COUNT(*) FROM variable;" );
+        verify( "only one entry has variables", true, q.next() && q.value( 0 ).toInt() == 3 );
+    }
+
+    const QList<StackFrame> frames = Database::backtraceForEntry( db, BacktraceEntry + 1 );
+    verify( "backtrace depth", 2, frames.size() );
+    if ( frames.size() == 2 ) {
+        verify( "frame module", string( "libfoo.so" ), frames[0].module.toStdString() );
+        verify( "frame function", string( "foo()" ), frames[0].function.toStdString() );
+        verify( "frame offset", static_cast<size_t>( 16 ), frames[0].functionOffset );
+        verify( "frame source file", string( "/src/foo.cpp" ), frames[0].sourceFile.toStdString() );
+        verify( "frame line", static_cast<size_t>( 42 ), frames[0].lineNumber );
+        verify( "outer frame function", string( "main" ), frames[1].function.toStdString() );
+        verify( "outer frame offset", static_cast<size_t>( 128 ), frames[1].functionOffset );
+    }
+    verify( "entry without backtrace", 0, Database::backtraceForEntry( db, VariablesEntry + 1 ).size() );
+}
+
+static void testRoundTrip( const QDir &dir )
+{
+    const QString databaseFileName = dir.filePath( "source.trace" );
+    const QString archiveFileName = ColumnarArchive::archiveFileNameFor( databaseFileName );
+    if ( !writeDatabase( databaseFileName ) ) {
+        return;
+    }
+
+    QString errMsg;
+    {
+        QSqlDatabase db = Database::open( databaseFileName, &errMsg );
+        verify( "opening the database", true, db.isValid() );
+        const bool written = ColumnarArchive::write( db, archiveFileName, &errMsg );
+        verify( "writing the archive", true, written );
+        if ( !written ) {
+            cout << "  " << qPrintable( errMsg ) << endl;
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase( databaseFileName );
+    verify( "archive file name is recognized", true, ColumnarArchive::isArchive( archiveFileName ) );
+
+    // Everything
+    const QString fullFileName = dir.filePath( "full.trace" );
+    {
+        QSqlDatabase db = ColumnarArchive::extract( archiveFileName, fullFileName, &errMsg );
+        verify( "extracting the archive", true, db.isValid() );
+        if ( db.isValid() ) {
+            verifyEntries( db, 0, EntryCount - 1 );
+            verifySpecialEntries( db );
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase( fullFileName );
+
+    // A time range spanning the boundary between the first two blocks
+    const int first = ColumnarArchive::BlockEntries - 50;
+    const int last = ColumnarArchive::BlockEntries + 50;
+    const QString rangeFileName = dir.filePath( "range.trace" );
+    {
+        QSqlDatabase db = ColumnarArchive::extract( archiveFileName, rangeFileName, &errMsg,
+                                                    QDateTime::fromMSecsSinceEpoch( FirstTimeStamp + first * TimeStampStep ),
+                                                    QDateTime::fromMSecsSinceEpoch( FirstTimeStamp + last * TimeStampStep ) );
+        verify( "extracting a time range", true, db.isValid() );
+        if ( db.isValid() ) {
+            verifyEntries( db, first, last );
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase( rangeFileName );
+
+    // A time range only starting after the last entry
+    const QString emptyFileName = dir.filePath( "empty.trace" );
+    {
+        QSqlDatabase db = ColumnarArchive::extract( archiveFileName, emptyFileName, &errMsg,
+                                                    QDateTime::fromMSecsSinceEpoch( FirstTimeStamp + EntryCount * TimeStampStep ) );
+        verify( "extracting an empty time range", true, db.isValid() );
+        if ( db.isValid() ) {
+            QSqlQuery q( db );
+            q.exec( "SELECT COUNT(*) FROM trace_entry;" );
+            verify( "no entries in empty time range", true, q.next() && q.value( 0 ).toInt() == 0 );
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase( emptyFileName );
+
+    QFile::remove( databaseFileName );
+    QFile::remove( archiveFileName );
+    QFile::remove( fullFileName );
+    QFile::remove( rangeFileName );
+    QFile::remove( emptyFileName );
+}
+
+int main( int argc, char **argv )
+{
+    QCoreApplication a( argc, argv );
+
+    QDir dir( QDir::tempPath() );
+    const QString dirName = QString::fromLatin1( "test_columnararchive_%1" ).arg( QCoreApplication::applicationPid() );
+    dir.mkdir( dirName );
+    dir.cd( dirName );
+
+    testRoundTrip( dir );
+
+    QDir::temp().rmdir( dirName );
+
+    cout << g_verificationCount << " verifications; "
+         << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
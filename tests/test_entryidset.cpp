@@ -0,0 +1,207 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../gui/entryidset.h"
+
+#include <iostream>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify(const char *what, T expected, T actual)
+{
+    if (!(expected == actual)) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected
+             << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+// Walks the set with next(), starting before the smallest possible id
+static QVector<unsigned int> walk(const EntryIdSet &set)
+{
+    QVector<unsigned int> ids;
+    unsigned int id = 0;
+    if (set.contains(0)) {
+        ids.append(0);
+    }
+    while (set.next(id, &id)) {
+        ids.append(id);
+    }
+    return ids;
+}
+
+static void testEmpty()
+{
+    EntryIdSet set;
+    unsigned int id = 42;
+    verify("empty set is empty", true, set.isEmpty());
+    verify("empty set has no ids", 0, set.size());
+    verify("empty set contains nothing", false, set.contains(0));
+    verify("no next id in empty set", false, set.next(0, &id));
+    verify("next id is not written", 42u, id);
+}
+
+static void testArrayContainer()
+{
+    EntryIdSet set;
+    set.insert(5);
+    set.insert(1);
+    set.insert(3);
+    set.insert(3);
+    verify("duplicates are counted once", 3, set.size());
+    verify("contains 1", true, set.contains(1));
+    verify("does not contain 2", false, set.contains(2));
+    verify("contains 5", true, set.contains(5));
+
+    unsigned int id = 0;
+    verify("next after 1 exists", true, set.next(1, &id));
+    verify("next after 1", 3u, id);
+    verify("next after 4 exists", true, set.next(4, &id));
+    verify("next after 4", 5u, id);
+    verify("no next after 5", false, set.next(5, &id));
+
+    set.clear();
+    verify("cleared set is empty", true, set.isEmpty());
+    verify("cleared set contains nothing", false, set.contains(1));
+}
+
+/* A container holding more than 4096 ids switches from a sorted array to
+ * a bitmap; lookups must give the same answers before and after.
+ */
+static void testBitmapContainer()
+{
+    const unsigned int base = 3u << 16;
+
+    EntryIdSet set;
+    for (unsigned int i = 0; i < 4096; ++i) {
+        set.insert(base + i * 2);
+    }
+    verify("ids before switching to a bitmap", 4096, set.size());
+    verify("contains last even id", true, set.contains(base + 8190));
+    verify("does not contain odd id", false, set.contains(base + 8189));
+
+    set.insert(base + 8190);
+    verify("duplicate does not switch to a bitmap", 4096, set.size());
+
+    set.insert(base + 1);
+    verify("ids after switching to a bitmap", 4097, set.size());
+    verify("contains inserted odd id", true, set.contains(base + 1));
+    verify("does not contain other odd id", false, set.contains(base + 3));
+    verify("contains first id", true, set.contains(base));
+    verify("contains last id", true, set.contains(base + 8190));
+    verify("does not contain id past the last one", false, set.contains(base + 8192));
+    verify("does not contain id in other container", false, set.contains(8190));
+
+    set.insert(base + 1);
+    verify("duplicate in bitmap is counted once", 4097, set.size());
+    set.insert(base + 0xffff);
+    verify("contains highest id of bitmap container", true, set.contains(base + 0xffff));
+
+    unsigned int id = 0;
+    verify("next before container exists", true, set.next(0, &id));
+    verify("next before container", base, id);
+    verify("next in bitmap exists", true, set.next(base, &id));
+    verify("next in bitmap", base + 1, id);
+    verify("next across bitmap words exists", true, set.next(base + 63, &id));
+    verify("next across bitmap words", base + 64, id);
+    verify("next across empty bitmap words exists", true, set.next(base + 8190, &id));
+    verify("next across empty bitmap words", base + 0xffff, id);
+    verify("no next after highest id", false, set.next(base + 0xffff, &id));
+
+    const QVector<unsigned int> ids = walk(set);
+    verify("walked ids", 4098, ids.size());
+    bool ascending = true;
+    for (int i = 1; i < ids.size(); ++i) {
+        ascending = ascending && ids[i - 1] < ids[i];
+    }
+    verify("walked ids are ascending", true, ascending);
+}
+
+static void testContainerBoundaries()
+{
+    EntryIdSet set;
+    set.insert(0);
+    set.insert(0xffff);
+    set.insert(0x10000);
+    set.insert(0x50003);
+    set.insert(0xffffffffu);
+    verify("ids in five containers", 5, set.size());
+
+    unsigned int id = 0;
+    verify("next at end of first container exists", true, set.next(0, &id));
+    verify("next at end of first container", 0xffffu, id);
+    verify("next in following container exists", true, set.next(0xffff, &id));
+    verify("next in following container", 0x10000u, id);
+    verify("next skipping missing containers exists", true, set.next(0x10000, &id));
+    verify("next skipping missing containers", 0x50003u, id);
+    verify("next from id not in set exists", true, set.next(0x20000, &id));
+    verify("next from id not in set", 0x50003u, id);
+    verify("next to highest id exists", true, set.next(0x50003, &id));
+    verify("next to highest id", 0xffffffffu, id);
+    verify("no next after highest id", false, set.next(0xffffffffu, &id));
+    verify("next before highest id exists", true, set.next(0xfffffffeu, &id));
+    verify("next before highest id", 0xffffffffu, id);
+
+    verify("contains 0", true, set.contains(0));
+    verify("contains highest id", true, set.contains(0xffffffffu));
+    verify("does not contain id before highest", false, set.contains(0xfffffffeu));
+
+    const QVector<unsigned int> ids = walk(set);
+    verify("walked ids", 5, ids.size());
+    if (ids.size() == 5) {
+        verify("first walked id", 0u, ids[0]);
+        verify("last walked id", 0xffffffffu, ids[4]);
+    }
+}
+
+static void testInsertionOrder()
+{
+    EntryIdSet set;
+    set.insert(0x30001);
+    set.insert(0x10001);
+    set.insert(0x20001);
+    set.insert(0x10000);
+
+    const QVector<unsigned int> ids = walk(set);
+    verify("walked ids", 4, ids.size());
+    if (ids.size() == 4) {
+        verify("first id", 0x10000u, ids[0]);
+        verify("second id", 0x10001u, ids[1]);
+        verify("third id", 0x20001u, ids[2]);
+        verify("fourth id", 0x30001u, ids[3]);
+    }
+}
+
+int main()
+{
+    testEmpty();
+    testArrayContainer();
+    testBitmapContainer();
+    testContainerBoundaries();
+    testInsertionOrder();
+
+    cout << g_verificationCount << " verifications; "
+         << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
@@ -0,0 +1,175 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Writes more entries through the mmapfile output than the kept segments can
+ * hold and verifies that the remaining segments can still be imported.
+ */
+
+#include "config.h" // for uint64_t
+#include "tracelib.h"
+#include "log.h"
+#include "output.h"
+#include "serializer.h"
+#include "trace.h"
+
+#include "../server/binarycontenthandler.h"
+#include "../server/segmentfilereader.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QScopedPointer>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+static const int EntryCount = 2000;
+static const unsigned long SegmentSize = 4096;
+static const unsigned long MaxSegments = 3;
+static const uint64_t FirstTimeStamp = 1400000000000ULL;
+
+TRACELIB_NAMESPACE_BEGIN
+
+// Like Trace::addEntry()
+static void writeEntry( Serializer &serializer, Output &output, const TraceEntry &entry )
+{
+    vector<char> data = serializer.serialize( entry );
+    if ( output.startsStream( data.size() ) ) {
+        serializer.restartStream();
+        data = serializer.serialize( entry );
+    }
+    output.write( data );
+}
+
+static void writeSegments( const string &fileName )
+{
+    static TracePoint evenTracePoint( TracePointType::Log, "test_segmentfiles.cpp", 10, "even", 0 );
+    static TracePoint oddTracePoint( TracePointType::Debug, "test_segmentfiles.cpp", 20, "odd", 0 );
+
+    NullLogOutput logOutput;
+    Log log( &logOutput, &logOutput );
+    BinarySerializer serializer;
+    MmapFileOutput output( &log, fileName, SegmentSize, MaxSegments );
+    output.setBinaryMode( serializer.isBinary() );
+    verify( "opening the mmapfile output", true, output.open() );
+
+    for ( int i = 0; i < EntryCount; ++i ) {
+        char message[32];
+        snprintf( message, sizeof( message ), "entry %d", i );
+        TraceEntry entry( i % 2 == 0 ? &evenTracePoint : &oddTracePoint, message,
+                          1, FirstTimeStamp + i * 7, 0 );
+        writeEntry( serializer, output, entry );
+    }
+}
+
+TRACELIB_NAMESPACE_END
+
+class EntryCollector : public XmlParseEventsHandler
+{
+public:
+    QList<TraceEntry> entries;
+
+protected:
+    virtual void handleTraceEntry( const TraceEntry &entry ) { entries.append( entry ); }
+    virtual void applyStorageConfiguration( const StorageConfiguration & ) { }
+    virtual void handleShutdownEvent( const ProcessShutdownEvent & ) { }
+};
+
+static void testRotatedSegments()
+{
+    QDir dir( QDir::tempPath() );
+    const QString dirName = QString::fromLatin1( "test_segmentfiles_%1" ).arg( QCoreApplication::applicationPid() );
+    dir.mkdir( dirName );
+    dir.cd( dirName );
+    const QString baseName = dir.filePath( QLatin1String( "trace" ) );
+
+    TRACELIB_NAMESPACE_IDENT(writeSegments)( baseName.toStdString() );
+
+    const QStringList segmentFiles = SegmentFileReader::segmentFiles( baseName );
+    verify( "number of kept segments", static_cast<int>( MaxSegments ), segmentFiles.size() );
+
+    // Import the segments like 'xml2trace --segments' does
+    EntryCollector collector;
+    QScopedPointer<BinaryContentHandler> parser;
+    foreach ( const QString &segmentFile, segmentFiles ) {
+        SegmentFileReader reader;
+        QString errMsg;
+        verify( "opening segment", true, reader.open( segmentFile, &errMsg ) );
+        verify( "segment starts a stream", true, reader.startsStream() );
+        if ( reader.startsStream() ) {
+            parser.reset( new BinaryContentHandler( &collector ) );
+        }
+
+        QByteArray record;
+        while ( parser && reader.readRecord( &record ) ) {
+            try {
+                parser->addData( record );
+                parser->continueParsing();
+            } catch ( const BinaryParseException &ex ) {
+                cout << "FAIL: decoding " << qPrintable( segmentFile ) << ": " << ex.what() << endl;
+                ++g_failureCount;
+                break;
+            }
+        }
+        verify( "segment is complete", false, reader.isTruncated() );
+    }
+
+    verify( "some entries were imported", true, !collector.entries.isEmpty() );
+    verify( "older entries were removed", true, collector.entries.size() < EntryCount );
+
+    const int firstIndex = EntryCount - collector.entries.size();
+    for ( int i = 0; i < collector.entries.size(); ++i ) {
+        const TraceEntry &entry = collector.entries[i];
+        const int index = firstIndex + i;
+        verify( "entry message", QString::fromLatin1( "entry %1" ).arg( index ).toStdString(), entry.message.toStdString() );
+        verify( "entry function", string( index % 2 == 0 ? "even" : "odd" ), entry.function.toStdString() );
+        verify( "entry timestamp", static_cast<qint64>( FirstTimeStamp + index * 7 ), entry.timestamp.toMSecsSinceEpoch() );
+    }
+
+    foreach ( const QString &segmentFile, segmentFiles ) {
+        QFile::remove( segmentFile );
+    }
+    QDir::temp().rmdir( dirName );
+}
+
+int main( int argc, char **argv )
+{
+    QCoreApplication a( argc, argv );
+
+    testRotatedSegments();
+
+    cout << g_verificationCount << " verifications; "
+         << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
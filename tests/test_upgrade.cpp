@@ -0,0 +1,239 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Creates a trace database using schema version 5, upgrades it to the
+ * current version and verifies that backtraces survive interning the
+ * stack frames and that the latest watched values are known.
+ */
+
+#include "../server/database.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+// Schema and contents of a version 5 database, as written by older servers
+static const char * const version5Statements[] = {
+    "CREATE TABLE schema_downgrade (from_version INTEGER, statements TEXT);",
+    "CREATE TABLE trace_entry (id INTEGER PRIMARY KEY AUTOINCREMENT, traced_thread_id INTEGER, timestamp INTEGER, trace_point_id INTEGER, message TEXT, stack_position INTEGER);",
+    "CREATE TABLE trace_point (id INTEGER PRIMARY KEY AUTOINCREMENT, type INTEGER, path_id INTEGER, line INTEGER, function_id INTEGER, group_id INTEGER, UNIQUE(type, path_id, line, function_id, group_id));",
+    "CREATE TABLE function_name (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, UNIQUE(name));",
+    "CREATE TABLE path_name (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, UNIQUE(name));",
+    "CREATE TABLE process (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, pid INTEGER, start_time INTEGER, end_time INTEGER, UNIQUE(name, pid));",
+    "CREATE TABLE traced_thread (id INTEGER PRIMARY KEY AUTOINCREMENT, process_id INTEGER, tid INTEGER, UNIQUE(process_id, tid));",
+    "CREATE TABLE variable (trace_entry_id INTEGER, name TEXT, value TEXT, type INTEGER);",
+    "CREATE TABLE stackframe (trace_entry_id INTEGER, depth INTEGER, module_name TEXT, function_name TEXT, offset INTEGER, file_name TEXT, line INTEGER);",
+    "CREATE TABLE trace_point_group(id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, UNIQUE(name));",
+    "INSERT INTO schema_downgrade VALUES(1, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(2, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(3, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(4, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(5, 'NOT IMPLEMENTED');",
+
+    "INSERT INTO process VALUES(1, 'app', 4711, 1400000000000, NULL);",
+    "INSERT INTO traced_thread VALUES(1, 1, 1);",
+    "INSERT INTO traced_thread VALUES(2, 1, 2);",
+    "INSERT INTO function_name VALUES(1, 'watch()');",
+    "INSERT INTO function_name VALUES(2, 'log()');",
+    "INSERT INTO path_name VALUES(1, '/src/test.cpp');",
+    "INSERT INTO trace_point VALUES(1, 3, 1, 10, 1, NULL);",
+    "INSERT INTO trace_point VALUES(2, 1, 1, 20, 2, NULL);",
+
+    // Entries 1, 2 and 4 watch variables, the others do not
+    "INSERT INTO trace_entry VALUES(1, 1, 1400000000001, 1, NULL, 0);",
+    "INSERT INTO trace_entry VALUES(2, 1, 1400000000002, 1, NULL, 0);",
+    "INSERT INTO trace_entry VALUES(3, 1, 1400000000003, 1, 'no variables', 0);",
+    "INSERT INTO trace_entry VALUES(4, 2, 1400000000004, 1, NULL, 0);",
+    "INSERT INTO trace_entry VALUES(5, 1, 1400000000005, 2, 'with backtrace', 0);",
+    "INSERT INTO trace_entry VALUES(6, 2, 1400000000006, 2, 'with backtrace', 0);",
+    "INSERT INTO variable VALUES(1, 'i', '1', 2);",
+    "INSERT INTO variable VALUES(2, 'i', '2', 2);",
+    "INSERT INTO variable VALUES(4, 'i', '4', 2);",
+
+    /* Both backtraces share frames, and frames of code without debug
+     * information lack file name and line number (NULL).
+     */
+    "INSERT INTO stackframe VALUES(5, 0, 'libfoo.so', 'foo()', 16, '/src/foo.cpp', 42);",
+    "INSERT INTO stackframe VALUES(5, 1, 'libc.so', 'qsort', 64, NULL, NULL);",
+    "INSERT INTO stackframe VALUES(5, 2, 'app', 'main', 128, '/src/main.cpp', 7);",
+    "INSERT INTO stackframe VALUES(6, 0, 'libc.so', 'qsort', 64, NULL, NULL);",
+    "INSERT INTO stackframe VALUES(6, 1, 'libc.so', 'qsort', 64, NULL, NULL);",
+    "INSERT INTO stackframe VALUES(6, 2, 'app', 'main', 128, '/src/main.cpp', 7);"
+};
+
+static bool createVersion5Database( const QString &fileName )
+{
+    bool created = true;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase( "QSQLITE", fileName );
+        db.setDatabaseName( fileName );
+        verify( "creating version 5 database", true, db.open() );
+
+        QSqlQuery query( db );
+        for ( unsigned i = 0; i < sizeof( version5Statements ) / sizeof( version5Statements[0] ); ++i ) {
+            if ( !query.exec( version5Statements[i] ) ) {
+                cout << "FAIL: executing '" << version5Statements[i] << "': "
+                     << qPrintable( query.lastError().text() ) << endl;
+                ++g_failureCount;
+                created = false;
+                break;
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase( fileName );
+    return created;
+}
+
+static int countRows( QSqlDatabase db, const char *statement )
+{
+    QSqlQuery q( db );
+    if ( !q.exec( statement ) || !q.next() ) {
+        return -1;
+    }
+    return q.value( 0 ).toInt();
+}
+
+static void verifyFrame( const StackFrame &frame, const char *module, const char *function,
+                         size_t offset, const char *sourceFile, size_t line )
+{
+    verify( "frame module", string( module ), frame.module.toStdString() );
+    verify( "frame function", string( function ), frame.function.toStdString() );
+    verify( "frame offset", offset, frame.functionOffset );
+    verify( "frame source file", string( sourceFile ), frame.sourceFile.toStdString() );
+    verify( "frame line", line, frame.lineNumber );
+}
+
+static void verifyBacktraces( QSqlDatabase db )
+{
+    verify( "interned frames", 3, countRows( db, "SELECT COUNT(*) FROM frame;" ) );
+    verify( "stack frames", 6, countRows( db, "SELECT COUNT(*) FROM stackframe;" ) );
+
+    const QList<StackFrame> first = Database::backtraceForEntry( db, 5 );
+    verify( "depth of first backtrace", 3, first.size() );
+    if ( first.size() == 3 ) {
+        verifyFrame( first[0], "libfoo.so", "foo()", 16, "/src/foo.cpp", 42 );
+        verifyFrame( first[1], "libc.so", "qsort", 64, "", 0 );
+        verifyFrame( first[2], "app", "main", 128, "/src/main.cpp", 7 );
+    }
+
+    const QList<StackFrame> second = Database::backtraceForEntry( db, 6 );
+    verify( "depth of second backtrace", 3, second.size() );
+    if ( second.size() == 3 ) {
+        verifyFrame( second[0], "libc.so", "qsort", 64, "", 0 );
+        verifyFrame( second[1], "libc.so", "qsort", 64, "", 0 );
+        verifyFrame( second[2], "app", "main", 128, "/src/main.cpp", 7 );
+    }
+
+    verify( "entry without backtrace", 0, Database::backtraceForEntry( db, 1 ).size() );
+}
+
+static void verifyWatchLatest( QSqlDatabase db )
+{
+    QSqlQuery q( db );
+    verify( "querying watch_latest", true,
+            q.exec( "SELECT trace_point_id, traced_thread_id, trace_entry_id FROM watch_latest"
+                    " ORDER BY trace_point_id, traced_thread_id;" ) );
+
+    // Entry 3 is more recent than 2 but carries no variables
+    verify( "latest watch of thread 1 exists", true, q.next() );
+    verify( "trace point of thread 1", 1, q.value( 0 ).toInt() );
+    verify( "thread 1", 1, q.value( 1 ).toInt() );
+    verify( "latest entry of thread 1", 2, q.value( 2 ).toInt() );
+
+    verify( "latest watch of thread 2 exists", true, q.next() );
+    verify( "trace point of thread 2", 1, q.value( 0 ).toInt() );
+    verify( "thread 2", 2, q.value( 1 ).toInt() );
+    verify( "latest entry of thread 2", 4, q.value( 2 ).toInt() );
+
+    verify( "no watch for entries without variables", false, q.next() );
+}
+
+static void testUpgradeFromVersion5( const QDir &dir )
+{
+    const QString fileName = dir.filePath( "version5.trace" );
+    if ( !createVersion5Database( fileName ) ) {
+        QFile::remove( fileName );
+        return;
+    }
+
+    {
+        QString errMsg;
+        QSqlDatabase db = Database::openAnyVersion( fileName, &errMsg );
+        verify( "opening version 5 database", true, db.isValid() );
+        verify( "version before upgrade", 5, Database::currentVersion( db, &errMsg ) );
+
+        const bool upgraded = Database::upgrade( db, &errMsg );
+        verify( "upgrading the database", true, upgraded );
+        if ( !upgraded ) {
+            cout << "  " << qPrintable( errMsg ) << endl;
+        }
+        verify( "version after upgrade", Database::expectedVersion, Database::currentVersion( db, &errMsg ) );
+
+        if ( upgraded ) {
+            verifyBacktraces( db );
+            verifyWatchLatest( db );
+            if ( Database::hasTextIndex( db ) ) {
+                verify( "all messages are indexed", 6, countRows( db, "SELECT COUNT(*) FROM trace_entry_text;" ) );
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase( fileName );
+    QFile::remove( fileName );
+}
+
+int main( int argc, char **argv )
+{
+    QCoreApplication a( argc, argv );
+
+    QDir dir( QDir::tempPath() );
+    const QString dirName = QString::fromLatin1( "test_upgrade_%1" ).arg( QCoreApplication::applicationPid() );
+    dir.mkdir( dirName );
+    dir.cd( dirName );
+
+    testUpgradeFromVersion5( dir );
+
+    QDir::temp().rmdir( dirName );
+
+    cout << g_verificationCount << " verifications; "
+         << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
@@ -0,0 +1,667 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures the cost of the tracelib hot path: the trace point macros (with
+ * tracing disabled and enabled), backtrace generation, the serializers and
+ * the outputs. Each benchmark is run with 1, 2, 4, ... up to the given number
+ * of threads; the results are printed to stdout as a JSON document so that
+ * they can be compared between builds.
+ *
+ * This is not registered as a test: the timings only mean something when
+ * compared with other runs on the same machine, so there is nothing to pass
+ * or fail. It links against tracelib internals which are only exported on
+ * Unix, so it is not built on Windows.
+ *
+ * Usage: tracelib_bench [--threads N] [--iterations N] [--filter SUBSTRING]
+ */
+
+#include "config.h" // for uint64_t
+#include "tracelib.h"
+#include "atomic.h"
+#include "configuration.h"
+#include "log.h"
+#include "mutex.h"
+#include "output.h"
+#include "serializer.h"
+#include "thread.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+TRACELIB_NAMESPACE_BEGIN
+
+// All allocations made while g_countAllocations is set are counted
+static AtomicInt g_countAllocations;
+static AtomicInt g_allocationCount;
+
+static uint64_t nanoSeconds()
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return static_cast<uint64_t>( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+static const char ConfigFileName[] = "tracelib_bench.xml";
+
+class NullOutput : public Output
+{
+public:
+    virtual void write( const vector<char> &data ) { }
+};
+
+class Benchmark
+{
+public:
+    Benchmark( const char *name, unsigned long iterationDivisor )
+        : m_name( name ), m_iterationDivisor( iterationDivisor ) { }
+    virtual ~Benchmark() { }
+
+    const char *name() const { return m_name; }
+    unsigned long iterationDivisor() const { return m_iterationDivisor; }
+
+    virtual bool setUp() { return true; }
+    virtual void tearDown() { }
+    virtual void run( unsigned long iterations ) = 0;
+
+private:
+    Benchmark( const Benchmark &other ); // disabled
+    void operator=( const Benchmark &rhs ); // disabled
+
+    const char * const m_name;
+    const unsigned long m_iterationDivisor;
+};
+
+/* Runs trace point macros against the active Trace object, configured with
+ * the given <tracepointset> element and a plaintext serializer. The output
+ * is replaced with a NullOutput so that only tracelib itself is measured.
+ */
+class TraceBenchmark : public Benchmark
+{
+public:
+    typedef void (*Body)( unsigned long iterations );
+
+    TraceBenchmark( const char *name, unsigned long iterationDivisor,
+                    const char *tracePointSet, Body body )
+        : Benchmark( name, iterationDivisor ),
+        m_tracePointSet( tracePointSet ),
+        m_body( body ) { }
+
+    virtual bool setUp() {
+        FILE *f = fopen( ConfigFileName, "w" );
+        if ( !f ) {
+            fprintf( stderr, "Failed to write %s\n", ConfigFileName );
+            return false;
+        }
+        fprintf( f, "<tracelibConfiguration><process><name>tracelib_bench</name>"
+                    "<serializer type=\"plaintext\"/>%s</process></tracelibConfiguration>",
+                 m_tracePointSet );
+        fclose( f );
+
+        setenv( "TRACELIB_CONFIG_FILE", ConfigFileName, 1 );
+        getActiveTrace()->setOutput( new NullOutput );
+        return true;
+    }
+
+    virtual void tearDown() {
+        Trace *trace = getActiveTrace();
+        setActiveTrace( 0 );
+        delete trace;
+        remove( ConfigFileName );
+    }
+
+    virtual void run( unsigned long iterations ) {
+        m_body( iterations );
+    }
+
+private:
+    const char * const m_tracePointSet;
+    const Body m_body;
+};
+
+static void traceDisabled( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE
+    }
+}
+
+static void traceEnabled( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE
+    }
+}
+
+static void watchOneVariable( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        const unsigned long v0 = i;
+        TRACELIB_WATCH(TRACELIB_VAR(v0))
+    }
+}
+
+static void watchFourVariables( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        const unsigned long v0 = i, v1 = i + 1, v2 = i + 2, v3 = i + 3;
+        TRACELIB_WATCH(TRACELIB_VAR(v0) << TRACELIB_VAR(v1) << TRACELIB_VAR(v2) << TRACELIB_VAR(v3))
+    }
+}
+
+static void watchSixteenVariables( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        const unsigned long v0 = i, v1 = i + 1, v2 = i + 2, v3 = i + 3;
+        const unsigned long v4 = i + 4, v5 = i + 5, v6 = i + 6, v7 = i + 7;
+        const unsigned long v8 = i + 8, v9 = i + 9, v10 = i + 10, v11 = i + 11;
+        const unsigned long v12 = i + 12, v13 = i + 13, v14 = i + 14, v15 = i + 15;
+        TRACELIB_WATCH(TRACELIB_VAR(v0) << TRACELIB_VAR(v1) << TRACELIB_VAR(v2) << TRACELIB_VAR(v3)
+                       << TRACELIB_VAR(v4) << TRACELIB_VAR(v5) << TRACELIB_VAR(v6) << TRACELIB_VAR(v7)
+                       << TRACELIB_VAR(v8) << TRACELIB_VAR(v9) << TRACELIB_VAR(v10) << TRACELIB_VAR(v11)
+                       << TRACELIB_VAR(v12) << TRACELIB_VAR(v13) << TRACELIB_VAR(v14) << TRACELIB_VAR(v15))
+    }
+}
+
+static void traceStream( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE_STREAM(NULL) << "iteration " << i << TRACELIB_STREAM_END;
+    }
+}
+
+static void traceWithBacktrace( unsigned long iterations )
+{
+    for ( unsigned long i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE
+    }
+}
+
+/* Serializes a watch point entry with four variables; the serializer is
+ * shared by all threads and locked just like Trace::addEntry() does.
+ */
+class SerializerBenchmark : public Benchmark
+{
+public:
+    SerializerBenchmark( const char *name, Serializer *serializer )
+        : Benchmark( name, 1 ), m_serializer( serializer ) { }
+    virtual ~SerializerBenchmark() { delete m_serializer; }
+
+    virtual void run( unsigned long iterations ) {
+        static TracePoint tracePoint( TracePointType::Watch, __FILE__, __LINE__, "SerializerBenchmark::run", 0 );
+
+        EntryArenaScope entryArenaScope;
+        const unsigned long v0 = 0, v1 = 1, v2 = 2, v3 = 3;
+        VariableSnapshot variables;
+        variables << TRACELIB_VAR(v0) << TRACELIB_VAR(v1) << TRACELIB_VAR(v2) << TRACELIB_VAR(v3);
+
+        TraceEntry entry( &tracePoint, "A benchmark message" );
+        entry.variables = &variables;
+        for ( unsigned long i = 0; i < iterations; ++i ) {
+            MutexLocker serializerLocker( m_serializerMutex );
+            m_serializer->serialize( entry );
+        }
+    }
+
+private:
+    Serializer * const m_serializer;
+    Mutex m_serializerMutex;
+};
+
+/* Writes a typical serialized entry to a shared output, locked just like
+ * Trace::addEntry() does.
+ */
+class OutputBenchmark : public Benchmark
+{
+public:
+    OutputBenchmark( const char *name, unsigned long iterationDivisor )
+        : Benchmark( name, iterationDivisor ),
+        m_log( &m_logOutput, &m_logOutput ),
+        m_output( 0 ),
+        m_data( 200, 'x' ) { }
+
+    virtual bool setUp() {
+        m_output = createOutput( &m_log );
+        if ( !m_output ) {
+            return false;
+        }
+        // Network outputs connect asynchronously
+        for ( int i = 0; i < 100 && !m_output->open(); ++i ) {
+            Thread::sleep( 10 );
+        }
+        if ( !m_output->canWrite() ) {
+            fprintf( stderr, "Failed to open the output for %s\n", name() );
+            return false;
+        }
+        return true;
+    }
+
+    virtual void tearDown() {
+        delete m_output;
+        m_output = 0;
+    }
+
+    virtual void run( unsigned long iterations ) {
+        for ( unsigned long i = 0; i < iterations; ++i ) {
+            MutexLocker outputLocker( m_outputMutex );
+            m_output->write( m_data );
+        }
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) = 0;
+
+private:
+    NullLogOutput m_logOutput;
+    Log m_log;
+    Output *m_output;
+    Mutex m_outputMutex;
+    const vector<char> m_data;
+};
+
+class FileOutputBenchmark : public OutputBenchmark
+{
+public:
+    FileOutputBenchmark() : OutputBenchmark( "output_file", 10 ) { }
+
+    virtual void tearDown() {
+        OutputBenchmark::tearDown();
+        remove( "tracelib_bench.trace" );
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) {
+        return new FileOutput( log, "tracelib_bench.trace" );
+    }
+};
+
+class MmapFileOutputBenchmark : public OutputBenchmark
+{
+public:
+    MmapFileOutputBenchmark() : OutputBenchmark( "output_mmapfile", 1 ) { }
+
+    virtual void tearDown() {
+        OutputBenchmark::tearDown();
+        // The segments are numbered consecutively, starting with 0
+        for ( unsigned long i = 0; ; ++i ) {
+            char fileName[64];
+            snprintf( fileName, sizeof( fileName ), "tracelib_bench.segments.%06lu", i );
+            if ( remove( fileName ) != 0 ) {
+                break;
+            }
+        }
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) {
+        return new MmapFileOutput( log, "tracelib_bench.segments" );
+    }
+};
+
+class MultiplexingOutputBenchmark : public OutputBenchmark
+{
+public:
+    MultiplexingOutputBenchmark() : OutputBenchmark( "output_multiplexing", 10 ) { }
+
+    virtual void tearDown() {
+        OutputBenchmark::tearDown();
+        remove( "tracelib_bench.trace" );
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) {
+        // MultiplexingOutput does not open the outputs it contains
+        FileOutput *fileOutput = new FileOutput( log, "tracelib_bench.trace" );
+        fileOutput->open();
+
+        MultiplexingOutput *output = new MultiplexingOutput;
+        output->addOutput( fileOutput );
+        output->addOutput( new NullOutput );
+        return output;
+    }
+};
+
+/* stdout carries the results, so it is pointed to the null device while
+ * this benchmark runs.
+ */
+class StdoutOutputBenchmark : public OutputBenchmark
+{
+public:
+    StdoutOutputBenchmark()
+        : OutputBenchmark( "output_stdout", 10 ),
+        m_savedStdout( -1 ) { }
+
+    virtual bool setUp() {
+        fflush( stdout );
+        m_savedStdout = dup( fileno( stdout ) );
+        FILE *nullDevice = fopen( "/dev/null", "w" );
+        dup2( fileno( nullDevice ), fileno( stdout ) );
+        fclose( nullDevice );
+        if ( !OutputBenchmark::setUp() ) {
+            tearDown();
+            return false;
+        }
+        return true;
+    }
+
+    virtual void tearDown() {
+        OutputBenchmark::tearDown();
+        fflush( stdout );
+        dup2( m_savedStdout, fileno( stdout ) );
+        close( m_savedStdout );
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) {
+        return new StdoutOutput;
+    }
+
+private:
+    int m_savedStdout;
+};
+
+/* Accepts a single connection and discards everything sent over it. */
+class DiscardingServer : public Thread
+{
+public:
+    DiscardingServer() : m_socket( -1 ), m_port( 0 ) { }
+    ~DiscardingServer() {
+        if ( m_socket != -1 ) {
+            close( m_socket );
+        }
+    }
+
+    bool listen() {
+        m_socket = socket( AF_INET, SOCK_STREAM, 0 );
+        sockaddr_in addr;
+        memset( &addr, 0, sizeof( addr ) );
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        socklen_t addrLen = sizeof( addr );
+        if ( m_socket == -1 ||
+             bind( m_socket, reinterpret_cast<sockaddr *>( &addr ), sizeof( addr ) ) != 0 ||
+             ::listen( m_socket, 1 ) != 0 ||
+             getsockname( m_socket, reinterpret_cast<sockaddr *>( &addr ), &addrLen ) != 0 ) {
+            return false;
+        }
+        m_port = ntohs( addr.sin_port );
+        return true;
+    }
+
+    unsigned short port() const { return m_port; }
+
+protected:
+    virtual void run() {
+        const int client = accept( m_socket, 0, 0 );
+        if ( client == -1 ) {
+            return;
+        }
+        char buf[65536];
+        while ( read( client, buf, sizeof( buf ) ) > 0 ) {
+        }
+        close( client );
+    }
+
+private:
+    int m_socket;
+    unsigned short m_port;
+};
+
+class NetworkOutputBenchmark : public OutputBenchmark
+{
+public:
+    NetworkOutputBenchmark()
+        : OutputBenchmark( "output_network", 10 ),
+        m_server( 0 ) { }
+
+    virtual bool setUp() {
+        m_server = new DiscardingServer;
+        if ( !m_server->listen() ) {
+            fprintf( stderr, "Failed to listen for connections\n" );
+            return false;
+        }
+        m_server->start();
+        return OutputBenchmark::setUp();
+    }
+
+    virtual void tearDown() {
+        // Closing the connection ends the server thread
+        OutputBenchmark::tearDown();
+        m_server->wait();
+        delete m_server;
+        m_server = 0;
+    }
+
+protected:
+    virtual Output *createOutput( Log *log ) {
+        return new NetworkOutput( log, "127.0.0.1", m_server->port() );
+    }
+
+private:
+    DiscardingServer *m_server;
+};
+
+class BenchmarkThread : public Thread
+{
+public:
+    BenchmarkThread( Benchmark *benchmark, unsigned long iterations, AtomicInt *go )
+        : m_benchmark( benchmark ), m_iterations( iterations ), m_go( go ) { }
+
+protected:
+    virtual void run() {
+        while ( !m_go->load() ) {
+        }
+        m_benchmark->run( m_iterations );
+    }
+
+private:
+    Benchmark * const m_benchmark;
+    const unsigned long m_iterations;
+    AtomicInt * const m_go;
+};
+
+/* Runs the benchmark in the given number of threads and returns the elapsed
+ * wall clock time in nanoseconds.
+ */
+static uint64_t runThreads( Benchmark *benchmark, int numThreads, unsigned long iterations )
+{
+    AtomicInt go;
+    vector<BenchmarkThread *> threads;
+    for ( int i = 0; i < numThreads; ++i ) {
+        threads.push_back( new BenchmarkThread( benchmark, iterations, &go ) );
+        threads.back()->start();
+    }
+
+    const uint64_t startTime = nanoSeconds();
+    go.store( 1 );
+    for ( int i = 0; i < numThreads; ++i ) {
+        threads[i]->wait();
+    }
+    const uint64_t elapsed = nanoSeconds() - startTime;
+
+    deleteRange( threads.begin(), threads.end() );
+    return elapsed;
+}
+
+static bool runBenchmark( Benchmark *benchmark, int maxThreads, unsigned long iterations,
+                          vector<string> *results )
+{
+    if ( !benchmark->setUp() ) {
+        return false;
+    }
+
+    iterations = max( iterations / benchmark->iterationDivisor(), 1UL );
+
+    // Warm up caches and configure the trace points
+    benchmark->run( min( iterations, 1000UL ) );
+
+    int numThreads = 1;
+    while ( true ) {
+        const uint64_t elapsed = runThreads( benchmark, numThreads, iterations );
+
+        // Counting allocations slows things down, so it gets a separate run
+        const unsigned long countedIterations = max( iterations / 10, 1UL );
+        g_allocationCount.store( 0 );
+        g_countAllocations.store( 1 );
+        runThreads( benchmark, numThreads, countedIterations );
+        g_countAllocations.store( 0 );
+        const long allocations = g_allocationCount.load();
+
+        // Printed later on since stdout might be redirected right now
+        const double totalOps = static_cast<double>( iterations ) * numThreads;
+        char buf[512];
+        snprintf( buf, sizeof( buf ),
+                  "    { \"name\": \"%s\", \"threads\": %d, \"iterations\": %lu, "
+                  "\"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, \"allocs_per_op\": %.2f }",
+                  benchmark->name(), numThreads, iterations,
+                  static_cast<double>( elapsed ) / iterations,
+                  totalOps * 1e9 / static_cast<double>( elapsed ),
+                  static_cast<double>( allocations ) / ( static_cast<double>( countedIterations ) * numThreads ) );
+        results->push_back( buf );
+
+        if ( numThreads == maxThreads ) {
+            break;
+        }
+        numThreads = min( numThreads * 2, maxThreads );
+    }
+
+    benchmark->tearDown();
+    return true;
+}
+
+static int runBenchmarks( int argc, char **argv )
+{
+    int maxThreads = 4;
+    unsigned long iterations = 200000;
+    const char *filter = 0;
+    for ( int i = 1; i < argc; ++i ) {
+        if ( strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc ) {
+            maxThreads = max( atoi( argv[++i] ), 1 );
+        } else if ( strcmp( argv[i], "--iterations" ) == 0 && i + 1 < argc ) {
+            iterations = max( strtoul( argv[++i], 0, 10 ), 1UL );
+        } else if ( strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc ) {
+            filter = argv[++i];
+        } else {
+            fprintf( stderr, "Usage: %s [--threads N] [--iterations N] [--filter SUBSTRING]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    static const char MatchNothing[] = "<tracepointset><pathfilter>no-such-file.cpp</pathfilter></tracepointset>";
+    static const char MatchAll[] = "<tracepointset variables=\"yes\"><matchallfilter/></tracepointset>";
+    static const char MatchAllWithBacktraces[] = "<tracepointset backtraces=\"yes\"><matchallfilter/></tracepointset>";
+    static const char MatchAllSampled[] = "<tracepointset sample=\"1/100\"><matchallfilter/></tracepointset>";
+    static const char MatchAllRateLimited[] = "<tracepointset maxrate=\"1000/s\"><matchallfilter/></tracepointset>";
+    static const char MatchAllBuffered[] = "<buffering overflow=\"drop\"/><tracepointset variables=\"yes\"><matchallfilter/></tracepointset>";
+
+    XMLSerializer *beautifiedXmlSerializer = new XMLSerializer;
+    beautifiedXmlSerializer->setBeautifiedOutput( true );
+
+    vector<Benchmark *> benchmarks;
+    benchmarks.push_back( new TraceBenchmark( "trace_disabled", 1, MatchNothing, traceDisabled ) );
+    benchmarks.push_back( new TraceBenchmark( "trace_enabled_nulloutput", 1, MatchAll, traceEnabled ) );
+    benchmarks.push_back( new TraceBenchmark( "trace_sampled", 1, MatchAllSampled, traceEnabled ) );
+    benchmarks.push_back( new TraceBenchmark( "trace_ratelimited", 1, MatchAllRateLimited, traceEnabled ) );
+    benchmarks.push_back( new TraceBenchmark( "watch_1_var", 1, MatchAll, watchOneVariable ) );
+    benchmarks.push_back( new TraceBenchmark( "watch_4_vars", 1, MatchAll, watchFourVariables ) );
+    benchmarks.push_back( new TraceBenchmark( "watch_16_vars", 1, MatchAll, watchSixteenVariables ) );
+    benchmarks.push_back( new TraceBenchmark( "watch_4_vars_buffered", 1, MatchAllBuffered, watchFourVariables ) );
+    benchmarks.push_back( new TraceBenchmark( "trace_stream", 1, MatchAll, traceStream ) );
+    benchmarks.push_back( new TraceBenchmark( "trace_backtrace", 100, MatchAllWithBacktraces, traceWithBacktrace ) );
+    benchmarks.push_back( new SerializerBenchmark( "serializer_plaintext", new PlaintextSerializer ) );
+    benchmarks.push_back( new SerializerBenchmark( "serializer_xml", new XMLSerializer ) );
+    benchmarks.push_back( new SerializerBenchmark( "serializer_xml_beautified", beautifiedXmlSerializer ) );
+    benchmarks.push_back( new SerializerBenchmark( "serializer_binary", new BinarySerializer ) );
+    benchmarks.push_back( new FileOutputBenchmark );
+    benchmarks.push_back( new MmapFileOutputBenchmark );
+    benchmarks.push_back( new StdoutOutputBenchmark );
+    benchmarks.push_back( new MultiplexingOutputBenchmark );
+    benchmarks.push_back( new NetworkOutputBenchmark );
+
+    vector<string> results;
+    int failures = 0;
+    vector<Benchmark *>::const_iterator it, end = benchmarks.end();
+    for ( it = benchmarks.begin(); it != end; ++it ) {
+        if ( filter && !strstr( ( *it )->name(), filter ) ) {
+            continue;
+        }
+        if ( !runBenchmark( *it, maxThreads, iterations, &results ) ) {
+            fprintf( stderr, "Benchmark %s failed to set up\n", ( *it )->name() );
+            ++failures;
+        }
+    }
+
+    printf( "{\n  \"benchmark\": \"tracelib_bench\",\n  \"max_threads\": %d,\n  \"results\": [\n", maxThreads );
+    for ( size_t i = 0; i < results.size(); ++i ) {
+        printf( "%s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "" );
+    }
+    printf( "  ]\n}\n" );
+
+    deleteRange( benchmarks.begin(), benchmarks.end() );
+    return failures;
+}
+
+TRACELIB_NAMESPACE_END
+
+void *operator new( size_t size )
+{
+    if ( TRACELIB_NAMESPACE_IDENT(g_countAllocations).loadRelaxed() ) {
+        TRACELIB_NAMESPACE_IDENT(g_allocationCount).fetchAndAdd( 1 );
+    }
+    void *p = malloc( size ? size : 1 );
+    if ( !p ) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void *p ) throw()
+{
+    free( p );
+}
+
+void operator delete[]( void *p ) throw()
+{
+    free( p );
+}
+
+
+int main( int argc, char **argv )
+{
+    return TRACELIB_NAMESPACE_IDENT(runBenchmarks)( argc, argv );
+}
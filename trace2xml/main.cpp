@@ -18,15 +18,19 @@
  */
 
 #include "../hooklib/tracelib.h"
+#include "../server/columnararchive.h"
 #include "../server/database.h"
 #include "config.h"
 
 #include <cstdio>
 #include <QCommandLineParser>
 #include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QTemporaryFile>
 #include <QVariant>
 
 namespace Error
@@ -57,7 +61,8 @@ static QString variableTypeAsString(int i)
     return s;
 }
 
-static bool toXml(const QSqlDatabase db, FILE *output, QString *errMsg)
+static bool toXml(const QSqlDatabase db, FILE *output, QString *errMsg,
+                  const QDateTime &from, const QDateTime &to)
 {
     using TRACELIB_NAMESPACE_IDENT(TracePointType);
 
@@ -129,6 +134,12 @@ static bool toXml(const QSqlDatabase db, FILE *output, QString *errMsg)
                               "WHERE"
                               " trace_entry_id = :trace_entry_id");
 
+    QString timeRange;
+    if (from.isValid())
+        timeRange += QString("AND trace_entry.timestamp >= %1 ").arg(from.toMSecsSinceEpoch());
+    if (to.isValid())
+        timeRange += QString("AND trace_entry.timestamp <= %1 ").arg(to.toMSecsSinceEpoch());
+
     QSqlQuery resultSet = db.exec("SELECT"
                                   " trace_entry.id,"
                                   " timestamp,"
@@ -160,6 +171,7 @@ static bool toXml(const QSqlDatabase db, FILE *output, QString *errMsg)
                                   " trace_entry.traced_thread_id = traced_thread.id "
                                   "AND"
                                   " traced_thread.process_id = process.id "
+                                  + timeRange +
                                   "ORDER BY"
                                   " trace_entry.id");
     if (db.lastError().isValid()) {
@@ -220,20 +232,53 @@ int main(int argc, char **argv)
 
     QCommandLineParser opt;
     QCommandLineOption output(QStringList() << "o" << "output", "Output File to write XML into, if not specified writes to stdout", "file");
+    QCommandLineOption from("from", "Only convert entries recorded at or after the given time (ISO 8601)", "time");
+    QCommandLineOption to("to", "Only convert entries recorded at or before the given time (ISO 8601)", "time");
     opt.addHelpOption();
     opt.addVersionOption();
-    opt.setApplicationDescription("Converts trace databases into xml files");
+    opt.setApplicationDescription("Converts trace databases and trace archives into xml files");
     opt.addOption(output);
-    opt.addPositionalArgument(".trace-file", "Trace database to convert");
+    opt.addOption(from);
+    opt.addOption(to);
+    opt.addPositionalArgument(".trace-file", "Trace database or .tracearchive file to convert");
     opt.process(a);
 
     if( opt.positionalArguments().isEmpty() ) {
         fprintf(stderr, "Missing command line argument.\n");
         opt.showHelp(Error::CommandLineArgs);
     }
+    QDateTime fromTime, toTime;
+    if (opt.isSet(from)) {
+        fromTime = QDateTime::fromString(opt.value(from), Qt::ISODate);
+        if (!fromTime.isValid()) {
+            fprintf(stderr, "Invalid time '%s'.\n", qPrintable(opt.value(from)));
+            return Error::CommandLineArgs;
+        }
+    }
+    if (opt.isSet(to)) {
+        toTime = QDateTime::fromString(opt.value(to), Qt::ISODate);
+        if (!toTime.isValid()) {
+            fprintf(stderr, "Invalid time '%s'.\n", qPrintable(opt.value(to)));
+            return Error::CommandLineArgs;
+        }
+    }
+
     QString traceFile = opt.positionalArguments().at(0);
     QString errMsg;
-    QSqlDatabase db = Database::open(traceFile, &errMsg);
+    // Archives are read by extracting the requested entries into a temporary database
+    QTemporaryFile extractedArchive(QDir::temp().filePath("trace2xml-XXXXXX.trace"));
+    QSqlDatabase db;
+    if (ColumnarArchive::isArchive(traceFile)) {
+        if (!extractedArchive.open()) {
+            fprintf(stderr, "Open error: %s\n", qPrintable(extractedArchive.errorString()));
+            return Error::Open;
+        }
+        extractedArchive.close();
+        db = ColumnarArchive::extract(traceFile, extractedArchive.fileName(), &errMsg,
+                                      fromTime, toTime);
+    } else {
+        db = Database::open(traceFile, &errMsg);
+    }
     if (!db.isValid()) {
         fprintf(stderr, "Open error: %s\n", qPrintable(errMsg));
         return Error::Open;
@@ -251,7 +296,7 @@ int main(int argc, char **argv)
         }
     }
 
-    if (!toXml(db, outputStream, &errMsg)) {
+    if (!toXml(db, outputStream, &errMsg, fromTime, toTime)) {
         fprintf(stderr, "Transformation error: %s\n", qPrintable(errMsg));
         return Error::Transformation;
     }
@@ -0,0 +1,178 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loadgenerator.h"
+
+#include "../hooklib/serializer.h"
+#include "../hooklib/trace.h"
+#include "../hooklib/tracepoint.h"
+#include "../server/database.h"
+
+#include <QTcpSocket>
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+QElapsedTimer &benchmarkClock()
+{
+    static QElapsedTimer clock;
+    return clock;
+}
+
+static const char MessagePrefix[] = "tracebench";
+
+// Don't hand more than this to the socket at once to keep the rate steady
+static const int MaxEntriesPerWrite = 256;
+
+static TRACELIB_NAMESPACE_IDENT(TracePoint) *tracePoint( int i )
+{
+    static const char * const functions[LoadGenerator::NumTracePoints] = {
+        "void Parser::parse()", "void Parser::parseElement()",
+        "bool Cache::lookup(const Key &)", "void Cache::insert(const Key &)",
+        "int main(int, char **)", "void Connection::send(const QByteArray &)",
+        "void Connection::receive()", "void Model::update()"
+    };
+    static TRACELIB_NAMESPACE_IDENT(TracePoint) *tracePoints[LoadGenerator::NumTracePoints] = { 0 };
+    if ( !tracePoints[i] ) {
+        tracePoints[i] = new TRACELIB_NAMESPACE_IDENT(TracePoint)(
+            i % 2 ? TRACELIB_NAMESPACE_IDENT(TracePointType)::Debug : TRACELIB_NAMESPACE_IDENT(TracePointType)::Log,
+            "tracebench/synthesized.cpp", 100 + i * 10, functions[i], 0 );
+    }
+    return tracePoints[i];
+}
+
+LoadGenerator::LoadGenerator( int connection, unsigned short port, QObject *parent )
+    : QThread( parent ),
+    m_connection( connection ),
+    m_port( port ),
+    m_rate( 0 ),
+    m_format( XmlFormat ),
+    m_stopRequested( 0 ),
+    m_sentEntries( 0 )
+{
+    // Created up front since the generators run concurrently
+    for ( int i = 0; i < NumTracePoints; ++i ) {
+        tracePoint( i );
+    }
+}
+
+void LoadGenerator::run()
+{
+    QTcpSocket socket;
+    socket.connectToHost( "127.0.0.1", m_port );
+    if ( !socket.waitForConnected() ) {
+        m_errorString = socket.errorString();
+        return;
+    }
+
+    if ( !m_replayData.isEmpty() ) {
+        socket.write( m_replayData );
+        while ( socket.bytesToWrite() > 0 && socket.waitForBytesWritten( -1 ) ) {
+        }
+        socket.disconnectFromHost();
+        if ( socket.state() != QAbstractSocket::UnconnectedState ) {
+            socket.waitForDisconnected();
+        }
+        return;
+    }
+
+    TRACELIB_NAMESPACE_IDENT(Serializer) *serializer;
+    if ( m_format == BinaryFormat ) {
+        serializer = new TRACELIB_NAMESPACE_IDENT(BinarySerializer);
+    } else {
+        serializer = new TRACELIB_NAMESPACE_IDENT(XMLSerializer);
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    qint64 sent = 0;
+    QByteArray data;
+    while ( !m_stopRequested.load() ) {
+        qint64 due = sent + MaxEntriesPerWrite;
+        if ( m_rate > 0 ) {
+            due = min( due, static_cast<qint64>( elapsed.nsecsElapsed() / 1e9 * m_rate ) );
+            if ( due <= sent ) {
+                QThread::usleep( 500 );
+                continue;
+            }
+        }
+
+        data.clear();
+        for ( ; sent < due; ++sent ) {
+            const QByteArray message = IngestRecorder::messageForEntry( m_connection, benchmarkClock().nsecsElapsed() ).toUtf8();
+            TRACELIB_NAMESPACE_IDENT(TraceEntry) entry( tracePoint( sent % NumTracePoints ), message.constData() );
+            const vector<char> serializedEntry = serializer->serialize( entry );
+            data.append( &serializedEntry[0], static_cast<int>( serializedEntry.size() ) );
+        }
+
+        socket.write( data );
+        while ( socket.bytesToWrite() > 0 ) {
+            if ( !socket.waitForBytesWritten( -1 ) ) {
+                m_errorString = socket.errorString();
+                delete serializer;
+                return;
+            }
+        }
+        m_sentEntries.store( static_cast<int>( sent ) );
+    }
+
+    delete serializer;
+    socket.disconnectFromHost();
+    if ( socket.state() != QAbstractSocket::UnconnectedState ) {
+        socket.waitForDisconnected();
+    }
+}
+
+IngestRecorder::IngestRecorder( QObject *parent )
+    : QObject( parent ),
+    m_storedEntries( 0 ),
+    m_lastStoreTime( 0 )
+{
+}
+
+QString IngestRecorder::messageForEntry( int connection, qint64 sendTime )
+{
+    return QString( "%1 %2 %3" ).arg( MessagePrefix ).arg( connection ).arg( sendTime );
+}
+
+void IngestRecorder::handleStoredEntry( const TraceEntry &e )
+{
+    ++m_storedEntries;
+    m_lastStoreTime = benchmarkClock().nsecsElapsed();
+
+    // Replayed traces don't carry send times
+    const QStringList fields = e.message.split( ' ' );
+    if ( fields.size() != 3 || fields[0] != MessagePrefix ) {
+        return;
+    }
+    bool ok;
+    const qint64 sendTime = fields[2].toLongLong( &ok );
+    if ( ok ) {
+        m_latencies.append( m_lastStoreTime - sendTime );
+    }
+}
+
+QVector<qint64> IngestRecorder::sortedLatencies() const
+{
+    QVector<qint64> latencies = m_latencies;
+    sort( latencies.begin(), latencies.end() );
+    return latencies;
+}
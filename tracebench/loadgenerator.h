@@ -0,0 +1,104 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+struct TraceEntry;
+
+/* Monotonic clock shared by the load generators and the IngestRecorder;
+ * entries carry the time at which they were sent in their message.
+ */
+QElapsedTimer &benchmarkClock();
+
+/* Sends trace data to the server over one TCP connection. Either a
+ * recorded trace (XML or binary, as written by tracelib) is replayed, or
+ * entries are synthesized with the tracelib serializers at the given rate.
+ */
+class LoadGenerator : public QThread
+{
+public:
+    enum Format { XmlFormat, BinaryFormat };
+
+    static const int NumTracePoints = 8;
+
+    LoadGenerator( int connection, unsigned short port, QObject *parent = 0 );
+
+    // Entries per second, 0 sends as fast as possible
+    void setRate( double rate ) { m_rate = rate; }
+    void setFormat( Format format ) { m_format = format; }
+    void setReplayData( const QByteArray &data ) { m_replayData = data; }
+
+    void stop() { m_stopRequested.store( 1 ); }
+
+    qint64 sentEntries() const { return m_sentEntries.load(); }
+    QString errorString() const { return m_errorString; }
+
+protected:
+    virtual void run();
+
+private:
+    LoadGenerator( const LoadGenerator &other ); // disabled
+    void operator=( const LoadGenerator &rhs ); // disabled
+
+    const int m_connection;
+    const unsigned short m_port;
+    double m_rate;
+    Format m_format;
+    QByteArray m_replayData;
+    QAtomicInt m_stopRequested;
+    QAtomicInt m_sentEntries;
+    QString m_errorString;
+};
+
+/* Collects the end-to-end latency of each synthesized entry once the
+ * server committed it to the database.
+ */
+class IngestRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    IngestRecorder( QObject *parent = 0 );
+
+    qint64 storedEntries() const { return m_storedEntries; }
+    // Time on the benchmarkClock() at which the last entry was stored
+    qint64 lastStoreTime() const { return m_lastStoreTime; }
+    // Nanoseconds from sending an entry until it was committed, sorted
+    QVector<qint64> sortedLatencies() const;
+
+    static QString messageForEntry( int connection, qint64 sendTime );
+
+public slots:
+    void handleStoredEntry( const TraceEntry &e );
+
+private:
+    qint64 m_storedEntries;
+    qint64 m_lastStoreTime;
+    QVector<qint64> m_latencies;
+};
+
+#endif // !defined(LOADGENERATOR_H)
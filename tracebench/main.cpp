@@ -0,0 +1,254 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2013-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loadgenerator.h"
+
+#include "../server/database.h"
+#include "../server/server.h"
+#include "../hooklib/tracelib_config.h"
+#include "config.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSqlDatabase>
+
+#include <cstdio>
+
+namespace Error
+{
+    const int None = 0;
+    const int CommandLineArgs = 1;
+    const int Database = 2;
+    const int Connection = 3;
+}
+
+/* The server runs in this process, so this includes the memory used by the
+ * load generators (which is small compared to the server's). Yields -1 if
+ * the values are not available on this platform.
+ */
+static void residentSetSize( qint64 *current, qint64 *peak )
+{
+    *current = *peak = -1;
+#if defined(Q_OS_LINUX)
+    QFile status( "/proc/self/status" );
+    if ( !status.open( QIODevice::ReadOnly ) ) {
+        return;
+    }
+    const QList<QByteArray> lines = status.readAll().split( '\n' );
+    foreach ( const QByteArray &line, lines ) {
+        const QList<QByteArray> fields = line.simplified().split( ' ' );
+        if ( fields.size() < 2 ) {
+            continue;
+        }
+        if ( fields[0] == "VmRSS:" ) {
+            *current = fields[1].toLongLong() * 1024;
+        } else if ( fields[0] == "VmHWM:" ) {
+            *peak = fields[1].toLongLong() * 1024;
+        }
+    }
+#endif
+}
+
+static double percentile( const QVector<qint64> &sortedValues, double p )
+{
+    if ( sortedValues.isEmpty() ) {
+        return 0;
+    }
+    const int idx = qMin( sortedValues.size() - 1, static_cast<int>( p * sortedValues.size() ) );
+    return sortedValues[idx] / 1e6;
+}
+
+int main( int argc, char **argv )
+{
+    QCoreApplication app( argc, argv );
+    app.setApplicationVersion(QLatin1String(TRACELIB_VERSION_STR));
+
+    QCommandLineParser opt;
+    QCommandLineOption connectionsOption(QStringList() << "c" << "connections", "Number of concurrent connections.",
+                                         "count", "4");
+    QCommandLineOption rateOption(QStringList() << "r" << "rate", "Total number of entries to send per second; 0 sends as fast as possible.",
+                                  "entries", "0");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "Number of seconds to send synthesized entries for.",
+                                      "seconds", "10");
+    QCommandLineOption formatOption(QStringList() << "f" << "format", "Format of the synthesized entries: xml or binary.",
+                                    "format", "xml");
+    QCommandLineOption replayOption("replay", "Send the given recorded trace (XML or binary) over each connection instead of synthesizing entries.",
+                                    "file");
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Port for the benchmarked server to listen on.",
+                                  "port", QString::number(TRACELIB_DEFAULT_PORT + 100));
+    QCommandLineOption databaseOption("database", "Trace database to store the entries into; a temporary one is used by default.",
+                                      "file");
+    opt.addHelpOption();
+    opt.addVersionOption();
+    opt.setApplicationDescription("Measures how fast a trace server stores the entries sent by many traced processes");
+    opt.addOption(connectionsOption);
+    opt.addOption(rateOption);
+    opt.addOption(durationOption);
+    opt.addOption(formatOption);
+    opt.addOption(replayOption);
+    opt.addOption(portOption);
+    opt.addOption(databaseOption);
+    opt.process(app);
+
+    bool ok;
+    const int connections = opt.value(connectionsOption).toInt(&ok);
+    if (!ok || connections < 1) {
+        fprintf(stderr, "Invalid number of connections '%s' given.\n", qPrintable(opt.value(connectionsOption)));
+        return Error::CommandLineArgs;
+    }
+    const double rate = opt.value(rateOption).toDouble(&ok);
+    if (!ok || rate < 0) {
+        fprintf(stderr, "Invalid rate '%s' given.\n", qPrintable(opt.value(rateOption)));
+        return Error::CommandLineArgs;
+    }
+    const double duration = opt.value(durationOption).toDouble(&ok);
+    if (!ok || duration <= 0) {
+        fprintf(stderr, "Invalid duration '%s' given.\n", qPrintable(opt.value(durationOption)));
+        return Error::CommandLineArgs;
+    }
+    LoadGenerator::Format format;
+    if (opt.value(formatOption) == "xml") {
+        format = LoadGenerator::XmlFormat;
+    } else if (opt.value(formatOption) == "binary") {
+        format = LoadGenerator::BinaryFormat;
+    } else {
+        fprintf(stderr, "Invalid format '%s' given.\n", qPrintable(opt.value(formatOption)));
+        return Error::CommandLineArgs;
+    }
+    const int port = opt.value(portOption).toInt(&ok);
+    if (!ok || port <= 0 || port >= 65535) {
+        fprintf(stderr, "Invalid port number '%s' given.\n", qPrintable(opt.value(portOption)));
+        return Error::CommandLineArgs;
+    }
+
+    QByteArray replayData;
+    if (opt.isSet(replayOption)) {
+        QFile replayFile(opt.value(replayOption));
+        if (!replayFile.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "Failed to open '%s': %s\n", qPrintable(replayFile.fileName()), qPrintable(replayFile.errorString()));
+            return Error::CommandLineArgs;
+        }
+        replayData = replayFile.readAll();
+    }
+
+    const bool temporaryDatabase = !opt.isSet(databaseOption);
+    const QString traceFile = temporaryDatabase
+        ? QDir::temp().filePath(QString("tracebench-%1.trace").arg(QCoreApplication::applicationPid()))
+        : opt.value(databaseOption);
+    QString errMsg;
+    if (!Database::isValidFileName(traceFile, &errMsg)) {
+        fprintf(stderr, "%s\n", qPrintable(errMsg));
+        return Error::CommandLineArgs;
+    }
+    {
+        QSqlDatabase database;
+        if (QFile::exists(traceFile)) {
+            database = Database::open(traceFile, &errMsg);
+        } else {
+            database = Database::create(traceFile, &errMsg);
+        }
+        if (!database.isValid()) {
+            fprintf(stderr, "Failed to open log database: %s\n", qPrintable(errMsg));
+            return Error::Database;
+        }
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(traceFile);
+
+    int result = Error::None;
+    {
+        Server server(traceFile, port, port + 1);
+        IngestRecorder recorder;
+        QObject::connect(&server, SIGNAL(traceEntryReceived(const TraceEntry &)),
+                         &recorder, SLOT(handleStoredEntry(const TraceEntry &)));
+
+        benchmarkClock().start();
+
+        QList<LoadGenerator *> generators;
+        for (int i = 0; i < connections; ++i) {
+            LoadGenerator *generator = new LoadGenerator(i, port);
+            generator->setRate(rate / connections);
+            generator->setFormat(format);
+            generator->setReplayData(replayData);
+            generators.append(generator);
+            generator->start();
+        }
+
+        QElapsedTimer elapsed;
+        elapsed.start();
+        while (replayData.isEmpty() && elapsed.elapsed() < duration * 1000) {
+            app.processEvents(QEventLoop::AllEvents, 50);
+        }
+        qint64 sentEntries = 0;
+        foreach (LoadGenerator *generator, generators) {
+            generator->stop();
+            while (!generator->wait(50)) {
+                app.processEvents(QEventLoop::AllEvents, 50);
+            }
+            if (!generator->errorString().isEmpty()) {
+                fprintf(stderr, "Connection failed: %s\n", qPrintable(generator->errorString()));
+                result = Error::Connection;
+            }
+            sentEntries += generator->sentEntries();
+        }
+        const qint64 sendMsecs = elapsed.elapsed();
+
+        // Wait until the server stored everything, or stopped making progress
+        qint64 storedEntries = -1;
+        QElapsedTimer idle;
+        idle.start();
+        while (idle.elapsed() < 2000 && (!replayData.isEmpty() || recorder.storedEntries() < sentEntries)) {
+            app.processEvents(QEventLoop::AllEvents, 50);
+            if (recorder.storedEntries() != storedEntries) {
+                storedEntries = recorder.storedEntries();
+                idle.restart();
+            }
+        }
+        const qint64 totalMsecs = recorder.lastStoreTime() / 1000000;
+
+        const QVector<qint64> latencies = recorder.sortedLatencies();
+        qint64 rss, peakRss;
+        residentSetSize(&rss, &peakRss);
+
+        printf("connections:      %d\n", connections);
+        if (replayData.isEmpty()) {
+            printf("entries sent:     %lld in %.1f s (%.0f entries/s)\n",
+                   sentEntries, sendMsecs / 1000.0, sentEntries * 1000.0 / qMax(sendMsecs, qint64(1)));
+        }
+        printf("entries stored:   %lld in %.1f s (%.0f entries/s)\n",
+               recorder.storedEntries(), totalMsecs / 1000.0,
+               recorder.storedEntries() * 1000.0 / qMax(totalMsecs, qint64(1)));
+        if (!latencies.isEmpty()) {
+            printf("send to commit:   p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+                   percentile(latencies, 0.5), percentile(latencies, 0.99), latencies.last() / 1e6);
+        }
+        if (rss != -1) {
+            printf("resident memory:  %.1f MB (peak %.1f MB)\n", rss / 1048576.0, peakRss / 1048576.0);
+        }
+
+        qDeleteAll(generators);
+    }
+
+    if (temporaryDatabase) {
+        QFile::remove(traceFile);
+    }
+    return result;
+}
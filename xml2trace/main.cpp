@@ -19,13 +19,16 @@
 
 #include "../hooklib/tracelib.h"
 #include "../server/xmlcontenthandler.h"
+#include "../server/binarycontenthandler.h"
 #include "../server/databasefeeder.h"
+#include "../server/segmentfilereader.h"
 #include "config.h"
 
 #include <cstdio>
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QFile>
+#include <QScopedPointer>
 #include <QSqlDatabase>
 
 namespace Error
@@ -54,6 +57,97 @@ static bool fromXml( QSqlDatabase &db, QFile &input, QString *errMsg )
             return false;
         }
     }
+    try {
+        feeder.flushPendingEntries();
+    } catch( const SQLTransactionException &ex ) {
+        *errMsg = "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+        return false;
+    }
+    return true;
+}
+
+static bool fromBinary( QSqlDatabase &db, QFile &input, QString *errMsg )
+{
+    DatabaseFeeder feeder( db );
+    BinaryContentHandler parser( &feeder );
+    while( !input.atEnd() ) {
+        try {
+            parser.addData( input.read( 1 << 16 ) );
+            parser.continueParsing();
+        } catch( const SQLTransactionException &ex ) {
+            *errMsg = "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+            return false;
+        } catch( const BinaryParseException &ex ) {
+            *errMsg = "Binary trace data error: " + QString::fromLatin1( ex.what() );
+            return false;
+        }
+    }
+    try {
+        feeder.flushPendingEntries();
+    } catch( const SQLTransactionException &ex ) {
+        *errMsg = "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+        return false;
+    }
+    return true;
+}
+
+/* Segments of a binary stream only make sense in order and starting with
+ * the first one, so binary segments before the first start of a stream (e.g.
+ * because older ones were removed) are skipped. The records of the XML
+ * serializer are self-contained, so XML segments are always imported.
+ */
+static bool fromSegments( QSqlDatabase &db, const QStringList &segmentFiles, QString *errMsg )
+{
+    DatabaseFeeder feeder( db );
+    QScopedPointer<XmlContentHandler> xmlParser;
+    QScopedPointer<BinaryContentHandler> binaryParser;
+    try {
+        foreach ( const QString &segmentFile, segmentFiles ) {
+            SegmentFileReader reader;
+            if ( !reader.open( segmentFile, errMsg ) ) {
+                return false;
+            }
+            if ( reader.startsStream() ) {
+                xmlParser.reset();
+                binaryParser.reset();
+            }
+
+            QByteArray record;
+            while ( reader.readRecord( &record ) ) {
+                if ( !xmlParser && !binaryParser ) {
+                    if ( BinaryContentHandler::isBinaryStream( record ) ) {
+                        binaryParser.reset( new BinaryContentHandler( &feeder ) );
+                    } else if ( reader.startsStream() || record.startsWith( '<' ) ) {
+                        xmlParser.reset( new XmlContentHandler( &feeder ) );
+                        xmlParser->addData( "<toplevel_trace_element>" );
+                    } else {
+                        fprintf( stderr, "Skipping %s, it continues a stream whose start is missing\n", qPrintable( segmentFile ) );
+                        break;
+                    }
+                }
+                if ( binaryParser ) {
+                    binaryParser->addData( record );
+                    binaryParser->continueParsing();
+                } else {
+                    xmlParser->addData( record );
+                    xmlParser->continueParsing();
+                }
+            }
+            if ( reader.isTruncated() ) {
+                fprintf( stderr, "Segment %s ends with an incomplete record\n", qPrintable( segmentFile ) );
+            }
+        }
+        feeder.flushPendingEntries();
+    } catch( const SQLTransactionException &ex ) {
+        *errMsg = "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+        return false;
+    } catch( const XmlParseException &ex ) {
+        *errMsg = "XML error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.parserMessage() + "(" + QString::number(ex.parserCode()) + ")";
+        return false;
+    } catch( const BinaryParseException &ex ) {
+        *errMsg = "Binary trace data error: " + QString::fromLatin1( ex.what() );
+        return false;
+    }
     return true;
 }
 
@@ -63,11 +157,13 @@ int main( int argc, char **argv )
     a.setApplicationVersion(QLatin1String(TRACELIB_VERSION_STR));
 
     QCommandLineParser opt;
-    QCommandLineOption inputOption(QStringList() << "i" << "input", "XML input file to read from, if not specified reads from stdin", "file");
-    opt.setApplicationDescription("Converts xml files into trace databases.");
+    QCommandLineOption inputOption(QStringList() << "i" << "input", "XML, binary or segment input file to read from, if not specified reads from stdin", "file");
+    QCommandLineOption segmentsOption(QStringList() << "s" << "segments", "Reads all segment files <filename>.<n> written by the mmapfile output, in order", "filename");
+    opt.setApplicationDescription("Converts xml files (or files written by the binary serializer or the mmapfile output) into trace databases.");
     opt.addHelpOption();
     opt.addVersionOption();
     opt.addOption(inputOption);
+    opt.addOption(segmentsOption);
     opt.addPositionalArgument(".trace-file", "Trace database output file to write into (.trace suffix will be appended if missing).");
     opt.process(a);
 
@@ -93,6 +189,19 @@ int main( int argc, char **argv )
         return Error::Open;
     }
 
+    if ( opt.isSet( segmentsOption ) ) {
+        const QStringList segmentFiles = SegmentFileReader::segmentFiles( opt.value( segmentsOption ) );
+        if ( segmentFiles.isEmpty() ) {
+            fprintf( stderr, "No segment files %s.<n> found.\n", qPrintable( opt.value( segmentsOption ) ) );
+            return Error::File;
+        }
+        if ( !fromSegments( db, segmentFiles, &errMsg ) ) {
+            fprintf( stderr, "Transformation error: %s\n", qPrintable( errMsg ));
+            return Error::Transformation;
+        }
+        return Error::None;
+    }
+
     QFile input;
     if ( !opt.isSet( inputOption ) ) {
         input.open( stdin, QIODevice::ReadOnly );
@@ -105,7 +214,15 @@ int main( int argc, char **argv )
         }
     }
 
-    if (!fromXml( db, input, &errMsg )) {
+    bool converted;
+    if ( SegmentFileReader::isSegmentFile( input.peek( 4 ) ) && !input.fileName().isEmpty() ) {
+        converted = fromSegments( db, QStringList() << input.fileName(), &errMsg );
+    } else if ( BinaryContentHandler::isBinaryStream( input.peek( 1 ) ) ) {
+        converted = fromBinary( db, input, &errMsg );
+    } else {
+        converted = fromXml( db, input, &errMsg );
+    }
+    if (!converted) {
         fprintf( stderr, "Transformation error: %s\n", qPrintable( errMsg ));
         return Error::Transformation;
     }